@@ -1,7 +1,23 @@
 #include "asyncresult.h"
+#include <QCoreApplication>
+#include <QThreadStorage>
 
 namespace qutim_sdk_0_3 {
 
+Detail::AsyncEvent::AsyncEvent() : QEvent(eventType())
+{
+}
+
+Detail::AsyncEvent::~AsyncEvent()
+{
+}
+
+QEvent::Type Detail::AsyncEvent::eventType()
+{
+	static QEvent::Type type = static_cast<QEvent::Type>(QEvent::registerEventType());
+	return type;
+}
+
 Detail::AsyncInvoker::AsyncInvoker()
 {
 	qRegisterMetaType<Callback>();
@@ -11,9 +27,33 @@ Detail::AsyncInvoker::~AsyncInvoker()
 {
 }
 
+Q_GLOBAL_STATIC(QThreadStorage<Detail::AsyncInvoker *>, invokers)
+
+Detail::AsyncInvoker *Detail::AsyncInvoker::instance()
+{
+	QThreadStorage<AsyncInvoker *> *storage = invokers();
+	if (!storage->hasLocalData())
+		storage->setLocalData(new AsyncInvoker);
+	return storage->localData();
+}
+
+void Detail::AsyncInvoker::post(AsyncEvent *event)
+{
+	QCoreApplication::postEvent(this, event);
+}
+
 void Detail::AsyncInvoker::invoke(const Callback &callback)
 {
 	callback();
 }
 
+bool Detail::AsyncInvoker::event(QEvent *event)
+{
+	if (event->type() == AsyncEvent::eventType()) {
+		static_cast<AsyncEvent *>(event)->invoke();
+		return true;
+	}
+	return QObject::event(event);
+}
+
 } // namespace qutim_sdk_0_3
@@ -2,12 +2,15 @@
 #define QUTIM_SDK_0_3_ASYNCRESULT_H
 
 #include <QObject>
+#include <QEvent>
 #include <QPointer>
 #include <QMutex>
 #include <tuple>
 #include <memory>
 #include <vector>
 #include <functional>
+#include <new>
+#include <type_traits>
 
 #include "libqutim_global.h"
 
@@ -16,6 +19,15 @@ namespace qutim_sdk_0_3 {
 template <typename... Args>
 class AsyncResult;
 
+// Queued callbacks are always called later from the event loop of the thread,
+// where the result was created. Inline ones are called right from connect
+// if the result is already known, e.g. if it was made by makeAsyncResult.
+enum AsyncConnectionType
+{
+	AsyncQueuedConnection,
+	AsyncInlineConnection
+};
+
 namespace Detail {
 
 class LIBQUTIM_EXPORT Callback : public std::function<void ()>
@@ -45,6 +57,16 @@ public:
 	}
 };
 
+class LIBQUTIM_EXPORT AsyncEvent : public QEvent
+{
+public:
+	AsyncEvent();
+	virtual ~AsyncEvent();
+
+	virtual void invoke() = 0;
+	static QEvent::Type eventType();
+};
+
 class LIBQUTIM_EXPORT AsyncInvoker : public QObject
 {
 	Q_OBJECT
@@ -52,70 +74,137 @@ public:
 	AsyncInvoker();
 	~AsyncInvoker();
 
+	// Invoker of the current thread, it is shared by all results created there
+	static AsyncInvoker *instance();
+	void post(AsyncEvent *event);
+
 public slots:
 	void invoke(const qutim_sdk_0_3::Detail::Callback &callback);
+
+protected:
+	bool event(QEvent *event);
 };
 
 template <typename... Args>
-class AsyncResultData
+class AsyncResultData : public std::enable_shared_from_this<AsyncResultData<Args...> >
 {
 	typedef std::tuple<Args...> Tuple;
-    typedef std::shared_ptr<Tuple> TuplePtr;
 public:
 	typedef std::function<void (const Args &...args)> Function;
 
-	AsyncResultData() : m_invoker(new AsyncInvoker)
+	AsyncResultData() : m_ready(false), m_invoker(AsyncInvoker::instance())
 	{
 	}
 
-	AsyncResultData(Args ...args) : m_args(new Tuple(std::forward<Args>(args)...)), m_invoker(new AsyncInvoker)
+	AsyncResultData(Args ...args) : m_ready(true), m_invoker(AsyncInvoker::instance())
 	{
+		new (&m_storage) Tuple(std::forward<Args>(args)...);
 	}
 
 	~AsyncResultData()
 	{
-		m_invoker->deleteLater();
+		if (m_ready)
+			tuple().~Tuple();
 	}
 
 	AsyncResultData(const AsyncResultData &) = delete;
 	AsyncResultData &operator =(const AsyncResultData &) = delete;
 
-	void connect(QObject *object, Function function)
+	void connect(QObject *object, Function function, AsyncConnectionType type)
 	{
-		QPointer<QObject> context = object;
-		connect_impl([context, function] (const Args &...args) {
-			if (context)
-				function(args...);
-		});
+		connect_impl(Slot(object, std::move(function)), type);
 	}
 
-	void connect(Function function)
+	void connect(Function function, AsyncConnectionType type)
 	{
-		connect_impl(std::move(function));
+		connect_impl(Slot(std::move(function)), type);
 	}
 
 	void handle(Args ...args)
 	{
-		QMutexLocker locker(&m_lock);
-		m_args = std::make_shared<Tuple>(std::forward<Args>(args)...);
-
-		std::vector<Function> callbacks = std::move(m_callbacks);
-		for (Function &callback : callbacks) {
-			call(std::move(callback));
+		std::vector<Slot> callbacks;
+		{
+			QMutexLocker locker(&m_lock);
+			// Arguments are read by queued callbacks without the lock, so they are never replaced
+			if (m_ready) {
+				qWarning("AsyncResult is already handled");
+				return;
+			}
+			new (&m_storage) Tuple(std::forward<Args>(args)...);
+			m_ready = true;
+			callbacks.swap(m_callbacks);
 		}
+
+		for (Slot &callback : callbacks)
+			post(std::move(callback));
 	}
 
 private:
-	void connect_impl(Function function)
+	struct Slot
 	{
-		QMutexLocker locker(&m_lock);
-		if (m_args) {
-			call(std::move(function));
+		Slot(Function function) : guarded(false), function(std::move(function))
+		{
+		}
+
+		Slot(QObject *context, Function function) :
+			context(context), guarded(true), function(std::move(function))
+		{
+		}
+
+		bool isAlive() const
+		{
+			return !guarded || context;
+		}
+
+		QPointer<QObject> context;
+		bool guarded;
+		Function function;
+	};
+
+	class Event : public AsyncEvent
+	{
+	public:
+		Event(std::shared_ptr<AsyncResultData> data, Slot callback) :
+			m_data(std::move(data)), m_callback(std::move(callback))
+		{
+		}
+
+		void invoke()
+		{
+			if (m_callback.isAlive())
+				m_data->call(m_callback.function);
+		}
+
+	private:
+		std::shared_ptr<AsyncResultData> m_data;
+		Slot m_callback;
+	};
+
+	void connect_impl(Slot callback, AsyncConnectionType type)
+	{
+		{
+			QMutexLocker locker(&m_lock);
+			if (!m_ready) {
+				m_callbacks.emplace_back(std::move(callback));
+				return;
+			}
+		}
+
+		if (type == AsyncInlineConnection) {
+			if (callback.isAlive())
+				call(callback.function);
 		} else {
-			m_callbacks.emplace_back(std::move(function));
+			post(std::move(callback));
 		}
 	}
 
+	void post(Slot callback)
+	{
+		// Invoker is gone with its thread, there is no one to call back
+		if (AsyncInvoker *invoker = m_invoker.data())
+			invoker->post(new Event(this->shared_from_this(), std::move(callback)));
+	}
+
 	template <size_t ...S>
 	struct Sequence
 	{
@@ -132,32 +221,32 @@ private:
 		typedef Sequence<S...> type;
 	};
 
-    typedef typename Generator<sizeof...(Args)>::type SequenceType;
+	typedef typename Generator<sizeof...(Args)>::type SequenceType;
 
-	void call(Function function)
+	Tuple &tuple()
 	{
-		TuplePtr args = m_args;
-        auto lambda = [args, function] () {
-            AsyncResultData::call(args, SequenceType(), function);
-        };
-        Callback callback(lambda);
+		return *reinterpret_cast<Tuple *>(&m_storage);
+	}
 
-		QMetaObject::invokeMethod(m_invoker, "invoke", Qt::QueuedConnection,
-								  Q_ARG(qutim_sdk_0_3::Detail::Callback, callback));
+	void call(const Function &function)
+	{
+		call(SequenceType(), function);
 	}
 
 	template <size_t ...S>
-	static void call(TuplePtr args, Sequence<S...>, const Function &function)
+	void call(Sequence<S...>, const Function &function)
 	{
-		function(std::get<S>(*args)...);
+		function(std::get<S>(tuple())...);
 	}
 
 	friend class AsyncResult<Args...>;
 
 	QMutex m_lock;
-	std::vector<Function> m_callbacks;
-	std::shared_ptr<Tuple> m_args;
-	AsyncInvoker *m_invoker;
+	std::vector<Slot> m_callbacks;
+	// Arguments are stored in place, so ready result costs a single allocation
+	typename std::aligned_storage<sizeof(Tuple), std::alignment_of<Tuple>::value>::type m_storage;
+	bool m_ready;
+	QPointer<AsyncInvoker> m_invoker;
 };
 
 } // namespace Detail
@@ -200,14 +289,14 @@ public:
 		return result;
 	}
 
-	void connect(QObject *object, Function &&function)
+	void connect(QObject *object, Function &&function, AsyncConnectionType type = AsyncQueuedConnection)
 	{
-		m_data->connect(object, std::forward<Function>(function));
+		m_data->connect(object, std::forward<Function>(function), type);
 	}
 
-	void connect(Function &&function)
+	void connect(Function &&function, AsyncConnectionType type = AsyncQueuedConnection)
 	{
-		m_data->connect(std::forward<Function>(function));
+		m_data->connect(std::forward<Function>(function), type);
 	}
 
 private:
@@ -201,6 +201,18 @@ void ChatSession::setActive(bool active)
 	emit activated(active);
 }
 
+void ChatSession::addContacts(const QList<Buddy*> &contacts)
+{
+	if (contacts.isEmpty())
+		return;
+	AddContactsArgument argument = { contacts, false };
+	virtual_hook(AddContactsHook, &argument);
+	if (argument.handled)
+		return;
+	foreach (Buddy *contact, contacts)
+		addContact(contact);
+}
+
 void ChatSession::virtual_hook(int id, void *data)
 {
 	Q_UNUSED(id);
@@ -50,6 +50,14 @@ class LIBQUTIM_EXPORT ChatSession : public QObject
 	Q_PROPERTY(qutim_sdk_0_3::ChatUnit *unit READ unit WRITE setChatUnit NOTIFY unitChanged)
 public:
     typedef std::function<void (quint64, const Message &, const QString &)> AppendHandler;
+	enum ChatSessionHook {
+		AddContactsHook = 0x100
+	};
+	struct AddContactsArgument
+	{
+		QList<qutim_sdk_0_3::Buddy*> contacts;
+		bool handled;
+	};
     
 	virtual ~ChatSession();
 	
@@ -64,6 +72,12 @@ public:
 	bool isActive();
 	QDateTime dateOpened() const;
 	void setDateOpened(const QDateTime &date);
+	/*!
+	  Adds the whole list of participants at once, e.g. initial roster of a room.
+	  Sessions which support it by AddContactsHook insert them with a single
+	  model update, otherwise addContact() is called for every buddy.
+	*/
+	void addContacts(const QList<qutim_sdk_0_3::Buddy*> &contacts);
 public slots:
 	virtual void addContact(qutim_sdk_0_3::Buddy *c) = 0;
 	virtual void removeContact(qutim_sdk_0_3::Buddy *c) = 0;
@@ -36,9 +36,15 @@
 #include <QCoreApplication>
 #include <QBasicTimer>
 #include <QSharedPointer>
+#include <QScopedPointer>
 #include <QStringBuilder>
 #include <QTimer>
 #include <QPointer>
+#include <QFile>
+#include <QDataStream>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QElapsedTimer>
 
 #define CONFIG_MAKE_DIRTY_ONLY_AT_SET_VALUE 1
 
@@ -48,20 +54,78 @@ Q_GLOBAL_STATIC(QList<ConfigBackend*>, all_config_backends)
 LIBQUTIM_EXPORT QList<ConfigBackend*> &get_config_backends()
 { return *all_config_backends(); }
 
+class ConfigAtom;
+
+/*
+ * Interned config path, nodes are shared by all atoms with the same path
+ * and by listeners of it. Root node is named by the config file.
+ */
+class ConfigPathNode
+{
+public:
+    struct Listener
+    {
+        QPointer<QObject> guard;
+        std::function<void (const QVariant &)> callback;
+    };
+
+    ConfigPathNode(ConfigPathNode *parent, const QString &name)
+        : parent(parent), name(name), depth(parent ? parent->depth + 1 : 0), subtreeListeners(0)
+    {
+    }
+
+    ~ConfigPathNode()
+    {
+        qDeleteAll(children);
+    }
+
+    ConfigPathNode *child(const QString &name)
+    {
+        ConfigPathNode *&node = children[name];
+        if (!node)
+            node = new ConfigPathNode(this, name);
+        return node;
+    }
+
+    ConfigPathNode *root()
+    {
+        ConfigPathNode *node = this;
+        while (node->parent)
+            node = node->parent;
+        return node;
+    }
+
+    // Key relative to the config file, like "/group/key"
+    QString fullName() const
+    {
+        if (!parent)
+            return QString();
+        return parent->fullName() % QLatin1Char('/') % name;
+    }
+
+    ConfigPathNode *parent;
+    QString name;
+    int depth;
+    // Number of listeners of this node and all its descendants
+    int subtreeListeners;
+    QHash<QString, ConfigPathNode *> children;
+    QList<Listener> listeners;
+};
+
 class ConfigPath
 {
 public:
     enum SpecialValue { Invalid };
 
-    ConfigPath(const QString &path, const QString &name) : m_frozen(false), m_path(path), m_name(name) {}
-    ConfigPath(SpecialValue) : m_frozen(true) {}
+    explicit ConfigPath(ConfigPathNode *node) : m_frozen(!node), m_node(node) {}
+    ConfigPath(SpecialValue) : m_frozen(true), m_node(nullptr) {}
     ConfigPath() = delete;
 
     ConfigPath child(const QString &name) const
     {
         if (m_frozen)
             return *this;
-        return ConfigPath(m_path, m_name % QLatin1Char('/') % name);
+        return ConfigPath(m_node->child(name));
     }
 
     ConfigPath freeze() const
@@ -76,23 +140,26 @@ public:
         return m_frozen;
     }
 
+    ConfigPathNode *node() const
+    {
+        return m_node;
+    }
+
     QString path() const
     {
-        return m_path;
+        return m_node ? m_node->root()->name : QString();
     }
 
     QString name() const
     {
-        return m_name;
+        return m_node ? m_node->fullName() : QString();
     }
 
 private:
     bool m_frozen;
-    QString m_path;
-    QString m_name;
+    ConfigPathNode *m_node;
 };
 
-class ConfigAtom;
 
 class ConfigSource
 {
@@ -104,17 +171,35 @@ public:
     ConfigSource();
     ~ConfigSource();
 
+    struct JournalEntry
+    {
+        QString path;
+        QVariant value;
+        bool removed;
+    };
+
     static ConfigSource::Ptr open(const QString &path, bool systemDir, bool create, ConfigBackend *bcknd = 0);
     inline void update() { lastModified = QFileInfo(fileName).lastModified(); }
     bool isValid() {
-        return QFileInfo(fileName).lastModified() == lastModified;
+        // File is changed by pending saves, but the memory is up to date
+        return pendingSaves > 0 || QFileInfo(fileName).lastModified() == lastModified;
     }
     void sync();
-    void makeDirty() { dirty = true; }
+    void makeDirty(const ConfigPath &path, const QVariant &value, bool removed);
+    void replayJournal();
+    QString journalFileName() const { return fileName + QLatin1String(".journal"); }
     QString fileName;
     ConfigBackend *backend;
     bool dirty;
-    bool isAtLoop;
+    // Backend supports partial loading and saving
+    bool isTree;
+    // Changes since the last save, they are appended to the journal instead of saving the whole file
+    QList<JournalEntry> journal;
+    // Some changes can't be expressed by the journal
+    bool fullSave;
+    bool isReplaying;
+    qint64 journalSize;
+    int pendingSaves;
     QSharedPointer<ConfigAtom> data;
     QDateTime lastModified;
 };
@@ -122,46 +207,64 @@ public:
 class ConfigNotifier
 {
 public:
-    void mark(const ConfigPath &path)
+    ~ConfigNotifier()
     {
-        m_changedPaths.insert(qMakePair(path.path(), path.name()));
+        qDeleteAll(m_roots);
+    }
 
-        if (!m_eventSent) {
-            m_eventSent = true;
-            QTimer::singleShot(0, [this] () {
-                if (qApp->closingDown())
-                    return;
-                notify();
-            });
-        }
+    ConfigPathNode *root(const QString &path)
+    {
+        ConfigPathNode *&node = m_roots[path];
+        if (!node)
+            node = new ConfigPathNode(nullptr, path);
+        return node;
     }
 
+    void mark(const QSharedPointer<ConfigAtom> &atom);
+    // Marks listened descendants of the node, which have no atoms yet
+    void markSubtree(ConfigPathNode *node);
+
     void notify();
 
     void listen(const ConfigPath &path, QObject *guard, const std::function<void (const QVariant &)> &callback)
     {
-        Entry entry = {
+        ConfigPathNode *node = path.node();
+        if (!node)
+            return;
+
+        ConfigPathNode::Listener listener = {
             guard,
             callback
         };
-        m_callbacks.insert(qMakePair(path.path(), path.name()), entry);
+        node->listeners << listener;
+        for (; node; node = node->parent)
+            ++node->subtreeListeners;
     }
 
 private:
-    struct Entry
+    void insert(ConfigPathNode *node, const QSharedPointer<ConfigAtom> &atom)
     {
-        QPointer<QObject> guard;
-        std::function<void (const QVariant &)> callback;
-    };
+        m_changed.insert(node, atom);
 
-    QSet<QPair<QString, QString>> m_changedPaths;
-    QMultiHash<QPair<QString, QString>, Entry> m_callbacks;
+        if (!m_eventSent) {
+            m_eventSent = true;
+            QTimer::singleShot(0, [this] () {
+                if (qApp->closingDown())
+                    return;
+                notify();
+            });
+        }
+    }
+
+    QHash<QString, ConfigPathNode *> m_roots;
+    // Changed nodes with listeners and atoms holding their new values
+    QHash<ConfigPathNode *, QWeakPointer<ConfigAtom>> m_changed;
     bool m_eventSent = false;
 };
 
 Q_GLOBAL_STATIC(ConfigNotifier, config_notifier)
 
-class ConfigAtom
+class ConfigAtom : public QEnableSharedFromThis<ConfigAtom>
 {
 public:
     typedef QSharedPointer<ConfigAtom> Ptr;
@@ -177,7 +280,7 @@ public:
     };
 
     ConfigAtom(const ConfigSource::WeakPtr &source, bool readOnly, const ConfigPath &path)
-        : m_source(source), m_path(path), m_type(Null), m_readOnly(readOnly)
+        : m_source(source), m_path(path), m_type(Null), m_readOnly(readOnly), m_modified(false)
     {
     }
 
@@ -201,16 +304,22 @@ public:
         case QVariant::Map: {
             const auto &input = variant.toMap();
             auto &map = result->ensureMap();
-            for (auto it = input.begin(); it != input.end(); ++it)
-                map.insert(it.key(), fromVariant(source, it.value(), readOnly, path.child(it.key())));
+            for (auto it = input.begin(); it != input.end(); ++it) {
+                auto child = fromVariant(source, it.value(), readOnly, path.child(it.key()));
+                child->m_parent = result;
+                map.insert(it.key(), child);
+            }
         }
             break;
         case QVariant::List: {
             const auto &input = variant.toList();
             auto &list = result->ensureList();
             list.reserve(input.size());
-            for (const auto &value : input)
-                list.append(fromVariant(source, value, readOnly, path.freeze()));
+            for (const auto &value : input) {
+                auto child = fromVariant(source, value, readOnly, path.freeze());
+                child->m_parent = result;
+                list.append(child);
+            }
         }
             break;
         default:
@@ -221,6 +330,61 @@ public:
         return result;
     }
 
+    static Ptr fromTree(const ConfigSource::WeakPtr &source, ConfigBackend *backend,
+                        const ConfigBackend::Tree &tree, bool readOnly, const ConfigPath &path)
+    {
+        auto result = Ptr::create(source, readOnly, path);
+        result->ensureMap();
+        result->fillMap(backend, tree);
+        return result;
+    }
+
+    static Ptr fromSubtree(const ConfigSource::WeakPtr &source, ConfigBackend *backend,
+                           const ConfigBackend::Subtree &subtree, bool readOnly, const ConfigPath &path)
+    {
+        // Map is decoded only when somebody looks inside of it
+        auto result = Ptr::create(source, readOnly, path);
+        result->ensureMap();
+        result->m_lazy.reset(new Lazy { backend, subtree, true });
+        return result;
+    }
+
+    // Collects changed maps and values, maps which weren't touched are kept as subtrees
+    ConfigBackend::Tree toTree()
+    {
+        ConfigBackend::Tree tree;
+        iterateMap([&tree] (const QString &key, const Ptr &child) {
+            if (child->m_lazy && !child->hasChanges()) {
+                tree.subtrees.insert(key, child->m_lazy->subtree);
+            } else if (child->isMap()) {
+                tree.children.insert(key, child->toTree());
+                child->m_lazy.reset();
+            } else if (!child->isNull()) {
+                tree.values.insert(key, child->toVariant());
+            }
+            child->clearChanges();
+        });
+        m_modified = false;
+        return tree;
+    }
+
+    // Moves subtrees to the file they were just saved to, so the old one can be released.
+    // Nothing is decoded: \a tree has the new places of the saved maps and the nested
+    // layout of the ones which were encoded anew
+    void rebind(const ConfigBackend::Tree &tree)
+    {
+        if (!isMap())
+            return;
+        iterateMap([&tree] (const QString &key, const Ptr &child) {
+            if (!child->isMap())
+                return;
+            if (tree.children.contains(key))
+                child->rebind(tree.children.value(key));
+            else if (child->m_lazy && tree.subtrees.contains(key))
+                child->moveSubtree(tree.subtrees.value(key));
+        });
+    }
+
     bool isReadOnly() const
     {
         return m_readOnly;
@@ -286,6 +450,7 @@ public:
                 return Ptr();
 
             it = map.insert(name, Ptr::create(m_source, m_readOnly, m_path.child(name)));
+            it.value()->m_parent = sharedFromThis();
         }
 
         return it.value();
@@ -299,8 +464,10 @@ public:
         if (m_readOnly && list.size() <= index)
             return Ptr();
 
-        while (list.size() <= index)
+        while (list.size() <= index) {
             list.append(Ptr::create(m_source, m_readOnly, m_path.freeze()));
+            list.last()->m_parent = sharedFromThis();
+        }
 
         return list.at(index);
     }
@@ -341,7 +508,7 @@ public:
 
         if (index < list.size()) {
             list.remove(index);
-            makeDirty();
+            makeDirty(m_path, toVariant(), false);
         }
     }
 
@@ -350,7 +517,7 @@ public:
         Q_ASSERT(isMap());
         if (Ptr atom = asMap().take(name)) {
             atom->markMeAndChildren();
-            makeDirty();
+            makeDirty(m_path.child(name), QVariant(), true);
         }
     }
 
@@ -377,7 +544,11 @@ public:
                 break;
             }
 
-            makeDirty();
+            const Ptr self = sharedFromThis();
+            iterateChildren([&self] (const Ptr &child) {
+                child->m_parent = self;
+            });
+            makeDirty(m_path, value, false);
         }
     }
 
@@ -386,6 +557,8 @@ public:
         Q_ASSERT(!m_readOnly);
         if (m_type == type)
             return;
+        if (m_type != Null)
+            m_modified = true;
 
         switch (type) {
         case Map:
@@ -408,28 +581,124 @@ public:
         return m_path;
     }
 
+    Ptr parent() const
+    {
+        return m_parent.toStrongRef();
+    }
+
+    // Atom wasn't removed or replaced since it was created for the node
+    bool isAttached(const ConfigPathNode *node) const
+    {
+        Ptr parent = m_parent.toStrongRef();
+        if (!parent)
+            return !node->parent;
+        if (!parent->isMap() || parent->asMap().value(node->name).data() != this)
+            return false;
+        // Maps inside of lists can't be checked by name
+        return parent->m_path.isFrozen() || parent->isAttached(node->parent);
+    }
+
 private:
-    void makeDirty()
+    struct Lazy
+    {
+        ConfigBackend *backend;
+        ConfigBackend::Subtree subtree;
+        // Map isn't decoded yet
+        bool pending;
+    };
+
+    void fillMap(ConfigBackend *backend, const ConfigBackend::Tree &tree)
+    {
+        auto &map = *data<ConfigMap>();
+        for (auto it = tree.values.begin(); it != tree.values.end(); ++it)
+            map.insert(it.key(), fromVariant(m_source, it.value(), m_readOnly, m_path.child(it.key())));
+        for (auto it = tree.children.begin(); it != tree.children.end(); ++it)
+            map.insert(it.key(), fromTree(m_source, backend, it.value(), m_readOnly, m_path.child(it.key())));
+        for (auto it = tree.subtrees.begin(); it != tree.subtrees.end(); ++it)
+            map.insert(it.key(), fromSubtree(m_source, backend, it.value(), m_readOnly, m_path.child(it.key())));
+        const Ptr self = sharedFromThis();
+        for (auto it = map.begin(); it != map.end(); ++it)
+            it.value()->m_parent = self;
+    }
+
+    // Unchanged blocks are copied as is, so nested ones keep their places relative to it
+    void moveSubtree(const ConfigBackend::Subtree &subtree)
+    {
+        const qint64 delta = subtree.offset - m_lazy->subtree.offset;
+        m_lazy->subtree = subtree;
+        if (m_lazy->pending)
+            return;
+        iterateMap([&subtree, delta] (const QString &, const Ptr &child) {
+            if (!child->isMap() || !child->m_lazy)
+                return;
+            const ConfigBackend::Subtree &old = child->m_lazy->subtree;
+            child->moveSubtree(ConfigBackend::Subtree { subtree.file, old.offset + delta, old.size });
+        });
+    }
+
+    void loadSubtree()
+    {
+        m_lazy->pending = false;
+        ConfigBackend::Tree tree;
+        if (!m_lazy->backend->loadSubtree(m_lazy->subtree, &tree))
+            qWarning() << "Failed to load config subtree" << m_path.name();
+        fillMap(m_lazy->backend, tree);
+    }
+
+    bool hasChanges()
     {
+        if (m_modified)
+            return true;
+        if (m_lazy && m_lazy->pending)
+            return false;
+        bool result = false;
+        iterateChildren([&result] (const Ptr &child) {
+            result = result || child->hasChanges();
+        });
+        return result;
+    }
+
+    void clearChanges()
+    {
+        if (m_lazy && m_lazy->pending)
+            return;
+        m_modified = false;
+        iterateChildren([] (const Ptr &child) {
+            child->clearChanges();
+        });
+    }
+
+    void makeDirty(const ConfigPath &path, const QVariant &value, bool removed)
+    {
+        m_modified = true;
         markMeAndChildren();
         if (auto source = m_source.toStrongRef())
-            source->makeDirty();
+            source->makeDirty(path, value, removed);
     }
 
     void markMeAndChildren()
     {
         mark();
-        if (isMap() && !m_path.isFrozen()) {
-            iterateMap([] (const QString &key, const Ptr &child) {
-                Q_UNUSED(key);
-                child->markMeAndChildren();
-            });
+        // Nobody listens to anything inside of this map
+        ConfigPathNode *node = m_path.node();
+        if (!node || node->subtreeListeners == 0 || !isMap() || m_path.isFrozen())
+            return;
+
+        if (m_lazy && m_lazy->pending) {
+            config_notifier()->markSubtree(node);
+            return;
         }
+
+        iterateMap([] (const QString &key, const Ptr &child) {
+            Q_UNUSED(key);
+            child->markMeAndChildren();
+        });
     }
 
-    void mark() const
+    void mark()
     {
-        config_notifier()->mark(m_path);
+        if (ConfigNotifier *notifier = config_notifier())
+            notifier->mark(sharedFromThis());
     }
 
     ConfigMap &asMap()
@@ -458,6 +727,8 @@ private:
             clear();
             new (map) ConfigMap();
             m_type = Map;
+        } else if (m_lazy && m_lazy->pending) {
+            loadSubtree();
         }
 
         return *map;
@@ -507,6 +778,7 @@ private:
         }
 
         m_type = Null;
+        m_lazy.reset();
     }
 
     template <typename T>
@@ -517,6 +789,7 @@ private:
     }
 
     ConfigSource::WeakPtr m_source;
+    QWeakPointer<ConfigAtom> m_parent;
     ConfigPath m_path;
     union {
         char m_map_buffer[sizeof(ConfigMap)];
@@ -526,6 +799,9 @@ private:
     };
     Type m_type;
     const bool m_readOnly;
+    // Changed since loading, only for atoms of sources with tree backends
+    bool m_modified;
+    QScopedPointer<Lazy> m_lazy;
 };
 
 class ConfigSourceHash : public QObject
@@ -577,47 +853,301 @@ private:
 
 Q_GLOBAL_STATIC(ConfigSourceHash, sourceHash)
 
+void ConfigNotifier::mark(const ConfigAtom::Ptr &atom)
+{
+    // Listeners of all ancestors are notified too
+    for (ConfigAtom::Ptr current = atom; current; current = current->parent()) {
+        const ConfigPath &path = current->path();
+        ConfigPathNode *node = path.node();
+        if (!node)
+            return;
+        // Atoms inside of lists share the path of the list
+        if (path.isFrozen() || node->listeners.isEmpty())
+            continue;
+        // Ancestors are already marked by the previous call
+        if (m_changed.contains(node) && m_changed.value(node) == current)
+            return;
+        insert(node, current);
+    }
+}
+
+void ConfigNotifier::markSubtree(ConfigPathNode *node)
+{
+    foreach (ConfigPathNode *child, node->children) {
+        if (child->subtreeListeners == 0)
+            continue;
+        if (!child->listeners.isEmpty())
+            insert(child, ConfigAtom::Ptr());
+        markSubtree(child);
+    }
+}
+
+static QVariant notifierValue(ConfigPathNode *node, const ConfigAtom::Ptr &atom)
+{
+    if (atom && !atom->isNull() && atom->isAttached(node))
+        return atom->toVariant();
+    // Value was removed or replaced, so it's looked up through all config layers
+    return Config(node->root()->name).value(node->fullName().mid(1));
+}
+
 void ConfigNotifier::notify()
 {
     m_eventSent = false;
-    auto changedPaths = m_changedPaths;
-    m_changedPaths.clear();
-    foreach (auto pair, changedPaths) {
-        QString path = pair.second;
-        int index;
-        while ((index = path.lastIndexOf(QLatin1Char('/'))) >= 0) {
-            path.resize(index);
-            changedPaths.insert(qMakePair(pair.first, path));
-        }
-    }
-    auto sortedPaths = changedPaths.toList();
-    typedef const QPair<QString, QString> & Pair;
-    std::sort(sortedPaths.begin(), sortedPaths.end(), [] (Pair first, Pair second) {
-        return std::make_tuple(first.first, -first.second.size(), first.second)
-                < std::make_tuple(second.first, -second.second.size(), second.second);
+    const auto changed = m_changed;
+    m_changed.clear();
+
+    // Listeners of nested paths are notified first
+    QList<ConfigPathNode *> nodes = changed.keys();
+    std::sort(nodes.begin(), nodes.end(), [] (ConfigPathNode *first, ConfigPathNode *second) {
+        return first->depth > second->depth;
     });
-    foreach (Pair path, sortedPaths) {
-        auto it = m_callbacks.find(path);
-        while (it != m_callbacks.end() && it.key() == path) {
-            if (!it.value().guard) {
-                auto it2 = it++;
-                m_callbacks.erase(it2);
+
+    foreach (ConfigPathNode *node, nodes) {
+        const ConfigAtom::Ptr atom = changed.value(node).toStrongRef();
+        QVariant value;
+        bool hasValue = false;
+        // Callbacks may add new listeners, so no iterators here
+        for (int i = 0; i < node->listeners.size(); ) {
+            if (!node->listeners.at(i).guard) {
+                node->listeners.removeAt(i);
+                for (ConfigPathNode *parent = node; parent; parent = parent->parent)
+                    --parent->subtreeListeners;
                 continue;
             }
-            QVariant value = Config(path.first).value(path.second);
-            it.value().callback(value);
-            ++it;
+            if (!hasValue) {
+                value = notifierValue(node, atom);
+                hasValue = true;
+            }
+            const auto callback = node->listeners.at(i).callback;
+            callback(value);
+            ++i;
         }
     }
 }
 
-ConfigSource::ConfigSource() : backend(nullptr), dirty(false), isAtLoop(false)
+enum {
+    // Delay to coalesce bursts of changes into a single save
+    SaveDelay = 200,
+    MaxJournalEntries = 256,
+    // Journal is compacted by saving the whole file when it grows larger
+    MaxJournalSize = 64 * 1024
+};
+
+class PostConfigSaveEvent : public QEvent
+{
+public:
+	PostConfigSaveEvent(const ConfigSource::WeakPtr &s, const QString &fileName,
+	                    bool fullSave, qint64 bytes, qint64 elapsed)
+	    : QEvent(eventType()), source(s), fileName(fileName),
+	      fullSave(fullSave), bytes(bytes), elapsed(elapsed), isTree(false) {}
+	static Type eventType()
+	{
+		static Type type = static_cast<Type>(registerEventType());
+		return type;
+	}
+	ConfigSource::WeakPtr source;
+	QString fileName;
+	bool fullSave;
+	qint64 bytes;
+	qint64 elapsed;
+	bool isTree;
+	ConfigBackend::Tree tree;
+};
+
+// Snapshot of the source is made at the GUI thread and is written at the saver's one
+class ConfigSaveTask : public QRunnable
+{
+public:
+    ConfigSaveTask(ConfigSource *source, const ConfigSource::WeakPtr &weak, QObject *receiver)
+        : m_source(weak), m_receiver(receiver), m_backend(source->backend),
+          m_fileName(source->fileName), m_journalFileName(source->journalFileName()),
+          m_isTree(source->isTree)
+    {
+        m_fullSave = source->fullSave || source->journalSize >= MaxJournalSize;
+        if (!m_fullSave)
+            m_journal = source->journal;
+        else if (m_isTree)
+            m_tree = source->data->toTree();
+        else
+            m_value = source->data->toVariant();
+    }
+
+    void run()
+    {
+        QElapsedTimer timer;
+        timer.start();
+        qint64 bytes = 0;
+        ConfigBackend::Tree saved;
+
+        if (m_fullSave) {
+            if (!m_isTree || !m_backend->saveTree(m_fileName, m_tree, &saved))
+                m_backend->save(m_fileName, m_value);
+            // Everything from the journal is already in the file
+            QFile::remove(m_journalFileName);
+            bytes = QFileInfo(m_fileName).size();
+        } else {
+            QByteArray data;
+            QDataStream stream(&data, QIODevice::WriteOnly);
+            stream.setVersion(QDataStream::Qt_5_0);
+            foreach (const ConfigSource::JournalEntry &entry, m_journal) {
+                // Records are length prefixed, so a torn tail is detected on replay
+                QByteArray record;
+                QDataStream recordStream(&record, QIODevice::WriteOnly);
+                recordStream.setVersion(QDataStream::Qt_5_0);
+                recordStream << quint8(entry.removed) << entry.path << entry.value;
+                stream << record;
+            }
+            QFile file(m_journalFileName);
+            if (file.open(QIODevice::WriteOnly | QIODevice::Append))
+                bytes = file.write(data);
+            else
+                qWarning() << "Can't write config journal" << m_journalFileName << file.errorString();
+        }
+
+        PostConfigSaveEvent *event = new PostConfigSaveEvent(m_source, m_fileName, m_fullSave,
+                                                             bytes, timer.elapsed());
+        // Atoms are moved to the new file at the GUI thread
+        event->isTree = m_fullSave && m_isTree;
+        event->tree = saved;
+        QCoreApplication::postEvent(m_receiver, event);
+    }
+
+private:
+    ConfigSource::WeakPtr m_source;
+    QObject *m_receiver;
+    ConfigBackend *m_backend;
+    QString m_fileName;
+    QString m_journalFileName;
+    bool m_isTree;
+    bool m_fullSave;
+    QList<ConfigSource::JournalEntry> m_journal;
+    ConfigBackend::Tree m_tree;
+    QVariant m_value;
+};
+
+class PostConfigSaver : public QObject
+{
+public:
+	PostConfigSaver() : m_savedBytes(0), m_saveCount(0)
+	{
+		// Single thread keeps saves of the same file in order
+		m_pool.setMaxThreadCount(1);
+		qAddPostRoutine(cleanup);
+	}
+
+	void schedule(const ConfigSource::Ptr &source)
+	{
+		m_scheduled.insert(source->fileName, source);
+		if (!m_timer.isActive())
+			m_timer.start(SaveDelay, this);
+	}
+
+	// Source may be dropped from the cache while its changes are still being written
+	ConfigSource::Ptr source(const QString &fileName) const
+	{
+		ConfigSource::Ptr result = m_scheduled.value(fileName);
+		return result ? result : m_active.value(fileName);
+	}
+
+	void save(ConfigSource *source, const ConfigSource::WeakPtr &weak)
+	{
+		m_pool.start(new ConfigSaveTask(source, weak, this));
+		source->dirty = false;
+		source->fullSave = false;
+		source->journal.clear();
+		++source->pendingSaves;
+	}
+
+	void flush()
+	{
+		m_timer.stop();
+		const auto scheduled = m_scheduled;
+		m_scheduled.clear();
+		foreach (const ConfigSource::Ptr &source, scheduled) {
+			if (!source->dirty)
+				continue;
+			save(source.data(), source);
+			m_active.insert(source->fileName, source);
+		}
+	}
+
+protected:
+	virtual void timerEvent(QTimerEvent *ev)
+	{
+		if (ev->timerId() == m_timer.timerId())
+			flush();
+		else
+			QObject::timerEvent(ev);
+	}
+
+	virtual bool event(QEvent *ev)
+	{
+		if (ev->type() == PostConfigSaveEvent::eventType()) {
+			PostConfigSaveEvent *saveEvent = static_cast<PostConfigSaveEvent*>(ev);
+			m_savedBytes += saveEvent->bytes;
+			++m_saveCount;
+			qDebug() << "Config" << saveEvent->fileName << (saveEvent->fullSave ? "saved:" : "journaled:")
+			         << saveEvent->bytes << "bytes in" << saveEvent->elapsed << "ms, total"
+			         << m_savedBytes << "bytes in" << m_saveCount << "saves";
+			if (ConfigSource::Ptr source = saveEvent->source.toStrongRef()) {
+				source->journalSize = saveEvent->fullSave ? 0 : source->journalSize + saveEvent->bytes;
+				if (saveEvent->isTree)
+					source->data->rebind(saveEvent->tree);
+				if (--source->pendingSaves == 0) {
+					source->update();
+					if (m_active.value(source->fileName) == source)
+						m_active.remove(source->fileName);
+				}
+			}
+			return true;
+		}
+		return QObject::event(ev);
+	}
+
+private:
+	static void cleanup();
+
+	QBasicTimer m_timer;
+	QHash<QString, ConfigSource::Ptr> m_scheduled;
+	QHash<QString, ConfigSource::Ptr> m_active;
+	QThreadPool m_pool;
+	qint64 m_savedBytes;
+	int m_saveCount;
+};
+
+Q_GLOBAL_STATIC(PostConfigSaver, postConfigSaver)
+
+void PostConfigSaver::cleanup()
+{
+	PostConfigSaver *saver = postConfigSaver();
+	saver->flush();
+	saver->m_pool.waitForDone();
+}
+
+static ConfigSource::Ptr findSource(const QString &fileName)
+{
+	ConfigSource::Ptr result = sourceHash()->value(fileName);
+	PostConfigSaver *saver = postConfigSaver();
+	if (!result && saver)
+		result = saver->source(fileName);
+	return result;
+}
+
+static QStringList parseNames(const QString &fullName);
+
+ConfigSource::ConfigSource()
+    : backend(nullptr), dirty(false), isTree(false), fullSave(false),
+      isReplaying(false), journalSize(0), pendingSaves(0)
 {
 }
 
 ConfigSource::~ConfigSource()
 {
-    if (dirty)
+    if (!dirty)
+        return;
+    if (PostConfigSaver *saver = postConfigSaver())
+        saver->save(this, ConfigSource::WeakPtr());
+    else
         sync();
 }
 
@@ -639,7 +1169,7 @@ ConfigSource::Ptr ConfigSource::open(const QString &path, bool systemDir, bool c
 	}
 	fileName = QDir::cleanPath(fileName);
 
-	ConfigSource::Ptr result = sourceHash()->value(fileName);
+	ConfigSource::Ptr result = findSource(fileName);
 	if (result && result->isValid())
 		return result;
 	
@@ -663,7 +1193,7 @@ ConfigSource::Ptr ConfigSource::open(const QString &path, bool systemDir, bool c
 			fileName += QLatin1Char('.');
 			fileName += QLatin1String(backend->name());
 	
-			result = sourceHash()->value(fileName);
+			result = findSource(fileName);
 			if (result && result->isValid())
 				return result;
 			info.setFile(fileName);
@@ -689,9 +1219,16 @@ ConfigSource::Ptr ConfigSource::open(const QString &path, bool systemDir, bool c
     const bool readOnly = !info.isWritable() && (systemDir || info.exists());
 
 	d->update();
-    const QVariant value = d->backend->load(d->fileName);
-    ConfigPath configPath = readOnly ? ConfigPath(ConfigPath::Invalid) : ConfigPath(originalPath, QString());
-    d->data = ConfigAtom::fromVariant(result, value, readOnly, configPath);
+    ConfigNotifier *notifier = config_notifier();
+    ConfigPath configPath = readOnly || !notifier ? ConfigPath(ConfigPath::Invalid) : ConfigPath(notifier->root(originalPath));
+    ConfigBackend::Tree tree;
+    if (d->backend->loadTree(d->fileName, &tree)) {
+        d->isTree = true;
+        d->data = ConfigAtom::fromTree(result, d->backend, tree, readOnly, configPath);
+    } else {
+        const QVariant value = d->backend->load(d->fileName);
+        d->data = ConfigAtom::fromVariant(result, value, readOnly, configPath);
+    }
 
     if (d->data->isValue() || d->data->isNull()) {
         if (!create)
@@ -700,56 +1237,96 @@ ConfigSource::Ptr ConfigSource::open(const QString &path, bool systemDir, bool c
         d->data = ConfigAtom::fromVariant(result, QVariantMap(), readOnly, configPath);
     }
 
+    if (!readOnly)
+        d->replayJournal();
+
 	sourceHash()->insert(fileName, result);
 	return result;
 }
 
 void ConfigSource::sync()
 {
-    backend->save(fileName, data->toVariant());
+    ConfigBackend::Tree saved;
+    if (!isTree || !backend->saveTree(fileName, data->toTree(), &saved))
+        backend->save(fileName, data->toVariant());
+    else
+        data->rebind(saved);
+    QFile::remove(journalFileName());
+    journal.clear();
+    journalSize = 0;
+    fullSave = false;
     dirty = false;
     update();
 }
 
-class PostConfigSaveEvent : public QEvent
+void ConfigSource::makeDirty(const ConfigPath &path, const QVariant &value, bool removed)
 {
-public:
-	PostConfigSaveEvent(const ConfigSource::Ptr &s) : QEvent(eventType()), source(s) {}
-	static Type eventType()
-	{
-		static Type type = static_cast<Type>(registerEventType());
-		return type;
-	}
-	ConfigSource::Ptr source;
-};
+    dirty = true;
+    if (isReplaying || fullSave)
+        return;
 
-class PostConfigSaver : public QObject
+    // Values inside of lists have no path, so the whole file has to be written
+    if (path.isFrozen() || journal.size() >= MaxJournalEntries) {
+        fullSave = true;
+        journal.clear();
+        return;
+    }
+
+    JournalEntry entry = { path.name(), value, removed };
+    journal << entry;
+}
+
+void ConfigSource::replayJournal()
 {
-public:
-	PostConfigSaver()
-	{
-		qAddPostRoutine(cleanup);
-	}
+    QFile file(journalFileName());
+    if (!file.open(QIODevice::ReadOnly))
+        return;
 
-	virtual bool event(QEvent *ev)
-	{
-		if (ev->type() == PostConfigSaveEvent::eventType()) {
-			PostConfigSaveEvent *saveEvent = static_cast<PostConfigSaveEvent*>(ev);
-			saveEvent->source->sync();
-			saveEvent->source->isAtLoop = false;
-			return true;
-		}
-		return QObject::event(ev);
-	}
-private:
-	static void cleanup();
-};
+    const QByteArray bytes = file.readAll();
+    QDataStream stream(bytes);
+    stream.setVersion(QDataStream::Qt_5_0);
+    int count = 0;
 
-Q_GLOBAL_STATIC(PostConfigSaver, postConfigSaver)
+    isReplaying = true;
+    while (!stream.atEnd()) {
+        QByteArray record;
+        stream >> record;
+        // Tail of the journal may be torn by a crash
+        if (stream.status() != QDataStream::Ok)
+            break;
 
-void PostConfigSaver::cleanup()
-{
-	QCoreApplication::sendPostedEvents(postConfigSaver(), PostConfigSaveEvent::eventType());
+        QDataStream recordStream(record);
+        recordStream.setVersion(QDataStream::Qt_5_0);
+        quint8 removed;
+        QString path;
+        QVariant value;
+        recordStream >> removed >> path >> value;
+        if (recordStream.status() != QDataStream::Ok)
+            break;
+
+        QStringList names = parseNames(path);
+        if (names.isEmpty())
+            continue;
+        const QString name = names.takeLast();
+        ConfigAtom::Ptr atom = data;
+        foreach (const QString &parent, names)
+            atom = atom->child(parent);
+        atom->convert(ConfigAtom::Map);
+        if (removed)
+            atom->remove(name);
+        else
+            atom->child(name)->replace(value);
+        ++count;
+    }
+    isReplaying = false;
+
+    journalSize = bytes.size();
+    if (count > 0) {
+        qDebug() << "Replayed" << count << "changes from" << file.fileName();
+        // Compact the journal with the next save
+        dirty = true;
+        fullSave = true;
+    }
 }
 
 class ConfigLevel
@@ -931,11 +1508,10 @@ void ConfigPrivate::sync()
 		return;
 
     ConfigSource::Ptr source = sources.value(0);
-	if (source && source->dirty && !source->isAtLoop) {
-		source->isAtLoop = true;
-		source->dirty = false;
-		QCoreApplication::postEvent(postConfigSaver(), new PostConfigSaveEvent(source), -2);
-    }
+	if (source && source->dirty) {
+		if (PostConfigSaver *saver = postConfigSaver())
+			saver->schedule(source);
+	}
 }
 
 QExplicitlySharedDataPointer<ConfigPrivate> ConfigPrivate::clone()
@@ -1274,7 +1850,8 @@ void Config::listen(const QString &name, QObject *guard, const std::function<voi
         ConfigPath path = atom->path();
         for (int i = 0; i < names.size(); ++i)
             path = path.child(names[i]);
-        config_notifier()->listen(path, guard, callback);
+        if (ConfigNotifier *notifier = config_notifier())
+            notifier->listen(path, guard, callback);
     }
 }
 
@@ -1309,6 +1886,33 @@ QByteArray ConfigBackend::name() const
 	return d->extension;
 }
 
+bool ConfigBackend::loadTree(const QString &file, Tree *tree)
+{
+	TreeArgument argument = { file, Subtree(), Tree(), false };
+	virtual_hook(LoadTreeHook, &argument);
+	if (argument.handled)
+		*tree = argument.tree;
+	return argument.handled;
+}
+
+bool ConfigBackend::loadSubtree(const Subtree &subtree, Tree *tree)
+{
+	TreeArgument argument = { QString(), subtree, Tree(), false };
+	virtual_hook(LoadSubtreeHook, &argument);
+	if (argument.handled)
+		*tree = argument.tree;
+	return argument.handled;
+}
+
+bool ConfigBackend::saveTree(const QString &file, const Tree &tree, Tree *saved)
+{
+	TreeArgument argument = { file, Subtree(), tree, false };
+	virtual_hook(SaveTreeHook, &argument);
+	if (argument.handled && saved)
+		*saved = argument.tree;
+	return argument.handled;
+}
+
 void ConfigBackend::virtual_hook(int id, void *data)
 {
 	Q_UNUSED(id);
@@ -30,8 +30,11 @@
 #include <functional>
 #include <QVariant>
 #include <QSharedData>
+#include <QSharedPointer>
 #include <QMetaTypeId>
 
+class QFile;
+
 namespace qutim_sdk_0_3
 {
 #ifndef Q_QDOC
@@ -194,12 +197,63 @@ class LIBQUTIM_EXPORT ConfigBackend : public QObject
     Q_OBJECT
     Q_DECLARE_PRIVATE(ConfigBackend)
 public:
+    enum ConfigBackendHook {
+        LoadTreeHook = 0x100,
+        LoadSubtreeHook,
+        SaveTreeHook
+    };
+
+    /*!
+      Map which is stored in the file but isn't decoded yet. Meaning of
+      \a offset and \a size is up to backend, \a file keeps the storage alive.
+    */
+    struct Subtree
+    {
+        QSharedPointer<QFile> file;
+        qint64 offset;
+        qint64 size;
+    };
+
+    /*!
+      Single level of the config tree. Nested maps are either decoded into
+      \a children or are left in \a subtrees to be decoded on first access.
+      On saving \a subtrees are the maps which weren't changed since loading.
+    */
+    struct Tree
+    {
+        QVariantMap values;
+        QMap<QString, Tree> children;
+        QMap<QString, Subtree> subtrees;
+    };
+
+    struct TreeArgument
+    {
+        QString file;
+        Subtree subtree;
+        Tree tree;
+        bool handled;
+    };
+
     ConfigBackend();
     virtual ~ConfigBackend();
 
     virtual QVariant load(const QString &file) = 0;
     virtual void save(const QString &file, const QVariant &entry) = 0;
 
+    /*!
+      Partial loading and saving, backends support it by handling
+      LoadTreeHook, LoadSubtreeHook and SaveTreeHook. Methods return false
+      if backend doesn't support it, load() and save() are used then.
+      SaveTreeHook may replace the tree of the argument by the places of the
+      maps in the written file, it's returned as \a saved then, so subtrees
+      no longer refer to the replaced file. Its \a subtrees have every saved
+      map and its \a children have the same for the maps which were passed
+      as children, so nothing has to be decoded again.
+    */
+    bool loadTree(const QString &file, Tree *tree);
+    bool loadSubtree(const Subtree &subtree, Tree *tree);
+    bool saveTree(const QString &file, const Tree &tree, Tree *saved = 0);
+
     QByteArray name() const;
 protected:
     virtual void virtual_hook(int id, void *data);
@@ -26,12 +26,21 @@
 #include "emoticons.h"
 #include "configbase.h"
 #include "objectgenerator.h"
+#include "utils.h"
+#include "emoticons_p.h"
+#include "metaobjectbuilder.h"
+#include "startuptrace_p.h"
 #include <QStringList>
+#include <QMutex>
+#include <QSharedPointer>
 #include <QSet>
 #include <QHash>
 #include <QImageReader>
 #include <QStringBuilder>
 #include <QTextDocument>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
 #include <QDebug>
 
 namespace qutim_sdk_0_3
@@ -40,16 +49,51 @@ namespace qutim_sdk_0_3
 
 namespace Emoticons
 {
+// Parses the current theme at startup on a worker thread
+class PreloadTask : public QRunnable
+{
+public:
+	PreloadTask(EmoticonsBackend *backend, const QString &name)
+		: m_backend(backend), m_name(name), m_provider(0)
+	{
+		setAutoDelete(false);
+	}
+
+	QString name() const { return m_name; }
+	EmoticonsProvider *wait()
+	{
+		m_done.acquire();
+		m_done.release();
+		return m_provider;
+	}
+
+	virtual void run()
+	{
+		StartupTrace::Scope scope(startupTrace(), "emoticons", m_name);
+		m_provider = m_backend->loadTheme(m_name);
+		m_done.release();
+	}
+
+private:
+	EmoticonsBackend *m_backend;
+	QString m_name;
+	EmoticonsProvider *m_provider;
+	QSemaphore m_done;
+};
+
 struct Private
 {
 	~Private();
 	QHash<QString, EmoticonsThemeData*> cache;
 	QList<EmoticonsBackend *> backends;
+	QScopedPointer<PreloadTask> preload;
 };
 static QScopedPointer<Private> p;
 
 Private::~Private()
 {
+	if (preload)
+		delete preload->wait();
 	qDeleteAll(backends);
 }
 }
@@ -66,13 +110,105 @@ struct EmoticonsThemeData : public QSharedData
 	EmoticonsProvider *provider;
 };
 
+/*
+ * Prefix tree of html-escaped emoticon codes, built once per theme. Finding
+ * the emoticon at some position of the text is a single walk down the tree
+ * instead of comparing the text with every code starting with the same char.
+ */
+class EmoticonsMatcher
+{
+public:
+	typedef EmoticonsProvider::Emoticon Emoticon;
+
+	EmoticonsMatcher(const QHash<QChar, QList<Emoticon> > &indexes);
+	// Returns emoticon at the begin of [chars, end), the one tokenize always preferred
+	const Emoticon *match(const QChar *chars, const QChar *end, bool strict, int *length) const;
+
+private:
+	static inline quint64 edgeKey(int node, QChar ch)
+	{ return (quint64(node) << 16) | ch.unicode(); }
+
+	// Index of the best emoticon which ends at the node, -1 if there is no one
+	QVector<int> m_terminals;
+	QHash<quint64, int> m_edges;
+	// Emoticons ordered by their priority
+	QVector<Emoticon> m_emoticons;
+};
+
+EmoticonsMatcher::EmoticonsMatcher(const QHash<QChar, QList<Emoticon> > &indexes)
+{
+	m_terminals.append(-1);
+	QHash<QChar, QList<Emoticon> >::const_iterator it;
+	for (it = indexes.constBegin(); it != indexes.constEnd(); ++it) {
+		foreach (const Emoticon &emo, it.value()) {
+			const QString &code = emo.matchTextEscaped;
+			// Text is looked up by the lower-cased char, so this one is never matched
+			if (code.at(0) != it.key())
+				continue;
+			int node = 0;
+			foreach (const QChar &ch, code) {
+				int &child = m_edges[edgeKey(node, ch)];
+				if (!child) {
+					child = m_terminals.size();
+					m_terminals.append(-1);
+				}
+				node = child;
+			}
+			// Lists are sorted by priority, so the first one wins
+			if (m_terminals.at(node) < 0)
+				m_terminals[node] = m_emoticons.size();
+			m_emoticons.append(emo);
+		}
+	}
+}
+
+const EmoticonsMatcher::Emoticon *EmoticonsMatcher::match(const QChar *chars, const QChar *end,
+                                                          bool strict, int *length) const
+{
+	int best = -1;
+	int node = 0;
+	for (const QChar *c = chars; c != end && !c->isNull(); ++c) {
+		node = m_edges.value(edgeKey(node, c->toLower()));
+		if (!node)
+			break;
+		const int index = m_terminals.at(node);
+		if (index < 0 || (best >= 0 && best < index))
+			continue;
+		if (strict && !(c + 1)->isNull() && !(c + 1)->isSpace())
+			continue;
+		best = index;
+		*length = c - chars + 1;
+	}
+	return best < 0 ? 0 : &m_emoticons.at(best);
+}
+
 struct EmoticonsProviderPrivate
 {
+	QSharedPointer<const EmoticonsMatcher> ensureMatcher();
+	void resetMatcher();
+
 	QStringList order;
 	QHash<QString, QStringList> map;
 	QHash<QChar, QList<EmoticonsProvider::Emoticon> > indexes;
+	// Theme may be used by several threads at once
+	QMutex matcherLock;
+	QSharedPointer<const EmoticonsMatcher> matcher;
 };
 
+QSharedPointer<const EmoticonsMatcher> EmoticonsProviderPrivate::ensureMatcher()
+{
+	QMutexLocker locker(&matcherLock);
+	if (!matcher)
+		matcher = QSharedPointer<const EmoticonsMatcher>(new EmoticonsMatcher(indexes));
+	return matcher;
+}
+
+void EmoticonsProviderPrivate::resetMatcher()
+{
+	QMutexLocker locker(&matcherLock);
+	matcher.clear();
+}
+
 namespace Emoticons
 {
 void ensurePrivate_helper()
@@ -154,6 +290,7 @@ void EmoticonsProvider::clearEmoticons()
 	p->order.clear();
 	p->map.clear();
 	p->indexes.clear();
+	p->resetMatcher();
 }
 
 inline void appendEmoticonToHash(QList<EmoticonsProvider::Emoticon> &ls, const EmoticonsProvider::Emoticon &e)
@@ -193,10 +330,12 @@ void EmoticonsProvider::appendEmoticon(const QString &imgPath, const QStringList
 		if (c1 != c2)
 			appendEmoticonToHash(p->indexes[c2], e);
 	}
+	p->resetMatcher();
 }
 
 void EmoticonsProvider::removeEmoticon(const QString &imgPath, const QStringList &codes)
 {
+	p->resetMatcher();
 	p->order.removeAll(imgPath);
 	p->map.remove(imgPath);
 	foreach (const QString &code, codes) {
@@ -277,12 +416,15 @@ QString EmoticonsTheme::themeName() const
 
 QString EmoticonsTheme::parseEmoticons(const QString &text, ParseMode mode, const QStringList &exclude)
 {
-	if (isNull())
+	if (isNull() && !(mode & ParseUrls))
 		return text;
 	QString result;
 	QList<Token> tokens = tokenize(text, mode);
 	for (QList<Token>::iterator it = tokens.begin(); it != tokens.end(); it++) {
 		switch(it->type) {
+		case Link:
+			result += UrlParser::linkHtml(it->text, it->url);
+			break;
 		case Image:
 			if (!exclude.contains(it->text)) {
 				result += it->imgHtmlCode;
@@ -305,18 +447,6 @@ enum HtmlState
 	SecondTag
 };
 
-inline bool compareEmoticon(const QChar *c, const QString &smile)
-{
-	const QChar *s = smile.constData();
-	while (c->toLower() == *s) {
-		if (s->isNull())
-			return true;
-		s++;
-		c++;
-	}
-	return s->isNull();
-}
-
 inline void appendEmoticon(QString &text, const QString &url, const QStringRef &emo)
 {
 	int i = 0, last = 0;
@@ -328,23 +458,26 @@ inline void appendEmoticon(QString &text, const QString &url, const QStringRef &
 	text += QStringRef(&url, last, url.length() - last);
 }
 
-QList<EmoticonsTheme::Token> EmoticonsTheme::tokenize(const QString &message, ParseMode mode)
+struct EmoticonsParserState
 {
-	QList<Token> tokens;
-	if (isNull()) {
-		tokens << Token(message);
-		return tokens;
-	}
-	HtmlState state = OutsideHtml;
-	bool at_amp = false;
+	HtmlState html;
+	bool atAmp;
+};
+
+// Tokenizes [from, to) part of the message, state is passed between parts split by links
+static void appendTokens(QList<EmoticonsTheme::Token> &tokens, const QString &message, int from, int to,
+                         EmoticonsTheme::ParseMode mode, const EmoticonsMatcher *matcher,
+                         EmoticonsParserState &parser)
+{
+	typedef EmoticonsTheme::Token Token;
+	HtmlState &state = parser.html;
+	bool &at_amp = parser.atAmp;
 	const QChar *begin = message.constData();
-	const QChar *chars = message.constData();
+	const QChar *chars = begin + from;
+	const QChar *end = begin + to;
 	QChar cur;
 	QString text;
-	typedef EmoticonsProvider::Emoticon Emoticon;
-	const QHash<QChar, QList<Emoticon> > allEmoticons = p->provider->emoticonsByChar();
-	QList<Emoticon>::const_iterator it;
-	while (!chars->isNull()) {
+	while (chars != end && !chars->isNull()) {
 		cur = *chars;
 		if (cur == '<') {
 			if (state == OutsideHtml)
@@ -359,7 +492,9 @@ QList<EmoticonsTheme::Token> EmoticonsTheme::tokenize(const QString &message, Pa
 			case L'"':
 			case L'\'':
 				do text += *(chars++);
-				while(!chars->isNull() && *chars != cur);
+				while(chars != end && !chars->isNull() && *chars != cur);
+				if (chars == end || chars->isNull())
+					cur = QChar();
 				break;
 			case L'>':
 				state = static_cast<HtmlState>((state + 1) % 4);
@@ -369,35 +504,26 @@ QList<EmoticonsTheme::Token> EmoticonsTheme::tokenize(const QString &message, Pa
 			}
 		} else if (state != TagText && at_amp) {
 			do text += *(chars++);
-			while(!chars->isNull() && *chars != ';');
-			cur = *chars;
+			while(chars != end && !chars->isNull() && *chars != ';');
+			cur = chars != end ? *chars : QChar();
 			at_amp = false;
 		} else if (state != TagText) {
-			bool found = false;
 			at_amp = cur == '&';
-			if (!(mode & StrictParse) || chars == begin || (chars-1)->isSpace()) {
-				const QList<Emoticon> emoticons = allEmoticons.value(cur.toLower());
-				for (it = emoticons.constBegin(); it != emoticons.constEnd(); it++ ) {
-					const Emoticon &emo = *it;
-					int length = emo.matchTextEscaped.length();
-					if (compareEmoticon(chars, emo.matchTextEscaped)
-							&& (!(mode&StrictParse) || (chars+length)->isNull() || (chars+length)->isSpace())) {
-						if (!text.isEmpty()) {
-							tokens << Token(text);
-							text = QString();
-						}
-						QString htmlCode;
-						appendEmoticon(htmlCode, emo.picHTMLCode, QStringRef(&message, chars - begin, length));
-						tokens << Token(QString(chars, length), emo.picPath, htmlCode);
-						found = true;
-						at_amp = false;
-						chars += length;
-						cur = *chars;
-						break;
+			if (matcher && (!(mode & EmoticonsTheme::StrictParse) || chars == begin || (chars-1)->isSpace())) {
+				int length = 0;
+				const bool strict = mode & EmoticonsTheme::StrictParse;
+				if (const EmoticonsProvider::Emoticon *emo = matcher->match(chars, end, strict, &length)) {
+					if (!text.isEmpty()) {
+						tokens << Token(text);
+						text = QString();
 					}
-				}
-				if (found)
+					QString htmlCode;
+					appendEmoticon(htmlCode, emo->picHTMLCode, QStringRef(&message, chars - begin, length));
+					tokens << Token(QString(chars, length), emo->picPath, htmlCode);
+					at_amp = false;
+					chars += length;
 					continue;
+				}
 			}
 		}
 		if (cur.isNull())
@@ -407,7 +533,34 @@ QList<EmoticonsTheme::Token> EmoticonsTheme::tokenize(const QString &message, Pa
 	}
 	if (!text.isEmpty())
 		tokens << Token(text);
+}
 
+QList<EmoticonsTheme::Token> EmoticonsTheme::tokenize(const QString &message, ParseMode mode)
+{
+	QList<Token> tokens;
+	if (isNull() && !(mode & ParseUrls)) {
+		tokens << Token(message);
+		return tokens;
+	}
+	QSharedPointer<const EmoticonsMatcher> matcher;
+	if (!isNull())
+		matcher = p->provider->p->ensureMatcher();
+	EmoticonsParserState state = { OutsideHtml, false };
+	if (!(mode & ParseUrls)) {
+		appendTokens(tokens, message, 0, message.size(), mode, matcher.data(), state);
+		return tokens;
+	}
+	foreach (const UrlParser::UrlToken &link, UrlParser::tokenize(message, UrlParser::Html)) {
+		if (link.url.isEmpty()) {
+			const int position = link.text.position();
+			appendTokens(tokens, message, position, position + link.text.size(), mode, matcher.data(), state);
+		} else {
+			Token token(link.text.toString());
+			token.type = Link;
+			token.url = link.url;
+			tokens << token;
+		}
+	}
 	return tokens;
 }
 
@@ -415,8 +568,47 @@ namespace Emoticons
 {
 Q_GLOBAL_STATIC_WITH_ARGS(EmoticonsTheme, currentTheme, (0))
 
+// Adopts the preloaded theme, waits for the worker if it's not finished yet
+static void finishPreload()
+{
+	if (!p || !p->preload)
+		return;
+	QScopedPointer<PreloadTask> task(p->preload.take());
+	EmoticonsProvider *provider = task->wait();
+	if (!provider)
+		return;
+	if (!currentTheme()->isNull() || p->cache.contains(task->name())) {
+		delete provider;
+		return;
+	}
+	EmoticonsThemeData *data = new EmoticonsThemeData;
+	data->provider = provider;
+	p->cache.insert(task->name(), data);
+	*currentTheme() = EmoticonsTheme(data);
+}
+
+void preloadTheme()
+{
+	if (!currentTheme()->isNull() || (p && p->preload))
+		return;
+	const QString name = currentThemeName();
+	if (name.isEmpty() || p->cache.contains(name))
+		return;
+	foreach (EmoticonsBackend *backend, p->backends) {
+		if (!backend->themeList().contains(name))
+			continue;
+		// Other backends are loaded later at the GUI thread as usual
+		if (qstrcmp(MetaObjectBuilder::info(backend->metaObject(), "ThreadSafe"), "yes"))
+			return;
+		p->preload.reset(new PreloadTask(backend, name));
+		QThreadPool::globalInstance()->start(p->preload.data());
+		return;
+	}
+}
+
 EmoticonsTheme theme()
 {
+	finishPreload();
 	if (currentTheme()->isNull())
 		*currentTheme() = theme(QString());
 	return *currentTheme();
@@ -456,6 +648,7 @@ EmoticonsTheme theme(const QString &name)
 	}
 	else
 		ensurePrivate();
+	finishPreload();
 
 	// Firstly look at cache
 	if (EmoticonsThemeData *data = p->cache.value(name))
@@ -480,6 +673,7 @@ EmoticonsTheme theme(const QString &name)
 QStringList themeList()
 {
 	ensurePrivate();
+	finishPreload();
 	QSet<QString> themes;
 	foreach (EmoticonsBackend *backend, p->backends) {
 		foreach (const QString &theme, backend->themeList())
@@ -492,6 +686,7 @@ QStringList themeList()
 
 void setTheme(const QString &name)
 {
+	finishPreload();
 	ConfigGroup group = Config("appearance").group("emoticons");
 	group.setValue("theme", name);
 	group.sync();
@@ -500,6 +695,7 @@ void setTheme(const QString &name)
 
 void setTheme(const EmoticonsTheme &theme)
 {
+	finishPreload();
 	ConfigGroup group = Config("appearance").group("emoticons");
 	group.setValue("theme", theme.themeName());
 	group.sync();
@@ -43,6 +43,8 @@ public:
 	{
 		DefaultParse = 0,
 		StrictParse  = 0x01,
+		// Links are found by the same pass and returned as Link tokens
+		ParseUrls    = 0x02
 	};
 	Q_DECLARE_FLAGS(ParseMode, ParseModeFlag)
 
@@ -50,7 +52,8 @@ public:
 	{
 		Undefined,
 		Text,
-		Image
+		Image,
+		Link
 	};
 
 	struct Token
@@ -63,6 +66,7 @@ public:
 		QString text;
 		QString imgPath;
 		QString imgHtmlCode;
+		QString url;
 	};
 
 	EmoticonsTheme(const QString &name = QString());
@@ -114,9 +118,12 @@ protected:
 	void appendEmoticon(const QString &imgPath, const QStringList &codes);
 	void removeEmoticon(const QString &imgPath, const QStringList &codes);
 private:
+	friend class EmoticonsTheme;
 	QScopedPointer<EmoticonsProviderPrivate> p;
 };
 
+// Backends with Q_CLASSINFO("ThreadSafe", "yes") may be asked by the core
+// to load the current theme from a worker thread at startup
 class LIBQUTIM_EXPORT EmoticonsBackend : public QObject
 {
 	Q_OBJECT
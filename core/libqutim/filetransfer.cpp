@@ -24,6 +24,7 @@
 ****************************************************************************/
 
 #include "filetransfer.h"
+#include "filetransferengine_p.h"
 #include "objectgenerator.h"
 #include "servicemanager.h"
 #include "chatunit.h"
@@ -172,7 +173,7 @@ public:
 		direction(d), error(FileTransferJob::NoError),
 		state(FileTransferJob::Initiation), currentIndex(-1),
 		progress(0), fileProgress(0), totalSize(0), q_ptr(q),
-		skipToNextFactoryAtError(true)
+		skipToNextFactoryAtError(true), engine(0)
 	{}
 	void addFile(const QFileInfo &info);
 	QIODevice *device(int index);
@@ -194,6 +195,7 @@ public:
 	FileTransferJob *q_ptr;
 	QDir dir;
 	bool skipToNextFactoryAtError;
+	FileTransferEngine *engine;
 };
 
 void FileTransferJobPrivate::addFile(const QFileInfo &info)
@@ -223,6 +225,7 @@ FileTransferJob::FileTransferJob(ChatUnit *unit, FileTransferJob::Direction dire
 
 FileTransferJob::~FileTransferJob()
 {
+	stopDataTransfer();
 }
 
 void FileTransferJob::send(const QUrl &url, const QString &title)
@@ -502,6 +505,32 @@ void FileTransferJob::setFileInfo(int index, const FileTransferInfo &info)
 	}
 }
 
+void FileTransferJob::startDataTransfer(QIODevice *device, QIODevice *socket, qint64 offset, qint64 size)
+{
+	Q_D(FileTransferJob);
+	stopDataTransfer();
+	FileTransferEngine *engine = new FileTransferEngine(d->direction, device, socket, offset, size, this);
+	connect(engine, &FileTransferEngine::progress, this, [this] (qint64 position) {
+		setFileProgress(position);
+	});
+	connect(engine, &FileTransferEngine::finished, this, [this, d, engine] (ErrorType error) {
+		// Handlers may start the next file right away
+		engine->deleteLater();
+		if (d->engine == engine)
+			d->engine = 0;
+		emit dataTransferFinished(error);
+	});
+	d->engine = engine;
+	engine->start();
+}
+
+void FileTransferJob::stopDataTransfer()
+{
+	Q_D(FileTransferJob);
+	delete d->engine;
+	d->engine = 0;
+}
+
 void FileTransferJob::virtual_hook(int id, void *data)
 {
 	Q_UNUSED(id);
@@ -127,6 +127,12 @@ protected:
 	void setState(State state);
 	void setStateString(const LocalizedString &state);
 	void setFileInfo(int index, const FileTransferInfo &info);
+	// Streams the device from the offset up to the size to the socket for outgoing jobs
+	// and the socket to the device for incoming ones. Data is read and written in the
+	// background by large chunks and the file progress is updated by the way.
+	// The device must not be used until dataTransferFinished() is emitted.
+	void startDataTransfer(QIODevice *device, QIODevice *socket, qint64 offset, qint64 size);
+	void stopDataTransfer();
 	virtual void virtual_hook(int id, void *data);
 signals:
 #if !defined(Q_MOC_RUN) && !defined(DOXYGEN_SHOULD_SKIP_THIS) && !defined(IN_IDE_PARSER)
@@ -144,6 +150,7 @@ private: // don't tell moc, doxygen or kdevelop, but those signals are in fact p
 	void stateStringChanged(const qutim_sdk_0_3::LocalizedString &);
 	void finished();
 	void accepted();
+	void dataTransferFinished(qutim_sdk_0_3::FileTransferJob::ErrorType error);
 private:
 	friend class FileTransferManager;
 	QScopedPointer<FileTransferJobPrivate> d_ptr;
@@ -0,0 +1,297 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "filetransferengine_p.h"
+#include <QAbstractSocket>
+#include <QFileDevice>
+#include <QThread>
+
+namespace qutim_sdk_0_3
+{
+
+enum
+{
+	InitialChunkSize = 64 * 1024,
+	MaxChunkSize = 4 * 1024 * 1024,
+	// Incoming data which is read from the socket but isn't written yet
+	MaxQueuedSize = 16 * 1024 * 1024,
+	PageSize = 4096
+};
+
+class FileTransferThread : public QThread
+{
+public:
+	FileTransferThread()
+	{
+		setObjectName(QLatin1String("FileTransferIO"));
+		start();
+	}
+	~FileTransferThread()
+	{
+		quit();
+		wait();
+	}
+};
+
+Q_GLOBAL_STATIC(FileTransferThread, ioThread)
+
+FileTransferEngine::FileTransferEngine(FileTransferJob::Direction direction, QIODevice *device,
+                                       QIODevice *socket, qint64 offset, qint64 size, QObject *parent) :
+	QObject(parent), m_direction(direction), m_worker(new FileTransferWorker(device, offset)),
+	m_socket(socket), m_readBufferSize(0), m_chunkSize(InitialChunkSize),
+	m_requested(offset), m_done(offset), m_end(size), m_reading(false), m_finished(false)
+{
+	if (FileTransferThread *thread = ioThread())
+		m_worker->moveToThread(thread);
+	// Queued even without the thread, so chunks don't recurse into each other
+	connect(this, SIGNAL(readRequested(qint64)), m_worker, SLOT(read(qint64)), Qt::QueuedConnection);
+	connect(this, SIGNAL(chunkReleased(QByteArray)), m_worker, SLOT(release(QByteArray)), Qt::QueuedConnection);
+	connect(this, SIGNAL(writeRequested(QByteArray)), m_worker, SLOT(write(QByteArray)), Qt::QueuedConnection);
+	connect(m_worker, SIGNAL(chunkRead(QByteArray)), SLOT(onChunkRead(QByteArray)), Qt::QueuedConnection);
+	connect(m_worker, SIGNAL(chunkWritten(qint64)), SLOT(onChunkWritten(qint64)), Qt::QueuedConnection);
+	connect(m_worker, SIGNAL(failed()), SLOT(onFailed()), Qt::QueuedConnection);
+}
+
+FileTransferEngine::~FileTransferEngine()
+{
+	if (!m_finished)
+		detach();
+	QThread *thread = m_worker->thread();
+	if (thread != QThread::currentThread() && thread->isRunning())
+		m_worker->deleteLater();
+	else
+		delete m_worker;
+}
+
+void FileTransferEngine::start()
+{
+	if (m_done >= m_end || !m_socket) {
+		QMetaObject::invokeMethod(this, "finish", Qt::QueuedConnection);
+		return;
+	}
+	if (m_direction == FileTransferJob::Outgoing) {
+		connect(m_socket.data(), SIGNAL(bytesWritten(qint64)), SLOT(onBytesWritten()));
+		requestChunks();
+	} else {
+		if (QAbstractSocket *socket = qobject_cast<QAbstractSocket*>(m_socket.data())) {
+			m_readBufferSize = socket->readBufferSize();
+			socket->setReadBufferSize(MaxQueuedSize);
+		}
+		connect(m_socket.data(), SIGNAL(readyRead()), SLOT(onReadyRead()));
+		m_reading = true;
+		onReadyRead();
+	}
+}
+
+void FileTransferEngine::onChunkRead(const QByteArray &chunk)
+{
+	if (m_finished || !m_socket) {
+		emit chunkReleased(chunk);
+		finish();
+		return;
+	}
+	// The socket has run dry while the chunk was read, so chunks are too small
+	if (m_socket.data()->bytesToWrite() == 0 && m_chunkSize < MaxChunkSize)
+		m_chunkSize *= 2;
+	const qint64 written = m_socket.data()->write(chunk);
+	emit chunkReleased(chunk);
+	if (written != chunk.size()) {
+		stop(FileTransferJob::NetworkError);
+		return;
+	}
+	m_done += chunk.size();
+	m_requested = m_done;
+	if (m_done >= m_end) {
+		emit progress(m_end);
+		stop(FileTransferJob::NoError);
+	} else {
+		requestChunks();
+	}
+}
+
+void FileTransferEngine::onChunkWritten(qint64 size)
+{
+	if (m_finished)
+		return;
+	m_done += size;
+	emit progress(m_done);
+	if (m_done >= m_end)
+		stop(FileTransferJob::NoError);
+	else
+		onReadyRead();
+}
+
+void FileTransferEngine::onFailed()
+{
+	stop(FileTransferJob::IOError);
+}
+
+void FileTransferEngine::onBytesWritten()
+{
+	if (m_finished || !m_socket)
+		return;
+	emit progress(m_done - m_socket.data()->bytesToWrite());
+	requestChunks();
+}
+
+void FileTransferEngine::onReadyRead()
+{
+	if (!m_reading || !m_socket)
+		return;
+	// Stop reading while the disk is behind, the socket's read buffer is limited
+	// as well, so the peer will wait for us
+	while (m_requested < m_end && m_requested - m_done < MaxQueuedSize) {
+		const qint64 size = qMin(m_socket.data()->bytesAvailable(), m_end - m_requested);
+		if (size <= 0)
+			break;
+		const QByteArray chunk = m_socket.data()->read(qMin<qint64>(size, MaxChunkSize));
+		if (chunk.isEmpty())
+			break;
+		m_requested += chunk.size();
+		emit writeRequested(chunk);
+	}
+}
+
+void FileTransferEngine::finish()
+{
+	stop(m_done >= m_end ? FileTransferJob::NoError : FileTransferJob::NetworkError);
+}
+
+void FileTransferEngine::requestChunks()
+{
+	// Only one chunk is read at once, and only if the socket has less than a chunk to write
+	if (m_finished || !m_socket || m_requested > m_done || m_requested >= m_end)
+		return;
+	if (m_socket.data()->bytesToWrite() >= m_chunkSize)
+		return;
+	const qint64 size = qMin(m_chunkSize, m_end - m_requested);
+	m_requested += size;
+	emit readRequested(size);
+}
+
+void FileTransferEngine::stop(FileTransferJob::ErrorType error)
+{
+	if (m_finished)
+		return;
+	detach();
+	emit finished(error);
+}
+
+void FileTransferEngine::detach()
+{
+	m_finished = true;
+	m_reading = false;
+	if (m_socket) {
+		disconnect(m_socket.data(), 0, this, 0);
+		if (m_direction == FileTransferJob::Incoming) {
+			if (QAbstractSocket *socket = qobject_cast<QAbstractSocket*>(m_socket.data()))
+				socket->setReadBufferSize(m_readBufferSize);
+		}
+	}
+	// The device may be deleted right after us, so wait until the worker leaves it
+	QThread *thread = m_worker->thread();
+	if (thread != QThread::currentThread() && thread->isRunning())
+		QMetaObject::invokeMethod(m_worker, "stop", Qt::BlockingQueuedConnection);
+	else
+		m_worker->stop();
+}
+
+FileTransferWorker::FileTransferWorker(QIODevice *device, qint64 offset) :
+	m_device(device), m_file(qobject_cast<QFileDevice*>(device)),
+	m_position(offset), m_canMap(m_file != 0)
+{
+}
+
+FileTransferWorker::~FileTransferWorker()
+{
+	stop();
+}
+
+void FileTransferWorker::read(qint64 size)
+{
+	if (!m_device)
+		return;
+	if (m_canMap) {
+		if (uchar *data = m_file->map(m_position, size)) {
+			// Fault the pages in here, so writing to the socket doesn't wait for the disk
+			const volatile uchar *pages = data;
+			uchar sum = 0;
+			for (qint64 i = 0; i < size; i += PageSize)
+				sum += pages[i];
+			Q_UNUSED(sum);
+			m_mapped.insert(data);
+			m_position += size;
+			emit chunkRead(QByteArray::fromRawData(reinterpret_cast<const char*>(data), int(size)));
+			return;
+		}
+		// Not every file can be mapped, read them as usual
+		m_canMap = false;
+	}
+	if (!m_device->isSequential() && m_device->pos() != m_position && !m_device->seek(m_position)) {
+		emit failed();
+		return;
+	}
+	const QByteArray chunk = m_device->read(size);
+	if (chunk.isEmpty()) {
+		emit failed();
+		return;
+	}
+	m_position += chunk.size();
+	emit chunkRead(chunk);
+}
+
+void FileTransferWorker::release(const QByteArray &chunk)
+{
+	uchar *data = reinterpret_cast<uchar*>(const_cast<char*>(chunk.constData()));
+	if (m_file && m_mapped.remove(data))
+		m_file->unmap(data);
+}
+
+void FileTransferWorker::write(const QByteArray &chunk)
+{
+	if (!m_device)
+		return;
+	if (m_device->write(chunk) != chunk.size()) {
+		emit failed();
+		return;
+	}
+	// Protocols check the file by its name as soon as it's complete
+	if (m_file)
+		m_file->flush();
+	emit chunkWritten(chunk.size());
+}
+
+void FileTransferWorker::stop()
+{
+	if (m_file) {
+		foreach (uchar *data, m_mapped)
+			m_file->unmap(data);
+	}
+	m_mapped.clear();
+	m_device = 0;
+	m_file = 0;
+}
+
+}
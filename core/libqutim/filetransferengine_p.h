@@ -0,0 +1,119 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef FILETRANSFERENGINE_P_H
+#define FILETRANSFERENGINE_P_H
+
+#include "filetransfer.h"
+#include <QPointer>
+#include <QSet>
+
+class QFileDevice;
+
+namespace qutim_sdk_0_3
+{
+
+class FileTransferWorker;
+
+/*
+ * Moves file data between a local device and a socket for FileTransferJob.
+ *
+ * The device is accessed only by a FileTransferWorker in the I/O thread
+ * shared by all jobs, the engine lives in the job's thread and touches only
+ * the socket. Outgoing files are mapped window by window and written to the
+ * socket straight from the mapping, other devices are read by chunks.
+ *
+ * Chunks start at 64 KiB and grow up to 4 MiB whenever the socket runs dry
+ * before the next chunk is ready. The next chunk is requested only when the
+ * socket has less than a chunk queued, and incoming data is not read from
+ * the socket while too much of it waits for the disk, so the peer is
+ * throttled by the socket buffers.
+ */
+class FileTransferEngine : public QObject
+{
+	Q_OBJECT
+public:
+	FileTransferEngine(FileTransferJob::Direction direction, QIODevice *device,
+	                   QIODevice *socket, qint64 offset, qint64 size, QObject *parent);
+	~FileTransferEngine();
+	void start();
+signals:
+	void progress(qint64 position);
+	void finished(qutim_sdk_0_3::FileTransferJob::ErrorType error);
+	void readRequested(qint64 size);
+	void chunkReleased(const QByteArray &chunk);
+	void writeRequested(const QByteArray &chunk);
+private slots:
+	void onChunkRead(const QByteArray &chunk);
+	void onChunkWritten(qint64 size);
+	void onFailed();
+	void onBytesWritten();
+	void onReadyRead();
+	void finish();
+private:
+	void requestChunks();
+	void stop(FileTransferJob::ErrorType error);
+	void detach();
+
+	FileTransferJob::Direction m_direction;
+	FileTransferWorker *m_worker;
+	QPointer<QIODevice> m_socket;
+	qint64 m_readBufferSize;
+	qint64 m_chunkSize;
+	// Position of the data requested from the worker or read from the socket
+	qint64 m_requested;
+	// Position of the data written to the socket or to the device
+	qint64 m_done;
+	qint64 m_end;
+	bool m_reading;
+	bool m_finished;
+};
+
+class FileTransferWorker : public QObject
+{
+	Q_OBJECT
+public:
+	FileTransferWorker(QIODevice *device, qint64 offset);
+	~FileTransferWorker();
+public slots:
+	void read(qint64 size);
+	void release(const QByteArray &chunk);
+	void write(const QByteArray &chunk);
+	void stop();
+signals:
+	void chunkRead(const QByteArray &chunk);
+	void chunkWritten(qint64 size);
+	void failed();
+private:
+	QIODevice *m_device;
+	QFileDevice *m_file;
+	QSet<uchar*> m_mapped;
+	qint64 m_position;
+	bool m_canMap;
+};
+
+}
+
+#endif // FILETRANSFERENGINE_P_H
@@ -33,6 +33,7 @@
 #include "../3rdparty/k8json/k8json.h"
 //#include <k8json/k8json.h>
 #include <QMetaProperty>
+#include <QVarLengthArray>
 
 namespace qutim_sdk_0_3
 {
@@ -177,6 +178,448 @@ namespace qutim_sdk_0_3
 				}
 			}
 		}
+
+		class ReaderPrivate
+		{
+		public:
+			enum Expectation
+			{
+				ExpectValue,
+				ExpectValueOrEnd,
+				ExpectKey,
+				ExpectKeyOrEnd,
+				ExpectCommaOrEnd,
+				ExpectNothing
+			};
+
+			ReaderPrivate(const uchar *data, int size)
+			{
+				reset(data, size);
+			}
+
+			void reset(const uchar *data, int size)
+			{
+				s = data;
+				end = data + qMax(size, 0);
+				token = Reader::Invalid;
+				tokenStart = data;
+				value = data;
+				valueLength = 0;
+				escaped = false;
+				depth = 0;
+				expect = ExpectValue;
+				failed = false;
+				stack.clear();
+			}
+
+			Reader::Token fail()
+			{
+				failed = true;
+				return setToken(Reader::Invalid, s);
+			}
+			Reader::Token setToken(Reader::Token t, const uchar *start)
+			{
+				token = t;
+				tokenStart = start;
+				return t;
+			}
+			void skipBlanks()
+			{
+				int len = end - s;
+				const uchar *next = len > 0 ? Json::skipBlanks(s, &len) : 0;
+				s = next ? next : end;
+			}
+			void valueFinished()
+			{
+				expect = stack.isEmpty() ? ExpectNothing : ExpectCommaOrEnd;
+			}
+			bool readString();
+			bool readLiteral(const char *literal, int length);
+			Reader::Token readValue();
+
+			const uchar *s;
+			const uchar *end;
+			Reader::Token token;
+			const uchar *tokenStart;
+			const uchar *value;
+			int valueLength;
+			bool escaped;
+			int depth;
+			Expectation expect;
+			bool failed;
+			QVarLengthArray<char, 16> stack;
+		};
+
+		bool ReaderPrivate::readString()
+		{
+			const uchar *start = ++s;
+			escaped = false;
+			while (s < end) {
+				if (*s == '\\') {
+					escaped = true;
+					s += 2;
+				} else if (*s == '"') {
+					value = start;
+					valueLength = s - start;
+					++s;
+					return true;
+				} else {
+					++s;
+				}
+			}
+			return false;
+		}
+
+		bool ReaderPrivate::readLiteral(const char *literal, int length)
+		{
+			if (end - s < length || qstrncmp(reinterpret_cast<const char *>(s), literal, length) != 0)
+				return false;
+			value = s;
+			valueLength = length;
+			s += length;
+			return true;
+		}
+
+		Reader::Token ReaderPrivate::readValue()
+		{
+			const uchar *start = s;
+			escaped = false;
+			depth = stack.size();
+			switch (*s) {
+			case '{':
+			case '[':
+				stack.append(*s);
+				expect = *s == '{' ? ExpectKeyOrEnd : ExpectValueOrEnd;
+				++s;
+				return setToken(*start == '{' ? Reader::BeginObject : Reader::BeginArray, start);
+			case '"':
+				if (!readString())
+					return fail();
+				valueFinished();
+				return setToken(Reader::String, start);
+			case 't':
+				if (!readLiteral("true", 4))
+					return fail();
+				valueFinished();
+				return setToken(Reader::Bool, start);
+			case 'f':
+				if (!readLiteral("false", 5))
+					return fail();
+				valueFinished();
+				return setToken(Reader::Bool, start);
+			case 'n':
+				if (!readLiteral("null", 4))
+					return fail();
+				valueFinished();
+				return setToken(Reader::Null, start);
+			default:
+				while (s < end && ((*s >= '0' && *s <= '9') || *s == '-' || *s == '+'
+								   || *s == '.' || *s == 'e' || *s == 'E')) {
+					++s;
+				}
+				if (s == start)
+					return fail();
+				value = start;
+				valueLength = s - start;
+				valueFinished();
+				return setToken(Reader::Number, start);
+			}
+		}
+
+		Reader::Reader() : d(new ReaderPrivate(0, 0))
+		{
+		}
+
+		Reader::Reader(const uchar *data, int size) : d(new ReaderPrivate(data, size))
+		{
+		}
+
+		Reader::Reader(const char *data, int size)
+			: d(new ReaderPrivate(reinterpret_cast<const uchar *>(data), size))
+		{
+		}
+
+		Reader::Reader(const QByteArray &data)
+			: d(new ReaderPrivate(reinterpret_cast<const uchar *>(data.constData()), data.size()))
+		{
+		}
+
+		Reader::~Reader()
+		{
+		}
+
+		void Reader::reset(const uchar *data, int size)
+		{
+			d->reset(data, size);
+		}
+
+		Reader::Token Reader::next()
+		{
+			if (d->failed)
+				return Invalid;
+			d->skipBlanks();
+			if (d->expect == ReaderPrivate::ExpectNothing)
+				return d->setToken(End, d->s);
+			if (d->s >= d->end)
+				return d->fail();
+
+			const uchar c = *d->s;
+			const char container = d->stack.isEmpty() ? 0 : d->stack.last();
+			const bool canEnd = d->expect == ReaderPrivate::ExpectCommaOrEnd
+					|| d->expect == ReaderPrivate::ExpectKeyOrEnd
+					|| d->expect == ReaderPrivate::ExpectValueOrEnd;
+			if (canEnd && ((c == '}' && container == '{') || (c == ']' && container == '['))) {
+				const uchar *start = d->s++;
+				d->stack.removeLast();
+				d->depth = d->stack.size();
+				d->valueFinished();
+				return d->setToken(c == '}' ? EndObject : EndArray, start);
+			}
+			if (d->expect == ReaderPrivate::ExpectCommaOrEnd) {
+				if (c != ',')
+					return d->fail();
+				++d->s;
+				d->skipBlanks();
+				if (d->s >= d->end)
+					return d->fail();
+				d->expect = container == '{' ? ReaderPrivate::ExpectKey : ReaderPrivate::ExpectValue;
+			}
+
+			if (d->expect == ReaderPrivate::ExpectKey || d->expect == ReaderPrivate::ExpectKeyOrEnd) {
+				const uchar *start = d->s;
+				if (*d->s != '"' || !d->readString())
+					return d->fail();
+				d->skipBlanks();
+				if (d->s >= d->end || *d->s != ':')
+					return d->fail();
+				++d->s;
+				d->depth = d->stack.size();
+				d->expect = ReaderPrivate::ExpectValue;
+				return d->setToken(Key, start);
+			}
+			return d->readValue();
+		}
+
+		Reader::Token Reader::token() const
+		{
+			return d->token;
+		}
+
+		bool Reader::skipValue()
+		{
+			if (d->token != BeginObject && d->token != BeginArray)
+				return !d->failed;
+			const int depth = d->depth;
+			forever {
+				const Token token = next();
+				if (token == Invalid || token == End)
+					return false;
+				if ((token == EndObject || token == EndArray) && d->depth == depth)
+					return true;
+			}
+		}
+
+		int Reader::depth() const
+		{
+			return d->depth;
+		}
+
+		const uchar *Reader::position() const
+		{
+			return d->tokenStart;
+		}
+
+		QByteArray Reader::rawValue() const
+		{
+			switch (d->token) {
+			case Key:
+			case String:
+			case Number:
+			case Bool:
+			case Null:
+				return QByteArray::fromRawData(reinterpret_cast<const char *>(d->value), d->valueLength);
+			default:
+				return QByteArray();
+			}
+		}
+
+		bool Reader::isEscaped() const
+		{
+			return d->escaped;
+		}
+
+		bool Reader::keyEquals(const char *key) const
+		{
+			if ((d->token != Key && d->token != String))
+				return false;
+			if (d->escaped)
+				return toString() == QLatin1String(key);
+			const int length = qstrlen(key);
+			return length == d->valueLength
+					&& qstrncmp(reinterpret_cast<const char *>(d->value), key, length) == 0;
+		}
+
+		static inline int hexValue(uchar c)
+		{
+			if (c >= '0' && c <= '9')
+				return c - '0';
+			if (c >= 'a' && c <= 'f')
+				return c - 'a' + 10;
+			if (c >= 'A' && c <= 'F')
+				return c - 'A' + 10;
+			return -1;
+		}
+
+		static bool readHex(const uchar *&s, const uchar *end, uint *code)
+		{
+			if (end - s < 4)
+				return false;
+			*code = 0;
+			for (int i = 0; i < 4; ++i) {
+				const int value = hexValue(*s++);
+				if (value < 0)
+					return false;
+				*code = (*code << 4) | value;
+			}
+			return true;
+		}
+
+		static void appendUtf8(QByteArray &result, uint code)
+		{
+			if (code < 0x80) {
+				result += char(code);
+			} else if (code < 0x800) {
+				result += char(0xc0 | (code >> 6));
+				result += char(0x80 | (code & 0x3f));
+			} else if (code < 0x10000) {
+				result += char(0xe0 | (code >> 12));
+				result += char(0x80 | ((code >> 6) & 0x3f));
+				result += char(0x80 | (code & 0x3f));
+			} else {
+				result += char(0xf0 | (code >> 18));
+				result += char(0x80 | ((code >> 12) & 0x3f));
+				result += char(0x80 | ((code >> 6) & 0x3f));
+				result += char(0x80 | (code & 0x3f));
+			}
+		}
+
+		QString Reader::toString() const
+		{
+			const char *value = reinterpret_cast<const char *>(d->value);
+			switch (d->token) {
+			case Key:
+			case String:
+				break;
+			case Number:
+			case Bool:
+			case Null:
+				return QString::fromLatin1(value, d->valueLength);
+			default:
+				return QString();
+			}
+			if (!d->escaped)
+				return QString::fromUtf8(value, d->valueLength);
+
+			QByteArray result;
+			result.reserve(d->valueLength);
+			const uchar *s = d->value;
+			const uchar *end = d->value + d->valueLength;
+			while (s < end) {
+				if (*s != '\\') {
+					result += char(*s++);
+					continue;
+				}
+				if (++s >= end)
+					break;
+				const uchar c = *s++;
+				switch (c) {
+				case 'b': result += '\b'; break;
+				case 'f': result += '\f'; break;
+				case 'n': result += '\n'; break;
+				case 'r': result += '\r'; break;
+				case 't': result += '\t'; break;
+				case 'u': {
+					uint code;
+					if (!readHex(s, end, &code)) {
+						code = 0xfffd;
+					} else if (code >= 0xd800 && code < 0xdc00) {
+						uint low;
+						const uchar *next = s;
+						if (end - next >= 6 && next[0] == '\\' && next[1] == 'u'
+								&& (next += 2, readHex(next, end, &low))
+								&& low >= 0xdc00 && low < 0xe000) {
+							code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+							s = next;
+						} else {
+							code = 0xfffd;
+						}
+					} else if (code >= 0xdc00 && code < 0xe000) {
+						code = 0xfffd;
+					}
+					appendUtf8(result, code);
+					break;
+				}
+				default:
+					result += char(c);
+					break;
+				}
+			}
+			return QString::fromUtf8(result);
+		}
+
+		bool Reader::toBool() const
+		{
+			return d->token == Bool && *d->value == 't';
+		}
+
+		qint64 Reader::toInteger(bool *ok) const
+		{
+			return rawValue().toLongLong(ok);
+		}
+
+		double Reader::toDouble(bool *ok) const
+		{
+			return rawValue().toDouble(ok);
+		}
+
+		QVariant Reader::toVariant()
+		{
+			switch (d->token) {
+			case Key:
+			case String:
+				return toString();
+			case Number: {
+				bool ok = false;
+				const qint64 integer = toInteger(&ok);
+				if (ok)
+					return integer;
+				return toDouble();
+			}
+			case Bool:
+				return toBool();
+			case BeginObject: {
+				QVariantMap map;
+				while (next() == Key) {
+					const QString name = toString();
+					next();
+					map.insert(name, toVariant());
+				}
+				return d->token == EndObject ? QVariant(map) : QVariant();
+			}
+			case BeginArray: {
+				QVariantList list;
+				forever {
+					const Token token = next();
+					if (token == EndArray || token == Invalid || token == End)
+						break;
+					list << toVariant();
+				}
+				return d->token == EndArray ? QVariant(list) : QVariant();
+			}
+			default:
+				return QVariant();
+			}
+		}
 	}
 }
 
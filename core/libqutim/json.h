@@ -31,6 +31,7 @@
 #include <QString>
 #include <QVariant>
 #include <QByteArray>
+#include <QScopedPointer>
 class QObject;
 
 namespace qutim_sdk_0_3
@@ -164,6 +165,111 @@ namespace qutim_sdk_0_3
 									  generatorExt cb = 0, QString *err = 0);
 
 		LIBQUTIM_EXPORT bool generate(QByteArray &res, const QVariant &val, int indent, QString *err);
+
+		class ReaderPrivate;
+
+		/**
+		* @brief Pull parser over a buffer with JSON data.
+		*
+		* Reader doesn't build any QVariant trees and doesn't copy the data,
+		* keys and values are available as views into the buffer and are
+		* unescaped only on request. Buffer must outlive the reader.
+		*
+		* @code
+		* Json::Reader reader(data, size);
+		* if (reader.next() == Json::Reader::BeginObject) {
+		*     while (reader.next() == Json::Reader::Key) {
+		*         if (reader.keyEquals("datetime") && reader.next() == Json::Reader::String)
+		*             return reader.toString();
+		*         reader.next();
+		*         reader.skipValue();
+		*     }
+		* }
+		* @endcode
+		*/
+		class LIBQUTIM_EXPORT Reader
+		{
+			Q_DISABLE_COPY(Reader)
+		public:
+			enum Token
+			{
+				Invalid,
+				BeginObject,
+				EndObject,
+				BeginArray,
+				EndArray,
+				Key,
+				String,
+				Number,
+				Bool,
+				Null,
+				End
+			};
+
+			Reader();
+			Reader(const uchar *data, int size);
+			Reader(const char *data, int size);
+			Reader(const QByteArray &data);
+			~Reader();
+
+			/**
+			* @brief Start reading another buffer from the beginning
+			*
+			* Lets one reader go through many records without allocating
+			* for each of them.
+			*/
+			void reset(const uchar *data, int size);
+
+			/**
+			* @brief Read next token
+			* @return Type of the token, @ref Invalid on syntax error
+			* and @ref End after the end of the top level value
+			*/
+			Token next();
+			Token token() const;
+			/**
+			* @brief Skip current object or array with all it's children
+			*
+			* Does nothing if current token is not @ref BeginObject or @ref BeginArray.
+			* @return @b False on syntax error
+			*/
+			bool skipValue();
+			/**
+			* @brief Nesting level of the current token, top level value has zero depth
+			*/
+			int depth() const;
+			/**
+			* @brief Position of the current token in the buffer
+			*/
+			const uchar *position() const;
+
+			/**
+			* @brief Raw data of the current key, string, number or literal
+			* without surrounding quotes and with escape sequences untouched.
+			* Returned array doesn't own the data.
+			*/
+			QByteArray rawValue() const;
+			/**
+			* @brief @b True if current key or string contains escape sequences
+			*/
+			bool isEscaped() const;
+			/**
+			* @brief Compare current key or string with latin1 string without unescaping
+			*/
+			bool keyEquals(const char *key) const;
+
+			QString toString() const;
+			bool toBool() const;
+			qint64 toInteger(bool *ok = 0) const;
+			double toDouble(bool *ok = 0) const;
+			/**
+			* @brief Convert current value or whole object or array to QVariant
+			* and move after it
+			*/
+			QVariant toVariant();
+		private:
+			QScopedPointer<ReaderPrivate> d;
+		};
 	}
 }
 
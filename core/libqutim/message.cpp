@@ -220,12 +220,10 @@ bool Message::hasProperty(const QString &name) const
 
 QString Message::formattedHtml() const
 {
-    QString html = UrlParser::parseUrls(this->html(), UrlParser::Html);
-
     if (property("topic", false))
-        return html;
+        return UrlParser::parseUrls(this->html(), UrlParser::Html);
 
-    return Emoticons::theme().parseEmoticons(html);
+    return Emoticons::theme().parseEmoticons(this->html(), EmoticonsTheme::ParseUrls);
 }
 
 bool Message::isSimiliar(const Message &other, int flags) const
@@ -27,15 +27,33 @@
 #include "debug.h"
 #include <memory>
 #include <QThreadStorage>
+#include <QElapsedTimer>
+#include <QSharedPointer>
+#include <QCoreApplication>
+#include <QThread>
 
 namespace qutim_sdk_0_3
 {
 
+// Live counters of the handler, times are in nanoseconds. Chains are run only on
+// the GUI thread, as handlers are registered there too, so counters are not atomic
+struct MessageHandlerStats
+{
+	MessageHandlerStats() : calls(0), rejects(0), errors(0), totalTime(0), maxTime(0) {}
+
+	quint64 calls;
+	quint64 rejects;
+	quint64 errors;
+	qint64 totalTime;
+	qint64 maxTime;
+};
+
 struct MessageHandlerInfo
 {
 	int priority;
 	QString name;
 	MessageHandler *handler;
+	QSharedPointer<MessageHandlerStats> stats;
 	
 	bool operator <(const MessageHandlerInfo &o) const
 	{
@@ -43,6 +61,8 @@ struct MessageHandlerInfo
 	}
 };
 
+// Lists are implicitly shared, so every message takes a snapshot of the chain
+// for free and only (un)registering of handlers detaches them
 typedef QList<MessageHandlerInfo> MessageHandlerList;
 typedef MessageHandlerList* MessageHandlerListPtr;
 struct Scope
@@ -53,6 +73,12 @@ struct Scope
 
 Q_GLOBAL_STATIC(Scope, scope)
 
+static inline bool isGuiThread()
+{
+	QCoreApplication *app = QCoreApplication::instance();
+	return !app || QThread::currentThread() == app->thread();
+}
+
 MessageHandler::~MessageHandler()
 {
 	if (scope())
@@ -69,7 +95,7 @@ void MessageHandler::registerHandler(MessageHandler *handler, const QString &nam
 	MessageHandlerListPtr lists[] = { &scope()->incoming, &scope()->outgoing };
 	int priorities[] = { incomingPriority, outgoingPriority };
 	for (int i = 0; i < 2; ++i) {
-		MessageHandlerInfo info = { priorities[i], name, handler };
+		MessageHandlerInfo info = { priorities[i], name, handler, QSharedPointer<MessageHandlerStats>::create() };
 		int index = qUpperBound(lists[i]->constBegin(),
 								lists[i]->constEnd(),
 								info,
@@ -103,23 +129,44 @@ struct MessageHandler::StateType : public std::enable_shared_from_this<StateType
         this->message.setChatUnit(message.chatUnit());
     }
 
+    void next()
+    {
+        if (index < list.size()) {
+            MessageHandler *stage = list.at(index++).handler;
+            currentMessageIdHook = messageId;
+            timer.start();
+            auto self = shared_from_this();
+            // Handlers which already know the result are continued right away,
+            // only really asynchronous ones wait for the event loop
+            stage->doHandle(message).connect([self] (MessageHandler::Result result, const QString &error) {
+                self->onResult(result, error);
+            }, AsyncInlineConnection);
+        } else {
+			handler.handle(message, MessageHandler::Accept, QString());
+        }
+    }
+
     void onResult(MessageHandler::Result result, const QString &error)
     {
+        const qint64 elapsed = timer.nsecsElapsed();
+        // Results of asynchronous handlers are delivered to the thread which started the chain
+        Q_ASSERT(isGuiThread());
+        MessageHandlerStats &stats = *list.at(index - 1).stats;
+        ++stats.calls;
+        stats.totalTime += elapsed;
+        stats.maxTime = qMax(stats.maxTime, elapsed);
+
         if (result != MessageHandler::Accept) {
+            ++(result == MessageHandler::Reject ? stats.rejects : stats.errors);
 			handler.handle(message, result, error);
             return;
         }
 
-        using namespace std::placeholders;
-        if (index < list.size()) {
-            currentMessageIdHook = messageId;
-			list[index++].handler->doHandle(message).connect(std::bind(&StateType::onResult, shared_from_this(), _1, _2));
-        } else {
-			handler.handle(message, MessageHandler::Accept, QString());
-        }
+        next();
     }
 
     int index;
+    QElapsedTimer timer;
     Message message;
     quint64 messageId;
     const MessageHandlerList list;
@@ -128,6 +175,7 @@ struct MessageHandler::StateType : public std::enable_shared_from_this<StateType
 
 AsyncResult<Message, MessageHandler::Result, QString> MessageHandler::handle(const Message &message)
 {
+    Q_ASSERT_X(isGuiThread(), "MessageHandler::handle", "Messages must be handled on the GUI thread");
     const MessageHandlerList &list = (message.isIncoming() ? scope()->incoming : scope()->outgoing);
 
     if (list.isEmpty()) {
@@ -135,7 +183,7 @@ AsyncResult<Message, MessageHandler::Result, QString> MessageHandler::handle(con
     }
 
 	auto state = std::make_shared<StateType>(message, list);
-    state->onResult(Accept, QString());
+    state->next();
 
 	return state->handler.result();
 }
@@ -153,7 +201,11 @@ void MessageHandler::traceHandlers()
 			MessageHandlerInfo &info = list[j];
 			if (j > 0)
 				dbg << " -> ";
-			dbg << "(0x" << QByteArray::number(info.priority, 16).constData() << ", " << info.name << ")";
+			const MessageHandlerStats &stats = *info.stats;
+			const qint64 average = stats.calls ? stats.totalTime / qint64(stats.calls) : 0;
+			dbg << "(0x" << QByteArray::number(info.priority, 16).constData() << ", " << info.name
+			    << ", calls: " << stats.calls << ", rejected: " << stats.rejects << ", failed: " << stats.errors
+			    << ", avg: " << average / 1000 << "us, max: " << stats.maxTime / 1000 << "us)";
 		}
     }
 }
@@ -61,6 +61,7 @@ public:
 	                            int incomingPriority = NormalPriortity,
 	                            int outgoingPriority = NormalPriortity);
 	static void unregisterHandler(MessageHandler *handler);
+	// Must be called on the GUI thread, handlers may finish on any thread
 	static AsyncResult<Message, Result, QString> handle(const Message &message);
 	static void traceHandlers();
     static quint64 originalMessageId();
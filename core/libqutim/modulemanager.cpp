@@ -42,6 +42,7 @@
 #include "servicemanager_p.h"
 #include "libqutim_version.h"
 #include "sound_p.h"
+#include "emoticons_p.h"
 #include <QPluginLoader>
 #include <QSettings>
 #include <QDir>
@@ -51,9 +52,10 @@
 #include <QVarLengthArray>
 #include <QLibrary>
 #include <QDesktopServices>
-#include <QTime>
 #include <QQueue>
 #include <QUrl>
+#include <QTimer>
+#include <QStandardPaths>
 #include <qendian.h>
 #include "objectgenerator.h"
 
@@ -82,7 +84,10 @@ ExtensionInfoList extensionList()
 
 QList<QPointer<Plugin> > pluginsList()
 {
-    return (managerSelf && d && d->is_inited) ? d->plugins : QList<QPointer<Plugin> >();
+    if (!managerSelf || !d || !d->is_inited)
+        return QList<QPointer<Plugin> >();
+    d->loadDeferredPlugins();
+    return d->plugins;
 }
 
 bool isCoreInited()
@@ -90,6 +95,14 @@ bool isCoreInited()
     return managerSelf && d && d->is_inited;
 }
 
+// All lookups of extensions go through here, so plugins which provide them
+// are loaded before the first use
+static ExtensionNode *findNode(const QByteArray &id)
+{
+	d->loadPendingProviders(id);
+	return d->nodes.value(id);
+}
+
 GeneratorList moduleGenerators(const QMetaObject *module, const char *iid)
 {
 	Q_ASSERT((module == 0) ^ (iid == 0));
@@ -99,7 +112,7 @@ GeneratorList moduleGenerators(const QMetaObject *module, const char *iid)
 	if (module && !iid)
 		iid = module->className();
 	const QByteArray id = QByteArray::fromRawData(iid, qstrlen(iid));
-    ExtensionNode *node = d->nodes.value(id);
+	ExtensionNode *node = findNode(id);
 	if (!node)
 		return list;
 	// BFS
@@ -253,6 +266,242 @@ static bool checkQutIMPluginData(const char *data, quint64 *debugId, QString *er
 	return isValidPattern && isValidQutimVersion;
 }
 
+ModuleManagerPrivate::PluginLoadResult ModuleManagerPrivate::loadPluginFile(const QString &fileName,
+                                                                            PluginManifest::Entry *entry,
+                                                                            QString *error, Plugin **result)
+{
+	const QString name = QFileInfo(fileName).fileName();
+	qint64 start = trace.elapsed();
+	if (entry->status != PluginManifest::Valid) {
+		// Just don't load old plugins
+		typedef const char * (*QutimPluginVerificationFunction)();
+		QScopedPointer<QLibrary> lib(new QLibrary(fileName));
+		if (!lib->load()) {
+			*error = lib->errorString();
+			return PluginLoadFailed;
+		}
+		trace.add("library", name, start);
+		start = trace.elapsed();
+		QutimPluginVerificationFunction verificationFunction = reinterpret_cast<QutimPluginVerificationFunction>(
+					lib->resolve("qutim_plugin_query_verification_data"));
+		if (!verificationFunction) {
+			lib->unload();
+			entry->status = PluginManifest::NotPlugin;
+			entry->error = fileName + " has no valid verification data";
+			*error = entry->error;
+			return PluginRejected;
+		}
+		QString verificationError;
+		if (!checkQutIMPluginData(verificationFunction(), &entry->debugId, &verificationError)) {
+			lib->unload();
+			entry->status = PluginManifest::Invalid;
+			entry->error = "Error while loading plugin " + fileName + ": " + verificationError;
+			*error = entry->error;
+			return PluginRejected;
+		}
+		trace.add("verify", name, start);
+		start = trace.elapsed();
+	}
+	QPluginLoader *loader = new QPluginLoader(fileName);
+	QObject *object = loader->instance();
+	trace.add("instance", name, start);
+	Plugin *plugin = qobject_cast<Plugin *>(object);
+	if (!plugin) {
+		if (!object) {
+			*error = loader->errorString();
+			loader->unload();
+			return PluginLoadFailed;
+		}
+		delete object;
+		loader->unload();
+		entry->status = PluginManifest::NotPlugin;
+		entry->error = fileName + " has no instance of qutIM's plugin";
+		*error = entry->error;
+		return PluginRejected;
+	}
+	if (entry->debugId)
+		debugAddPluginId(entry->debugId, plugin->metaObject());
+	start = trace.elapsed();
+	plugin->init();
+	trace.add("init", name, start);
+	if (!plugin->p->validate()) {
+		delete object;
+		entry->status = PluginManifest::Invalid;
+		entry->error = fileName + " has invalid plugin info";
+		*error = entry->error;
+		return PluginRejected;
+	}
+	entry->status = PluginManifest::Valid;
+	entry->className = plugin->metaObject()->className();
+	// Same ids as nodes created for the extensions by addExtension
+	QSet<QByteArray> ids;
+	foreach (const ExtensionInfo &info, plugin->avaiableExtensions()) {
+		for (const QMetaObject *meta = info.generator()->metaObject(); meta; meta = meta->superClass())
+			ids << meta->className();
+		foreach (const QByteArray &iid, info.generator()->interfaces())
+			ids << iid;
+	}
+	entry->extensionIds = ids.toList();
+	entry->error.clear();
+	*result = plugin;
+	return PluginLoaded;
+}
+
+void ModuleManagerPrivate::registerPlugin(Plugin *plugin, const QString &fileName, bool withExtensions)
+{
+	PluginInfo::Data *info = plugin->p->info.data();
+	info->inited = 1;
+	info->fileName = fileName;
+	QFileInfo fileInfo = info->fileName;
+	QString baseName = fileInfo.baseName();
+	if (baseName.startsWith(QStringLiteral("lib")))
+		baseName.remove(0, 3);
+	info->libraryName = baseName;
+
+	plugins.append(plugin);
+	if (!withExtensions)
+		return;
+	extensions << plugin->avaiableExtensions();
+	foreach(ExtensionInfo info, plugin->avaiableExtensions())
+		extsPlugins.insert(info.name(), plugin);
+}
+
+void ModuleManagerPrivate::loadPluginFiles(QList<PendingPlugin> files, bool withExtensions,
+                                           QList<PendingPlugin> *failed)
+{
+	QMap<QString, QString> errors;
+	QList<PendingPlugin> nextTry;
+	forever {
+		for (int i = 0; i < files.count(); ++i) {
+			PendingPlugin &file = files[i];
+			const PluginManifest::Status status = file.entry.status;
+			Plugin *plugin = 0;
+			QString error;
+			switch (loadPluginFile(file.fileName, &file.entry, &error, &plugin)) {
+			case PluginLoaded:
+				errors.remove(file.fileName);
+				registerPlugin(plugin, file.fileName, withExtensions);
+				break;
+			case PluginRejected:
+				errors.insert(file.fileName, error);
+				break;
+			case PluginLoadFailed:
+				errors.insert(file.fileName, error);
+				nextTry << file;
+				break;
+			}
+			if (file.entry.status != status)
+				manifest.insert(QFileInfo(file.fileName), file.entry);
+		}
+		if (!nextTry.isEmpty() && nextTry.size() != files.size()) {
+			qSwap(nextTry, files);
+			nextTry.clear();
+		} else {
+			break;
+		}
+	}
+	// They may need plugins which are not loaded yet, so let caller try them later
+	if (failed) {
+		foreach (const PendingPlugin &file, nextTry) {
+			errors.remove(file.fileName);
+			*failed << file;
+		}
+	}
+	foreach (const QString &error, errors)
+		qDebug() << error;
+	if (!manifest.save())
+		qWarning() << "Can't save plugin manifest";
+}
+
+void ModuleManagerPrivate::loadPendingFiles(const QList<PendingPlugin> &files, const QString &reason,
+                                            bool retryLater)
+{
+	const int first = extensions.size();
+	StartupTrace::Scope scope(&trace, "plugins", reason);
+	QList<PendingPlugin> failed;
+	loadPluginFiles(files, true, retryLater ? &failed : 0);
+	pendingPlugins << failed;
+	for (int i = first; i < extensions.size(); ++i) {
+		const ExtensionInfo &info = extensions.at(i);
+		addExtension(info);
+		extensionsHash.insert(info.generator()->metaObject()->className(), info);
+	}
+}
+
+void ModuleManagerPrivate::loadPendingProviders(const QByteArray &id)
+{
+	QList<PendingPlugin> files;
+	for (int i = 0; i < pendingPlugins.size(); ++i) {
+		if (pendingPlugins.at(i).entry.extensionIds.contains(id)) {
+			files << pendingPlugins.takeAt(i);
+			--i;
+		}
+	}
+	if (!files.isEmpty())
+		loadPendingFiles(files, QLatin1String(id), true);
+}
+
+void ModuleManagerPrivate::loadPendingPlugins(const QSet<QByteArray> &disabled)
+{
+	QList<PendingPlugin> files;
+	// Plugins may ask for extensions from their init()
+	qSwap(files, pendingPlugins);
+	for (int i = 0; i < files.size(); ++i) {
+		if (disabled.contains(files.at(i).entry.className)) {
+			deferredPlugins << files.takeAt(i);
+			--i;
+		}
+	}
+	if (!files.isEmpty())
+		loadPendingFiles(files, QStringLiteral("pending"), false);
+}
+
+void ModuleManagerPrivate::loadDeferredPlugins()
+{
+	if (deferredPlugins.isEmpty())
+		return;
+	QList<PendingPlugin> files;
+	qSwap(files, deferredPlugins);
+	// Nobody should use extensions of disabled plugins
+	loadPluginFiles(files, false);
+}
+
+StartupTrace *startupTrace()
+{
+	return d ? &d->trace : 0;
+}
+
+void ModuleManagerPrivate::addStartupStage(const char *category, const QString &name,
+                                           const std::function<void ()> &run)
+{
+	StartupStage stage = { category, name, run };
+	startupStages.enqueue(stage);
+}
+
+void ModuleManagerPrivate::runStartupStages()
+{
+	if (startupStages.isEmpty())
+		return;
+	const StartupStage stage = startupStages.dequeue();
+	{
+		StartupTrace::Scope scope(&trace, stage.category, stage.name);
+		stage.run();
+	}
+	if (!startupStages.isEmpty()) {
+		QTimer::singleShot(0, managerSelf, [this] () {
+			runStartupStages();
+		});
+		return;
+	}
+#ifdef QUTIM_TEST_PERFOMANCE
+	trace.dump();
+#endif // QUTIM_TEST_PERFOMANCE
+	// Timeline of every launch is kept, so startup regressions may be tracked
+	QString path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+	if (path.isEmpty() || !trace.save(path + QLatin1String("/startup")))
+		qWarning() << "Can't save startup trace";
+}
+
 void ModuleManagerPrivate::initLocalPeer(const QString &message, bool *shouldExit)
 {
 	*shouldExit = false;
@@ -414,6 +663,7 @@ void ModuleManager::loadPlugins(const QStringList &additional_paths)
 	// Static plugins
 	foreach (QObject *object, QPluginLoader::staticInstances()) {
 		if (Plugin *plugin = qobject_cast<Plugin *>(object)) {
+			StartupTrace::Scope scope(&d->trace, "init", QLatin1String(plugin->metaObject()->className()));
 			plugin->init();
             if (plugin->p->validate()) {
                 plugin->p->info.data()->inited = 1;
@@ -465,112 +715,42 @@ void ModuleManager::loadPlugins(const QStringList &additional_paths)
 
 	paths.removeDuplicates();
 	QSet<QString> pluginPathsList;
-	QMap<QString, QString> errors;
+	QList<PendingPlugin> unknownPlugins;
+	d->manifest.load();
 
-	foreach (const QString &path, paths) {
-		QDir plugins_dir = path;
-		QFileInfoList files = plugins_dir.entryInfoList(QDir::AllEntries);
-		QFileInfoList nextTry;
-		forever {
+	{
+		StartupTrace::Scope scope(&d->trace, "plugins", QStringLiteral("scan"));
+		foreach (const QString &path, paths) {
+			QDir plugins_dir = path;
+			QFileInfoList files = plugins_dir.entryInfoList(QDir::AllEntries);
 			for (int i = 0; i < files.count(); ++i) {
 				QString filename = files[i].canonicalFilePath();
 				if(pluginPathsList.contains(filename) || !QLibrary::isLibrary(filename) || !files[i].isFile())
 					continue;
 				pluginPathsList << filename;
-				// Just don't load old plugins
-				typedef const char * (*QutimPluginVerificationFunction)();
-				QutimPluginVerificationFunction verificationFunction = NULL;
-#ifdef QUTIM_TEST_PERFOMANCE
-				QTime timer;
-				int libLoadTime, verifyTime, instanceTime, initTime;
-				quint64 debugId = 0;
-#endif // QUTIM_TEST_PERFOMANCE
-				{
-#ifdef QUTIM_TEST_PERFOMANCE
-					timer.start();
-#endif // QUTIM_TEST_PERFOMANCE
-					QScopedPointer<QLibrary> lib(new QLibrary(filename));
-					if (lib->load()) {
-						errors.remove(filename);
-#ifdef QUTIM_TEST_PERFOMANCE
-						libLoadTime = timer.elapsed();
-						timer.restart();
-#endif // QUTIM_TEST_PERFOMANCE
-						verificationFunction = reinterpret_cast<QutimPluginVerificationFunction>(
-									lib->resolve("qutim_plugin_query_verification_data"));
-#ifdef QUTIM_TEST_PERFOMANCE
-						verifyTime = timer.elapsed();
-						timer.restart();
-#endif // QUTIM_TEST_PERFOMANCE
-						if (!verificationFunction) {
-							lib->unload();
-							errors.insert(filename, filename + " has no valid verification data");
-							continue;
-						}
-						QString error;
-						if (!checkQutIMPluginData(verificationFunction(), &debugId, &error)) {
-							lib->unload();
-							errors.insert(filename, "Error while loading plugin " + filename + ": " + error);
-							continue;
-						}
-					} else {
-						errors.insert(filename, lib->errorString());
-						nextTry << files[i];
-						pluginPathsList.remove(filename);
-						continue;
-					}
-				}
-				QPluginLoader *loader = new QPluginLoader(filename);
-				QObject *object = loader->instance();
-#ifdef QUTIM_TEST_PERFOMANCE
-				instanceTime = timer.elapsed(); timer.restart();
-#endif // QUTIM_TEST_PERFOMANCE
-				
-				if (Plugin *plugin = qobject_cast<Plugin *>(object)) {
-					if (debugId)
-						debugAddPluginId(debugId, plugin->metaObject());
-					plugin->init();
-#ifdef QUTIM_TEST_PERFOMANCE
-					initTime = timer.elapsed();
-					qDebug() << files[i].fileName();
-                    qDebug() << "load:" << libLoadTime << "ms, verify:" << verifyTime
-							<< "ms, instance:" << instanceTime << "ms, init:" << initTime << "ms";
-#endif // QUTIM_TEST_PERFOMANCE
-                    if (plugin->p->validate()) {
-                        PluginInfo::Data *info = plugin->p->info.data();
-                        info->inited = 1;
-                        info->fileName = filename;
-                        QFileInfo fileInfo = info->fileName;
-                        QString baseName = fileInfo.baseName();
-                        if (baseName.startsWith(QStringLiteral("lib")))
-                            baseName.remove(0, 3);
-                        info->libraryName = baseName;
-
-                        d->plugins.append(plugin);
-                        d->extensions << plugin->avaiableExtensions();
-						foreach(ExtensionInfo info, plugin->avaiableExtensions())
-                            d->extsPlugins.insert(info.name(), plugin);
-					} else {
-						delete object;
-					}
-				} else {
-					if (object)
-						delete object;
-					else {
-						errors.insert(filename, loader->errorString());
-					}
-					loader->unload();
+				PendingPlugin plugin = { filename, d->manifest.entry(files[i]) };
+				switch (plugin.entry.status) {
+				case PluginManifest::Valid:
+					d->pendingPlugins << plugin;
+					break;
+				case PluginManifest::NotPlugin:
+				case PluginManifest::Invalid:
+					qDebug() << plugin.entry.error;
+					break;
+				default:
+					unknownPlugins << plugin;
+					break;
 				}
 			}
-			if (!nextTry.isEmpty() && nextTry.size() != files.size()) {
-				qSwap(nextTry, files);
-				nextTry.clear();
-			} else {
-				break;
-			}
 		}
-		foreach (const QString &error, errors)
-			qDebug() << error;
+	}
+	// New and changed libraries have to be checked right now, known ones are
+	// loaded together with them as they may depend on each other
+	if (!unknownPlugins.isEmpty()) {
+		StartupTrace::Scope scope(&d->trace, "plugins", QStringLiteral("unknown"));
+		unknownPlugins << d->pendingPlugins;
+		d->pendingPlugins.clear();
+		d->loadPluginFiles(unknownPlugins, true);
 	}
 
 #ifndef NO_COMMANDS
@@ -616,7 +796,7 @@ ExtensionInfoList ModuleManager::extensions(const char *iid) const
 {
 	ExtensionInfoList list;
 	const QByteArray id = QByteArray::fromRawData(iid, qstrlen(iid));
-    ExtensionNode *node = d->nodes.value(id);
+	ExtensionNode *node = findNode(id);
 	if (!node)
 		return list;
 	// BFS
@@ -667,6 +847,7 @@ void ModuleManager::initExtensions()
 	// TODO: remove old API and this hack
 	QList<ConfigBackend*> &configBackends = get_config_backends();
 	if (configBackends.isEmpty()) {
+		StartupTrace::Scope scope(&d->trace, "config", QStringLiteral("backends"));
 		const ExtensionInfoList exts = extensions(ConfigBackend::staticMetaObject.className());
 		for (int i = 0; i < exts.size(); ++i) {
 			const ExtensionInfo &info = exts.at(i);
@@ -683,6 +864,16 @@ void ModuleManager::initExtensions()
 	QSet<PluginInfo::Data*> disabledPlugins;
 	Config pluginsConfig;
 	pluginsConfig.beginGroup("plugins/list");
+	{
+		// Plugins which were not needed before profile was chosen
+		QSet<QByteArray> disabledClasses;
+		foreach (const PendingPlugin &plugin, d->pendingPlugins) {
+			const QByteArray &className = plugin.entry.className;
+			if (!pluginsConfig.value(QLatin1String(className), true))
+				disabledClasses << className;
+		}
+		d->loadPendingPlugins(disabledClasses);
+	}
 	{
         foreach (QPointer<Plugin> plugin, d->plugins) {
             if (!pluginsConfig.value(plugin.data()->metaObject()->className(), true))
@@ -762,72 +953,75 @@ void ModuleManager::initExtensions()
 	qApp->setWindowIcon(Icon("qutim"));
 #endif
 
+	// Services like the contact list exist by now. The rest is split into stages
+	// with returns to the event loop between them, so the main window is shown
+	// before accounts are loaded. Emoticons are parsed by a worker meanwhile.
+	Emoticons::preloadTheme();
 	{
 		const ExtensionInfoList exts = extensions(qobject_interface_iid<StartupModule *>());
 		for (int i = 0; i < exts.size(); ++i) {
 			//				Plugin *plugin = it.key();
 			//				if (!pluginsConfig.value(plugin->metaObject()->className(), true))
 			//					continue;
-#ifdef QUTIM_TEST_PERFOMANCE
-			QTime timer;
-			timer.start();
-#endif
-			exts.at(i).generator()->generate<StartupModule>();
-#ifdef QUTIM_TEST_PERFOMANCE
-			qDebug() << "Startup:" << exts.at(i).generator()->metaObject()->className() << "," << timer.elapsed() << "ms";
-#endif
+			const ObjectGenerator *generator = exts.at(i).generator();
+			d->addStartupStage("startup", QLatin1String(generator->metaObject()->className()), [generator] () {
+				generator->generate<StartupModule>();
+			});
 		}
 	}
 
 	foreach(Protocol *proto, Protocol::all()) {
-#ifdef QUTIM_TEST_PERFOMANCE
-		QTime timer;
-		timer.start();
-#endif
-		proto->loadAccounts();
-#ifdef QUTIM_TEST_PERFOMANCE
-		qDebug() << proto->id() << ", load:" << timer.elapsed() << "ms";
-#endif
+		QPointer<Protocol> protocol = proto;
+		d->addStartupStage("accounts", proto->id(), [protocol] () {
+			if (protocol)
+				protocol->loadAccounts();
+		});
 	}
 
-	if (MetaContactManager *manager = MetaContactManager::instance())
-		manager->loadContacts();
-
-    for (int i = 0; i < d->plugins.size(); i++) {
-        Plugin *plugin = d->plugins.at(i).data();
-		//			if (plugin && pluginsConfig.value(plugin->metaObject()->className(), true)) {
-		if (plugin && !disabledPlugins.contains(plugin->info().data())) {
-			if (plugin->info().capabilities() & Plugin::Loadable) {
-#ifdef QUTIM_TEST_PERFOMANCE
-				QTime timer;
-				timer.start();
-#endif
-				if (plugin->load()) {
-					plugin->info().data()->loaded = 1;
-				} else {
-#ifdef QUTIM_TEST_PERFOMANCE
-					qDebug() << plugin->metaObject()->className() <<  ", load:" << timer.elapsed() << "ms";
-#endif
-					continue;
-				}
-#ifdef QUTIM_TEST_PERFOMANCE
-				qDebug() << plugin->metaObject()->className() << ", load:" << timer.elapsed() << "ms";
-#endif
-				if (PluginFactory *factory = qobject_cast<PluginFactory*>(plugin)) {
-					QList<Plugin*> plugins = factory->loadPlugins();
-					for (int j = 0; j < plugins.size(); j++) {
-						Plugin *subPlugin = plugins.at(j);
-						if (!pluginsConfig.value(subPlugin->metaObject()->className(), true))
-							disabledPlugins << subPlugin->info().data();
-						subPlugin->init();
-                        d->plugins << subPlugin;
+	d->addStartupStage("contacts", QStringLiteral("metacontacts"), [] () {
+		if (MetaContactManager *manager = MetaContactManager::instance())
+			manager->loadContacts();
+	});
+
+	d->addStartupStage("plugins", QStringLiteral("load"), [disabledPlugins] () mutable {
+		Config pluginsConfig;
+		pluginsConfig.beginGroup("plugins/list");
+		for (int i = 0; i < d->plugins.size(); i++) {
+			Plugin *plugin = d->plugins.at(i).data();
+			// Disabled plugins are also added by pluginsList() while stages wait for the event loop
+			if (plugin && !disabledPlugins.contains(plugin->info().data())
+			        && pluginsConfig.value(plugin->metaObject()->className(), true)) {
+				if (plugin->info().capabilities() & Plugin::Loadable) {
+					const qint64 start = d->trace.elapsed();
+					const bool loaded = plugin->load();
+					d->trace.add("load", QLatin1String(plugin->metaObject()->className()), start);
+					if (loaded)
+						plugin->info().data()->loaded = 1;
+					else
+						continue;
+					if (PluginFactory *factory = qobject_cast<PluginFactory*>(plugin)) {
+						QList<Plugin*> plugins = factory->loadPlugins();
+						for (int j = 0; j < plugins.size(); j++) {
+							Plugin *subPlugin = plugins.at(j);
+							if (!pluginsConfig.value(subPlugin->metaObject()->className(), true))
+								disabledPlugins << subPlugin->info().data();
+							subPlugin->init();
+							d->plugins << subPlugin;
+						}
 					}
 				}
 			}
+			qDebug() << i << d->plugins.size() << d->plugins.at(i).data()->metaObject()->className();
 		}
-		qDebug() << i << d->plugins.size() << d->plugins.at(i).data()->metaObject()->className();
-	}
-	Event("startup").send();
+	});
+
+	d->addStartupStage("event", QStringLiteral("startup"), [] () {
+		Event("startup").send();
+		// Notification backends are created by the stages above
+		NotificationRequest request(Notification::AppStartup);
+		request.send();
+	});
+	d->runStartupStages();
 }
 
 void ModuleManager::onQuit()
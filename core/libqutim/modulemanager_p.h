@@ -28,8 +28,12 @@
 #include "modulemanager.h"
 #include "protocol.h"
 #include "accountmanager_p.h"
+#include "pluginmanifest_p.h"
+#include "startuptrace_p.h"
 #include "../3rdparty/qtsolutions/qtlocalpeer.h"
 #include <QSet>
+#include <QQueue>
+#include <functional>
 
 namespace qutim_sdk_0_3
 {
@@ -50,6 +54,21 @@ struct PluginData
 	PluginInfo info;
 };
 
+// Library known from the manifest as a valid plugin, it's not loaded yet
+struct PendingPlugin
+{
+	QString fileName;
+	PluginManifest::Entry entry;
+};
+
+// Part of the startup done after services are initialized
+struct StartupStage
+{
+	const char *category;
+	QString name;
+	std::function<void ()> run;
+};
+
 typedef QHash<QByteArray, ExtensionNode*> ExtensionNodeHash;
 
 /**
@@ -66,6 +85,29 @@ public:
     inline ~ModuleManagerPrivate() {}
 	void initLocalPeer(const QString &message, bool *shouldExit);
 
+	enum PluginLoadResult
+	{
+		PluginLoaded,
+		PluginRejected,
+		// Library can't be loaded, may be it depends on another plugin
+		PluginLoadFailed
+	};
+	// Verification data is checked only if the manifest doesn't know the library yet
+	PluginLoadResult loadPluginFile(const QString &fileName, PluginManifest::Entry *entry,
+	                                QString *error, Plugin **result);
+	void registerPlugin(Plugin *plugin, const QString &fileName, bool withExtensions);
+	// Files which failed to load are returned by failed, if it's not null
+	void loadPluginFiles(QList<PendingPlugin> files, bool withExtensions,
+	                     QList<PendingPlugin> *failed = 0);
+	void loadPendingFiles(const QList<PendingPlugin> &files, const QString &reason, bool retryLater);
+	// Loads only pending plugins with extensions for the id
+	void loadPendingProviders(const QByteArray &id);
+	void loadPendingPlugins(const QSet<QByteArray> &disabled);
+	void loadDeferredPlugins();
+	void addStartupStage(const char *category, const QString &name, const std::function<void ()> &run);
+	// Runs stages one by one, returning to the event loop after each of them
+	void runStartupStages();
+
     QList<QPointer<Plugin> > plugins;
 	QScopedPointer<QtLocalPeer> localPeer;
 	bool is_inited;
@@ -82,6 +124,13 @@ public:
 	QSet<const QMetaObject *> meta_modules;
 	QList<const ExtensionInfo> modules;
 	ExtensionNodeHash nodes;
+	StartupTrace trace;
+	PluginManifest manifest;
+	// Loaded by the first lookup of their extensions or by initExtensions
+	QList<PendingPlugin> pendingPlugins;
+	// Disabled plugins, loaded only for pluginsList()
+	QList<PendingPlugin> deferredPlugins;
+	QQueue<StartupStage> startupStages;
 };
 
 class LazyGenerator : public ObjectGenerator
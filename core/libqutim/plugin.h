@@ -173,6 +173,7 @@ protected:
 private:
     QScopedPointer<PluginPrivate> p;
     friend class ModuleManager;
+    friend class ModuleManagerPrivate;
 #endif
 };
 
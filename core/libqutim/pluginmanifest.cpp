@@ -0,0 +1,128 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "pluginmanifest_p.h"
+#include "libqutim_version.h"
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDir>
+#include <QDebug>
+
+namespace qutim_sdk_0_3
+{
+
+enum {
+	ManifestVersion = 3,
+	// Dates and strings must be read back the same way whichever Qt writes them
+	StreamVersion = QDataStream::Qt_5_0
+};
+
+PluginManifest::PluginManifest() : m_changed(false)
+{
+}
+
+void PluginManifest::load()
+{
+	m_entries.clear();
+	m_changed = false;
+	// Application name is not known yet at construction time
+	QString path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+	if (!path.isEmpty())
+		m_fileName = path + QLatin1String("/plugins.manifest");
+	QFile file(m_fileName);
+	if (m_fileName.isEmpty() || !file.open(QIODevice::ReadOnly))
+		return;
+	QDataStream in(&file);
+	in.setVersion(StreamVersion);
+	quint32 version;
+	quint32 streamVersion;
+	QByteArray libqutimVersion;
+	in >> version >> streamVersion >> libqutimVersion;
+	// Verification result depends on libqutim's version
+	if (version != ManifestVersion || streamVersion != StreamVersion || libqutimVersion != versionString())
+		return;
+	quint32 count;
+	in >> count;
+	for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+		QString path;
+		quint8 status;
+		Entry entry;
+		in >> path >> status >> entry.size >> entry.modified >> entry.debugId
+		   >> entry.error >> entry.className >> entry.extensionIds;
+		entry.status = static_cast<Status>(status);
+		m_entries.insert(path, entry);
+	}
+	if (in.status() != QDataStream::Ok) {
+		qWarning() << "Plugin manifest" << m_fileName << "is corrupted";
+		m_entries.clear();
+	}
+}
+
+bool PluginManifest::save()
+{
+	if (!m_changed || m_fileName.isEmpty())
+		return true;
+	QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+	QSaveFile file(m_fileName);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+	QHash<QString, Entry>::const_iterator it;
+	QList<QString> paths;
+	// Forget removed libraries
+	for (it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+		if (QFileInfo::exists(it.key()))
+			paths << it.key();
+	}
+	QDataStream out(&file);
+	out.setVersion(StreamVersion);
+	out << quint32(ManifestVersion) << quint32(StreamVersion) << QByteArray(versionString())
+	    << quint32(paths.size());
+	foreach (const QString &path, paths) {
+		const Entry &entry = m_entries[path];
+		out << path << quint8(entry.status) << entry.size << entry.modified << entry.debugId
+		    << entry.error << entry.className << entry.extensionIds;
+	}
+	m_changed = !file.commit();
+	return !m_changed;
+}
+
+PluginManifest::Entry PluginManifest::entry(const QFileInfo &info) const
+{
+	QHash<QString, Entry>::const_iterator it = m_entries.find(info.canonicalFilePath());
+	if (it == m_entries.constEnd() || it->size != info.size() || it->modified != info.lastModified())
+		return Entry();
+	return *it;
+}
+
+void PluginManifest::insert(const QFileInfo &info, Entry entry)
+{
+	entry.size = info.size();
+	entry.modified = info.lastModified();
+	m_entries.insert(info.canonicalFilePath(), entry);
+	m_changed = true;
+}
+
+}
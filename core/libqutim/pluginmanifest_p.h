@@ -0,0 +1,85 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef PLUGINMANIFEST_P_H
+#define PLUGINMANIFEST_P_H
+
+#include <QHash>
+#include <QDateTime>
+#include <QFileInfo>
+
+namespace qutim_sdk_0_3
+{
+
+/*
+ * Cache of what is known about every library in plugin directories, so
+ * unchanged libraries are not loaded just to find out that they are not
+ * qutIM plugins, are built against another libqutim or are disabled.
+ * Entries are matched by the canonical path, size and modification time.
+ */
+class PluginManifest
+{
+public:
+	enum Status
+	{
+		Unknown = 0,
+		NotPlugin,
+		Invalid,
+		Valid
+	};
+
+	struct Entry
+	{
+		Entry() : status(Unknown), size(0), debugId(0) {}
+
+		Status status;
+		qint64 size;
+		QDateTime modified;
+		quint64 debugId;
+		QString error;
+		// Class name of the plugin, it's used as a key in "plugins/list" config
+		QByteArray className;
+		// Class names and interfaces of the extensions, including the base classes
+		QList<QByteArray> extensionIds;
+	};
+
+	PluginManifest();
+
+	void load();
+	bool save();
+
+	// Returns Unknown entry if the library was changed since it was stored
+	Entry entry(const QFileInfo &info) const;
+	void insert(const QFileInfo &info, Entry entry);
+
+private:
+	QString m_fileName;
+	QHash<QString, Entry> m_entries;
+	bool m_changed;
+};
+
+}
+
+#endif // PLUGINMANIFEST_P_H
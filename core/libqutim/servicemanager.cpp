@@ -39,6 +39,7 @@ ServicePointerData::ServicePointerData() : object(0)
 
 void ServiceManagerPrivate::init()
 {
+	StartupTrace::Scope scope(startupTrace(), "services", QStringLiteral("init"));
 	Config cfg;
 	cfg.beginGroup(QLatin1String("services/list"));
 	const ExtensionInfoList extensions = extensionList();
@@ -86,6 +87,8 @@ void ServiceManagerPrivate::init(const QByteArray &service, const ExtensionInfo
 			init(id, checked.value(id), used);
 		}
 	}
+	// Dependencies from "Uses" are already created, so it's the own time of the service
+	StartupTrace::Scope scope(startupTrace(), "service", QLatin1String(service));
 	QObject *object = info.generator()->generate();
 	initializationOrder << data(service);
 	initializationOrder.last()->object = object;
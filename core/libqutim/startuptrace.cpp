@@ -0,0 +1,144 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "startuptrace_p.h"
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QThread>
+#include <QHash>
+#include <QDir>
+#include <QDebug>
+
+namespace qutim_sdk_0_3
+{
+
+enum { MaxStoredTraces = 10 };
+
+StartupTrace::Scope::Scope(StartupTrace *trace, const char *category, const QString &name)
+	: m_trace(trace), m_category(category), m_name(name), m_start(trace ? trace->elapsed() : 0)
+{
+}
+
+StartupTrace::Scope::~Scope()
+{
+	if (m_trace)
+		m_trace->add(m_category, m_name, m_start);
+}
+
+StartupTrace::StartupTrace() : m_mainThread(QThread::currentThreadId())
+{
+	m_timer.start();
+}
+
+qint64 StartupTrace::elapsed() const
+{
+	return m_timer.nsecsElapsed() / 1000;
+}
+
+void StartupTrace::add(const char *category, const QString &name, qint64 start)
+{
+	Event event = { category, name, start, elapsed() - start, QThread::currentThreadId() };
+	QMutexLocker locker(&m_lock);
+	m_events.append(event);
+}
+
+QVector<StartupTrace::Event> StartupTrace::events() const
+{
+	QMutexLocker locker(&m_lock);
+	return m_events;
+}
+
+void StartupTrace::dump() const
+{
+	foreach (const Event &event, events()) {
+		qDebug("startup: %-10s %-40s at %7.1f ms, took %7.1f ms%s", event.category,
+		       qPrintable(event.name), event.start / 1000., event.duration / 1000.,
+		       event.thread == m_mainThread ? "" : " (worker)");
+	}
+}
+
+QByteArray StartupTrace::toChromeTrace() const
+{
+	const qint64 pid = QCoreApplication::applicationPid();
+	// Thread handles are meaningless for the reader, so number them in order of appearance
+	QHash<Qt::HANDLE, int> threads;
+	threads.insert(m_mainThread, 0);
+	QJsonArray traceEvents;
+	foreach (const Event &event, events()) {
+		QHash<Qt::HANDLE, int>::iterator it = threads.find(event.thread);
+		if (it == threads.end())
+			it = threads.insert(event.thread, threads.size());
+		QJsonObject object;
+		object.insert(QStringLiteral("name"), event.name);
+		object.insert(QStringLiteral("cat"), QLatin1String(event.category));
+		object.insert(QStringLiteral("ph"), QStringLiteral("X"));
+		object.insert(QStringLiteral("ts"), double(event.start));
+		object.insert(QStringLiteral("dur"), double(event.duration));
+		object.insert(QStringLiteral("pid"), double(pid));
+		object.insert(QStringLiteral("tid"), it.value());
+		traceEvents.append(object);
+	}
+	for (QHash<Qt::HANDLE, int>::const_iterator it = threads.constBegin(); it != threads.constEnd(); ++it) {
+		QJsonObject args;
+		args.insert(QStringLiteral("name"), it.value() ? QStringLiteral("Worker %1").arg(it.value())
+		                                                : QStringLiteral("GUI"));
+		QJsonObject object;
+		object.insert(QStringLiteral("name"), QStringLiteral("thread_name"));
+		object.insert(QStringLiteral("ph"), QStringLiteral("M"));
+		object.insert(QStringLiteral("pid"), double(pid));
+		object.insert(QStringLiteral("tid"), it.value());
+		object.insert(QStringLiteral("args"), args);
+		traceEvents.append(object);
+	}
+	QJsonObject root;
+	root.insert(QStringLiteral("traceEvents"), traceEvents);
+	root.insert(QStringLiteral("displayTimeUnit"), QStringLiteral("ms"));
+	return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+bool StartupTrace::save(const QString &dirPath) const
+{
+	QDir dir(dirPath);
+	if (!dir.mkpath(QStringLiteral(".")))
+		return false;
+	const QStringList filters(QStringLiteral("startup-*.json"));
+	// Names contain launch time, so the oldest traces are the first ones
+	QStringList traces = dir.entryList(filters, QDir::Files, QDir::Name);
+	while (traces.size() >= MaxStoredTraces)
+		dir.remove(traces.takeFirst());
+
+	const QString name = QDateTime::currentDateTime().toString(QStringLiteral("'startup-'yyyyMMdd-hhmmss-zzz'.json'"));
+	QSaveFile file(dir.filePath(name));
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+	file.write(toChromeTrace());
+	return file.commit();
+}
+
+}
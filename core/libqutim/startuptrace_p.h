@@ -0,0 +1,91 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef STARTUPTRACE_P_H
+#define STARTUPTRACE_P_H
+
+#include <QElapsedTimer>
+#include <QVector>
+#include <QString>
+#include <QMutex>
+
+namespace qutim_sdk_0_3
+{
+
+/*
+ * Timeline of the startup: loading of plugin libraries, services, startup
+ * modules, accounts and plugins. Times are in microseconds since the trace
+ * start. Events may be added from any thread, the timeline of every launch
+ * is stored in Chrome's trace event format (chrome://tracing).
+ */
+class StartupTrace
+{
+public:
+	struct Event
+	{
+		const char *category;
+		QString name;
+		qint64 start;
+		qint64 duration;
+		Qt::HANDLE thread;
+	};
+
+	class Scope
+	{
+	public:
+		// Does nothing if trace is null
+		Scope(StartupTrace *trace, const char *category, const QString &name);
+		~Scope();
+	private:
+		StartupTrace *m_trace;
+		const char *m_category;
+		QString m_name;
+		qint64 m_start;
+	};
+
+	StartupTrace();
+
+	qint64 elapsed() const;
+	// Adds event which started at start and ends now
+	void add(const char *category, const QString &name, qint64 start);
+	QVector<Event> events() const;
+	void dump() const;
+	QByteArray toChromeTrace() const;
+	// Writes new trace to the directory, only few latest traces are kept there
+	bool save(const QString &dirPath) const;
+
+private:
+	QElapsedTimer m_timer;
+	Qt::HANDLE m_mainThread;
+	mutable QMutex m_lock;
+	QVector<Event> m_events;
+};
+
+// Trace of the current launch, null if there is no ModuleManager
+StartupTrace *startupTrace();
+
+}
+
+#endif // STARTUPTRACE_P_H
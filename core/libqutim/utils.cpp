@@ -405,32 +405,40 @@ namespace qutim_sdk_0_3
 		return str;
 	}
 	
-	LIBQUTIM_EXPORT QString &validateCpp(QString &text)
+	// Appends escaped text to the result, so callers can build a whole script in one buffer
+	LIBQUTIM_EXPORT void validateCpp(const QString &text, QString *result)
 	{
-		QString txt;
-		txt.reserve(text.size() * 1.2);
-		for (int i = 0; i < text.size(); i++) {
-			switch (text.at(i).unicode()) {
+		const QChar *data = text.constData();
+		const QChar * const dataEnd = data + text.size();
+		for (; data != dataEnd; ++data) {
+			switch (data->unicode()) {
 			case L'\"':
-				txt += QLatin1String("\\\"");
+				*result += QLatin1String("\\\"");
 				break;
 			case L'\n':
-				txt += QLatin1String("\\n");
+				*result += QLatin1String("\\n");
 				break;
 			case L'\t':
-				txt += QLatin1String("\\t");
+				*result += QLatin1String("\\t");
 				break;
 			case L'\\':
-				txt += QLatin1String("\\\\");
+				*result += QLatin1String("\\\\");
 				break;
 			case L'\r':
-				txt += QLatin1String("\\r");
+				*result += QLatin1String("\\r");
 				break;
 			default:
-				txt += text.at(i);
+				*result += *data;
 				break;
 			}
 		}
+	}
+
+	LIBQUTIM_EXPORT QString &validateCpp(QString &text)
+	{
+		QString txt;
+		txt.reserve(text.size() * 1.2);
+		validateCpp(text, &txt);
 		return (text = txt);
 	}
 
@@ -445,7 +453,15 @@ namespace qutim_sdk_0_3
 	UrlParser::UrlTokenList UrlParser::tokenize(const QString &text, Flags flags)
 	{
 		UrlTokenList result;
-		static QRegExp linkRegExp("([a-zA-Z0-9\\-\\_\\.]+@([a-zA-Z0-9\\-\\_]+\\.)+[a-zA-Z]+)|"
+		// Every link contains one of these, so most of messages don't need the regexp at all
+		if (!text.contains(QLatin1Char('@'))
+		        && !text.contains(QLatin1String("://"))
+		        && !text.contains(QLatin1String("www."), Qt::CaseInsensitive)) {
+			UrlToken tok = { text.midRef(0), QString() };
+			result << tok;
+			return result;
+		}
+		static const QRegExp linkPattern("([a-zA-Z0-9\\-\\_\\.]+@([a-zA-Z0-9\\-\\_]+\\.)+[a-zA-Z]+)|"
 		                          "([a-z]+(\\+[a-z]+)?://|www\\.)"
 		                          "[\\w-]+(\\.[\\w-]+)*\\.\\w+"
 		                          "(:\\d+)?"
@@ -453,7 +469,9 @@ namespace qutim_sdk_0_3
 		                          "(\\?[\\w\\+\\.\\[\\]!%\\$/\\(\\),:;@\\'&=~-]*)?"
 		                          "(#[\\w\\+\\.\\[\\]!%\\$/\\\\\\(\\)\\|,:;@&=~-]*)?)?",
 		                          Qt::CaseInsensitive);
-		Q_ASSERT(linkRegExp.isValid());
+		Q_ASSERT(linkPattern.isValid());
+		// QRegExp keeps state of the last match, so every call needs its own copy
+		QRegExp linkRegExp = linkPattern;
 		QList<QPair<int, int> > tags;
 		int currentTag = 0;
 		if (flags & Html) {
@@ -542,20 +560,23 @@ namespace qutim_sdk_0_3
 	
 	QString UrlParser::parseUrls(const QString &text, Flags flags)
 	{
-        const QString hrefTemplate(QLatin1String("<a href='%1' title='%2' target='_blank'>%3</a>"));
 		QString html;
 		foreach (const UrlToken &token, tokenize(text, flags)) {
-			if (token.url.isEmpty()) {
+			if (token.url.isEmpty())
 				html += token.text.toString();
-			} else {
-				QUrl url = QUrl::fromUserInput(token.url);
-				QByteArray urlEncoded = url.toEncoded();
-				html += hrefTemplate.arg(QString::fromLatin1(urlEncoded, urlEncoded.size()),
-				                         url.toString(),
-				                         token.text.toString());
-			}
+			else
+				html += linkHtml(token.text.toString(), token.url);
 		}
 		return html;
 	}
+
+	QString UrlParser::linkHtml(const QString &text, const QString &url)
+	{
+		const QString hrefTemplate(QLatin1String("<a href='%1' title='%2' target='_blank'>%3</a>"));
+		QUrl link = QUrl::fromUserInput(url);
+		QByteArray urlEncoded = link.toEncoded();
+		return hrefTemplate.arg(QString::fromLatin1(urlEncoded, urlEncoded.size()),
+		                        link.toString(), text);
+	}
 }
 
@@ -55,6 +55,7 @@ public:
 	
 	static UrlTokenList tokenize(const QString &text, Flags flags = None);
 	static QString parseUrls(const QString &text, Flags flags = None);
+	static QString linkHtml(const QString &text, const QString &url);
 private:
 	UrlParser();
 	~UrlParser();
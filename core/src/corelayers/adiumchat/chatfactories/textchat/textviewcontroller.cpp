@@ -57,6 +57,7 @@ TextViewController::TextViewController()
 	m_cache.setMaxCost(40);
 	m_isLastIncoming = false;
 	m_scrollBarPosition = 0;
+	m_historyPending = 0;
 	Config cfg = Config(QLatin1String("appearance")).group(QLatin1String("chat"));
 	m_groupUntil = cfg.value<ushort>(QLatin1String("groupUntil"), 900);
 	cfg.beginGroup(QLatin1String("textview"));
@@ -99,6 +100,7 @@ void TextViewController::setChatSession(ChatSession *session)
 {
 	m_session = session;
 	m_session->installEventFilter(this);
+	m_delayed.clear();
 	loadHistory();
 }
 
@@ -111,6 +113,11 @@ void TextViewController::appendMessage(const qutim_sdk_0_3::Message &msg)
 {
 	if (msg.text().isEmpty())
 		return;
+	// History must be shown above messages received during its loading
+	if (m_historyPending > 0 && !msg.property("history", false)) {
+		m_delayed << msg;
+		return;
+	}
 	QTextCursor cursor(this);
 	cursor.beginEditBlock();
 	bool shouldScroll = isNearBottom();
@@ -386,16 +393,37 @@ void TextViewController::loadHistory()
 	qDebug() << Q_FUNC_INFO;
 	Config config = Config(QLatin1String("appearance")).group(QLatin1String("chat/history"));
 	int max_num = config.value(QLatin1String("maxDisplayMessages"), 5);
-    MessageList messages = History::instance()->readSync(m_session->getUnit(), max_num);
-	foreach (Message mess, messages) {
-		mess.setProperty("silent", true);
-		mess.setProperty("store", false);
-		mess.setProperty("history", true);
-		if (!mess.chatUnit()) //TODO FIXME
-			mess.setChatUnit(m_session->getUnit());
-		m_session->append(mess);
-	}
+	QPointer<ChatSession> session = m_session;
+	QPointer<TextViewController> self = this;
+	++m_historyPending;
+	History::instance()->read(m_session->getUnit(), max_num).connect(this, [this, session, self] (const MessageList &messages) {
+		if (session && session == m_session) {
+			m_historyPending += messages.size();
+			foreach (Message mess, messages) {
+				mess.setProperty("silent", true);
+				mess.setProperty("store", false);
+				mess.setProperty("history", true);
+				if (!mess.chatUnit()) //TODO FIXME
+					mess.setChatUnit(session->getUnit());
+				session->append(mess, [self] (quint64, const Message &, const QString &) {
+					if (self)
+						self->onHistoryMessageHandled();
+				});
+			}
+		}
+		onHistoryMessageHandled();
+	});
+}
+
+void TextViewController::onHistoryMessageHandled()
+{
+	if (--m_historyPending > 0)
+		return;
 	m_lastSender.clear();
+	MessageList delayed;
+	delayed.swap(m_delayed);
+	foreach (const Message &msg, delayed)
+		appendMessage(msg);
 }
 
 QString TextViewController::makeName(const Message &mes)
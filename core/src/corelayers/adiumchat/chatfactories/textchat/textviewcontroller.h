@@ -94,12 +94,16 @@ private:
 	QPixmap createBullet(const QColor &color);
 	void init();
 	void loadHistory();
+	void onHistoryMessageHandled();
 	int addEmoticon(const QString &filename);
 	QString makeName(const qutim_sdk_0_3::Message &mes);
 	bool shouldBreak(const QDateTime &time);
 	
 	QPointer<QTextBrowser> m_textEdit;
 	qutim_sdk_0_3::ChatSession *m_session;
+	// Live messages wait here while history is loaded
+	int m_historyPending;
+	qutim_sdk_0_3::MessageList m_delayed;
 	QCache<qint64, int> m_cache;
 	QDateTime m_lastTime;
 	QString m_lastSender;
@@ -102,6 +102,18 @@ void ChatSessionImpl::addContact(Buddy* c)
 	emit buddiesChanged();
 }
 
+void ChatSessionImpl::virtual_hook(int id, void *data)
+{
+	if (id == AddContactsHook) {
+		AddContactsArgument *argument = reinterpret_cast<AddContactsArgument*>(data);
+		if (d_func()->model.data()->addContacts(argument->contacts) > 0)
+			emit buddiesChanged();
+		argument->handled = true;
+		return;
+	}
+	ChatSession::virtual_hook(id, data);
+}
+
 qint64 ChatSessionImpl::doAppendMessage(Message &message)
 {
 	Q_D(ChatSessionImpl);
@@ -324,10 +336,12 @@ void ChatSessionImpl::setChatUnit(ChatUnit* unit)
 		}
 	}
 	if (!!(conf = qobject_cast<Conference *>(unit))) {
+		QList<Buddy*> buddies;
 		foreach (ChatUnit *u, conf->lowerUnits()) {
 			if (Buddy *buddy = qobject_cast<Buddy*>(u))
-				addContact(buddy);
+				buddies << buddy;
 		}
+		addContacts(buddies);
 	}
 
 	if (d->menu)
@@ -88,6 +88,8 @@ public slots:
 	QVariant evaluateJavaScript(const QString &scriptSource);
 	void clearChat();
 	QString quote();
+protected:
+	virtual void virtual_hook(int id, void *data);
 private:
 	QScopedPointer<ChatSessionImplPrivate> d_ptr;
 };
@@ -26,6 +26,9 @@
 
 #include "chatsessionmodel.h"
 #include <QMetaMethod>
+#include <QSet>
+#include <algorithm>
+#include <iterator>
 
 namespace Core
 {
@@ -75,22 +78,79 @@ void ChatSessionModel::addContact(Buddy *unit)
 	int index = it - m_units.begin();
 	beginInsertRows(QModelIndex(), index, index);
 	m_units.insert(index, unit);
+	connectUnit(unit);
+	endInsertRows();
+}
+
+int ChatSessionModel::addContacts(const QList<Buddy*> &units)
+{
+	QSet<Buddy*> known;
+	known.reserve(m_units.size() + units.size());
+	foreach (const Node &node, m_units)
+		known.insert(node.unit);
+
+	QList<Node> nodes;
+	nodes.reserve(units.size());
+	foreach (Buddy *unit, units) {
+		if (!unit || known.contains(unit))
+			continue;
+		known.insert(unit);
+		nodes.append(Node(unit));
+	}
+	if (nodes.isEmpty())
+		return 0;
+	std::sort(nodes.begin(), nodes.end());
 
-	auto unitMeta = unit->metaObject();
-	int funcIndex = unitMeta->indexOfProperty("priority");
-	QMetaProperty priorityProperty = unitMeta->property(funcIndex);
-	QMetaMethod affiliationSignal = priorityProperty.notifySignal();
-	funcIndex = metaObject()->indexOfSlot("onPriorityChanged(int,int)");
-	QMetaMethod prioritySlot = metaObject()->method(funcIndex);
+	// Initial roster of the room is a single range, otherwise rows are spread
+	// over the whole list and one reset is cheaper than a lot of insertions
+	const bool reset = !m_units.isEmpty();
+	if (!reset) {
+		beginInsertRows(QModelIndex(), 0, nodes.size() - 1);
+		m_units = nodes;
+	} else {
+		beginResetModel();
+		QList<Node> units;
+		units.reserve(m_units.size() + nodes.size());
+		std::merge(m_units.constBegin(), m_units.constEnd(),
+		           nodes.constBegin(), nodes.constEnd(),
+		           std::back_inserter(units));
+		m_units = units;
+	}
+	foreach (const Node &node, nodes)
+		connectUnit(node.unit);
+	if (reset)
+		endResetModel();
+	else
+		endInsertRows();
+	return nodes.size();
+}
+
+void ChatSessionModel::connectUnit(Buddy *unit)
+{
+	// Notify signal of "priority" differs from protocol to protocol, so cache
+	// it per class instead of looking it up for every participant
+	typedef QHash<const QMetaObject*, QMetaMethod> SignalCache;
+	static SignalCache prioritySignals;
+	static const QMetaMethod prioritySlot = staticMetaObject.method(
+	            staticMetaObject.indexOfSlot("onPriorityChanged(int,int)"));
 
-	connect(unit, affiliationSignal, this, prioritySlot);
+	const QMetaObject *unitMeta = unit->metaObject();
+	SignalCache::iterator it = prioritySignals.find(unitMeta);
+	if (it == prioritySignals.end()) {
+		const int index = unitMeta->indexOfProperty("priority");
+		QMetaMethod signal;
+		if (index >= 0)
+			signal = unitMeta->property(index).notifySignal();
+		it = prioritySignals.insert(unitMeta, signal);
+	}
+	if (it->isValid())
+		connect(unit, *it, this, prioritySlot);
 	connect(unit, SIGNAL(titleChanged(QString,QString)),
 			this, SLOT(onNameChanged(QString,QString)));
 	connect(unit, SIGNAL(statusChanged(qutim_sdk_0_3::Status,qutim_sdk_0_3::Status)),
 			this, SLOT(onStatusChanged(qutim_sdk_0_3::Status)));
 	connect(unit, SIGNAL(destroyed(QObject*)),
 			this, SLOT(onContactDestroyed(QObject*)));
-	endInsertRows();
 }
 
 void ChatSessionModel::removeContact(Buddy *unit)
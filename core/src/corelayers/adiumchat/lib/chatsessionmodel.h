@@ -61,6 +61,8 @@ public:
 	virtual int rowCount(const QModelIndex &parent = QModelIndex()) const;
 	virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
 	void addContact(qutim_sdk_0_3::Buddy *c);
+	// Returns count of really added contacts
+	int addContacts(const QList<qutim_sdk_0_3::Buddy*> &contacts);
 	void removeContact(qutim_sdk_0_3::Buddy *c);
 private slots:
 	void onNameChanged(const QString &title, const QString &oldTitle);
@@ -86,6 +88,8 @@ private:
 		}
 	};
 
+	void connectUnit(qutim_sdk_0_3::Buddy *unit);
+
 	QList<Node> m_units;
 };
 }
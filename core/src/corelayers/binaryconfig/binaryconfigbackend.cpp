@@ -0,0 +1,376 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "binaryconfigbackend.h"
+#include <qutim/debug.h>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QMutex>
+#include <QtEndian>
+#include <cstring>
+
+namespace qutim_sdk_0_3
+{
+LIBQUTIM_EXPORT QList<ConfigBackend*> &get_config_backends();
+}
+
+namespace Core
+{
+
+enum {
+    FormatVersion = 1,
+    HeaderSize = 8,
+    RecordSizeLength = 4
+};
+
+enum EntryKind {
+    ValueEntry,
+    MapEntry
+};
+
+static const char formatMagic[] = "QCFG";
+
+class BinaryConfigFile : public QFile
+{
+public:
+    BinaryConfigFile(const QString &name) : QFile(name), m_mapped(0), m_data(0)
+    {
+    }
+
+    bool map()
+    {
+        if (!open(QIODevice::ReadOnly))
+            return false;
+        if (size() == 0)
+            return true;
+        m_mapped = QFile::map(0, size());
+        m_data = m_mapped;
+        return m_data;
+    }
+
+    // Moves contents to memory, so the file can be replaced while subtrees still use it
+    void detach()
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_mapped)
+            return;
+        m_copy = QByteArray(reinterpret_cast<const char*>(m_mapped), size());
+        unmap(m_mapped);
+        close();
+        m_mapped = 0;
+        m_data = reinterpret_cast<const uchar*>(m_copy.constData());
+    }
+
+    // Guards data() against detach() from the saving thread
+    QMutex *mutex() { return &m_mutex; }
+    const uchar *data() const { return m_data; }
+
+private:
+    QMutex m_mutex;
+    uchar *m_mapped;
+    const uchar *m_data;
+    QByteArray m_copy;
+};
+
+typedef QSharedPointer<BinaryConfigFile> BinaryConfigFilePtr;
+
+// Files which are still mapped, they are detached before being overwritten
+struct MappedFiles
+{
+    QMutex mutex;
+    QMultiHash<QString, QWeakPointer<BinaryConfigFile> > files;
+};
+
+Q_GLOBAL_STATIC(MappedFiles, mappedFiles)
+
+static void addMappedFile(const BinaryConfigFilePtr &file)
+{
+    MappedFiles *mapped = mappedFiles();
+    QMutexLocker locker(&mapped->mutex);
+    mapped->files.insert(file->fileName(), file);
+}
+
+static void detachMappedFiles(const QString &fileName)
+{
+    MappedFiles *mapped = mappedFiles();
+    QMutexLocker locker(&mapped->mutex);
+    foreach (const QWeakPointer<BinaryConfigFile> &weak, mapped->files.values(fileName)) {
+        if (BinaryConfigFilePtr file = weak.toStrongRef())
+            file->detach();
+    }
+    mapped->files.remove(fileName);
+}
+
+static BinaryConfigFile *subtreeFile(const ConfigBackend::Subtree &subtree)
+{
+    return static_cast<BinaryConfigFile*>(subtree.file.data());
+}
+
+static const uchar *subtreeData(const ConfigBackend::Subtree &subtree)
+{
+    return subtreeFile(subtree)->data() + subtree.offset;
+}
+
+static bool decodeBlock(const ConfigBackend::Subtree &subtree, ConfigBackend::Tree *tree)
+{
+    if (subtree.size < RecordSizeLength)
+        return false;
+
+    QMutexLocker locker(subtreeFile(subtree)->mutex());
+    const uchar *block = subtreeData(subtree);
+    const qint64 recordEnd = subtree.size - RecordSizeLength;
+    const quint32 recordSize = qFromLittleEndian<quint32>(block + recordEnd);
+    if (recordSize > recordEnd)
+        return false;
+    const qint64 recordStart = recordEnd - recordSize;
+
+    const QByteArray record = QByteArray::fromRawData(reinterpret_cast<const char*>(block) + recordStart,
+                                                      recordSize);
+    QDataStream stream(record);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 count;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString key;
+        quint8 kind;
+        stream >> key >> kind;
+        if (kind == ValueEntry) {
+            QVariant value;
+            stream >> value;
+            tree->values.insert(key, value);
+        } else if (kind == MapEntry) {
+            qint64 offset;
+            qint64 size;
+            stream >> offset >> size;
+            // Nested blocks must lie before the record of this one
+            if (offset < 0 || size < 0 || offset + size > recordStart)
+                return false;
+            ConfigBackend::Subtree child = { subtree.file, subtree.offset + offset, size };
+            tree->subtrees.insert(key, child);
+        } else {
+            return false;
+        }
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+// Appends block of the tree to the data and returns its size, places of the nested
+// blocks in \a file are stored to the \a layout
+static qint64 encodeBlock(QByteArray &data, const ConfigBackend::Tree &tree,
+                          const QSharedPointer<QFile> &file = QSharedPointer<QFile>(),
+                          ConfigBackend::Tree *layout = 0)
+{
+    const qint64 start = data.size();
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << quint32(tree.values.size() + tree.children.size() + tree.subtrees.size());
+
+    for (auto it = tree.values.begin(); it != tree.values.end(); ++it)
+        stream << it.key() << quint8(ValueEntry) << it.value();
+
+    for (auto it = tree.children.begin(); it != tree.children.end(); ++it) {
+        const qint64 offset = data.size() - start;
+        const qint64 size = encodeBlock(data, it.value(), file, layout ? &layout->children[it.key()] : 0);
+        stream << it.key() << quint8(MapEntry) << offset << size;
+        if (layout)
+            layout->subtrees.insert(it.key(), ConfigBackend::Subtree { file, start + offset, size });
+    }
+
+    for (auto it = tree.subtrees.begin(); it != tree.subtrees.end(); ++it) {
+        const ConfigBackend::Subtree &subtree = it.value();
+        const qint64 offset = data.size() - start;
+        QMutexLocker locker(subtreeFile(subtree)->mutex());
+        data.append(reinterpret_cast<const char*>(subtreeData(subtree)), subtree.size);
+        stream << it.key() << quint8(MapEntry) << offset << subtree.size;
+        if (layout)
+            layout->subtrees.insert(it.key(), ConfigBackend::Subtree { file, start + offset, subtree.size });
+    }
+
+    uchar recordSize[RecordSizeLength];
+    qToLittleEndian<quint32>(record.size(), recordSize);
+    data += record;
+    data.append(reinterpret_cast<const char*>(recordSize), RecordSizeLength);
+    return data.size() - start;
+}
+
+static ConfigBackend::Tree treeFromVariant(const QVariantMap &map)
+{
+    ConfigBackend::Tree tree;
+    for (auto it = map.begin(); it != map.end(); ++it) {
+        if (it.value().type() == QVariant::Map)
+            tree.children.insert(it.key(), treeFromVariant(it.value().toMap()));
+        else
+            tree.values.insert(it.key(), it.value());
+    }
+    return tree;
+}
+
+static QVariantMap variantFromTree(const ConfigBackend::Tree &tree)
+{
+    QVariantMap map = tree.values;
+    for (auto it = tree.children.begin(); it != tree.children.end(); ++it)
+        map.insert(it.key(), variantFromTree(it.value()));
+    for (auto it = tree.subtrees.begin(); it != tree.subtrees.end(); ++it) {
+        ConfigBackend::Tree subtree;
+        if (decodeBlock(it.value(), &subtree))
+            map.insert(it.key(), variantFromTree(subtree));
+    }
+    return map;
+}
+
+QVariant BinaryConfigBackend::load(const QString &file)
+{
+    Tree tree;
+    if (!read(file, &tree))
+        return QVariant();
+    return variantFromTree(tree);
+}
+
+void BinaryConfigBackend::save(const QString &file, const QVariant &entry)
+{
+    write(file, treeFromVariant(entry.toMap()));
+}
+
+void BinaryConfigBackend::virtual_hook(int id, void *data)
+{
+    switch (id) {
+    case LoadTreeHook: {
+        TreeArgument *argument = reinterpret_cast<TreeArgument*>(data);
+        if (!QFile::exists(argument->file))
+            convert(argument->file);
+        read(argument->file, &argument->tree);
+        argument->handled = true;
+        break;
+    }
+    case LoadSubtreeHook: {
+        TreeArgument *argument = reinterpret_cast<TreeArgument*>(data);
+        argument->handled = decodeBlock(argument->subtree, &argument->tree);
+        if (!argument->handled)
+            argument->tree = Tree();
+        break;
+    }
+    case SaveTreeHook: {
+        TreeArgument *argument = reinterpret_cast<TreeArgument*>(data);
+        Tree saved;
+        if (write(argument->file, argument->tree, &saved))
+            argument->tree = saved;
+        argument->handled = true;
+        break;
+    }
+    default:
+        ConfigBackend::virtual_hook(id, data);
+        break;
+    }
+}
+
+bool BinaryConfigBackend::read(const QString &fileName, Tree *tree)
+{
+    BinaryConfigFilePtr file = BinaryConfigFilePtr::create(fileName);
+    if (!file->map() || file->size() == 0)
+        return false;
+    addMappedFile(file);
+
+    const uchar *data = file->data();
+    if (file->size() < HeaderSize
+            || memcmp(data, formatMagic, 4) != 0
+            || qFromLittleEndian<quint32>(data + 4) != FormatVersion) {
+        qWarning() << "Unknown config format at" << fileName;
+        return false;
+    }
+
+    Subtree root = { file, HeaderSize, file->size() - HeaderSize };
+    if (!decodeBlock(root, tree)) {
+        qWarning() << "Config file is corrupted:" << fileName;
+        *tree = Tree();
+        return false;
+    }
+    return true;
+}
+
+bool BinaryConfigBackend::write(const QString &fileName, const Tree &tree, Tree *saved)
+{
+    QByteArray data(formatMagic, 4);
+    uchar version[4];
+    qToLittleEndian<quint32>(FormatVersion, version);
+    data.append(reinterpret_cast<const char*>(version), 4);
+    // New file is mapped once it's written, Config moves its subtrees there
+    BinaryConfigFilePtr savedFile;
+    Tree layout;
+    if (saved)
+        savedFile = BinaryConfigFilePtr::create(fileName);
+    encodeBlock(data, tree, savedFile, saved ? &layout : 0);
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Can't write config" << fileName << file.errorString();
+        return false;
+    }
+    file.write(data);
+
+    // Unchanged subtrees are already copied, but atoms still refer to the old file
+    // and it can't be replaced while it's mapped on some platforms
+    detachMappedFiles(fileName);
+    if (!file.commit()) {
+        qWarning() << "Can't write config" << fileName << file.errorString();
+        return false;
+    }
+    if (!saved)
+        return true;
+    if (!savedFile->map()) {
+        qWarning() << "Can't map config" << fileName << savedFile->errorString();
+        return false;
+    }
+    addMappedFile(savedFile);
+    layout.values = tree.values;
+    *saved = layout;
+    return true;
+}
+
+bool BinaryConfigBackend::convert(const QString &fileName)
+{
+    const QFileInfo info(fileName);
+    const QString baseName = info.path() + QLatin1Char('/') + info.completeBaseName();
+    foreach (ConfigBackend *backend, get_config_backends()) {
+        if (backend == this)
+            continue;
+        const QString otherName = baseName + QLatin1Char('.') + QLatin1String(backend->name());
+        if (!QFile::exists(otherName))
+            continue;
+
+        // The original file is left untouched, so it's possible to switch back
+        const QVariant value = backend->load(otherName);
+        if (value.type() != QVariant::Map)
+            continue;
+        qDebug() << "Converting config" << otherName << "to" << fileName;
+        return write(fileName, treeFromVariant(value.toMap()));
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,71 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef BINARYCONFIGBACKEND_H
+#define BINARYCONFIGBACKEND_H
+
+#include <qutim/config.h>
+
+using namespace qutim_sdk_0_3;
+
+namespace Core
+{
+
+/*
+ * Config file is a tree of blocks, every map is stored as a block with all
+ * its nested maps placed before its own record:
+ *
+ *   "QCFG" version root-block
+ *   block  := child-block* record record-size
+ *   record := count (key kind (value | offset size))*
+ *
+ * Offsets of nested blocks are relative to the start of the parent block,
+ * so unchanged blocks are copied to the new file as is. File is mapped to
+ * memory and maps are decoded only when Config reaches them. Before the file
+ * is overwritten its old mappings are copied to memory, Config moves the
+ * subtrees to the new file once saving is finished.
+ */
+class BinaryConfigBackend : public qutim_sdk_0_3::ConfigBackend
+{
+    Q_OBJECT
+    Q_CLASSINFO("Extension", "qcfg")
+public:
+    virtual QVariant load(const QString &file);
+    virtual void save(const QString &file, const QVariant &entry);
+
+protected:
+    virtual void virtual_hook(int id, void *data);
+
+private:
+    bool read(const QString &fileName, Tree *tree);
+    // Places of the maps in the new file are stored to \a saved, see ConfigBackend::saveTree()
+    bool write(const QString &fileName, const Tree &tree, Tree *saved = 0);
+    // Converts config of another backend, e.g. "profile.json" for "profile.qcfg"
+    bool convert(const QString &fileName);
+};
+
+}
+
+#endif // BINARYCONFIGBACKEND_H
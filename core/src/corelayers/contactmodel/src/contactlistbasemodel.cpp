@@ -32,13 +32,27 @@
 
 #include <QCoreApplication>
 #include <QStringBuilder>
-#include <QQueue>
+#include <QVector>
 #include <QtAlgorithms>
 #include <QtDebug>
 #include <QUrlQuery>
+#include <algorithm>
 
 using namespace qutim_sdk_0_3;
 
+enum {
+	ChangesInterval = 16,
+	// Proxy model resorts every reported range under its own layout change
+	MergedRowsCount = 16
+};
+
+template <typename T>
+static inline void updatePositions(QList<T> &nodes, int from)
+{
+	for (int i = from; i < nodes.size(); ++i)
+		nodes[i].setPosition(i);
+}
+
 ContactListBaseModel::ContactListBaseModel(QObject *parent) :
 	QAbstractItemModel(parent), NotificationBackend("ContactList")
 {
@@ -260,6 +274,10 @@ void ContactListBaseModel::handleNotification(Notification *notification)
 
 void ContactListBaseModel::timerEvent(QTimerEvent *event)
 {
+	if (event->timerId() == m_changesTimer.timerId()) {
+		applyChanges();
+		return;
+	}
 	if (event->timerId() == m_notificationTimer.timerId()) {
 		m_showNotificationIcon = !m_showNotificationIcon;
 
@@ -445,6 +463,8 @@ void ContactListBaseModel::onContactDestroyed(QObject *obj)
 
 	if (m_notificationHash.remove(contact) > 0 && m_notificationHash.isEmpty())
 		m_notificationTimer.stop();
+	m_changedContacts.remove(contact);
+	m_previousTags.remove(contact);
 
 	ContactHash::Iterator it = m_contactHash.find(contact);
 
@@ -455,14 +475,11 @@ void ContactListBaseModel::onContactDestroyed(QObject *obj)
 		foreach (ContactNode *node, contacts) {
 			ContactListNode *parentNode = node->parent();
 			QModelIndex parentIndex = createIndex(node->parent());
-			QList<ContactNode>::iterator jt = qBinaryFind(parentNode->contacts.begin(),
-														  parentNode->contacts.end(),
-														  contact,
-														  Comparator());
-			Q_ASSERT(jt != parentNode->contacts.end());
-			int index = jt - parentNode->contacts.begin();
+			int index = node->position();
+			Q_ASSERT(&parentNode->contacts[index] == node);
 			beginRemoveRows(parentIndex, index, index);
-			parentNode->contacts.erase(jt);
+			parentNode->contacts.removeAt(index);
+			updatePositions(parentNode->contacts, index);
 			endRemoveRows();
 		}
 	}
@@ -482,6 +499,8 @@ void ContactListBaseModel::onContactRemoved(Contact *contact)
 	if (m_notificationHash.remove(contact) > 0 && m_notificationHash.isEmpty())
 		m_notificationTimer.stop();
 
+	// Nodes are looked up by current tags of the contact
+	applyTagsChange(contact);
 	removeContact(contact);
 
 	disconnectContact(contact);
@@ -489,38 +508,8 @@ void ContactListBaseModel::onContactRemoved(Contact *contact)
 
 void ContactListBaseModel::onContactChanged(Contact *contact, bool parentsChanged)
 {
-	ContactHash::Iterator it = m_contactHash.find(contact);
-
-	QSet<BaseNode*> used;
-	QQueue<BaseNode*> queue;
-
-	if (it != m_contactHash.end()) {
-		if (!parentsChanged) {
-			foreach (ContactNode *node, *it) {
-				QModelIndex index = createIndex(node);
-				dataChanged(index, index);
-			}
-		} else {
-			// Restricted nodes
-			used << NULL << &m_root;
-
-			foreach (ContactNode *node, *it) {
-				used << node;
-				queue.enqueue(node);
-			}
-
-			while (!queue.isEmpty()) {
-				BaseNode *node = queue.dequeue();
-				QModelIndex index = createIndex(node);
-				dataChanged(index, index);
-
-				if (!used.contains(node->parent())) {
-					used << node->parent();
-					queue.enqueue(node->parent());
-				}
-			}
-		}
-	}
+	if (m_contactHash.contains(contact))
+		markContactChanged(contact, parentsChanged);
 }
 
 void ContactListBaseModel::onContactChanged()
@@ -534,7 +523,11 @@ void ContactListBaseModel::onContactTagsChanged(const QStringList &current, cons
 	addTags(current);
 
 	if (Contact *contact = qobject_cast<Contact*>(sender())) {
-		updateContactTags(contact, current, previous);
+		// Contact is moved once per frame, from the tags it's placed by now
+		if (!m_previousTags.contains(contact))
+			m_previousTags.insert(contact, previous);
+		if (!m_changesTimer.isActive())
+			m_changesTimer.start(ChangesInterval, this);
 		onContactChanged(contact);
 	}
 }
@@ -550,12 +543,9 @@ void ContactListBaseModel::onStatusChanged(const Status &current, const Status &
 	} else {
 		ContactHash::Iterator it = m_contactHash.find(contact);
 		if (it != m_contactHash.end()) {
-			foreach (ContactNode *node, *it) {
-				QModelIndex contactIndex = createIndex(node);
-				dataChanged(contactIndex, contactIndex);
-
+			foreach (ContactNode *node, *it)
 				updateItemCount(contact, node->parent(), online ? 1 : -1, 0);
-			}
+			markContactChanged(contact, false);
 		}
 	}
 }
@@ -574,6 +564,7 @@ ContactListBaseModel::AccountNode *ContactListBaseModel::ensureAccount(Account *
 	beginInsertRows(index, parent->accounts.size(), parent->accounts.size());
 	parent->accounts.append(AccountNode(account, m_root));
 	AccountNode *node = &parent->accounts.last();
+	node->setPosition(parent->accounts.size() - 1);
 	endInsertRows();
 
 	return node;
@@ -600,6 +591,7 @@ ContactListBaseModel::TagNode *ContactListBaseModel::ensureTag(const QString &na
 
 	beginInsertRows(parentIndex, index, index);
 	it = parent->tags.insert(it, TagNode(name, *parent));
+	updatePositions(parent->tags, index);
 	endInsertRows();
 
 	return &*it;
@@ -619,6 +611,7 @@ ContactListBaseModel::ContactNode *ContactListBaseModel::ensureContact(Contact *
 
 		beginInsertRows(parentIndex, index, index);
 		it = parent->contacts.insert(it, ContactNode(contact, *parent));
+		updatePositions(parent->contacts, index);
 		ContactNode &node = *it;
 		m_contactHash[contact].append(&node);
 		Q_ASSERT(m_contactHash[contact].count(&node) == 1);
@@ -651,6 +644,7 @@ void ContactListBaseModel::eraseContact(Contact *contact, ContactListBaseModel::
 		if (jt->isEmpty())
 			m_contactHash.erase(jt);
 		parent->contacts.erase(it);
+		updatePositions(parent->contacts, index);
 		endRemoveRows();
 
 		const bool online = (contact->status() != Status::Offline);
@@ -791,16 +785,88 @@ void ContactListBaseModel::updateItemCount(Contact *contact, ContactListBaseMode
 		modified |= fix_hash(parent->onlineContacts, contact, online);
 		modified |= fix_hash(parent->totalContacts, contact, total);
 
-		if (modified) {
-			QModelIndex index = createIndex(parent);
-			dataChanged(index, index);
-		}
+		if (modified)
+			markNodeChanged(parent);
 		parent = node_cast<ContactListNode *>(parent->parent());
 	}
 }
 
+void ContactListBaseModel::markContactChanged(Contact *contact, bool parentsChanged)
+{
+	m_changedContacts.insert(contact);
+	if (parentsChanged) {
+		foreach (ContactNode *node, m_contactHash.value(contact)) {
+			for (ContactListNode *parent = node->parent(); parent && parent != &m_root;
+				 parent = node_cast<ContactListNode *>(parent->parent())) {
+				markNodeChanged(parent);
+			}
+		}
+	}
+	if (!m_changesTimer.isActive())
+		m_changesTimer.start(ChangesInterval, this);
+}
+
+void ContactListBaseModel::markNodeChanged(ContactListNode *node)
+{
+	m_changedNodes.insert(node);
+	if (!m_changesTimer.isActive())
+		m_changesTimer.start(ChangesInterval, this);
+}
+
+void ContactListBaseModel::applyTagsChange(Contact *contact)
+{
+	QHash<Contact*, QStringList>::Iterator it = m_previousTags.find(contact);
+	if (it == m_previousTags.end())
+		return;
+	const QStringList previous = *it;
+	m_previousTags.erase(it);
+	updateContactTags(contact, contact->tags(), previous);
+}
+
+void ContactListBaseModel::applyChanges()
+{
+	// Rows are moved first, so positions of changed ones are known
+	foreach (Contact *contact, m_previousTags.keys())
+		applyTagsChange(contact);
+
+	m_changesTimer.stop();
+	if (m_changedContacts.isEmpty() && m_changedNodes.isEmpty())
+		return;
+
+	// Rows are grouped by parents, so adjacent ones are reported by a single signal
+	QHash<BaseNode*, QVector<int> > rows;
+	foreach (Contact *contact, m_changedContacts) {
+		foreach (ContactNode *node, m_contactHash.value(contact))
+			rows[node->parent()] << node->position();
+	}
+	foreach (ContactListNode *node, m_changedNodes)
+		rows[node->parent()] << createIndex(node).row();
+	m_changedContacts.clear();
+	m_changedNodes.clear();
+
+	for (QHash<BaseNode*, QVector<int> >::Iterator it = rows.begin(); it != rows.end(); ++it) {
+		const QModelIndex parentIndex = createIndex(it.key());
+		QVector<int> &parentRows = it.value();
+		std::sort(parentRows.begin(), parentRows.end());
+		if (parentRows.size() >= MergedRowsCount) {
+			// Resorting of a few unchanged rows is cheaper than a layout change per range
+			emit dataChanged(index(parentRows.first(), 0, parentIndex), index(parentRows.last(), 0, parentIndex));
+			continue;
+		}
+		for (int i = 0; i < parentRows.size(); ) {
+			int last = i;
+			while (last + 1 < parentRows.size() && parentRows[last + 1] <= parentRows[last] + 1)
+				++last;
+			emit dataChanged(index(parentRows[i], 0, parentIndex), index(parentRows[last], 0, parentIndex));
+			i = last + 1;
+		}
+	}
+}
+
 void ContactListBaseModel::removeAccountNode(Account *account, ContactListBaseModel::BaseNode *parent)
 {
+	// Pending changes may point to the removed nodes
+	applyChanges();
 	if (AccountListNode *node = node_cast<AccountListNode*>(parent)) {
 		for (int index = 0; index < node->accounts.size(); ++index) {
 			AccountNode *accountNode = &node->accounts[index];
@@ -808,6 +874,7 @@ void ContactListBaseModel::removeAccountNode(Account *account, ContactListBaseMo
 				beginRemoveRows(createIndex(parent), index, index);
 				clearContacts(accountNode);
 				node->accounts.removeAt(index);
+				updatePositions(node->accounts, index);
 				endRemoveRows();
 				return;
 			}
@@ -833,35 +900,43 @@ void ContactListBaseModel::clearContacts(ContactListBaseModel::BaseNode *current
 
 QModelIndex ContactListBaseModel::createIndex(ContactListBaseModel::BaseNode *node) const
 {
+#ifdef CONTACTLIST_CHECK_NODES
+	// It walks the whole tree, so it's too slow even for usual debug builds
 	Q_ASSERT(findNode(node));
+#endif
+	const int position = node->position();
 	if (AccountNode *accountNode = node_cast<AccountNode*>(node)) {
-		QList<AccountNode> &accounts = accountNode->parent()->accounts;
-		for (int index = 0; index < accounts.size(); ++index) {
-			if (accounts[index] == *accountNode) {
-				return createIndex(accounts[index],
-								   index
-								   + accountNode->parent()->contacts.size()
-								   + accountNode->parent()->tags.size());
-			}
-		}
+		AccountListNode *parent = accountNode->parent();
+		Q_ASSERT(&parent->accounts[position] == accountNode);
+		return createIndex(*accountNode, position + parent->contacts.size() + parent->tags.size());
 	} else if (TagNode *tagNode = node_cast<TagNode*>(node)) {
-		QList<TagNode> &tags = tagNode->parent()->tags;
-		QList<TagNode>::iterator it = qBinaryFind(tags.begin(), tags.end(), *tagNode);
-		if (it != tags.end()) {
-			int index = it - tags.begin();
-			return createIndex(*it, index + tagNode->parent()->contacts.size());
-		}
+		TagListNode *parent = tagNode->parent();
+		Q_ASSERT(&parent->tags[position] == tagNode);
+		return createIndex(*tagNode, position + parent->contacts.size());
 	} else if (ContactNode *contactNode = node_cast<ContactNode*>(node)) {
-		QList<ContactNode> &contacts = contactNode->parent()->contacts;
-		QList<ContactNode>::iterator it = qBinaryFind(contacts.begin(), contacts.end(), *contactNode);
-		if (it != contacts.end()) {
-			int index = it - contacts.begin();
-			return createIndex(*it, index);
-		}
+		Q_ASSERT(&contactNode->parent()->contacts[position] == contactNode);
+		return createIndex(*contactNode, position);
 	}
 	return QModelIndex();
 }
 
+Contact *ContactListBaseModel::contactAt(const QModelIndex &index) const
+{
+	ContactNode *node = extractNode<ContactNode>(index);
+	return node && node->contact ? node->contact.data() : NULL;
+}
+
+ContactListItemType ContactListBaseModel::itemTypeAt(const QModelIndex &index) const
+{
+	if (AccountNode *node = extractNode<AccountNode>(index))
+		return node->account ? AccountType : InvalidType;
+	else if (extractNode<TagNode>(index))
+		return TagType;
+	else if (ContactNode *node = extractNode<ContactNode>(index))
+		return node->contact ? ContactType : InvalidType;
+	return InvalidType;
+}
+
 ContactListBaseModel::BaseNode *ContactListBaseModel::extractNode(const QModelIndex &index) const
 {
 	if (!index.isValid())
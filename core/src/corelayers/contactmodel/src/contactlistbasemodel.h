@@ -32,6 +32,7 @@
 #include <qutim/notification.h>
 #include <QAbstractItemModel>
 #include <QBasicTimer>
+#include <QSet>
 
 class ContactListFrontModel;
 
@@ -149,14 +150,18 @@ protected:
     class BaseNode
 	{
     public:
-		inline BaseNode(NodeType type, BaseNode *parent) : m_type(type), m_parent(parent) {}
+		inline BaseNode(NodeType type, BaseNode *parent) : m_type(type), m_parent(parent), m_position(0) {}
 
 		inline NodeType type() const { return m_type; }
 		inline BaseNode *parent() const { return m_parent; }
+		// Position in the parent's list of nodes of the same type, kept up to date by the model
+		inline int position() const { return m_position; }
+		inline void setPosition(int position) { m_position = position; }
 
 	private:
 		NodeType m_type;
 		BaseNode *m_parent;
+		int m_position;
 	};
 
 	class ContactNode : public BaseNode
@@ -309,6 +314,10 @@ private:
 	void addTags(const QStringList &tags);
 
 	void updateItemCount(qutim_sdk_0_3::Contact *contact, ContactListNode *parent, int online, int total);
+	void markContactChanged(qutim_sdk_0_3::Contact *contact, bool parentsChanged);
+	void markNodeChanged(ContactListNode *node);
+	void applyTagsChange(qutim_sdk_0_3::Contact *contact);
+	void applyChanges();
 	void removeAccountNode(qutim_sdk_0_3::Account *account, BaseNode *parent);
 	void clearContacts(BaseNode *parent);
 
@@ -320,6 +329,9 @@ private:
 	{ return (node && (node->type() & reinterpret_cast<T>(NULL)->Type) == reinterpret_cast<T>(NULL)->Type) ? static_cast<T>(node) : NULL; }
 	template <typename T> inline T *extractNode(const QModelIndex &index) const
 	{ return node_cast<T*>(extractNode(index)); }
+	// Cheap equivalents of data(ContactRole) and data(ItemTypeRole) for ContactListFrontModel
+	qutim_sdk_0_3::Contact *contactAt(const QModelIndex &index) const;
+	ContactListItemType itemTypeAt(const QModelIndex &index) const;
 
 	typedef QHash<qutim_sdk_0_3::Contact*, QList<ContactNode *> > ContactHash;
 	typedef QList<qutim_sdk_0_3::Notification *> NotificationList;
@@ -341,6 +353,10 @@ private:
 	QIcon m_birthdayIcon;
 	QIcon m_defaultNotificationIcon;
 	QBasicTimer m_notificationTimer;
+	QBasicTimer m_changesTimer;
+	QSet<qutim_sdk_0_3::Contact*> m_changedContacts;
+	QSet<ContactListNode*> m_changedNodes;
+	QHash<qutim_sdk_0_3::Contact*, QStringList> m_previousTags;
 	quint16 m_realAccountRequestId;
 	quint16 m_realUnitRequestId;
 	bool m_showNotificationIcon;
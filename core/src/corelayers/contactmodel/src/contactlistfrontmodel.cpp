@@ -380,7 +380,8 @@ void ContactListFrontModel::onRowsRemoved(const QModelIndex &parent, int first,
 bool ContactListFrontModel::filterAcceptsRowImpl(int sourceRow, const QModelIndex &sourceParent, bool checkCollapse) const
 {
     const QRegExp regexp = filterRegExp();
-    QModelIndex index = sourceModel()->index(sourceRow, 0, sourceParent);
+    const ContactListBaseModel *model = static_cast<ContactListBaseModel*>(sourceModel());
+    QModelIndex index = model->index(sourceRow, 0, sourceParent);
 
     if (checkCollapse) {
         QVariant collapsed = sourceParent.data(CollapsedRole);
@@ -391,9 +392,9 @@ bool ContactListFrontModel::filterAcceptsRowImpl(int sourceRow, const QModelInde
     if (m_filterTags.isEmpty() && m_showOffline && regexp.isEmpty())
         return true;
 
-    switch (index.data(ItemTypeRole).toInt()) {
+    switch (model->itemTypeAt(index)) {
     case ContactType: {
-        Contact *contact = qobject_cast<Contact*>(index.data(BuddyRole).value<Buddy*>());
+        Contact *contact = model->contactAt(index);
         Q_ASSERT(contact);
         if (!regexp.isEmpty()) {
             return contact->id().contains(regexp) || contact->name().contains(regexp);
@@ -410,17 +411,15 @@ bool ContactListFrontModel::filterAcceptsRowImpl(int sourceRow, const QModelInde
                 if (!hasAny)
                     return false;
             }
-            if (!m_showOffline) {
-                const Status status = index.data(StatusRole).value<Status>();
-                return status != Status::Offline;
-            }
+            if (!m_showOffline)
+                return contact->status() != Status::Offline;
         }
         break;
     }
     case TagType: {
         if (!m_filterTags.isEmpty() && !m_filterTags.contains(index.data(TagNameRole).toString()))
             return false;
-        int count = sourceModel()->rowCount(index);
+        int count = model->rowCount(index);
         for (int i = 0; i < count; ++i) {
             if (filterAcceptsRowImpl(i, index, false))
                 return true;
@@ -440,15 +439,16 @@ bool ContactListFrontModel::filterAcceptsRow(int sourceRow, const QModelIndex &s
 
 bool ContactListFrontModel::lessThan(const QModelIndex &left, const QModelIndex &right) const
 {
-	const ContactListItemType leftType = static_cast<ContactListItemType>(left.data(ItemTypeRole).toInt());
-	const ContactListItemType rightType = static_cast<ContactListItemType>(right.data(ItemTypeRole).toInt());
+	const ContactListBaseModel *model = static_cast<ContactListBaseModel*>(sourceModel());
+	const ContactListItemType leftType = model->itemTypeAt(left);
+	const ContactListItemType rightType = model->itemTypeAt(right);
 	if (leftType != rightType)
 		return leftType < rightType;
 
 	switch (leftType) {
 	case ContactType: {
-		Contact *leftContact = qobject_cast<Contact*>(left.data(BuddyRole).value<Buddy*>());
-		Contact *rightContact = qobject_cast<Contact*>(right.data(BuddyRole).value<Buddy*>());
+		Contact *leftContact = model->contactAt(left);
+		Contact *rightContact = model->contactAt(right);
 		Q_ASSERT(leftContact);
 		Q_ASSERT(rightContact);
 		return m_comparator->compare(leftContact, rightContact) < 0;
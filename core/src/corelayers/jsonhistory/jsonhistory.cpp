@@ -29,105 +29,234 @@
 #include <qutim/protocol.h>
 #include <qutim/systeminfo.h>
 #include <qutim/json.h>
+#include <qutim/config.h>
 #include <QStringBuilder>
 #include <QThreadPool>
+#include <limits>
 #include "historywindow.h"
+#include "jsonhistoryindex.h"
+#include "jsonhistorywordindex.h"
+#include "jsonhistorytailcache.h"
 #include <qutim/icon.h>
 #include <qutim/debug.h>
 //#include <QElapsedTimer>
 
 namespace Core
 {
-JsonHistoryStoreJob::JsonHistoryStoreJob(JsonHistoryScope::Ptr scope) : d(scope)
+JsonHistoryWriter::JsonHistoryWriter(JsonHistoryScope::Ptr scope, int flushInterval, int flushSize)
+	: d(scope), m_flushInterval(flushInterval), m_flushSize(flushSize),
+	  m_statisticsMessages(0), m_statisticsBytes(0), m_maxQueueDepth(0)
 {
-	d->hasRunnable = true;
-	setAutoDelete(true);
+	m_files.setMaxCost(16);
 }
 
-void JsonHistoryStoreJob::run()
+void JsonHistoryWriter::enqueue(const History::ContactInfo &contact, const Message &message)
 {
+	QMutexLocker locker(&d->mutex);
+	d->queue << qMakePair(contact, message);
+	++d->queuedCount;
+	if (d->queue.size() == 1 || d->queue.size() >= m_flushSize)
+		d->wakeUp.wakeOne();
+}
+
+void JsonHistoryWriter::stop()
+{
+	{
+		QMutexLocker locker(&d->mutex);
+		d->stopped = true;
+		d->wakeUp.wakeOne();
+	}
+	wait();
+}
+
+void JsonHistoryWriter::run()
+{
+	m_statisticsTimer.start();
+	QMutexLocker locker(&d->mutex);
 	forever {
-		d->mutex.lock();
 		if (d->queue.isEmpty()) {
-			d->hasRunnable = false;
-			d->mutex.unlock();
-			break;
+			if (d->stopped)
+				break;
+			d->wakeUp.wait(&d->mutex);
+			continue;
 		}
-        auto it = d->queue.begin();
-        QDate date = it->second.time().date();
-        auto firstContact = it->first;
-        QList<QPair<History::ContactInfo, Message>> queue;
-		while (it != d->queue.end()) {
-            if (firstContact == it->first
-                    && date == it->second.time().date()) {
-				queue << *it;
-				d->queue.erase(it++);
-			} else {
-				++it;
-			}
+		// Let the batch grow a bit, so bursts touch every file only once
+		if (!d->syncRequested && !d->stopped && d->queue.size() < m_flushSize)
+			d->wakeUp.wait(&d->mutex, m_flushInterval);
+
+		Queue queue;
+		queue.swap(d->queue);
+		const quint64 queuedCount = d->queuedCount;
+		d->syncRequested = false;
+		locker.unlock();
+
+		writeQueue(queue);
+		reportStatistics(queue.size());
+
+		locker.relock();
+		d->writtenCount = queuedCount;
+		d->written.wakeAll();
+	}
+	m_files.clear();
+}
+
+void JsonHistoryWriter::writeQueue(const Queue &queue)
+{
+	// Split messages by month files in a single pass keeping their order
+	QHash<QString, int> indexes;
+	QVector<QPair<QString, MessageList>> files;
+	for (Queue::const_iterator it = queue.constBegin(); it != queue.constEnd(); ++it) {
+		const History::ContactInfo &contact = it->first;
+		QDate date = it->second.time().date();
+		if (!date.isValid())
+			date = QDate::currentDate();
+		const QString key = contact.protocol % QLatin1Char('\n')
+				% contact.account % QLatin1Char('\n')
+				% contact.contact % QLatin1Char('\n')
+				% QString::number(date.year() * 12 + date.month());
+		QHash<QString, int>::iterator index = indexes.find(key);
+		if (index == indexes.end()) {
+			index = indexes.insert(key, files.size());
+			files << qMakePair(d->getFileName(contact, date), MessageList());
 		}
-		d->mutex.unlock();
-		
-        QString fileName = d->getFileName(firstContact, date);
-		QFile file(fileName);
-		QDateTime lastModified = QFileInfo(fileName).lastModified();
-		bool new_file = !file.exists();
-		if(!file.open(QIODevice::ReadWrite))
+		files[index.value()].second << it->second;
+	}
+
+	for (int i = 0; i < files.size(); ++i)
+		writeFile(files.at(i).first, files.at(i).second);
+}
+
+void JsonHistoryWriter::writeFile(const QString &fileName, const MessageList &messages)
+{
+	QMutexLocker fileLocker(&d->fileMutex);
+	const QFileInfo fileInfo(fileName);
+	QDateTime lastModified = fileInfo.lastModified();
+	bool new_file = !fileInfo.exists();
+	QFile *handle = m_files.object(fileName);
+	if (!handle || new_file) {
+		m_files.remove(fileName);
+		handle = new QFile(fileName);
+		if (!handle->open(QIODevice::ReadWrite)) {
+			delete handle;
 			return;
-		if(new_file) {
-			file.write("[\n");
+		}
+		m_files.insert(fileName, handle);
+	}
+	QFile &file = *handle;
+	JsonHistoryIndex index(fileName);
+	JsonHistoryWordIndex *words = d->words.take(fileName);
+	if(new_file) {
+		file.write("[\n");
+		index.reset();
+		delete words;
+		words = new JsonHistoryWordIndex(fileName);
+		words->reset();
+	} else {
+		JsonHistoryScope::EndCache::iterator it = d->cache.find(fileName);
+		uint end = 0;
+		if (it != d->cache.end() && it->lastModified == lastModified) {
+			end = it->end;
+			if (!words || words->end() != end) {
+				delete words;
+				words = new JsonHistoryWordIndex(fileName);
+				if (!words->load(end)) {
+					delete words;
+					words = 0;
+				}
+			}
 		} else {
-			JsonHistoryScope::EndCache::iterator it = d->cache.find(fileName);
-			uint end;
-			if (it != d->cache.end() && it->lastModified == lastModified)
-				end = it->end;
-			else
+			delete words;
+			words = 0;
+		}
+		if (!words) {
+			// Imports the file into the indexes if it's not indexed yet
+			words = new JsonHistoryWordIndex(fileName);
+			end = 0;
+			if (const uchar *fmap = file.map(0, file.size())) {
+				if (index.load(fmap, file.size()) && !words->load(index.end()))
+					words->rebuild(fmap, index);
+				end = index.end();
+				file.unmap(const_cast<uchar *>(fmap));
+			}
+			if (end == 0)
 				end = d->findEnd(file);
 			file.resize(end);
-			file.seek(end);
-			file.write(",\n");
 		}
-		for (int i = 0; i < queue.size(); ++i) {
-            const Message &message = queue.at(i).second;
-			if (i > 0)
-				file.write(",\n");
-			file.write(" {\n");
-			foreach(const QByteArray &name, message.dynamicPropertyNames()) {
-				QByteArray data;
-				if(!Json::generate(data, message.property(name), 2))
-					continue;
-				file.write("  ");
-				file.write(Json::quote(QString::fromUtf8(name)).toUtf8());
-				file.write(": ");
-				file.write(data);
-				file.write(",\n");
-			}
-			file.write("  \"datetime\": \"");
-			QDateTime time = message.time();
-			if(!time.isValid())
-				time = QDateTime::currentDateTime();
-			file.write(time.toString(Qt::ISODate).toLatin1());
-			file.write("\",\n  \"in\": ");
-			file.write(message.isIncoming() ? "true" : "false");
-			file.write(",\n  \"text\": ");
-			file.write(Json::quote(message.text()).toUtf8());
-			file.write(",\n  \"html\": ");
-			file.write(Json::quote(message.html()).toUtf8());
-			file.write("\n }");
+		// Only "\n]" follows the end, so it's just overwritten by new records
+		file.seek(end);
+		file.write(",\n");
+	}
+	const qint64 start = file.pos();
+	QVector<JsonHistoryIndex::Entry> entries;
+	entries.reserve(messages.size());
+	for (int i = 0; i < messages.size(); ++i) {
+		const Message &message = messages.at(i);
+		if (i > 0)
+			file.write(",\n");
+		JsonHistoryIndex::Entry entry;
+		entry.offset = file.pos() + 1;
+		file.write(" {\n");
+		foreach(const QByteArray &name, message.dynamicPropertyNames()) {
+			QByteArray data;
+			if(!Json::generate(data, message.property(name), 2))
+				continue;
+			file.write("  ");
+			file.write(Json::quote(QString::fromUtf8(name)).toUtf8());
+			file.write(": ");
+			file.write(data);
+			file.write(",\n");
 		}
-		uint end = file.pos();
-		file.write("\n]");
-		file.close();
-		lastModified = QFileInfo(fileName).lastModified();
-		d->cache.insert(fileName, JsonHistoryScope::EndValue(lastModified, end));
-	//	It will produce something like this:
-	//	{
-	//	 "datetime": "2009-06-20T01:42:22",
-	//	 "type": 1,
-	//	 "in": true,
-	//	 "text": "some cool text"
-	//	}
+		file.write("  \"datetime\": \"");
+		QDateTime time = message.time();
+		if(!time.isValid())
+			time = QDateTime::currentDateTime();
+		QString timeString = time.toString(Qt::ISODate);
+		file.write(timeString.toLatin1());
+		file.write("\",\n  \"in\": ");
+		file.write(message.isIncoming() ? "true" : "false");
+		file.write(",\n  \"text\": ");
+		file.write(Json::quote(message.text()).toUtf8());
+		file.write(",\n  \"html\": ");
+		file.write(Json::quote(message.html()).toUtf8());
+		file.write("\n }");
+		// Keep exactly the same time as the one which will be read from the file
+		entry.time = JsonHistoryIndex::timeFromString(timeString);
+		entry.length = file.pos() - entry.offset;
+		entries << entry;
+		words->add(JsonHistoryIndex::day(entry), message.text());
 	}
+	uint end = file.pos();
+	file.write("\n]");
+	file.flush();
+	m_statisticsMessages += messages.size();
+	m_statisticsBytes += file.pos() - start;
+	index.append(entries);
+	words->flush(end);
+	d->words.insert(fileName, words, words->cost());
+	lastModified = QFileInfo(fileName).lastModified();
+	d->cache.insert(fileName, JsonHistoryScope::EndValue(lastModified, end));
+//	It will produce something like this:
+//	{
+//	 "datetime": "2009-06-20T01:42:22",
+//	 "type": 1,
+//	 "in": true,
+//	 "text": "some cool text"
+//	}
+}
+
+void JsonHistoryWriter::reportStatistics(int queueDepth)
+{
+	m_maxQueueDepth = qMax(m_maxQueueDepth, queueDepth);
+	const qint64 elapsed = m_statisticsTimer.elapsed();
+	if (elapsed < 10000)
+		return;
+	qDebug() << "Written" << m_statisticsMessages * 1000 / elapsed << "messages/s,"
+			 << m_statisticsBytes * 1000 / elapsed << "bytes/s, last queue depth"
+			 << queueDepth << "max queue depth" << m_maxQueueDepth;
+	m_statisticsTimer.restart();
+	m_statisticsMessages = 0;
+	m_statisticsBytes = 0;
+	m_maxQueueDepth = 0;
 }
 
 
@@ -161,16 +290,31 @@ void init(History *history)
 
 JsonHistory::JsonHistory() : m_scope(new JsonHistoryScope)
 {
+	// Cost of a word index is a number of its trigrams
+	m_scope->words.setMaxCost(1000000);
 	static bool inited = false;
 	if (!inited) {
 		inited = true;
 		init(this);
 	}
-    m_scope->hasRunnable = false;
+    m_scope->queuedCount = 0;
+    m_scope->writtenCount = 0;
+    m_scope->syncRequested = false;
+    m_scope->stopped = false;
+
+    Config config = Config().group(QStringLiteral("history"));
+    m_scope->tails.reset(new JsonHistoryTailCache(config.value(QStringLiteral("cacheMessages"), 100),
+                                                  config.value(QStringLiteral("cacheMemory"), 4096) * 1024));
+    m_writer = new JsonHistoryWriter(m_scope,
+                                     config.value(QStringLiteral("flushInterval"), 250),
+                                     config.value(QStringLiteral("flushSize"), 256));
+    m_writer->start(QThread::LowPriority);
 }
 
 JsonHistory::~JsonHistory()
 {
+    m_writer->stop();
+    delete m_writer;
 }
 
 uint JsonHistoryScope::findEnd(QFile &file)
@@ -249,99 +393,205 @@ QDir JsonHistoryScope::getAccountDir(const History::AccountInfo &info) const
 	return history_dir.filePath(path);
 }
 
+quint32 JsonHistoryScope::candidateDays(const QString &fileName, const uchar *data,
+                                        const JsonHistoryIndex &index, const QString &literal)
+{
+    JsonHistoryWordIndex *wordIndex = words.object(fileName);
+    if (wordIndex && wordIndex->end() == index.end())
+        return wordIndex->days(literal);
+
+    wordIndex = new JsonHistoryWordIndex(fileName);
+    if (!wordIndex->load(index.end()))
+        wordIndex->rebuild(data, index);
+    const quint32 result = wordIndex->days(literal);
+    words.insert(fileName, wordIndex, wordIndex->cost());
+    return result;
+}
+
+quint32 JsonHistoryScope::matchingDays(const QString &fileName, const QRegularExpression &regex, bool firstOnly)
+{
+    QFile file(fileName);
+    JsonHistoryIndex index(fileName);
+    QByteArray data;
+    const uchar *fmap = 0;
+    uint size = 0;
+    quint32 candidates = 0;
+    const bool filter = regex.isValid() && !regex.pattern().isEmpty();
+    {
+        QMutexLocker locker(&fileMutex);
+        if (!file.open(QIODevice::ReadOnly))
+            return 0;
+        size = file.size();
+        fmap = file.map(0, size);
+        if (!fmap) {
+            data = file.readAll();
+            fmap = reinterpret_cast<const uchar *>(data.constData());
+        }
+        if (!index.load(fmap, size))
+            return 0;
+        foreach (const JsonHistoryIndex::Entry &entry, index.entries())
+            candidates |= 1u << (JsonHistoryIndex::day(entry) - 1);
+
+        QString literal;
+        if (filter && JsonHistoryWordIndex::literalFromPattern(regex.pattern(), &literal))
+            candidates &= candidateDays(fileName, fmap, index, literal);
+    }
+    if (!filter)
+        return candidates;
+
+    // Index may give false positives, so check the candidate days by the regex
+    quint32 result = 0;
+    Json::Reader reader;
+    foreach (const JsonHistoryIndex::Entry &entry, index.entries()) {
+        const quint32 bit = 1u << (JsonHistoryIndex::day(entry) - 1);
+        if (!(candidates & bit) || (result & bit))
+            continue;
+        if (JsonHistoryIndex::field(reader, fmap, entry, "text").contains(regex)) {
+            result |= bit;
+            if (firstOnly)
+                break;
+        }
+    }
+    return result;
+}
+
+void JsonHistoryScope::sync()
+{
+    QMutexLocker locker(&mutex);
+    const quint64 target = queuedCount;
+    while (writtenCount < target && !stopped) {
+        syncRequested = true;
+        wakeUp.wakeOne();
+        written.wait(&mutex);
+    }
+}
+
 void JsonHistory::store(const Message &message)
 {
     if (!message.chatUnit())
         return;
 
-    QMutexLocker locker(&m_scope->mutex);
-    m_scope->queue << qMakePair(info(message.chatUnit()), message);
-    if (!m_scope->hasRunnable)
-        QThreadPool::globalInstance()->start(new JsonHistoryStoreJob(m_scope));
+    Message stored = message;
+    // Writer and tail cache must agree on time of the message
+    if (!stored.time().isValid())
+        stored.setTime(QDateTime::currentDateTime());
+    const ContactInfo contact = info(message.chatUnit());
+    m_writer->enqueue(contact, stored);
+    m_scope->tails->append(contact, stored);
 }
 
-AsyncResult<MessageList> JsonHistory::read(const ContactInfo &info, const QDateTime &from, const QDateTime &to, int max_num)
+MessageList JsonHistoryScope::readFiles(const History::ContactInfo &info, const QDateTime &from,
+                                       const QDateTime &to, int max_num)
 {
-    AsyncResultHandler<MessageList> handler;
-    auto scope = m_scope;
-
-    runJob([scope, info, from, to, max_num, handler] () {
-        QDir dir = scope->getAccountDir(info);
-        QString filter = quote(info.contact);
-        filter += ".*.json";
-
-        MessageList items;
-        QStringList files = dir.entryList(QStringList() << filter, QDir::Readable | QDir::Files | QDir::NoDotAndDotDot, QDir::Name);
-        if (files.isEmpty()) {
-            handler.handle(items);
-            return;
+    QDir dir = getAccountDir(info);
+    QString filter = JsonHistory::quote(info.contact);
+    filter += ".*.json";
+
+    MessageList items;
+    QStringList files = dir.entryList(QStringList() << filter, QDir::Readable | QDir::Files | QDir::NoDotAndDotDot, QDir::Name);
+    if (files.isEmpty())
+        return items;
+    const qint64 fromTime = from.isValid() ? from.toMSecsSinceEpoch() : std::numeric_limits<qint64>::min();
+    const qint64 toTime = to.isValid() ? to.toMSecsSinceEpoch() : std::numeric_limits<qint64>::max();
+    const QDate fromMonth = from.isValid() ? QDate(from.date().year(), from.date().month(), 1) : QDate();
+    const QDate toMonth = to.isValid() ? QDate(to.date().year(), to.date().month(), 1) : QDate();
+
+    for (int i = files.size() - 1; i >= 0; i--) {
+        // Files are named by months, so most of them can be skipped without opening
+        const QString date = files[i].section(QLatin1Char('.'), -2, -2);
+        const QDate month = QDate::fromString(date, QStringLiteral("yyyyMM"));
+        if (month.isValid()) {
+            if (toMonth.isValid() && month > toMonth)
+                continue;
+            if (fromMonth.isValid() && month < fromMonth)
+                break;
         }
-        for (int i = files.size() - 1; i >= 0; i--) {
-            QList<const uchar *> pointers;
-            QFile file(dir.filePath(files[i]));
+
+        QFile file(dir.filePath(files[i]));
+        JsonHistoryIndex index(file.fileName());
+        QByteArray data;
+        const uchar *fmap = 0;
+        uint size = 0;
+        {
+            QMutexLocker locker(&fileMutex);
             if (!file.open(QIODevice::ReadOnly))
                 continue;
-            int len = file.size();
-            QByteArray data;
-            const uchar *fmap = file.map(0, file.size());
+            size = file.size();
+            fmap = file.map(0, size);
             if (!fmap) {
                 data = file.readAll();
-                fmap = (uchar *)data.constData();
+                fmap = reinterpret_cast<const uchar *>(data.constData());
             }
-            const uchar *s = Json::skipBlanks(fmap, &len);
-            uchar qch = *s;
-            if (!s || (qch != '[' && qch != '{'))
+            if (!index.load(fmap, size))
                 continue;
-            qch = (qch == '{' ? '}' : ']');
-            s++;
-            len--;
-            bool first = true;
-            while(s) {
-                s = Json::skipBlanks(s, &len);
-                if(len < 2 || (s && *s == qch))
-                    break;
-                if((!first && *s != ',') || (first && *s == ','))
-                    break;
-                first = false;
-                if(*s == ',') {
-                    s++;
-                    len--;
-                }
-                pointers.prepend(s);
-                if (!(s = Json::skipRecord(s, &len))) {
-                    pointers.removeFirst();
-                    break;
+        }
+
+        const QVector<JsonHistoryIndex::Entry> &entries = index.entries();
+        int j = index.isSorted() ? index.lowerBound(toTime) : entries.size();
+        while (--j >= 0) {
+            const JsonHistoryIndex::Entry &entry = entries.at(j);
+            if (entry.time >= toTime)
+                continue;
+            if (entry.time < fromTime) {
+                if (index.isSorted()) {
+                    return items;
                 }
+                continue;
             }
-            QVariant value;
-            for (int i = 0; i < pointers.size(); i++) {
-                value.clear();
-                s = pointers[i];
-                len = file.size() + 1 - (s - fmap);
-                Json::parseRecord(value, s, &len);
-                QVariantMap message = value.toMap();
-                Message item;
-                QVariantMap::iterator it = message.begin();
-                for (; it != message.end(); it++) {
-                    QString key = it.key();
-                    if(key == QLatin1String("datetime"))
-                        item.setTime(QDateTime::fromString(it.value().toString(), Qt::ISODate));
-                    else
-                        item.setProperty(key.toUtf8(), it.value());
-                }
-                if (item.time() >= to)
-                    continue;
-                if (item.time() < from) {
-                    handler.handle(items);
-                    return;
-                }
-                items.prepend(item);
-                if ((items.size() >= max_num) && (max_num != -1)) {
-                    handler.handle(items);
-                    return;
-                }
+
+            QVariantMap message = JsonHistoryIndex::record(fmap, size, entry);
+            Message item;
+            QVariantMap::iterator it = message.begin();
+            for (; it != message.end(); it++) {
+                QString key = it.key();
+                if(key == QLatin1String("datetime"))
+                    item.setTime(QDateTime::fromString(it.value().toString(), Qt::ISODate));
+                else
+                    item.setProperty(key.toUtf8(), it.value());
+            }
+            items.prepend(item);
+            if ((items.size() >= max_num) && (max_num != -1)) {
+                return items;
             }
         }
+    }
+
+    return items;
+}
+
+AsyncResult<MessageList> JsonHistory::read(const ContactInfo &info, const QDateTime &from, const QDateTime &to, int max_num)
+{
+    AsyncResultHandler<MessageList> handler;
+    auto scope = m_scope;
+
+    // Messages are stored from this thread, so nothing newer than 'to' can be on the disk
+    // if 'to' is now and nothing will be stored until the read is finished
+    quint64 queuedCount;
+    {
+        QMutexLocker locker(&m_scope->mutex);
+        queuedCount = m_scope->queuedCount;
+    }
+    const bool newest = !from.isValid()
+            && (!to.isValid() || to >= QDateTime::currentDateTime().addSecs(-1));
+
+    runJob([scope, info, from, to, max_num, handler, queuedCount, newest] () {
+        // Tails are updated by store() immediately, so there is no need to wait for the writer
+        MessageList items;
+        if (scope->tails->read(info, from, to, max_num, &items)) {
+            handler.handle(items);
+            return;
+        }
+
+        scope->sync();
+        items = scope->readFiles(info, from, to, max_num);
+
+        if (newest) {
+            const bool complete = max_num == -1 || items.size() < max_num;
+            scope->tails->fill(info, items, complete, [scope, queuedCount] () {
+                QMutexLocker locker(&scope->mutex);
+                return scope->queuedCount == queuedCount;
+            });
+        }
 
         handler.handle(items);
     });
@@ -407,16 +657,17 @@ AsyncResult<QVector<History::ContactInfo>> JsonHistory::contacts(const AccountIn
 
 AsyncResult<QList<QDate>> JsonHistory::months(const ContactInfo &contact, const QRegularExpression &regex)
 {
-    Q_UNUSED(regex);
     AsyncResultHandler<QList<QDate>> handler;
 
     auto scope = m_scope;
-    runJob([handler, scope, contact] () {
+    runJob([handler, scope, contact, regex] () {
+        scope->sync();
         QList<QDate> result;
         QSet<QString> used;
+        const bool filter = regex.isValid() && !regex.pattern().isEmpty();
 
         QDir accountDir = scope->getAccountDir(contact);
-        QStringList filters = QStringList() << JsonHistory::quote(contact.contact) + QStringLiteral(".*");
+        QStringList filters = QStringList() << JsonHistory::quote(contact.contact) + QStringLiteral(".*.json");
         QStringList filesNames = accountDir.entryList(filters, QDir::Files | QDir::NoDotAndDotDot, QDir::Name);
 
         foreach (const QString &fileName, filesNames) {
@@ -425,6 +676,9 @@ AsyncResult<QList<QDate>> JsonHistory::months(const ContactInfo &contact, const
                 continue;
             used.insert(date);
 
+            if (filter && !scope->matchingDays(accountDir.filePath(fileName), regex, true))
+                continue;
+
             int year = date.mid(0, 4).toInt();
             int month = date.mid(4, 2).toInt();
 
@@ -445,58 +699,16 @@ AsyncResult<QList<QDate>> JsonHistory::dates(const ContactInfo &contact, const Q
 
     auto scope = m_scope;
     runJob([handler, scope, contact, month, regex] () {
-        QSet<QDate> result;
-
-        QFile file(scope->getFileName(contact, month));
-        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            handler.handle(result.toList());
-            return;
-        }
-
-        int len = file.size();
-        QByteArray data;
-        const uchar *fmap = file.map(0, file.size());
-        if (!fmap) {
-            data = file.readAll();
-            fmap = (uchar *)data.constData();
-        }
-        const uchar *s = Json::skipBlanks(fmap, &len);
-        QVariant val;
-        uchar qch = *s;
-        if (!s || (qch != '[' && qch != '{'))
-            return;
-        qch = (qch == '{' ? '}' : ']');
-        s++;
-        len--;
-        bool first = true;
-        while (s) {
-            val.clear();
-            s = Json::skipBlanks(s, &len);
-            if (len < 2 || (s && *s == qch))
-                break;
-            if ((!first && *s != ',') || (first && *s == ','))
-                break;
-            first = false;
-            if (*s == ',') {
-                s++;
-                len--;
-            }
-            if (!(s = Json::parseRecord(val, s, &len))) {
-                break;
-            } else {
-                const QVariantMap message = val.toMap();
-                const QDate date = QDateTime::fromString(message.value("datetime").toString(), Qt::ISODate).date();
-                const QString text = message.value("text").toString();
+        scope->sync();
+        QList<QDate> result;
 
-                if (!regex.isValid() || text.contains(regex))
-                    result.insert(date);
-            }
+        const quint32 days = scope->matchingDays(scope->getFileName(contact, month), regex, false);
+        for (int day = 1; day <= month.daysInMonth(); ++day) {
+            if (days & (1u << (day - 1)))
+                result << QDate(month.year(), month.month(), day);
         }
 
-        QList<QDate> sortedResult = result.toList();
-        std::sort(sortedResult.begin(), sortedResult.end());
-
-        handler.handle(sortedResult);
+        handler.handle(result);
     });
 
     return handler.result();
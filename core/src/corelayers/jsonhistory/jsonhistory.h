@@ -28,16 +28,23 @@
 
 #include <qutim/history.h>
 #include <QRunnable>
+#include <QThread>
 #include <QDir>
-#include <QLinkedList>
 #include <QPointer>
 #include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QCache>
+#include <QScopedPointer>
 
 using namespace qutim_sdk_0_3;
 
 namespace Core
 {
 class HistoryWindow;
+class JsonHistoryIndex;
+class JsonHistoryWordIndex;
+class JsonHistoryTailCache;
 
 class JsonHistoryScope
 {
@@ -48,6 +55,10 @@ public:
     QString getFileName(const Message &message) const;
     QString getFileName(const History::ContactInfo &info, const QDate &time) const;
     QDir getAccountDir(const History::AccountInfo &info) const;
+    // Must be called with locked fileMutex
+    quint32 candidateDays(const QString &fileName, const uchar *data,
+                          const JsonHistoryIndex &index, const QString &literal);
+    quint32 matchingDays(const QString &fileName, const QRegularExpression &regex, bool firstOnly);
 
     struct EndValue
     {
@@ -57,20 +68,57 @@ public:
     };
 
     typedef QHash<QString, EndValue> EndCache;
-    bool hasRunnable;
+    typedef QList<QPair<History::ContactInfo, Message>> Queue;
+    // Blocks until all already queued messages are written
+    void sync();
+    MessageList readFiles(const History::ContactInfo &info, const QDateTime &from,
+                          const QDateTime &to, int max_num);
+
     EndCache cache;
-    QLinkedList<QPair<History::ContactInfo, Message>> queue;
+    // Guards the queue of messages and the writer's state
     QMutex mutex;
+    Queue queue;
+    QWaitCondition wakeUp;
+    QWaitCondition written;
+    quint64 queuedCount;
+    quint64 writtenCount;
+    bool syncRequested;
+    bool stopped;
+    // Guards json files and their indexes against concurrent append and rebuild
+    QMutex fileMutex;
+    QCache<QString, JsonHistoryWordIndex> words;
+    QScopedPointer<JsonHistoryTailCache> tails;
 };
 
-class JsonHistoryStoreJob : public QRunnable
+class JsonHistoryWriter : public QThread
 {
 public:
-    JsonHistoryStoreJob(JsonHistoryScope::Ptr scope);
+    JsonHistoryWriter(JsonHistoryScope::Ptr scope, int flushInterval, int flushSize);
+
+    void enqueue(const History::ContactInfo &contact, const Message &message);
+    void stop();
+
+protected:
     void run() override;
-	
+
 private:
+    typedef JsonHistoryScope::Queue Queue;
+
+    void writeQueue(const Queue &queue);
+    void writeFile(const QString &fileName, const MessageList &messages);
+    void reportStatistics(int queueDepth);
+
     JsonHistoryScope::Ptr d;
+    // Open handles of recently written files, so a burst doesn't reopen them per batch
+    QCache<QString, QFile> m_files;
+    int m_flushInterval;
+    int m_flushSize;
+
+    // Statistics, used only by the writer thread
+    QElapsedTimer m_statisticsTimer;
+    quint64 m_statisticsMessages;
+    quint64 m_statisticsBytes;
+    int m_maxQueueDepth;
 };
 
 class JsonHistoryJob : public QRunnable
@@ -105,6 +153,7 @@ private slots:
 	void onHistoryActionTriggered(QObject *object);
 private:
     JsonHistoryScope::Ptr m_scope;
+    JsonHistoryWriter *m_writer;
 	QPointer<HistoryWindow> m_historyWindow;
 };
 }
@@ -0,0 +1,295 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "jsonhistoryindex.h"
+#include <qutim/json.h>
+#include <qutim/debug.h>
+#include <QFile>
+#include <QDateTime>
+#include <QtEndian>
+#include <algorithm>
+
+using namespace qutim_sdk_0_3;
+
+namespace Core
+{
+enum
+{
+    IndexVersion = 1,
+    HeaderSize = 8,
+    EntrySize = 16
+};
+
+static const char indexMagic[] = "QJHI";
+
+JsonHistoryIndex::JsonHistoryIndex(const QString &jsonFileName)
+    : m_fileName(indexFileName(jsonFileName)), m_sorted(true)
+{
+}
+
+QString JsonHistoryIndex::indexFileName(const QString &jsonFileName)
+{
+    QString fileName = jsonFileName;
+    if (fileName.endsWith(QLatin1String(".json")))
+        fileName.chop(5);
+    fileName += QLatin1String(".idx");
+    return fileName;
+}
+
+qint64 JsonHistoryIndex::timeFromString(const QString &time)
+{
+    QDateTime dateTime = QDateTime::fromString(time, Qt::ISODate);
+    return dateTime.isValid() ? dateTime.toMSecsSinceEpoch() : 0;
+}
+
+int JsonHistoryIndex::day(const Entry &entry)
+{
+    return QDateTime::fromMSecsSinceEpoch(entry.time).date().day();
+}
+
+QVariantMap JsonHistoryIndex::record(const uchar *data, uint size, const Entry &entry)
+{
+    QVariant value;
+    int len = size - entry.offset;
+    Json::parseRecord(value, data + entry.offset, &len);
+    return value.toMap();
+}
+
+static bool findField(Json::Reader &reader, const char *name)
+{
+    if (reader.next() != Json::Reader::BeginObject)
+        return false;
+    while (reader.next() == Json::Reader::Key) {
+        const bool found = reader.keyEquals(name);
+        reader.next();
+        if (found)
+            return true;
+        if (!reader.skipValue())
+            return false;
+    }
+    return false;
+}
+
+QString JsonHistoryIndex::field(const uchar *data, const Entry &entry, const char *name)
+{
+    Json::Reader reader;
+    return field(reader, data, entry, name);
+}
+
+QString JsonHistoryIndex::field(Json::Reader &reader, const uchar *data, const Entry &entry, const char *name)
+{
+    reader.reset(data + entry.offset, entry.length);
+    return findField(reader, name) ? reader.toString() : QString();
+}
+
+bool JsonHistoryIndex::load(const uchar *data, uint size)
+{
+    if (read() && isValid(data, size))
+        return true;
+    qDebug() << "Rebuilding history index" << m_fileName;
+    return rebuild(data, size);
+}
+
+bool JsonHistoryIndex::reset()
+{
+    m_entries.clear();
+    m_sorted = true;
+    return write();
+}
+
+bool JsonHistoryIndex::append(const QVector<Entry> &entries)
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+    // Index without header will be rebuilt from the json file on next load
+    if (file.size() < HeaderSize)
+        return false;
+
+    QByteArray data(entries.size() * EntrySize, Qt::Uninitialized);
+    uchar *s = reinterpret_cast<uchar *>(data.data());
+    foreach (const Entry &entry, entries) {
+        if (!m_entries.isEmpty() && m_entries.last().time > entry.time)
+            m_sorted = false;
+        m_entries << entry;
+        qToLittleEndian<qint64>(entry.time, s);
+        qToLittleEndian<quint32>(entry.offset, s + 8);
+        qToLittleEndian<quint32>(entry.length, s + 12);
+        s += EntrySize;
+    }
+    return file.write(data) == data.size();
+}
+
+uint JsonHistoryIndex::end() const
+{
+    if (m_entries.isEmpty())
+        return 0;
+    const Entry &last = m_entries.last();
+    return last.offset + last.length;
+}
+
+int JsonHistoryIndex::lowerBound(qint64 time) const
+{
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), time,
+                               [] (const Entry &entry, qint64 time) {
+        return entry.time < time;
+    });
+    return it - m_entries.begin();
+}
+
+bool JsonHistoryIndex::read()
+{
+    m_entries.clear();
+    m_sorted = true;
+
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QByteArray data = file.readAll();
+    const uchar *s = reinterpret_cast<const uchar *>(data.constData());
+    if (data.size() < HeaderSize
+            || qstrncmp(data.constData(), indexMagic, 4) != 0
+            || qFromLittleEndian<quint32>(s + 4) != IndexVersion
+            || (data.size() - HeaderSize) % EntrySize != 0) {
+        return false;
+    }
+
+    const int count = (data.size() - HeaderSize) / EntrySize;
+    m_entries.resize(count);
+    s += HeaderSize;
+    for (int i = 0; i < count; ++i, s += EntrySize) {
+        Entry &entry = m_entries[i];
+        entry.time = qFromLittleEndian<qint64>(s);
+        entry.offset = qFromLittleEndian<quint32>(s + 8);
+        entry.length = qFromLittleEndian<quint32>(s + 12);
+        if (i > 0 && m_entries[i - 1].time > entry.time)
+            m_sorted = false;
+    }
+    return true;
+}
+
+bool JsonHistoryIndex::isValid(const uchar *data, uint size) const
+{
+    int len = size;
+    const uchar *s = Json::skipBlanks(data, &len);
+    if (!s || *s != '[')
+        return false;
+    ++s;
+    --len;
+    if (!m_entries.isEmpty()) {
+        // Both the first and the last records must be exactly where we expect them
+        s = Json::skipBlanks(s, &len);
+        const uint end = this->end();
+        if (!s || uint(s - data) != m_entries.first().offset
+                || end > size
+                || data[end - m_entries.last().length] != '{'
+                || data[end - 1] != '}') {
+            return false;
+        }
+        s = data + end;
+        len = size - end;
+    }
+    // Everything after the last indexed record must be the closing bracket
+    s = Json::skipBlanks(s, &len);
+    if (!s || len < 1 || *s != ']')
+        return false;
+    ++s;
+    --len;
+    while (len > 0 && *s <= ' ') {
+        ++s;
+        --len;
+    }
+    return len == 0;
+}
+
+bool JsonHistoryIndex::rebuild(const uchar *data, uint size)
+{
+    m_entries.clear();
+    m_sorted = true;
+
+    int len = size;
+    const uchar *s = Json::skipBlanks(data, &len);
+    if (!s || *s != '[')
+        return false;
+    s++;
+    len--;
+    bool first = true;
+    Json::Reader reader;
+    while (s) {
+        s = Json::skipBlanks(s, &len);
+        if (!s || len < 2 || *s == ']')
+            break;
+        if ((!first && *s != ',') || (first && *s == ','))
+            break;
+        first = false;
+        if (*s == ',') {
+            s++;
+            len--;
+            s = Json::skipBlanks(s, &len);
+            if (!s)
+                break;
+        }
+        const uchar *record = s;
+        if (!(s = Json::skipRecord(s, &len)))
+            break;
+        const uchar *recordEnd = s;
+        while (recordEnd > record && recordEnd[-1] <= ' ')
+            --recordEnd;
+
+        Entry entry;
+        entry.offset = record - data;
+        entry.length = recordEnd - record;
+        entry.time = timeFromString(field(reader, data, entry, "datetime"));
+        if (!m_entries.isEmpty() && m_entries.last().time > entry.time)
+            m_sorted = false;
+        m_entries << entry;
+    }
+
+    if (!write())
+        qWarning() << "Can't write history index" << m_fileName;
+    return true;
+}
+
+bool JsonHistoryIndex::write() const
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QByteArray data(HeaderSize + m_entries.size() * EntrySize, Qt::Uninitialized);
+    uchar *s = reinterpret_cast<uchar *>(data.data());
+    memcpy(s, indexMagic, 4);
+    qToLittleEndian<quint32>(IndexVersion, s + 4);
+    s += HeaderSize;
+    foreach (const Entry &entry, m_entries) {
+        qToLittleEndian<qint64>(entry.time, s);
+        qToLittleEndian<quint32>(entry.offset, s + 8);
+        qToLittleEndian<quint32>(entry.length, s + 12);
+        s += EntrySize;
+    }
+    return file.write(data) == data.size();
+}
+
+}
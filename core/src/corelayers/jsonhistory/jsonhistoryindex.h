@@ -0,0 +1,99 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef JSONHISTORYINDEX_H
+#define JSONHISTORYINDEX_H
+
+#include <QString>
+#include <QVector>
+#include <QVariantMap>
+
+namespace qutim_sdk_0_3
+{
+namespace Json
+{
+class Reader;
+}
+}
+
+namespace Core
+{
+
+/*
+ * Every month file "<contact>.yyyyMM.json" is an append-only list of records,
+ * so we keep a sidecar "<contact>.yyyyMM.idx" with one fixed-size entry per
+ * record: message time and the record position inside of the json file.
+ * It lets read() seek directly to the needed messages without decoding
+ * the whole month. Absent or outdated indexes are rebuilt from the json file.
+ */
+class JsonHistoryIndex
+{
+public:
+    struct Entry
+    {
+        qint64 time;
+        quint32 offset;
+        quint32 length;
+    };
+
+    JsonHistoryIndex(const QString &jsonFileName);
+
+    static QString indexFileName(const QString &jsonFileName);
+    static qint64 timeFromString(const QString &time);
+    static int day(const Entry &entry);
+    static QVariantMap record(const uchar *data, uint size, const Entry &entry);
+    // Extracts single string field of the record without decoding the rest of it
+    static QString field(const uchar *data, const Entry &entry, const char *name);
+    // Same, reader is reused between records of one scan
+    static QString field(qutim_sdk_0_3::Json::Reader &reader, const uchar *data,
+                         const Entry &entry, const char *name);
+
+    // Loads index for json data, rebuilds it if it doesn't match the data
+    bool load(const uchar *data, uint size);
+    // Creates empty index for a new json file
+    bool reset();
+    bool append(const QVector<Entry> &entries);
+
+    const QVector<Entry> &entries() const { return m_entries; }
+    bool isSorted() const { return m_sorted; }
+    // Position right after the last record, 0 if there are no records
+    uint end() const;
+    // First entry with time not less than the given one, valid only for sorted indexes
+    int lowerBound(qint64 time) const;
+
+private:
+    bool read();
+    bool isValid(const uchar *data, uint size) const;
+    bool rebuild(const uchar *data, uint size);
+    bool write() const;
+
+    QString m_fileName;
+    QVector<Entry> m_entries;
+    bool m_sorted;
+};
+
+}
+
+#endif // JSONHISTORYINDEX_H
@@ -0,0 +1,178 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "jsonhistorytailcache.h"
+#include <qutim/debug.h>
+#include <qutim/json.h>
+#include <QStringBuilder>
+#include <algorithm>
+
+namespace Core
+{
+
+enum { StatisticsPeriod = 100 };
+
+JsonHistoryTailCache::JsonHistoryTailCache(int maxMessages, int maxCost)
+    : m_maxMessages(maxMessages)
+{
+    m_tails.setMaxCost(maxCost);
+}
+
+Message JsonHistoryTailCache::toStored(const Message &message)
+{
+    // Only dynamic properties, time with seconds precision, direction, text and html survive
+    Message result;
+    QByteArray data;
+    foreach (const QByteArray &name, message.dynamicPropertyNames()) {
+        const QVariant value = message.property(name);
+        data.clear();
+        if (Json::generate(data, value, 2))
+            result.setProperty(name, value);
+    }
+    QDateTime time = message.time();
+    result.setTime(time.addMSecs(-time.time().msec()));
+    result.setIncoming(message.isIncoming());
+    result.setText(message.text());
+    result.setHtml(message.html());
+    return result;
+}
+
+void JsonHistoryTailCache::append(const History::ContactInfo &contact, const Message &message)
+{
+    QMutexLocker locker(&m_mutex);
+    const QString key = JsonHistoryTailCache::key(contact);
+    Tail *tail = m_tails.take(key);
+    if (!tail)
+        return;
+
+    const Message stored = toStored(message);
+    MessageList &messages = tail->messages;
+    if (!messages.isEmpty() && stored.time() < messages.last().time()) {
+        // Messages are appended to the file as they come, but are read by time. Tail can't
+        // tell whether it has all messages before its first one, so then the index is used
+        if (!tail->complete && stored.time() < messages.first().time()) {
+            delete tail;
+            return;
+        }
+        const auto position = std::upper_bound(messages.begin(), messages.end(), stored,
+                                               [] (const Message &a, const Message &b) {
+            return a.time() < b.time();
+        });
+        messages.insert(position, stored);
+    } else {
+        messages << stored;
+    }
+    tail->cost += cost(stored);
+    while (tail->messages.size() > m_maxMessages) {
+        tail->cost -= cost(tail->messages.takeFirst());
+        tail->complete = false;
+    }
+    insert(key, tail);
+}
+
+bool JsonHistoryTailCache::read(const History::ContactInfo &contact, const QDateTime &from,
+                                const QDateTime &to, int maxCount, MessageList *result)
+{
+    QMutexLocker locker(&m_mutex);
+    Tail *tail = m_tails.object(key(contact));
+    bool covered = false;
+    if (tail) {
+        int last = tail->messages.size();
+        int first = last;
+        covered = tail->complete;
+        while (first > 0) {
+            const QDateTime &time = tail->messages.at(first - 1).time();
+            if (to.isValid() && time >= to) {
+                last = --first;
+                continue;
+            }
+            if (from.isValid() && time < from) {
+                covered = true;
+                break;
+            }
+            if (maxCount != -1 && last - first >= maxCount) {
+                covered = true;
+                break;
+            }
+            --first;
+        }
+        if (maxCount != -1 && last - first >= maxCount)
+            covered = true;
+        if (covered)
+            *result = tail->messages.mid(first, last - first);
+    }
+    locker.unlock();
+
+    (covered ? m_hits : m_misses).ref();
+    reportStatistics();
+    return covered;
+}
+
+void JsonHistoryTailCache::fill(const History::ContactInfo &contact, const MessageList &messages,
+                                bool complete, const std::function<bool ()> &isActual)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!isActual())
+        return;
+
+    Tail *tail = new Tail;
+    tail->messages = messages.mid(qMax(0, messages.size() - m_maxMessages));
+    tail->complete = complete && tail->messages.size() == messages.size();
+    tail->cost = 0;
+    foreach (const Message &message, tail->messages)
+        tail->cost += cost(message);
+    insert(key(contact), tail);
+}
+
+QString JsonHistoryTailCache::key(const History::ContactInfo &contact)
+{
+    return contact.protocol % QLatin1Char('\n')
+            % contact.account % QLatin1Char('\n')
+            % contact.contact;
+}
+
+int JsonHistoryTailCache::cost(const Message &message)
+{
+    return int(sizeof(Message)) + (message.text().size() + message.html().size()) * int(sizeof(QChar));
+}
+
+void JsonHistoryTailCache::insert(const QString &key, Tail *tail)
+{
+    // QCache rejects and deletes too expensive objects on its own
+    m_tails.insert(key, tail, qMax(1, tail->cost));
+}
+
+void JsonHistoryTailCache::reportStatistics()
+{
+    const int hits = m_hits.load();
+    const int misses = m_misses.load();
+    if ((hits + misses) % StatisticsPeriod != 0)
+        return;
+    QMutexLocker locker(&m_mutex);
+    qDebug() << "Tail cache:" << hits << "hits," << misses << "misses,"
+             << m_tails.totalCost() << "bytes in" << m_tails.count() << "contacts";
+}
+
+}
@@ -0,0 +1,85 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef JSONHISTORYTAILCACHE_H
+#define JSONHISTORYTAILCACHE_H
+
+#include <qutim/history.h>
+#include <QCache>
+#include <QMutex>
+#include <QAtomicInt>
+#include <functional>
+
+using namespace qutim_sdk_0_3;
+
+namespace Core
+{
+
+/*
+ * LRU cache of the newest messages of recently used contacts, so reopening
+ * of a chat doesn't touch the disk at all. Tails are created by the first
+ * read of the newest messages and then are kept up to date by store().
+ * Cost of every tail is an approximate size of its messages in bytes.
+ */
+class JsonHistoryTailCache
+{
+public:
+    JsonHistoryTailCache(int maxMessages, int maxCost);
+
+    // Message must be in the same form as it's stored to disk
+    static Message toStored(const Message &message);
+
+    // Keeps the tail sorted by time, drops it if the message is older than all of an incomplete one
+    void append(const History::ContactInfo &contact, const Message &message);
+    bool read(const History::ContactInfo &contact, const QDateTime &from, const QDateTime &to,
+              int maxCount, MessageList *result);
+    // Messages must be the newest ones, isActual is checked under the cache lock
+    void fill(const History::ContactInfo &contact, const MessageList &messages, bool complete,
+              const std::function<bool ()> &isActual);
+
+private:
+    struct Tail
+    {
+        MessageList messages;
+        // Tail contains the whole history of the contact
+        bool complete;
+        int cost;
+    };
+
+    static QString key(const History::ContactInfo &contact);
+    static int cost(const Message &message);
+    void insert(const QString &key, Tail *tail);
+    void reportStatistics();
+
+    QMutex m_mutex;
+    QCache<QString, Tail> m_tails;
+    int m_maxMessages;
+    QAtomicInt m_hits;
+    QAtomicInt m_misses;
+};
+
+}
+
+#endif // JSONHISTORYTAILCACHE_H
@@ -0,0 +1,191 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "jsonhistorywordindex.h"
+#include "jsonhistoryindex.h"
+#include <qutim/json.h>
+#include <QFile>
+#include <QStringList>
+
+using namespace qutim_sdk_0_3;
+
+namespace Core
+{
+
+enum { TrigramSize = 3 };
+
+template <typename Handler>
+static void forEachTrigram(const QString &text, Handler handler)
+{
+    const QString lower = text.toLower();
+    int start = 0;
+    for (int i = 0; i <= lower.size(); ++i) {
+        if (i < lower.size() && lower.at(i).isLetterOrNumber())
+            continue;
+        for (int j = start; j + TrigramSize <= i; ++j)
+            handler(lower.mid(j, TrigramSize));
+        start = i + 1;
+    }
+}
+
+JsonHistoryWordIndex::JsonHistoryWordIndex(const QString &jsonFileName)
+    : m_fileName(wordsFileName(jsonFileName)), m_end(0)
+{
+}
+
+QString JsonHistoryWordIndex::wordsFileName(const QString &jsonFileName)
+{
+    QString fileName = jsonFileName;
+    if (fileName.endsWith(QLatin1String(".json")))
+        fileName.chop(5);
+    fileName += QLatin1String(".words");
+    return fileName;
+}
+
+bool JsonHistoryWordIndex::literalFromPattern(const QString &pattern, QString *literal)
+{
+    static const QString special = QStringLiteral("()[]{}.*+?^$|");
+    const bool group = pattern.startsWith(QLatin1Char('('));
+    literal->clear();
+    for (int i = group ? 1 : 0; i < pattern.size(); ++i) {
+        QChar ch = pattern.at(i);
+        if (ch == QLatin1Char('\\')) {
+            if (++i >= pattern.size())
+                return false;
+            ch = pattern.at(i);
+            // Escaped latin letters and digits are character classes or back references
+            if (ch.unicode() < 0x80 && ch.isLetterOrNumber())
+                return false;
+            literal->append(ch);
+        } else if (group && ch == QLatin1Char(')') && i == pattern.size() - 1) {
+            return true;
+        } else if (special.contains(ch)) {
+            return false;
+        } else {
+            literal->append(ch);
+        }
+    }
+    return !group;
+}
+
+bool JsonHistoryWordIndex::load(uint end)
+{
+    m_days.clear();
+    m_pending.clear();
+    m_end = 0;
+
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    bool hasMarker = false;
+    bool hasTail = false;
+    uint marker = 0;
+    const QByteArray data = file.readAll();
+    foreach (const QByteArray &line, data.split('\n')) {
+        if (line.isEmpty())
+            continue;
+        if (line.at(0) == '#') {
+            marker = line.mid(1).toUInt(&hasMarker);
+            hasTail = false;
+            continue;
+        }
+        const int space = line.indexOf(' ');
+        const int day = space > 0 ? line.left(space).toInt() : 0;
+        if (day < 1 || day > 31)
+            return false;
+        m_days[QString::fromUtf8(line.mid(space + 1))] |= 1u << (day - 1);
+        hasTail = true;
+    }
+
+    // Postings without a marker are left from an interrupted write
+    if (!hasMarker || hasTail || marker != end) {
+        m_days.clear();
+        return false;
+    }
+    m_end = end;
+    return true;
+}
+
+bool JsonHistoryWordIndex::rebuild(const uchar *data, const JsonHistoryIndex &index)
+{
+    if (!reset())
+        return false;
+    Json::Reader reader;
+    foreach (const JsonHistoryIndex::Entry &entry, index.entries())
+        add(JsonHistoryIndex::day(entry), JsonHistoryIndex::field(reader, data, entry, "text"));
+    return flush(index.end());
+}
+
+bool JsonHistoryWordIndex::reset()
+{
+    m_days.clear();
+    m_pending.clear();
+    m_end = 0;
+    QFile file(m_fileName);
+    return file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+}
+
+void JsonHistoryWordIndex::add(int day, const QString &text)
+{
+    if (day < 1 || day > 31)
+        return;
+    const quint32 bit = 1u << (day - 1);
+    const QByteArray prefix = QByteArray::number(day) + ' ';
+    forEachTrigram(text, [this, bit, &prefix] (const QString &trigram) {
+        quint32 &mask = m_days[trigram];
+        if (mask & bit)
+            return;
+        mask |= bit;
+        m_pending += prefix;
+        m_pending += trigram.toUtf8();
+        m_pending += '\n';
+    });
+}
+
+bool JsonHistoryWordIndex::flush(uint end)
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+    m_pending += '#';
+    m_pending += QByteArray::number(end);
+    m_pending += '\n';
+    const bool ok = file.write(m_pending) == m_pending.size();
+    m_pending.clear();
+    m_end = end;
+    return ok;
+}
+
+quint32 JsonHistoryWordIndex::days(const QString &literal) const
+{
+    quint32 result = ~0u;
+    forEachTrigram(literal, [this, &result] (const QString &trigram) {
+        result &= m_days.value(trigram);
+    });
+    return result;
+}
+
+}
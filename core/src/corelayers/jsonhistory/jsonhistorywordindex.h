@@ -0,0 +1,77 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef JSONHISTORYWORDINDEX_H
+#define JSONHISTORYWORDINDEX_H
+
+#include <QString>
+#include <QHash>
+#include <QByteArray>
+
+namespace Core
+{
+class JsonHistoryIndex;
+
+/*
+ * Inverted index of a month file "<contact>.yyyyMM.json", stored next to it
+ * as "<contact>.yyyyMM.words". It maps lower-cased character trigrams of
+ * message texts to bit masks of days they were used at, so search can check
+ * only the days which may contain the searched substring.
+ *
+ * The file is append-only: every posting is a "<day> <trigram>" line and
+ * every stored batch ends with a "#<end>" line, where end is the position
+ * after the last indexed json record. Index with another end is outdated.
+ */
+class JsonHistoryWordIndex
+{
+public:
+    JsonHistoryWordIndex(const QString &jsonFileName);
+
+    static QString wordsFileName(const QString &jsonFileName);
+    // Extracts literal text from patterns like "(word)" produced by QRegularExpression::escape
+    static bool literalFromPattern(const QString &pattern, QString *literal);
+
+    bool load(uint end);
+    bool rebuild(const uchar *data, const JsonHistoryIndex &index);
+    bool reset();
+
+    void add(int day, const QString &text);
+    bool flush(uint end);
+
+    // Bit mask of days which may contain the literal, bit 0 is the first day
+    quint32 days(const QString &literal) const;
+    uint end() const { return m_end; }
+    int cost() const { return m_days.size() + 1; }
+
+private:
+    QString m_fileName;
+    QHash<QString, quint32> m_days;
+    QByteArray m_pending;
+    uint m_end;
+};
+
+}
+
+#endif // JSONHISTORYWORDINDEX_H
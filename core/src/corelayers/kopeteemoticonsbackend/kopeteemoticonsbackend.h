@@ -32,6 +32,8 @@ using namespace qutim_sdk_0_3;
 class KopeteEmoticonsBackend : public EmoticonsBackend
 {
 	Q_OBJECT
+	// It only reads theme files
+	Q_CLASSINFO("ThreadSafe", "yes")
 public:
     virtual EmoticonsProvider* loadTheme(const QString& name);
     virtual QStringList themeList();	
@@ -122,9 +122,6 @@ void ModuleManagerImpl::initExtensions()
 	QSslSocket::addDefaultCaCertificates(path, QSsl::Pem, QRegExp::Wildcard);
 	
 	ModuleManager::initExtensions();
-
-	NotificationRequest request(Notification::AppStartup);
-	request.send();
 }
 }
 
@@ -0,0 +1,177 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+#include "tests.h"
+#include <qutim/asyncresult.h>
+#include <QtTest>
+#include <QThread>
+
+using namespace qutim_sdk_0_3;
+
+typedef AsyncResult<int, QString> TestResult;
+typedef AsyncResultHandler<int, QString> TestHandler;
+
+// Handles the result from its own thread
+class HandlerThread : public QThread
+{
+public:
+	HandlerThread(const TestHandler &handler) : m_handler(handler) {}
+
+protected:
+	void run()
+	{
+		m_handler.handle(42, QLatin1String("thread"));
+	}
+
+private:
+	TestHandler m_handler;
+};
+
+class AsyncResultTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void ready();
+	void pending();
+	void handledOnce();
+	void context();
+	void thread();
+	void inlineResults();
+	void queuedResults();
+};
+
+void AsyncResultTest::ready()
+{
+	int value = 0;
+	TestResult result = makeAsyncResult(1, QString(QLatin1String("one")));
+	result.connect([&value] (int number, const QString &) { value += number; }, AsyncInlineConnection);
+	QCOMPARE(value, 1);
+
+	// Queued callbacks are called from the event loop even if the result is known
+	result.connect([&value] (int number, const QString &) { value += number * 10; });
+	QCOMPARE(value, 1);
+	QTRY_COMPARE(value, 11);
+}
+
+void AsyncResultTest::pending()
+{
+	TestHandler handler;
+	TestResult result = handler.result();
+	QString text;
+	result.connect([&text] (int, const QString &value) { text = value; }, AsyncInlineConnection);
+	QVERIFY(text.isEmpty());
+
+	// Callbacks waiting for the result are always queued
+	handler.handle(2, QLatin1String("two"));
+	QVERIFY(text.isEmpty());
+	QTRY_COMPARE(text, QLatin1String("two"));
+
+	// Result may be connected to after it's handled
+	QString late;
+	result.connect([&late] (int, const QString &value) { late = value; }, AsyncInlineConnection);
+	QCOMPARE(late, QLatin1String("two"));
+}
+
+void AsyncResultTest::handledOnce()
+{
+	TestHandler handler;
+	int calls = 0;
+	int value = 0;
+	handler.result().connect([&] (int number, const QString &) { ++calls; value = number; });
+	handler.handle(1, QString());
+	QTest::ignoreMessage(QtWarningMsg, "AsyncResult is already handled");
+	handler.handle(2, QString());
+	QTRY_COMPARE(calls, 1);
+	QCoreApplication::processEvents();
+	QCOMPARE(calls, 1);
+	QCOMPARE(value, 1);
+}
+
+void AsyncResultTest::context()
+{
+	TestHandler handler;
+	QScopedPointer<QObject> object(new QObject);
+	bool called = false;
+	bool guarded = false;
+	handler.result().connect(object.data(), [&guarded] (int, const QString &) { guarded = true; });
+	handler.result().connect([&called] (int, const QString &) { called = true; });
+	handler.handle(3, QString());
+	object.reset();
+	QTRY_VERIFY(called);
+	QVERIFY(!guarded);
+}
+
+void AsyncResultTest::thread()
+{
+	TestHandler handler;
+	QThread *callbackThread = 0;
+	int value = 0;
+	handler.result().connect([&] (int number, const QString &) {
+		callbackThread = QThread::currentThread();
+		value = number;
+	});
+	HandlerThread thread(handler);
+	thread.start();
+	QVERIFY(thread.wait(5000));
+
+	// Callbacks are called in the thread the result was created in
+	QTRY_COMPARE(value, 42);
+	QCOMPARE(callbackThread, QThread::currentThread());
+}
+
+// Results known at once, as most of message handlers return them
+void AsyncResultTest::inlineResults()
+{
+	int sum = 0;
+	QBENCHMARK {
+		for (int i = 0; i < 10000; ++i) {
+			makeAsyncResult(i, QString()).connect([&sum] (int number, const QString &) {
+				sum += number;
+			}, AsyncInlineConnection);
+		}
+	}
+	QVERIFY(sum > 0);
+}
+
+void AsyncResultTest::queuedResults()
+{
+	int calls = 0;
+	QBENCHMARK {
+		for (int i = 0; i < 10000; ++i) {
+			TestHandler handler;
+			handler.result().connect([&calls] (int, const QString &) { ++calls; });
+			handler.handle(i, QString());
+		}
+		QCoreApplication::processEvents();
+	}
+	QVERIFY(calls > 0);
+}
+
+int testAsyncResult(int argc, char *argv[])
+{
+	AsyncResultTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "asyncresulttest.moc"
@@ -0,0 +1,182 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+#include "tests.h"
+#include <qutim/config.h>
+#include <QtTest>
+
+using namespace qutim_sdk_0_3;
+
+// Keeps the config in memory, so the test doesn't depend on any backend plugin
+class MemoryConfigBackend : public ConfigBackend
+{
+	Q_OBJECT
+	Q_CLASSINFO("Extension", "mem")
+public:
+	QVariant load(const QString &file)
+	{
+		Q_UNUSED(file);
+		return QVariantMap();
+	}
+	void save(const QString &file, const QVariant &entry)
+	{
+		Q_UNUSED(file);
+		Q_UNUSED(entry);
+	}
+};
+
+class ConfigTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void nestedFirst();
+	void siblings();
+	void guard();
+	void setValue_data();
+	void setValue();
+private:
+	Config config(const QString &name);
+
+	QTemporaryDir m_dir;
+	// Config sources may outlive the test object, so backend is never deleted
+	ConfigBackend *m_backend;
+};
+
+void ConfigTest::initTestCase()
+{
+	QVERIFY(m_dir.isValid());
+	m_backend = new MemoryConfigBackend;
+}
+
+Config ConfigTest::config(const QString &name)
+{
+	return Config(m_dir.path() + QLatin1Char('/') + name + QLatin1String(".mem"), m_backend);
+}
+
+void ConfigTest::nestedFirst()
+{
+	Config cfg = config(QLatin1String("nested"));
+	QObject guard;
+	QStringList calls;
+	QVariant keyValue;
+	QVariant groupValue;
+	cfg.listen(QLatin1String("group"), &guard, [&] (const QVariant &value) {
+		calls << QLatin1String("group");
+		groupValue = value;
+	});
+	cfg.listen(QLatin1String("group/key"), &guard, [&] (const QVariant &value) {
+		calls << QLatin1String("group/key");
+		keyValue = value;
+	});
+
+	cfg.setValue(QLatin1String("group/key"), 1);
+	cfg.setValue(QLatin1String("group/key"), 2);
+	QVERIFY(calls.isEmpty());
+	QCoreApplication::processEvents();
+
+	// Changes are coalesced, listeners of nested paths are notified first
+	QCOMPARE(calls, QStringList() << QLatin1String("group/key") << QLatin1String("group"));
+	QCOMPARE(keyValue.toInt(), 2);
+	QCOMPARE(groupValue.toMap().value(QLatin1String("key")).toInt(), 2);
+}
+
+void ConfigTest::siblings()
+{
+	Config cfg = config(QLatin1String("siblings"));
+	QObject guard;
+	int first = 0;
+	int second = 0;
+	cfg.listen(QLatin1String("group/first"), &guard, [&] (const QVariant &) { ++first; });
+	cfg.listen(QLatin1String("group/second"), &guard, [&] (const QVariant &) { ++second; });
+
+	cfg.setValue(QLatin1String("group/first"), QLatin1String("value"));
+	QCoreApplication::processEvents();
+	QCOMPARE(first, 1);
+	QCOMPARE(second, 0);
+
+	// Removed value is looked up through the config again
+	QVariant removed = QLatin1String("not called");
+	cfg.listen(QLatin1String("group/first"), &guard, [&] (const QVariant &value) { removed = value; });
+	Config group = cfg.group(QLatin1String("group"));
+	group.remove(QLatin1String("first"));
+	QCoreApplication::processEvents();
+	QCOMPARE(first, 2);
+	QCOMPARE(second, 0);
+	QVERIFY(!removed.isValid());
+}
+
+void ConfigTest::guard()
+{
+	Config cfg = config(QLatin1String("guard"));
+	QScopedPointer<QObject> guard(new QObject);
+	int calls = 0;
+	cfg.listen(QLatin1String("key"), guard.data(), [&] (const QVariant &) { ++calls; });
+
+	cfg.setValue(QLatin1String("key"), 1);
+	QCoreApplication::processEvents();
+	QCOMPARE(calls, 1);
+
+	guard.reset();
+	cfg.setValue(QLatin1String("key"), 2);
+	QCoreApplication::processEvents();
+	QCOMPARE(calls, 1);
+}
+
+void ConfigTest::setValue_data()
+{
+	QTest::addColumn<int>("listeners");
+	QTest::newRow("none") << 0;
+	QTest::newRow("1000") << 1000;
+	QTest::newRow("10000") << 10000;
+}
+
+// Listeners of other paths should not slow down changes of unrelated values
+void ConfigTest::setValue()
+{
+	QFETCH(int, listeners);
+	Config cfg = config(QLatin1String("listeners") + QString::number(listeners));
+	QObject guard;
+	int calls = 0;
+	for (int i = 0; i < listeners; ++i) {
+		cfg.listen(QLatin1String("other/") + QString::number(i), &guard,
+		           [&] (const QVariant &) { ++calls; });
+	}
+
+	int value = 0;
+	QBENCHMARK {
+		cfg.setValue(QLatin1String("group/key"), ++value);
+		QCoreApplication::processEvents();
+	}
+	QCOMPARE(calls, 0);
+	QCOMPARE(cfg.value(QLatin1String("group/key"), 0), value);
+}
+
+int testConfig(int argc, char *argv[])
+{
+	ConfigTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "configtest.moc"
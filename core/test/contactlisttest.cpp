@@ -0,0 +1,299 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+#include "tests.h"
+#include "../src/corelayers/contactmodel/src/contactlistgroupmodel.h"
+#include <QtTest>
+
+using namespace qutim_sdk_0_3;
+
+class TestContact : public Contact
+{
+	Q_OBJECT
+public:
+	TestContact(const QString &id, const QStringList &tags)
+		: Contact(0), m_id(id), m_tags(tags), m_status(Status::Online)
+	{
+	}
+
+	QString id() const { return m_id; }
+	bool sendMessage(const Message &message) { Q_UNUSED(message); return false; }
+	QStringList tags() const { return m_tags; }
+	void setTags(const QStringList &tags)
+	{
+		const QStringList previous = m_tags;
+		m_tags = tags;
+		emit tagsChanged(m_tags, previous);
+	}
+	bool isInList() const { return true; }
+	void setInList(bool inList) { Q_UNUSED(inList); }
+	Status status() const { return m_status; }
+	void setStatus(const Status &status)
+	{
+		const Status previous = m_status;
+		m_status = status;
+		emit statusChanged(m_status, previous);
+	}
+
+private:
+	QString m_id;
+	QStringList m_tags;
+	Status m_status;
+};
+
+class TestContactListModel : public ContactListGroupModel
+{
+public:
+	// Same as connectContact(), but there is no contact comparator service in the test
+	void watch(Contact *contact)
+	{
+		connect(contact, SIGNAL(destroyed(QObject*)),
+		        this, SLOT(onContactDestroyed(QObject*)));
+		connect(contact, SIGNAL(tagsChanged(QStringList,QStringList)),
+		        this, SLOT(onContactTagsChanged(QStringList,QStringList)));
+		connect(contact, SIGNAL(statusChanged(qutim_sdk_0_3::Status,qutim_sdk_0_3::Status)),
+		        this, SLOT(onStatusChanged(qutim_sdk_0_3::Status,qutim_sdk_0_3::Status)));
+	}
+
+	TestContact *add(const QString &id, const QStringList &tags)
+	{
+		TestContact *contact = new TestContact(id, tags);
+		addContact(contact);
+		watch(contact);
+		return contact;
+	}
+
+	QModelIndex tagIndex(const QString &name) const
+	{
+		for (int i = 0; i < rowCount(); ++i) {
+			const QModelIndex tag = index(i, 0);
+			if (tag.data(TagNameRole).toString() == name)
+				return tag;
+		}
+		return QModelIndex();
+	}
+};
+
+static QStringList randomTags(int count)
+{
+	QStringList tags;
+	const int size = qrand() % 3;
+	for (int i = 0; i < size; ++i) {
+		const QString tag = QLatin1String("tag") + QString::number(qrand() % count);
+		if (!tags.contains(tag))
+			tags << tag;
+	}
+	return tags;
+}
+
+class ContactListTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void positions();
+	void parents_data();
+	void parents();
+	void tagMoves();
+	void ranges();
+	void storm();
+private:
+	void checkTree(const QAbstractItemModel &model, const QModelIndex &parent);
+	void checkCounts(const TestContactListModel &model, const QList<TestContact *> &contacts);
+};
+
+void ContactListTest::initTestCase()
+{
+	qsrand(9);
+}
+
+// Indexes made from stored positions must agree with rows they were found at
+void ContactListTest::checkTree(const QAbstractItemModel &model, const QModelIndex &parent)
+{
+	for (int row = 0; row < model.rowCount(parent); ++row) {
+		const QModelIndex child = model.index(row, 0, parent);
+		QVERIFY(child.isValid());
+		QCOMPARE(child.row(), row);
+		QCOMPARE(model.parent(child), parent);
+		checkTree(model, child);
+		if (QTest::currentTestFailed())
+			return;
+	}
+}
+
+void ContactListTest::checkCounts(const TestContactListModel &model, const QList<TestContact *> &contacts)
+{
+	QMap<QString, QSet<QObject *> > expected;
+	foreach (TestContact *contact, contacts) {
+		QStringList tags = contact->tags();
+		if (tags.isEmpty())
+			tags << QLatin1String("Without tags");
+		foreach (const QString &tag, tags)
+			expected[tag].insert(contact);
+	}
+	for (QMap<QString, QSet<QObject *> >::ConstIterator it = expected.constBegin(); it != expected.constEnd(); ++it) {
+		const QModelIndex tag = model.tagIndex(it.key());
+		QVERIFY(tag.isValid());
+		QSet<QObject *> actual;
+		for (int row = 0; row < model.rowCount(tag); ++row)
+			actual.insert(model.index(row, 0, tag).data(ContactRole).value<QObject *>());
+		QCOMPARE(actual, it.value());
+	}
+}
+
+void ContactListTest::positions()
+{
+	TestContactListModel model;
+	QList<TestContact *> contacts;
+	for (int i = 0; i < 300; ++i)
+		contacts << model.add(QString::number(i), randomTags(5));
+	checkTree(model, QModelIndex());
+	checkCounts(model, contacts);
+
+	// Removal from the middle of lists shifts positions of the rest
+	for (int i = contacts.size() - 1; i >= 0; i -= 3)
+		delete contacts.takeAt(i);
+	checkTree(model, QModelIndex());
+	checkCounts(model, contacts);
+
+	qDeleteAll(contacts);
+	checkTree(model, QModelIndex());
+	for (int row = 0; row < model.rowCount(); ++row)
+		QCOMPARE(model.rowCount(model.index(row, 0)), 0);
+}
+
+void ContactListTest::parents_data()
+{
+	QTest::addColumn<int>("count");
+	QTest::newRow("1000") << 1000;
+	QTest::newRow("10000") << 10000;
+}
+
+// Views ask for parents of every visible row, tags are found by stored positions
+void ContactListTest::parents()
+{
+	QFETCH(int, count);
+	TestContactListModel model;
+	QList<TestContact *> contacts;
+	for (int i = 0; i < count; ++i) {
+		const QString tag = QLatin1String("tag") + QString::number(i % 20);
+		contacts << model.add(QString::number(i), QStringList() << tag);
+	}
+
+	int found = 0;
+	QBENCHMARK {
+		for (int i = 0; i < model.rowCount(); ++i) {
+			const QModelIndex tag = model.index(i, 0);
+			for (int row = 0; row < model.rowCount(tag); ++row)
+				found += model.parent(model.index(row, 0, tag)) == tag;
+		}
+	}
+	QVERIFY(found >= count);
+	qDeleteAll(contacts);
+}
+
+// Tags are changed twice within a frame, the contact is moved once
+void ContactListTest::tagMoves()
+{
+	TestContactListModel model;
+	TestContact *contact = model.add(QLatin1String("contact"), QStringList() << QLatin1String("a"));
+	QSignalSpy inserted(&model, SIGNAL(rowsInserted(QModelIndex,int,int)));
+	QSignalSpy removed(&model, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+
+	contact->setTags(QStringList() << QLatin1String("b"));
+	contact->setTags(QStringList() << QLatin1String("c"));
+	QCOMPARE(model.rowCount(model.tagIndex(QLatin1String("a"))), 1);
+	QCOMPARE(inserted.count(), 0);
+
+	QTRY_VERIFY(model.tagIndex(QLatin1String("c")).isValid());
+	QCOMPARE(model.rowCount(model.tagIndex(QLatin1String("a"))), 0);
+	QCOMPARE(model.rowCount(model.tagIndex(QLatin1String("c"))), 1);
+	QVERIFY(!model.tagIndex(QLatin1String("b")).isValid());
+	// Contact is removed from "a", tag "c" and the contact in it are inserted
+	QCOMPARE(removed.count(), 1);
+	QCOMPARE(inserted.count(), 2);
+	checkTree(model, QModelIndex());
+	delete contact;
+}
+
+void ContactListTest::ranges()
+{
+	TestContactListModel model;
+	QList<TestContact *> contacts;
+	for (int i = 0; i < 40; ++i)
+		contacts << model.add(QString::number(i), QStringList() << QLatin1String("tag"));
+	const QModelIndex tag = model.tagIndex(QLatin1String("tag"));
+	QList<TestContact *> rows;
+	for (int row = 0; row < model.rowCount(tag); ++row)
+		rows << qobject_cast<TestContact *>(model.index(row, 0, tag).data(ContactRole).value<QObject *>());
+	QCOMPARE(rows.size(), 40);
+
+	// Adjacent rows are reported by a single signal
+	QSignalSpy changed(&model, SIGNAL(dataChanged(QModelIndex,QModelIndex)));
+	foreach (int row, QList<int>() << 5 << 3 << 4 << 10 << 4)
+		rows.at(row)->setStatus(Status::Away);
+	QCOMPARE(changed.count(), 0);
+	QTRY_COMPARE(changed.count(), 2);
+	QCOMPARE(changed.at(0).at(0).toModelIndex().parent(), tag);
+	QCOMPARE(changed.at(0).at(0).toModelIndex().row(), 3);
+	QCOMPARE(changed.at(0).at(1).toModelIndex().row(), 5);
+	QCOMPARE(changed.at(1).at(0).toModelIndex().row(), 10);
+	QCOMPARE(changed.at(1).at(1).toModelIndex().row(), 10);
+
+	// Many changed rows of a parent are reported as one range
+	changed.clear();
+	for (int row = 2; row < 38; row += 2)
+		rows.at(row)->setStatus(Status::Online);
+	QTRY_COMPARE(changed.count(), 1);
+	QCOMPARE(changed.at(0).at(0).toModelIndex().row(), 2);
+	QCOMPARE(changed.at(0).at(1).toModelIndex().row(), 36);
+	qDeleteAll(contacts);
+}
+
+// Presence storm after connecting causes a signal per tag instead of one per contact
+void ContactListTest::storm()
+{
+	TestContactListModel model;
+	QList<TestContact *> contacts;
+	for (int i = 0; i < 2000; ++i) {
+		const QString tag = QLatin1String("tag") + QString::number(i % 10);
+		contacts << model.add(QString::number(i), QStringList() << tag);
+	}
+
+	QSignalSpy changed(&model, SIGNAL(dataChanged(QModelIndex,QModelIndex)));
+	foreach (TestContact *contact, contacts)
+		contact->setStatus(Status::FreeChat);
+	QTRY_VERIFY(changed.count() > 0);
+	QCOMPARE(changed.count(), 10);
+	checkTree(model, QModelIndex());
+	qDeleteAll(contacts);
+}
+
+int testContactList(int argc, char *argv[])
+{
+	ContactListTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "contactlisttest.moc"
@@ -0,0 +1,217 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+#include "tests.h"
+#include <qutim/filetransfer.h>
+#include <QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+using namespace qutim_sdk_0_3;
+
+class TestTransferJob : public FileTransferJob
+{
+public:
+	TestTransferJob(Direction direction) : FileTransferJob(0, direction, 0) {}
+
+	void transfer(QIODevice *device, QIODevice *socket, qint64 offset, qint64 size)
+	{
+		startDataTransfer(device, socket, offset, size);
+	}
+
+protected:
+	void doSend() {}
+	void doStop() {}
+	void doReceive() {}
+};
+
+// Connected pair of sockets, the job works with the client one
+class Loopback
+{
+public:
+	Loopback() : peer(0) {}
+
+	bool open()
+	{
+		if (!server.listen(QHostAddress::LocalHost))
+			return false;
+		client.connectToHost(QHostAddress::LocalHost, server.serverPort());
+		if (!client.waitForConnected(5000) || !server.waitForNewConnection(5000))
+			return false;
+		peer = server.nextPendingConnection();
+		return peer != 0;
+	}
+
+	QTcpServer server;
+	QTcpSocket client;
+	QTcpSocket *peer;
+};
+
+static QByteArray fileData(int size)
+{
+	QByteArray data(size, Qt::Uninitialized);
+	for (int i = 0; i < size; ++i)
+		data[i] = char(i * 7 + i / 4096);
+	return data;
+}
+
+class FileTransferTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void outgoing_data();
+	void outgoing();
+	void incoming();
+	void send_data();
+	void send();
+private:
+	QString writeFile(const QByteArray &data);
+
+	QTemporaryDir m_dir;
+};
+
+void FileTransferTest::initTestCase()
+{
+	QVERIFY(m_dir.isValid());
+	qRegisterMetaType<FileTransferJob::ErrorType>("qutim_sdk_0_3::FileTransferJob::ErrorType");
+}
+
+QString FileTransferTest::writeFile(const QByteArray &data)
+{
+	const QString fileName = m_dir.path() + QLatin1String("/file") + QString::number(data.size());
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+		return QString();
+	return fileName;
+}
+
+void FileTransferTest::outgoing_data()
+{
+	QTest::addColumn<bool>("mapped");
+	QTest::addColumn<int>("size");
+	QTest::addColumn<int>("offset");
+	QTest::newRow("empty") << true << 0 << 0;
+	QTest::newRow("small") << true << 1000 << 0;
+	QTest::newRow("file") << true << 9 * 1024 * 1024 + 17 << 0;
+	QTest::newRow("resumed") << true << 9 * 1024 * 1024 + 17 << 1024 * 1024 + 3;
+	QTest::newRow("buffer") << false << 9 * 1024 * 1024 + 17 << 0;
+	QTest::newRow("resumed buffer") << false << 9 * 1024 * 1024 + 17 << 5;
+}
+
+// Files are sent by mapped windows, other devices by chunks
+void FileTransferTest::outgoing()
+{
+	QFETCH(bool, mapped);
+	QFETCH(int, size);
+	QFETCH(int, offset);
+	const QByteArray data = fileData(size);
+	QScopedPointer<QIODevice> device;
+	if (mapped) {
+		const QString fileName = writeFile(data);
+		QVERIFY(!fileName.isEmpty());
+		device.reset(new QFile(fileName));
+	} else {
+		QBuffer *buffer = new QBuffer;
+		buffer->setData(data);
+		device.reset(buffer);
+	}
+	QVERIFY(device->open(QIODevice::ReadOnly));
+
+	Loopback loopback;
+	QVERIFY(loopback.open());
+	QByteArray received;
+	connect(loopback.peer, &QTcpSocket::readyRead, [&] () {
+		received += loopback.peer->readAll();
+	});
+
+	TestTransferJob job(FileTransferJob::Outgoing);
+	QSignalSpy finished(&job, SIGNAL(dataTransferFinished(qutim_sdk_0_3::FileTransferJob::ErrorType)));
+	job.transfer(device.data(), &loopback.client, offset, size);
+	QTRY_COMPARE_WITH_TIMEOUT(finished.count(), 1, 20000);
+	QCOMPARE(finished.at(0).at(0).value<FileTransferJob::ErrorType>(), FileTransferJob::NoError);
+	QCOMPARE(job.progress(), qint64(size));
+
+	QTRY_COMPARE_WITH_TIMEOUT(received.size(), size - offset, 20000);
+	QVERIFY(received == data.mid(offset));
+}
+
+void FileTransferTest::incoming()
+{
+	const QByteArray data = fileData(20 * 1024 * 1024 + 5);
+	QFile file(m_dir.path() + QLatin1String("/incoming"));
+	QVERIFY(file.open(QIODevice::WriteOnly));
+
+	Loopback loopback;
+	QVERIFY(loopback.open());
+	TestTransferJob job(FileTransferJob::Incoming);
+	QSignalSpy finished(&job, SIGNAL(dataTransferFinished(qutim_sdk_0_3::FileTransferJob::ErrorType)));
+	job.transfer(&file, &loopback.client, 0, data.size());
+	loopback.peer->write(data);
+	QTRY_COMPARE_WITH_TIMEOUT(finished.count(), 1, 20000);
+	QCOMPARE(finished.at(0).at(0).value<FileTransferJob::ErrorType>(), FileTransferJob::NoError);
+	QCOMPARE(job.progress(), qint64(data.size()));
+	file.close();
+
+	QVERIFY(file.open(QIODevice::ReadOnly));
+	QVERIFY(file.readAll() == data);
+}
+
+void FileTransferTest::send_data()
+{
+	QTest::addColumn<int>("size");
+	QTest::newRow("1 MiB") << 1024 * 1024;
+	QTest::newRow("64 MiB") << 64 * 1024 * 1024;
+}
+
+// Throughput of sending a file over the loopback
+void FileTransferTest::send()
+{
+	QFETCH(int, size);
+	const QString fileName = writeFile(fileData(size));
+	QVERIFY(!fileName.isEmpty());
+
+	qint64 received = 0;
+	QBENCHMARK {
+		QFile file(fileName);
+		QVERIFY(file.open(QIODevice::ReadOnly));
+		Loopback loopback;
+		QVERIFY(loopback.open());
+		received = 0;
+		connect(loopback.peer, &QTcpSocket::readyRead, [&] () {
+			received += loopback.peer->readAll().size();
+		});
+		TestTransferJob job(FileTransferJob::Outgoing);
+		job.transfer(&file, &loopback.client, 0, size);
+		QTRY_COMPARE_WITH_TIMEOUT(received, qint64(size), 60000);
+	}
+}
+
+int testFileTransfer(int argc, char *argv[])
+{
+	FileTransferTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "filetransfertest.moc"
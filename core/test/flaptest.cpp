@@ -0,0 +1,211 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+#include "tests.h"
+#include "../../protocols/oscar/src/flap.h"
+#include <QtTest>
+#include <QBuffer>
+
+using namespace qutim_sdk_0_3::oscar;
+
+// Stream of frames of all channels with payloads of different sizes
+static QList<QByteArray> makeFrames(int count)
+{
+	QList<QByteArray> frames;
+	for (int i = 0; i < count; ++i) {
+		FLAP flap(quint8(1 + i % 5));
+		flap.setSeqNum(quint16(i));
+		QByteArray payload((i * 37) % 300, Qt::Uninitialized);
+		for (int j = 0; j < payload.size(); ++j)
+			payload[j] = char(i + j);
+		flap.append(payload);
+		frames << flap.toByteArray();
+	}
+	return frames;
+}
+
+/*
+ * Mirrors AbstractConnection::readData(): chunk is appended to the buffer,
+ * all complete frames are parsed as views of it and then dropped
+ */
+static bool drain(QByteArray &buffer, const QByteArray &chunk, QList<QByteArray> *frames)
+{
+	buffer += chunk;
+	int offset = 0;
+	FLAP flap;
+	forever {
+		const int size = FLAP::frameSize(buffer.constData() + offset, buffer.size() - offset);
+		if (size < 0)
+			return false;
+		if (size == 0)
+			break;
+		flap.setRawFrame(buffer.constData() + offset, size);
+		if (flap.data().constData() != buffer.constData() + offset + 6)
+			return false;
+		offset += size;
+		frames->append(flap.toByteArray());
+	}
+	buffer.remove(0, offset);
+	return true;
+}
+
+// FLAP per event loop iteration, as AbstractConnection read them before
+static QList<QByteArray> readFrames(const QByteArray &stream)
+{
+	QBuffer device;
+	device.setData(stream);
+	device.open(QIODevice::ReadOnly);
+	QList<QByteArray> frames;
+	FLAP flap;
+	while (device.bytesAvailable() > 0) {
+		if (!flap.readData(&device))
+			break;
+		if (!flap.isFinished())
+			break;
+		frames << flap.toByteArray();
+		flap.clear();
+	}
+	return frames;
+}
+
+class FlapTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void frameSize();
+	void rawFrame();
+	void drain_data();
+	void drain();
+	void read_data();
+	void read();
+};
+
+void FlapTest::frameSize()
+{
+	FLAP flap(0x02);
+	flap.setSeqNum(0x1234);
+	flap.append(QByteArray("payload"));
+	const QByteArray frame = flap.toByteArray();
+	QCOMPARE(frame.size(), 13);
+
+	for (int i = 0; i < frame.size(); ++i)
+		QCOMPARE(FLAP::frameSize(frame.constData(), i), 0);
+	QCOMPARE(FLAP::frameSize(frame.constData(), frame.size()), frame.size());
+	const QByteArray twoFrames = frame + frame;
+	QCOMPARE(FLAP::frameSize(twoFrames.constData(), twoFrames.size()), frame.size());
+
+	// Broken stream is reported at its first byte
+	QCOMPARE(FLAP::frameSize("x", 1), -1);
+	QCOMPARE(FLAP::frameSize("\x2a", 1), 0);
+}
+
+void FlapTest::rawFrame()
+{
+	FLAP original(0x05);
+	original.setSeqNum(0xfedc);
+	original.append<quint32>(0xdeadbeef);
+	const QByteArray frame = original.toByteArray();
+
+	FLAP flap;
+	flap.setRawFrame(frame.constData(), frame.size());
+	QVERIFY(flap.isFinished());
+	QCOMPARE(flap.channel(), quint8(0x05));
+	QCOMPARE(flap.seqNum(), quint16(0xfedc));
+	QCOMPARE(flap.read<quint32>(), quint32(0xdeadbeef));
+	QCOMPARE(flap.dataSize(), 0u);
+	QCOMPARE(flap.toByteArray(), frame);
+}
+
+void FlapTest::drain_data()
+{
+	QTest::addColumn<int>("chunk");
+	QTest::newRow("byte") << 1;
+	QTest::newRow("header") << 6;
+	QTest::newRow("odd") << 7;
+	QTest::newRow("page") << 4096;
+	QTest::newRow("whole") << 0;
+}
+
+// Frames split by socket reads at any position are parsed in order
+void FlapTest::drain()
+{
+	QFETCH(int, chunk);
+	const QList<QByteArray> expected = makeFrames(200);
+	QByteArray stream;
+	foreach (const QByteArray &frame, expected)
+		stream += frame;
+	if (chunk == 0)
+		chunk = stream.size();
+
+	QByteArray buffer;
+	QList<QByteArray> frames;
+	for (int i = 0; i < stream.size(); i += chunk)
+		QVERIFY(::drain(buffer, stream.mid(i, chunk), &frames));
+	QVERIFY(buffer.isEmpty());
+	QCOMPARE(frames, expected);
+	QCOMPARE(readFrames(stream), expected);
+
+	// Garbage after valid frames stops the connection
+	buffer.clear();
+	frames.clear();
+	QVERIFY(!::drain(buffer, expected.first() + "garbage", &frames));
+	QCOMPARE(frames.size(), 1);
+}
+
+void FlapTest::read_data()
+{
+	QTest::addColumn<bool>("old");
+	QTest::newRow("drain") << false;
+	QTest::newRow("device") << true;
+}
+
+// Cost of parsing a burst of frames which came by a single read
+void FlapTest::read()
+{
+	QFETCH(bool, old);
+	QByteArray stream;
+	foreach (const QByteArray &frame, makeFrames(1000))
+		stream += frame;
+
+	int count = 0;
+	QBENCHMARK {
+		if (old) {
+			count = readFrames(stream).size();
+		} else {
+			QByteArray buffer;
+			QList<QByteArray> frames;
+			::drain(buffer, stream, &frames);
+			count = frames.size();
+		}
+	}
+	QCOMPARE(count, 1000);
+}
+
+int testFlap(int argc, char *argv[])
+{
+	FlapTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "flaptest.moc"
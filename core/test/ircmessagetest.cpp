@@ -0,0 +1,217 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+#include "tests.h"
+#include "../../protocols/irc/src/ircmessage.h"
+#include <QtTest>
+#include <QTextCodec>
+
+using namespace qutim_sdk_0_3::irc;
+
+// Regular expressions IrcConnection used before the tokenizer
+static bool referenceParse(const QByteArray &line, QTextCodec *codec, IrcMessage *message)
+{
+	message->clear();
+	const QString msg = codec->toUnicode(line);
+	static QRegExp rx("^(:([^\\s!@]+|)(\\S+|)\\s+|)(\\w+|\\d{3})(\\s+(.*)|)");
+	if (rx.indexIn(msg) != 0)
+		return false;
+	const QString params = rx.cap(6);
+	static QRegExp paramRx("(:[^\\r\\n]*|[^\\s\\r\\n]+)");
+	int pos = 0;
+	forever {
+		pos = paramRx.indexIn(params, pos);
+		if (pos < 0)
+			break;
+		const QString param = paramRx.cap(1);
+		if (param.startsWith(QLatin1Char(':'))) {
+			message->params << param.mid(1);
+			break;
+		}
+		message->params << param;
+		pos += paramRx.matchedLength();
+	}
+	message->name = rx.cap(2);
+	message->host = rx.cap(3);
+	if (message->host.startsWith(QLatin1Char('!')))
+		message->host = message->host.mid(1);
+	message->command = rx.cap(4);
+	return true;
+}
+
+static QList<QByteArray> replayLines()
+{
+	return QList<QByteArray>()
+	        << ":irc.example.net 001 nick :Welcome to the Internet Relay Network nick\r\n"
+	        << ":irc.example.net 353 nick = #qutim :nick @op +voice other\r\n"
+	        << ":nick!user@host.example.com PRIVMSG #qutim :hello, world\r\n"
+	        << ":nick!user@host.example.com PRIVMSG #qutim :\001ACTION waves\001\r\n"
+	        << ":nick!user@host.example.com JOIN #qutim\r\n"
+	        << ":nick!user@host.example.com MODE #qutim +o other\r\n"
+	        << ":nick@host QUIT :Ping timeout\r\n"
+	        << "PING :irc.example.net\r\n"
+	        << ":nick!user@host PRIVMSG #qutim :\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82\r\n";
+}
+
+class IrcMessageTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void compare_data();
+	void compare();
+	void tags();
+	void invalid();
+	void ctcp_data();
+	void ctcp();
+	void parse_data();
+	void parse();
+private:
+	QTextCodec *m_codec;
+};
+
+void IrcMessageTest::initTestCase()
+{
+	m_codec = QTextCodec::codecForName("UTF-8");
+	QVERIFY(m_codec);
+}
+
+void IrcMessageTest::compare_data()
+{
+	QTest::addColumn<QByteArray>("line");
+	const QList<QByteArray> lines = replayLines();
+	for (int i = 0; i < lines.size(); ++i)
+		QTest::newRow(QByteArray("replay " + QByteArray::number(i)).constData()) << lines.at(i);
+	QTest::newRow("no params") << QByteArray(":irc.example.net PONG\r\n");
+	QTest::newRow("many spaces") << QByteArray(":nick!user@host   KICK  #qutim   other  :reason  \r\n");
+	QTest::newRow("empty trailing") << QByteArray(":nick!user@host TOPIC #qutim :\r\n");
+	QTest::newRow("no newline") << QByteArray(":nick!user@host NICK other");
+}
+
+// Tokenizer splits lines the same way the regular expressions did
+void IrcMessageTest::compare()
+{
+	QFETCH(QByteArray, line);
+	IrcMessage message;
+	IrcMessage reference;
+	QVERIFY(IrcMessage::parse(line, m_codec, &message));
+	QVERIFY(referenceParse(line, m_codec, &reference));
+	QCOMPARE(message.name, reference.name);
+	QCOMPARE(message.host, reference.host);
+	QCOMPARE(message.command, reference.command);
+	QCOMPARE(message.params, reference.params);
+	QVERIFY(message.tags.isEmpty());
+}
+
+void IrcMessageTest::tags()
+{
+	IrcMessage message;
+	QVERIFY(IrcMessage::parse("@time=2012-01-01T12:00:00.000Z;msgid=a\\sb\\:c\\\\d;+flag "
+	                          ":nick!user@host PRIVMSG #qutim :text\r\n", m_codec, &message));
+	QCOMPARE(message.tags.size(), 3);
+	QCOMPARE(message.tags.value(QLatin1String("time")), QLatin1String("2012-01-01T12:00:00.000Z"));
+	QCOMPARE(message.tags.value(QLatin1String("msgid")), QLatin1String("a b;c\\d"));
+	QVERIFY(message.tags.contains(QLatin1String("+flag")));
+	QVERIFY(message.tags.value(QLatin1String("+flag")).isEmpty());
+	QCOMPARE(message.name, QLatin1String("nick"));
+	QCOMPARE(message.host, QLatin1String("user@host"));
+	QCOMPARE(message.command, QLatin1String("PRIVMSG"));
+	QCOMPARE(message.params, QStringList() << QLatin1String("#qutim") << QLatin1String("text"));
+
+	// Tags are cleared with the rest of the message
+	QVERIFY(IrcMessage::parse("PING :server\r\n", m_codec, &message));
+	QVERIFY(message.tags.isEmpty());
+	QVERIFY(message.name.isEmpty());
+}
+
+void IrcMessageTest::invalid()
+{
+	IrcMessage message;
+	QVERIFY(!IrcMessage::parse(QByteArray(), m_codec, &message));
+	QVERIFY(!IrcMessage::parse("\r\n", m_codec, &message));
+	QVERIFY(!IrcMessage::parse(":nick!user@host\r\n", m_codec, &message));
+	QVERIFY(!IrcMessage::parse("@tag=value\r\n", m_codec, &message));
+}
+
+void IrcMessageTest::ctcp_data()
+{
+	QTest::addColumn<QString>("text");
+	QTest::newRow("action") << QString::fromLatin1("\001ACTION waves\001");
+	QTest::newRow("no params") << QString::fromLatin1("\001VERSION\001");
+	QTest::newRow("empty params") << QString::fromLatin1("\001PING \001");
+	QTest::newRow("spaces") << QString::fromLatin1("\001ACTION  two  spaces \001");
+	QTest::newRow("text after") << QString::fromLatin1("\001PING 123\001 tail");
+	QTest::newRow("empty") << QString::fromLatin1("\001\001");
+	QTest::newRow("no end") << QString::fromLatin1("\001ACTION");
+	QTest::newRow("plain") << QString::fromLatin1("ACTION waves");
+}
+
+// Splitting of CTCP matches ctcpRx IrcConnection used before
+void IrcMessageTest::ctcp()
+{
+	QFETCH(QString, text);
+	QRegExp ctcpRx("^\\001(\\S+)( (.*)|)\\001");
+	QString cmd;
+	QString params;
+	const bool parsed = IrcMessage::parseCtcp(text, &cmd, &params);
+	QCOMPARE(parsed, ctcpRx.indexIn(text) == 0);
+	if (parsed) {
+		QCOMPARE(cmd, ctcpRx.cap(1));
+		QCOMPARE(params, ctcpRx.cap(3));
+	}
+}
+
+void IrcMessageTest::parse_data()
+{
+	QTest::addColumn<bool>("reference");
+	QTest::newRow("tokenizer") << false;
+	QTest::newRow("regexp") << true;
+}
+
+// Replays a burst of typical lines through both parsers
+void IrcMessageTest::parse()
+{
+	QFETCH(bool, reference);
+	const QList<QByteArray> lines = replayLines();
+	IrcMessage message;
+	int parsed = 0;
+	QBENCHMARK {
+		for (int i = 0; i < 1000; ++i) {
+			foreach (const QByteArray &line, lines) {
+				if (reference ? referenceParse(line, m_codec, &message)
+				              : IrcMessage::parse(line, m_codec, &message))
+					++parsed;
+			}
+		}
+	}
+	QVERIFY(parsed > 0);
+}
+
+int testIrcMessage(int argc, char *argv[])
+{
+	IrcMessageTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "ircmessagetest.moc"
@@ -0,0 +1,184 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "tests.h"
+#include "../../protocols/irc/src/ircsendqueue.h"
+#include <QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+using namespace qutim_sdk_0_3::irc;
+
+/*
+ * Commands are sent the way IrcConnection sends them, a fake server
+ * records the lines and the time they came at
+ */
+class IrcSendQueueTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void init();
+	void cleanup();
+	void burst();
+	void order();
+	void joinAfterPart();
+private:
+	void send(int timeout);
+
+	struct Line
+	{
+		QByteArray data;
+		qint64 time;
+	};
+
+	IrcSendQueue m_queue;
+	QTcpServer m_server;
+	QTcpSocket m_client;
+	QTcpSocket *m_peer;
+	QElapsedTimer m_clock;
+	QList<Line> m_lines;
+};
+
+void IrcSendQueueTest::init()
+{
+	m_queue = IrcSendQueue();
+	m_lines.clear();
+	QVERIFY(m_server.listen(QHostAddress::LocalHost));
+	m_client.connectToHost(m_server.serverAddress(), m_server.serverPort());
+	QVERIFY(m_client.waitForConnected(1000));
+	QVERIFY(m_server.waitForNewConnection(1000));
+	m_peer = m_server.nextPendingConnection();
+	connect(m_peer, &QTcpSocket::readyRead, this, [this] () {
+		while (m_peer->canReadLine()) {
+			Line line = { m_peer->readLine().trimmed(), m_clock.elapsed() };
+			m_lines << line;
+		}
+	});
+	m_clock.start();
+}
+
+void IrcSendQueueTest::cleanup()
+{
+	m_client.abort();
+	delete m_peer;
+	m_server.close();
+}
+
+void IrcSendQueueTest::send(int timeout)
+{
+	const int count = m_lines.size() + m_queue.depth();
+	QElapsedTimer timer;
+	timer.start();
+	while (m_queue.depth() > 0 && timer.elapsed() < timeout) {
+		QString command;
+		while (m_queue.takeNext(&command))
+			m_client.write(command.toUtf8() + "\r\n");
+		m_client.flush();
+		QTest::qWait(qMax(m_queue.nextDelay(), 1));
+	}
+	QTRY_COMPARE_WITH_TIMEOUT(m_lines.size(), count, timeout);
+}
+
+void IrcSendQueueTest::burst()
+{
+	enum { Burst = 3, Interval = 200, Count = 6 };
+	m_queue.setLimits(Burst, Interval);
+	for (int i = 0; i < Count; ++i)
+		m_queue.enqueue(QString::fromLatin1("PRIVMSG #qutim :%1").arg(i), false);
+	send(Count * Interval * 2);
+	if (QTest::currentTestFailed())
+		return;
+
+	// Burst goes at once, then one command per interval
+	for (int i = 0; i < Count; ++i) {
+		QCOMPARE(m_lines.at(i).data, QString::fromLatin1("PRIVMSG #qutim :%1").arg(i).toUtf8());
+		if (i < Burst)
+			QVERIFY(m_lines.at(i).time < Interval / 2);
+		else
+			QVERIFY(m_lines.at(i).time >= (i - Burst + 1) * Interval - Interval / 4);
+	}
+}
+
+void IrcSendQueueTest::order()
+{
+	m_queue.setLimits(100, 0);
+	m_queue.enqueue(QLatin1String("PRIVMSG #x :a"), false);
+	m_queue.enqueue(QLatin1String("PART #x"), false);
+	m_queue.enqueue(QLatin1String("JOIN #x"), false);
+	m_queue.enqueue(QLatin1String("PRIVMSG #x :b"), false);
+	m_queue.enqueue(QLatin1String("QUIT :bye"), false);
+	m_queue.enqueue(QLatin1String("PRIVMSG #y :c"), false);
+	m_queue.enqueue(QLatin1String("JOIN #z"), false);
+	m_queue.enqueue(QLatin1String("JOIN #w key"), false);
+	m_queue.enqueue(QLatin1String("WHOIS nick"), true);
+	send(1000);
+	if (QTest::currentTestFailed())
+		return;
+
+	QList<QByteArray> lines;
+	foreach (const Line &line, m_lines)
+		lines << line.data;
+	// High priority goes first, targets take turns and JOINs are merged
+	QCOMPARE(lines, QList<QByteArray>()
+	         << "WHOIS nick"
+	         << "PRIVMSG #x :a"
+	         << "PRIVMSG #y :c"
+	         << "JOIN #w,#z key"
+	         << "PART #x"
+	         << "JOIN #x"
+	         << "PRIVMSG #x :b"
+	         << "QUIT :bye");
+}
+
+void IrcSendQueueTest::joinAfterPart()
+{
+	m_queue.setLimits(100, 0);
+	m_queue.enqueue(QLatin1String("JOIN #v"), false);
+	m_queue.enqueue(QLatin1String("PART #v"), false);
+	m_queue.enqueue(QLatin1String("PRIVMSG #v :d"), false);
+	m_queue.enqueue(QLatin1String("JOIN #u"), false);
+	m_queue.enqueue(QLatin1String("JOIN #v,#t"), false);
+	send(1000);
+	if (QTest::currentTestFailed())
+		return;
+
+	QList<QByteArray> lines;
+	foreach (const Line &line, m_lines)
+		lines << line.data;
+	// Commands of #v keep their order, JOIN of #u isn't merged past them
+	QCOMPARE(lines, QList<QByteArray>()
+	         << "JOIN #v"
+	         << "PART #v"
+	         << "PRIVMSG #v :d"
+	         << "JOIN #u,#v,#t");
+}
+
+int testIrcSendQueue(int argc, char *argv[])
+{
+	IrcSendQueueTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "ircsendqueuetest.moc"
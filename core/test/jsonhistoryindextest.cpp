@@ -0,0 +1,224 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+#include "tests.h"
+#include "../src/corelayers/jsonhistory/jsonhistoryindex.h"
+#include <QtTest>
+
+using namespace Core;
+
+// Month of history the way JsonHistory writes it
+static QByteArray historyData(int count, int shuffled = -1)
+{
+	QByteArray data = "[";
+	const QDateTime start(QDate(2012, 1, 1), QTime(0, 0));
+	for (int i = 0; i < count; ++i) {
+		const int minute = i == shuffled ? 0 : i;
+		data += i == 0 ? "\n " : ",\n ";
+		data += "{\n  \"datetime\": \"";
+		data += start.addSecs(minute * 60).toString(Qt::ISODate).toLatin1();
+		data += "\",\n  \"in\": true,\n  \"html\": \"<b>";
+		data += QByteArray::number(i);
+		data += "</b>\",\n  \"text\": \"line \\\"";
+		data += QByteArray::number(i);
+		data += "\\\"\\n\"\n }";
+	}
+	data += "\n]\n";
+	return data;
+}
+
+static const uchar *bytes(const QByteArray &data)
+{
+	return reinterpret_cast<const uchar *>(data.constData());
+}
+
+class JsonHistoryIndexTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void init();
+	void rebuild();
+	void reload();
+	void outdated();
+	void unsorted();
+	void append();
+	void load_data();
+	void load();
+private:
+	QString jsonFileName() const;
+
+	QScopedPointer<QTemporaryDir> m_dir;
+};
+
+void JsonHistoryIndexTest::init()
+{
+	m_dir.reset(new QTemporaryDir);
+	QVERIFY(m_dir->isValid());
+}
+
+QString JsonHistoryIndexTest::jsonFileName() const
+{
+	return m_dir->path() + QLatin1String("/contact.201201.json");
+}
+
+void JsonHistoryIndexTest::rebuild()
+{
+	const QByteArray data = historyData(100);
+	JsonHistoryIndex index(jsonFileName());
+	QVERIFY(index.load(bytes(data), data.size()));
+	QVERIFY(QFile::exists(JsonHistoryIndex::indexFileName(jsonFileName())));
+	QCOMPARE(index.entries().size(), 100);
+	QVERIFY(index.isSorted());
+	QCOMPARE(index.end(), uint(data.lastIndexOf('}') + 1));
+
+	const QDateTime start(QDate(2012, 1, 1), QTime(0, 0));
+	for (int i = 0; i < index.entries().size(); ++i) {
+		const JsonHistoryIndex::Entry &entry = index.entries().at(i);
+		QCOMPARE(data.at(entry.offset), '{');
+		QCOMPARE(data.at(entry.offset + entry.length - 1), '}');
+		QCOMPARE(entry.time, start.addSecs(i * 60).toMSecsSinceEpoch());
+		QCOMPARE(JsonHistoryIndex::field(bytes(data), entry, "html"),
+		         QLatin1String("<b>") + QString::number(i) + QLatin1String("</b>"));
+		QCOMPARE(JsonHistoryIndex::field(bytes(data), entry, "text"),
+		         QLatin1String("line \"") + QString::number(i) + QLatin1String("\"\n"));
+		QVERIFY(JsonHistoryIndex::field(bytes(data), entry, "missing").isNull());
+		const QVariantMap record = JsonHistoryIndex::record(bytes(data), data.size(), entry);
+		QCOMPARE(record.value(QLatin1String("in")).toBool(), true);
+	}
+	QCOMPARE(index.lowerBound(start.addSecs(10 * 60).toMSecsSinceEpoch()), 10);
+	QCOMPARE(index.lowerBound(start.addSecs(10 * 60 - 1).toMSecsSinceEpoch()), 10);
+	QCOMPARE(index.lowerBound(start.addDays(1).toMSecsSinceEpoch()), 100);
+}
+
+void JsonHistoryIndexTest::reload()
+{
+	const QByteArray data = historyData(10);
+	JsonHistoryIndex first(jsonFileName());
+	QVERIFY(first.load(bytes(data), data.size()));
+
+	JsonHistoryIndex second(jsonFileName());
+	QVERIFY(second.load(bytes(data), data.size()));
+	QCOMPARE(second.entries().size(), first.entries().size());
+	for (int i = 0; i < first.entries().size(); ++i) {
+		QCOMPARE(second.entries().at(i).time, first.entries().at(i).time);
+		QCOMPARE(second.entries().at(i).offset, first.entries().at(i).offset);
+		QCOMPARE(second.entries().at(i).length, first.entries().at(i).length);
+	}
+}
+
+// Json file changed behind the index, e.g. by an older version of qutIM
+void JsonHistoryIndexTest::outdated()
+{
+	QByteArray data = historyData(10);
+	{
+		JsonHistoryIndex index(jsonFileName());
+		QVERIFY(index.load(bytes(data), data.size()));
+	}
+	data = historyData(11);
+	JsonHistoryIndex index(jsonFileName());
+	QVERIFY(index.load(bytes(data), data.size()));
+	QCOMPARE(index.entries().size(), 11);
+
+	// Garbage after the last record is not a valid history
+	data = historyData(11) + "garbage";
+	QVERIFY(index.load(bytes(data), data.size()));
+	QCOMPARE(index.entries().size(), 11);
+	data.chop(7);
+	JsonHistoryIndex reread(jsonFileName());
+	QVERIFY(reread.load(bytes(data), data.size()));
+	QCOMPARE(reread.entries().size(), 11);
+}
+
+void JsonHistoryIndexTest::unsorted()
+{
+	const QByteArray data = historyData(20, 15);
+	JsonHistoryIndex index(jsonFileName());
+	QVERIFY(index.load(bytes(data), data.size()));
+	QCOMPARE(index.entries().size(), 20);
+	QVERIFY(!index.isSorted());
+
+	JsonHistoryIndex reread(jsonFileName());
+	QVERIFY(reread.load(bytes(data), data.size()));
+	QVERIFY(!reread.isSorted());
+}
+
+void JsonHistoryIndexTest::append()
+{
+	JsonHistoryIndex index(jsonFileName());
+	QVERIFY(index.reset());
+	QCOMPARE(index.end(), 0u);
+
+	QVector<JsonHistoryIndex::Entry> entries;
+	for (int i = 0; i < 3; ++i) {
+		const JsonHistoryIndex::Entry entry = { (i + 1) * 1000, quint32(2 + i * 10), 8 };
+		entries << entry;
+	}
+	QVERIFY(index.append(entries));
+	QVERIFY(index.isSorted());
+	QCOMPARE(index.end(), 30u);
+
+	entries.resize(1);
+	entries[0].time = 500;
+	entries[0].offset = 32;
+	QVERIFY(index.append(entries));
+	QVERIFY(!index.isSorted());
+	QCOMPARE(index.entries().size(), 4);
+}
+
+void JsonHistoryIndexTest::load_data()
+{
+	QTest::addColumn<bool>("valid");
+	QTest::newRow("index") << true;
+	QTest::newRow("rebuild") << false;
+}
+
+// Opening of a month with ten thousands of messages
+void JsonHistoryIndexTest::load()
+{
+	QFETCH(bool, valid);
+	const QByteArray data = historyData(10000);
+	const QString indexFileName = JsonHistoryIndex::indexFileName(jsonFileName());
+	{
+		JsonHistoryIndex index(jsonFileName());
+		QVERIFY(index.load(bytes(data), data.size()));
+	}
+
+	int count = 0;
+	QBENCHMARK {
+		if (!valid)
+			QFile::remove(indexFileName);
+		JsonHistoryIndex index(jsonFileName());
+		index.load(bytes(data), data.size());
+		count = index.entries().size();
+	}
+	QCOMPARE(count, 10000);
+}
+
+int testJsonHistoryIndex(int argc, char *argv[])
+{
+	JsonHistoryIndexTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "jsonhistoryindextest.moc"
@@ -0,0 +1,140 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+#include "tests.h"
+#include "../src/corelayers/jsonhistory/jsonhistorytailcache.h"
+#include <QtTest>
+
+using namespace Core;
+
+static Message message(int minute)
+{
+	Message result(QString::number(minute));
+	result.setTime(QDateTime(QDate(2012, 1, 1), QTime(0, 0)).addSecs(minute * 60));
+	return result;
+}
+
+static MessageList messages(const QList<int> &minutes)
+{
+	MessageList result;
+	foreach (int minute, minutes)
+		result << JsonHistoryTailCache::toStored(message(minute));
+	return result;
+}
+
+static QList<int> minutes(const MessageList &messages)
+{
+	QList<int> result;
+	foreach (const Message &message, messages)
+		result << message.text().toInt();
+	return result;
+}
+
+class JsonHistoryTailCacheTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void init();
+	void append();
+	void late_data();
+	void late();
+	void older();
+private:
+	bool readAll(MessageList *result);
+
+	History::ContactInfo m_contact;
+	QScopedPointer<JsonHistoryTailCache> m_cache;
+};
+
+void JsonHistoryTailCacheTest::init()
+{
+	m_contact.protocol = QLatin1String("proto");
+	m_contact.account = QLatin1String("account");
+	m_contact.contact = QLatin1String("contact");
+	m_cache.reset(new JsonHistoryTailCache(4, 1024 * 1024));
+}
+
+bool JsonHistoryTailCacheTest::readAll(MessageList *result)
+{
+	return m_cache->read(m_contact, QDateTime(), QDateTime(), -1, result);
+}
+
+void JsonHistoryTailCacheTest::append()
+{
+	m_cache->fill(m_contact, messages(QList<int>() << 1 << 2), true, [] () { return true; });
+	m_cache->append(m_contact, message(3));
+	m_cache->append(m_contact, message(4));
+	m_cache->append(m_contact, message(5));
+
+	// Oldest messages are dropped, so the tail isn't complete anymore
+	MessageList result;
+	QVERIFY(!readAll(&result));
+	QVERIFY(m_cache->read(m_contact, QDateTime(), QDateTime(), 3, &result));
+	QCOMPARE(minutes(result), QList<int>() << 3 << 4 << 5);
+}
+
+void JsonHistoryTailCacheTest::late_data()
+{
+	QTest::addColumn<bool>("complete");
+	QTest::addColumn<int>("minute");
+	QTest::addColumn<QList<int> >("expected");
+	QTest::newRow("between") << false << 15 << (QList<int>() << 10 << 15 << 20 << 30);
+	QTest::newRow("same time") << false << 20 << (QList<int>() << 10 << 20 << 20 << 30);
+	QTest::newRow("first") << true << 5 << (QList<int>() << 5 << 10 << 20 << 30);
+}
+
+// Messages may come later than newer ones, e.g. offline messages from the server
+void JsonHistoryTailCacheTest::late()
+{
+	QFETCH(bool, complete);
+	QFETCH(int, minute);
+	QFETCH(QList<int>, expected);
+	m_cache->fill(m_contact, messages(QList<int>() << 10 << 20 << 30), complete, [] () { return true; });
+	m_cache->append(m_contact, message(minute));
+
+	MessageList result;
+	QVERIFY(m_cache->read(m_contact, QDateTime(), QDateTime(), 4, &result));
+	QCOMPARE(minutes(result), expected);
+	QCOMPARE(readAll(&result), complete);
+}
+
+void JsonHistoryTailCacheTest::older()
+{
+	m_cache->fill(m_contact, messages(QList<int>() << 10 << 20 << 30), false, [] () { return true; });
+	m_cache->append(m_contact, message(5));
+
+	// Tail doesn't know what was before its first message, so the index has to be used
+	MessageList result;
+	QVERIFY(!m_cache->read(m_contact, QDateTime(), QDateTime(), 1, &result));
+	m_cache->append(m_contact, message(40));
+	QVERIFY(!m_cache->read(m_contact, QDateTime(), QDateTime(), 1, &result));
+}
+
+int testJsonHistoryTailCache(int argc, char *argv[])
+{
+	JsonHistoryTailCacheTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "jsonhistorytailcachetest.moc"
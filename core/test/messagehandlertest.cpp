@@ -0,0 +1,216 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+#include "tests.h"
+#include <qutim/messagehandler.h>
+#include <QtTest>
+
+using namespace qutim_sdk_0_3;
+
+// Appends own name to the text of the message and answers with the given result
+class TestMessageHandler : public MessageHandler
+{
+public:
+	TestMessageHandler(const QString &name, Result result = Accept)
+		: m_name(name), m_result(result), m_async(false)
+	{
+	}
+
+	void setAsync(bool async) { m_async = async; }
+
+	// Finishes the last asynchronous call
+	void finish()
+	{
+		m_pending.handle(m_result, QString());
+	}
+
+protected:
+	MessageHandlerAsyncResult doHandle(Message &message)
+	{
+		message.setText(message.text() + m_name);
+		if (m_async) {
+			m_pending = AsyncResultHandler<Result, QString>();
+			return m_pending.result();
+		}
+		return makeAsyncResult(m_result, m_result == Accept ? QString() : m_name);
+	}
+
+private:
+	QString m_name;
+	Result m_result;
+	bool m_async;
+	AsyncResultHandler<Result, QString> m_pending;
+};
+
+struct HandledMessage
+{
+	HandledMessage() : handled(false), result(MessageHandler::Error) {}
+
+	bool handled;
+	Message message;
+	MessageHandler::Result result;
+	QString error;
+};
+
+static void handleMessage(const Message &message, HandledMessage *handled)
+{
+	MessageHandler::handle(message).connect([handled] (const Message &message,
+	                                                    MessageHandler::Result result,
+	                                                    const QString &error) {
+		handled->handled = true;
+		handled->message = message;
+		handled->result = result;
+		handled->error = error;
+	}, AsyncInlineConnection);
+}
+
+static Message incoming(const QString &text)
+{
+	Message message(text);
+	message.setIncoming(true);
+	return message;
+}
+
+class MessageHandlerTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void priorities();
+	void reject();
+	void async();
+	void unregister();
+	void chain_data();
+	void chain();
+};
+
+void MessageHandlerTest::priorities()
+{
+	TestMessageHandler low(QLatin1String("c"));
+	TestMessageHandler normal(QLatin1String("b"));
+	TestMessageHandler high(QLatin1String("a"));
+	MessageHandler::registerHandler(&low, MessageHandler::LowPriority, MessageHandler::HighPriority);
+	MessageHandler::registerHandler(&high, MessageHandler::HighPriority, MessageHandler::LowPriority);
+	MessageHandler::registerHandler(&normal);
+
+	// Handlers which know the result are continued inline, so it's ready right away
+	HandledMessage handled;
+	handleMessage(incoming(QString()), &handled);
+	QVERIFY(handled.handled);
+	QCOMPARE(handled.result, MessageHandler::Accept);
+	QCOMPARE(handled.message.text(), QLatin1String("abc"));
+
+	handleMessage(Message(), &handled);
+	QCOMPARE(handled.message.text(), QLatin1String("cba"));
+}
+
+void MessageHandlerTest::reject()
+{
+	TestMessageHandler first(QLatin1String("a"));
+	TestMessageHandler reject(QLatin1String("b"), MessageHandler::Reject);
+	TestMessageHandler last(QLatin1String("c"));
+	MessageHandler::registerHandler(&first, MessageHandler::HighPriority, MessageHandler::HighPriority);
+	MessageHandler::registerHandler(&reject);
+	MessageHandler::registerHandler(&last, MessageHandler::LowPriority, MessageHandler::LowPriority);
+
+	HandledMessage handled;
+	handleMessage(incoming(QString()), &handled);
+	QVERIFY(handled.handled);
+	QCOMPARE(handled.result, MessageHandler::Reject);
+	QCOMPARE(handled.error, QLatin1String("b"));
+	QCOMPARE(handled.message.text(), QLatin1String("ab"));
+}
+
+void MessageHandlerTest::async()
+{
+	TestMessageHandler first(QLatin1String("a"));
+	TestMessageHandler async(QLatin1String("b"));
+	TestMessageHandler last(QLatin1String("c"));
+	async.setAsync(true);
+	MessageHandler::registerHandler(&first, MessageHandler::HighPriority, MessageHandler::HighPriority);
+	MessageHandler::registerHandler(&async);
+	MessageHandler::registerHandler(&last, MessageHandler::LowPriority, MessageHandler::LowPriority);
+
+	HandledMessage handled;
+	handleMessage(incoming(QString()), &handled);
+	QVERIFY(!handled.handled);
+
+	async.finish();
+	QTRY_VERIFY(handled.handled);
+	QCOMPARE(handled.result, MessageHandler::Accept);
+	QCOMPARE(handled.message.text(), QLatin1String("abc"));
+}
+
+void MessageHandlerTest::unregister()
+{
+	TestMessageHandler first(QLatin1String("a"));
+	{
+		TestMessageHandler second(QLatin1String("b"));
+		MessageHandler::registerHandler(&first);
+		MessageHandler::registerHandler(&second);
+	}
+
+	HandledMessage handled;
+	handleMessage(incoming(QString()), &handled);
+	QCOMPARE(handled.message.text(), QLatin1String("a"));
+
+	MessageHandler::unregisterHandler(&first);
+	handleMessage(incoming(QLatin1String("text")), &handled);
+	QCOMPARE(handled.message.text(), QLatin1String("text"));
+}
+
+void MessageHandlerTest::chain_data()
+{
+	QTest::addColumn<int>("handlers");
+	QTest::newRow("1") << 1;
+	QTest::newRow("10") << 10;
+	QTest::newRow("30") << 30;
+}
+
+// Cost of passing messages through the chain of handlers, which answer at once
+void MessageHandlerTest::chain()
+{
+	QFETCH(int, handlers);
+	QList<TestMessageHandler *> list;
+	for (int i = 0; i < handlers; ++i) {
+		list << new TestMessageHandler(QString());
+		MessageHandler::registerHandler(list.last(), MessageHandler::NormalPriortity + i);
+	}
+
+	const Message message = incoming(QLatin1String("text"));
+	HandledMessage handled;
+	QBENCHMARK {
+		for (int i = 0; i < 1000; ++i)
+			handleMessage(message, &handled);
+	}
+	QCOMPARE(handled.result, MessageHandler::Accept);
+	qDeleteAll(list);
+}
+
+int testMessageHandler(int argc, char *argv[])
+{
+	MessageHandlerTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "messagehandlertest.moc"
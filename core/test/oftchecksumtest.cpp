@@ -0,0 +1,160 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "tests.h"
+#include "../../protocols/oscar/src/oftchecksum.h"
+#include <QtTest>
+
+using namespace qutim_sdk_0_3::oscar;
+
+// Byte loop OftChecksumThread used before, adapted from miranda's oft_calc_checksum
+static quint32 referenceChecksum(const char *buffer, int len, quint32 oldChecksum, int offset)
+{
+	quint32 checksum = (oldChecksum >> 16) & 0xffff;
+	for (int i = 0; i < len; i++)
+	{
+		quint16 val = buffer[i];
+		if (((i + offset) & 1) == 0)
+			val = val << 8;
+		if (checksum < val)
+			checksum -= val + 1;
+		else // simulate carry
+			checksum -= val;
+	}
+	checksum = ((checksum & 0x0000ffff) + (checksum >> 16));
+	checksum = ((checksum & 0x0000ffff) + (checksum >> 16));
+	return (quint32)checksum << 16;
+}
+
+// Bytes with the high bit set check sign extension of the reference
+static QByteArray randomData(int size)
+{
+	QByteArray data(size, Qt::Uninitialized);
+	for (int i = 0; i < size; ++i)
+		data[i] = char(qrand());
+	return data;
+}
+
+class OftChecksumTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void empty();
+	void lengths_data();
+	void lengths();
+	void alignments();
+	void chunks_data();
+	void chunks();
+};
+
+void OftChecksumTest::initTestCase()
+{
+	qsrand(7);
+}
+
+void OftChecksumTest::empty()
+{
+	const char data[] = "";
+	QCOMPARE(OftChecksum::sum(data, 0, 0), quint64(0));
+	QCOMPARE(OftChecksum::update(0xffff0000, data, 0, 0), referenceChecksum(data, 0, 0xffff0000, 0));
+	QCOMPARE(OftChecksum::update(0x12340000, data, 0, 1), referenceChecksum(data, 0, 0x12340000, 1));
+}
+
+void OftChecksumTest::lengths_data()
+{
+	QTest::addColumn<int>("size");
+	// Around the blocks of SSE2 and AVX2 code and the scalar tail after them
+	const int sizes[] = { 1, 2, 3, 15, 16, 17, 31, 32, 33, 63, 64, 65, 255, 1023, 4097, 65537 };
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+		QTest::newRow(QByteArray::number(sizes[i]).constData()) << sizes[i];
+}
+
+void OftChecksumTest::lengths()
+{
+	QFETCH(int, size);
+	const QByteArray data = randomData(size);
+	for (int position = 0; position < 2; ++position) {
+		QCOMPARE(OftChecksum::update(0xffff0000, data.constData(), size, position),
+		         referenceChecksum(data.constData(), size, 0xffff0000, position));
+	}
+	const quint32 checksum = quint32(qrand()) << 16;
+	QCOMPARE(OftChecksum::update(checksum, data.constData(), size, 0),
+	         referenceChecksum(data.constData(), size, checksum, 0));
+}
+
+void OftChecksumTest::alignments()
+{
+	const QByteArray data = randomData(1024 + 64);
+	// Unaligned loads and odd positions in the file
+	for (int start = 0; start < 64; ++start) {
+		for (int position = 0; position < 4; ++position) {
+			const int size = 1024 - start % 3;
+			QCOMPARE(OftChecksum::update(0xffff0000, data.constData() + start, size, position),
+			         referenceChecksum(data.constData() + start, size, 0xffff0000, position));
+		}
+	}
+}
+
+void OftChecksumTest::chunks_data()
+{
+	QTest::addColumn<int>("chunk");
+	QTest::newRow("odd") << 7;
+	QTest::newRow("block") << 32;
+	QTest::newRow("block + 1") << 33;
+	QTest::newRow("large odd") << 4095;
+}
+
+void OftChecksumTest::chunks()
+{
+	QFETCH(int, chunk);
+	const int size = 16 * 1024 + 5;
+	const QByteArray data = randomData(size);
+
+	// Receiver used to update checksum by every received chunk
+	quint32 checksum = 0xffff0000;
+	quint32 reference = 0xffff0000;
+	quint64 sum = 0;
+	for (int offset = 0; offset < size; offset += chunk) {
+		const int length = qMin(chunk, size - offset);
+		const char *part = data.constData() + offset;
+		checksum = OftChecksum::update(checksum, part, length, offset);
+		reference = referenceChecksum(part, length, reference, offset);
+		sum += OftChecksum::sum(part, length, offset);
+	}
+	QCOMPARE(checksum, reference);
+
+	// Sums of parts are added by the checksum thread
+	QCOMPARE(OftChecksum::update(0xffff0000, sum),
+	         referenceChecksum(data.constData(), size, 0xffff0000, 0));
+}
+
+int testOftChecksum(int argc, char *argv[])
+{
+	OftChecksumTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "oftchecksumtest.moc"
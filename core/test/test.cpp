@@ -28,6 +28,10 @@
 
 
 #include "k8json.h"
+#include "../libqutim/json.h"
+#include "tests.h"
+
+using namespace qutim_sdk_0_3;
 
 
 static void testCounter () {
@@ -235,8 +239,80 @@ static void testReaderAll2 () {
 }
 
 
-int main (/*int argc, char *argv[]*/) {
-  QTextCodec::setCodecForCStrings(QTextCodec::codecForName("koi8-u"));
+/*
+ * JsonHistory needs a single field of every record, compare building
+ * of whole records with pulling of the field by Json::Reader
+ */
+static void testHistoryFields () {
+  do {
+
+  QFile fl("tc_hist.json");
+  if (!fl.open(QIODevice::ReadOnly)) {
+    fprintf(stderr, "ERROR: can't open input file!\n");
+    return;
+  }
+
+  const uchar *fmap = (const uchar *)(fl.map(0, fl.size()));
+  int len = fl.size();
+  const uchar *sj = Json::skipBlanks(fmap, &len);
+  if (!sj || *sj != '[') {
+    fprintf(stderr, "ERROR: invalid JSON file!\n");
+    break;
+  }
+  sj++; len--;
+
+  int cnt = 0;
+  QTime st;
+  st.start();
+
+  QVariant val;
+  while (sj) {
+    sj = Json::skipBlanks(sj, &len);
+    if (len < 2 || (sj && *sj == ']')) break;
+    if (*sj == ',') { sj++; len--; }
+    val.clear();
+    sj = Json::parseRecord(val, sj, &len);
+    if (!sj) {
+      fprintf(stderr, "ERROR: invalid JSON file!\n");
+      break;
+    }
+    if (!val.toMap().value("datetime").toString().isEmpty()) cnt++;
+  }
+  qDebug() << "parseRecord time taken (ms):" << st.elapsed();
+  fprintf(stdout, "%i datetimes found.\n", cnt);
+
+  cnt = 0;
+  st.start();
+
+  Json::Reader reader(fmap, fl.size());
+  if (reader.next() != Json::Reader::BeginArray) {
+    fprintf(stderr, "ERROR: invalid JSON file!\n");
+    break;
+  }
+  while (reader.next() == Json::Reader::BeginObject) {
+    while (reader.next() == Json::Reader::Key) {
+      const bool found = reader.keyEquals("datetime");
+      reader.next();
+      if (found) {
+        if (!reader.toString().isEmpty()) cnt++;
+      } else if (!reader.skipValue()) {
+        break;
+      }
+    }
+  }
+  if (reader.token() != Json::Reader::EndArray) {
+    fprintf(stderr, "ERROR: invalid JSON file!\n");
+    break;
+  }
+  qDebug() << "Reader time taken (ms):" << st.elapsed();
+  fprintf(stdout, "%i datetimes found.\n", cnt);
+
+  } while (0);
+}
+
+
+int main (int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
   QTextCodec::setCodecForLocale(QTextCodec::codecForName("koi8-u"));
 
 /*
@@ -253,7 +329,22 @@ int main (/*int argc, char *argv[]*/) {
   testReader();
   //testReaderAll();
   //testReaderAll2();
-
-  return 0;
+  //testHistoryFields();
+
+  int failed = 0;
+  failed += testAsyncResult(argc, argv);
+  failed += testConfig(argc, argv);
+  failed += testContactList(argc, argv);
+  failed += testFileTransfer(argc, argv);
+  failed += testFlap(argc, argv);
+  failed += testIrcMessage(argc, argv);
+  failed += testIrcSendQueue(argc, argv);
+  failed += testJsonHistoryIndex(argc, argv);
+  failed += testJsonHistoryTailCache(argc, argv);
+  failed += testMessageHandler(argc, argv);
+  failed += testOftChecksum(argc, argv);
+  failed += testTlv(argc, argv);
+
+  return failed ? 1 : 0;
 }
 
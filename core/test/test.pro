@@ -1,8 +1,9 @@
 TEMPLATE = app
 TARGET = test
 
-QT -= xml gui
-CONFIG += qt console warn_on
+QT -= xml
+QT += network testlib
+CONFIG += qt console warn_on c++11
 CONFIG += debug_and_release
 #CONFIG += debug
 #CONFIG += release
@@ -32,5 +33,47 @@ DEFINES += K8JSON_INCLUDE_WRITER
 DEFINES += K8JSON_INCLUDE_GENERATOR
 include(../k8json.pri)
 
+# Tests of libqutim link to the library built by qbs, point QUTIM_BUILD_DIR
+# to the build directory of the product and QUTIM_LIB_DIR to the library
+QUTIM_BUILD_DIR = $$(QUTIM_BUILD_DIR)
+QUTIM_LIB_DIR = $$(QUTIM_LIB_DIR)
+isEmpty(QUTIM_LIB_DIR): QUTIM_LIB_DIR = $$QUTIM_BUILD_DIR
+INCLUDEPATH += \
+  $$QUTIM_BUILD_DIR/GeneratedFiles/libqutim/include \
+  $$QUTIM_BUILD_DIR/GeneratedFiles/libqutim/include/qutim
+# qbs names the library after the product
+LIBS += -L$$QUTIM_LIB_DIR -llibqutim
+
+# Sources of liboscar are built in
+DEFINES += LIBOSCAR_LIBRARY
+
+HEADERS += \
+  $$PWD/tests.h \
+  $$PWD/../src/corelayers/contactmodel/src/contactlistbasemodel.h \
+  $$PWD/../src/corelayers/contactmodel/src/contactlistgroupmodel.h
+
 SOURCES += \
-  $$PWD/test.cpp
+  $$PWD/test.cpp \
+  $$PWD/asyncresulttest.cpp \
+  $$PWD/configtest.cpp \
+  $$PWD/contactlisttest.cpp \
+  $$PWD/../src/corelayers/contactmodel/src/contactlistbasemodel.cpp \
+  $$PWD/../src/corelayers/contactmodel/src/contactlistgroupmodel.cpp \
+  $$PWD/filetransfertest.cpp \
+  $$PWD/flaptest.cpp \
+  $$PWD/../../protocols/oscar/src/flap.cpp \
+  $$PWD/../../protocols/oscar/src/dataunit.cpp \
+  $$PWD/../../protocols/oscar/src/util.cpp \
+  $$PWD/ircmessagetest.cpp \
+  $$PWD/../../protocols/irc/src/ircmessage.cpp \
+  $$PWD/ircsendqueuetest.cpp \
+  $$PWD/../../protocols/irc/src/ircsendqueue.cpp \
+  $$PWD/jsonhistoryindextest.cpp \
+  $$PWD/../src/corelayers/jsonhistory/jsonhistoryindex.cpp \
+  $$PWD/jsonhistorytailcachetest.cpp \
+  $$PWD/../src/corelayers/jsonhistory/jsonhistorytailcache.cpp \
+  $$PWD/messagehandlertest.cpp \
+  $$PWD/oftchecksumtest.cpp \
+  $$PWD/../../protocols/oscar/src/oftchecksum.cpp \
+  $$PWD/tlvtest.cpp \
+  $$PWD/../../protocols/oscar/src/tlv.cpp
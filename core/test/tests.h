@@ -0,0 +1,43 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef TESTS_H
+#define TESTS_H
+
+// Every function runs a QtTest object and returns the number of failed tests
+int testAsyncResult(int argc, char *argv[]);
+int testConfig(int argc, char *argv[]);
+int testContactList(int argc, char *argv[]);
+int testFileTransfer(int argc, char *argv[]);
+int testFlap(int argc, char *argv[]);
+int testIrcMessage(int argc, char *argv[]);
+int testIrcSendQueue(int argc, char *argv[]);
+int testJsonHistoryIndex(int argc, char *argv[]);
+int testJsonHistoryTailCache(int argc, char *argv[]);
+int testMessageHandler(int argc, char *argv[]);
+int testOftChecksum(int argc, char *argv[]);
+int testTlv(int argc, char *argv[]);
+
+#endif // TESTS_H
@@ -0,0 +1,248 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+#include "tests.h"
+#include "../../protocols/oscar/src/tlv.h"
+#include <QtTest>
+
+using namespace qutim_sdk_0_3::oscar;
+
+static QByteArray tlvBytes(quint16 type, const QByteArray &data)
+{
+	DataUnit unit;
+	unit.append<quint16>(type);
+	unit.append<quint16>(quint16(data.size()));
+	unit.append(data);
+	return unit.data();
+}
+
+// Block of TLVs as a typical SNAC carries them, types are not sorted
+static QByteArray snacBlock()
+{
+	QByteArray block;
+	for (int i = 0; i < 12; ++i) {
+		const quint16 type = quint16((i * 7) % 12 + 1);
+		block += tlvBytes(type, QByteArray(i * 3, char('a' + i)));
+	}
+	return block;
+}
+
+// Parsing of TLVs into QMap TLVMap has replaced
+static QMap<quint16, TLV> referenceRead(const QByteArray &block)
+{
+	QMap<quint16, TLV> tlvs;
+	DataUnit data(block);
+	while (data.dataSize() >= 4) {
+		TLV tlv = data.read<TLV>();
+		if (tlv.type() == 0xffff)
+			break;
+		tlvs.insert(tlv.type(), tlv);
+	}
+	return tlvs;
+}
+
+class TlvTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void read();
+	void duplicates();
+	void bounds();
+	void detached();
+	void rawData();
+	void insert();
+	void write();
+	void parse_data();
+	void parse();
+};
+
+void TlvTest::read()
+{
+	const QByteArray block = snacBlock();
+	const TLVMap tlvs = TLVMap::fromByteArray(block);
+	const QMap<quint16, TLV> reference = referenceRead(block);
+	QCOMPARE(tlvs.size(), reference.size());
+
+	// Map is iterated in order of types as QMap was
+	QMap<quint16, TLV>::const_iterator expected = reference.constBegin();
+	for (TLVMap::const_iterator it = tlvs.constBegin(); it != tlvs.constEnd(); ++it, ++expected) {
+		QCOMPARE(it.key(), expected.key());
+		QCOMPARE(it->data(), expected->data());
+		QVERIFY(tlvs.contains(it.key()));
+		QCOMPARE(tlvs.value(it.key()).data(), expected->data());
+	}
+	QVERIFY(!tlvs.contains(0));
+	QVERIFY(tlvs.find(100) == tlvs.constEnd());
+	QVERIFY(tlvs.value(100).data().isEmpty());
+	QVERIFY(tlvs.values(100).isEmpty());
+}
+
+void TlvTest::duplicates()
+{
+	QByteArray block;
+	block += tlvBytes(0x0002, QByteArray("first"));
+	block += tlvBytes(0x0001, QByteArray("\x00\x00\x00\x2a", 4));
+	block += tlvBytes(0x0002, QByteArray("second"));
+	const TLVMap tlvs = TLVMap::fromByteArray(block);
+
+	// The later TLV of the same type wins
+	QCOMPARE(tlvs.size(), 2);
+	QCOMPARE(tlvs.value(0x0002).data(), QByteArray("second"));
+	QCOMPARE(tlvs.values(0x0002).size(), 1);
+	QCOMPARE(tlvs.value<quint32>(0x0001), quint32(42));
+	QCOMPARE(tlvs.value<quint32>(0x0003, 7), quint32(7));
+	// Typed values may be read repeatedly
+	QCOMPARE(tlvs.value<quint32>(0x0001), quint32(42));
+}
+
+void TlvTest::bounds()
+{
+	QByteArray block;
+	block += tlvBytes(0x0001, QByteArray("one"));
+	block += tlvBytes(0x0002, QByteArray("two"));
+	block += tlvBytes(0xffff, QByteArray());
+	block += tlvBytes(0x0003, QByteArray("three"));
+
+	// Type 0xffff ends the block
+	DataUnit data(block);
+	TLVMap tlvs = data.read<TLVMap>();
+	QCOMPARE(tlvs.size(), 2);
+	QCOMPARE(data.dataSize(), uint(tlvBytes(0x0003, QByteArray("three")).size()));
+
+	// Reading is limited by the count and the rest is left in the data unit
+	data.setData(block);
+	tlvs = TLVMap::read(data, 1);
+	QCOMPARE(tlvs.size(), 1);
+	QCOMPARE(data.read<TLV>().type(), quint16(0x0002));
+
+	// Truncated TLV gets the rest of the data
+	QByteArray truncated = tlvBytes(0x0004, QByteArray("four"));
+	truncated.chop(2);
+	tlvs = TLVMap::fromByteArray(truncated);
+	QCOMPARE(tlvs.value(0x0004).data(), QByteArray("fo"));
+}
+
+void TlvTest::detached()
+{
+	TLV tlv;
+	const char *blockData = 0;
+	{
+		QByteArray block = snacBlock();
+		const TLVMap tlvs = TLVMap::fromByteArray(block);
+		blockData = tlvs.find(5)->data().constData();
+		tlv = tlvs.value(5);
+		QVERIFY(tlv.data().constData() != blockData);
+		block.fill('x');
+	}
+	// Value outlives both the map and the source data
+	QCOMPARE(tlv.data(), referenceRead(snacBlock()).value(5).data());
+}
+
+void TlvTest::rawData()
+{
+	const DataUnit unit(QByteArray("\x00\x03" "abcdef", 8));
+	QCOMPARE(unit.read<QString, quint16>(), QString::fromLatin1("abc"));
+	// Views point into the unit, copies may outlive it
+	const QByteArray view = unit.readRawData(2);
+	QCOMPARE(view, QByteArray("de"));
+	QCOMPARE(view.constData(), unit.data().constData() + 5);
+	const QByteArray copy = unit.readData(10);
+	QCOMPARE(copy, QByteArray("f"));
+	QVERIFY(copy.constData() != unit.data().constData() + 7);
+	QCOMPARE(unit.dataSize(), 0u);
+	QVERIFY(unit.readRawData(1).isEmpty());
+}
+
+void TlvTest::insert()
+{
+	TLVMap tlvs;
+	tlvs.insert<quint16>(0x0003, 3);
+	tlvs.insert<quint16>(0x0001, 1);
+	tlvs.insert(0x0002);
+	tlvs.insert<quint16>(0x0001, 10);
+	QCOMPARE(tlvs.size(), 3);
+	QCOMPARE(tlvs.value<quint16>(0x0001), quint16(10));
+	QList<quint16> types;
+	foreach (const TLV &tlv, tlvs)
+		types << tlv.type();
+	QCOMPARE(types, QList<quint16>() << 1 << 2 << 3);
+
+	QCOMPARE(tlvs.remove(0x0002), 1);
+	QCOMPARE(tlvs.remove(0x0002), 0);
+	QCOMPARE(tlvs.size(), 2);
+	QCOMPARE(tlvs.valuesSize(), quint32(12));
+}
+
+void TlvTest::write()
+{
+	QMap<quint16, TLV> reference = referenceRead(snacBlock());
+	const TLVMap tlvs(reference);
+
+	QByteArray expected;
+	foreach (const TLV &tlv, reference)
+		expected += tlv.toByteArray();
+	QCOMPARE(QByteArray(tlvs), expected);
+	QCOMPARE(int(tlvs.valuesSize()), expected.size());
+
+	DataUnit unit;
+	unit.append<quint16>(0x0102);
+	unit.append(tlvs);
+	QCOMPARE(unit.data().mid(2), expected);
+	QCOMPARE(TLVMap::fromByteArray(expected).size(), reference.size());
+}
+
+void TlvTest::parse_data()
+{
+	QTest::addColumn<bool>("reference");
+	QTest::newRow("TLVMap") << false;
+	QTest::newRow("QMap") << true;
+}
+
+// Cost of parsing TLVs of a SNAC and looking up a few of them
+void TlvTest::parse()
+{
+	QFETCH(bool, reference);
+	const QByteArray block = snacBlock();
+	int found = 0;
+	QBENCHMARK {
+		for (int i = 0; i < 1000; ++i) {
+			if (reference) {
+				const QMap<quint16, TLV> tlvs = referenceRead(block);
+				found += tlvs.contains(3) + tlvs.contains(7) + tlvs.contains(11);
+			} else {
+				const TLVMap tlvs = TLVMap::fromByteArray(block);
+				found += tlvs.contains(3) + tlvs.contains(7) + tlvs.contains(11);
+			}
+		}
+	}
+	QVERIFY(found > 0);
+}
+
+int testTlv(int argc, char *argv[])
+{
+	TlvTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "tlvtest.moc"
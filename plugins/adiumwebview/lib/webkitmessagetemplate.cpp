@@ -0,0 +1,285 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "webkitmessagetemplate_p.h"
+#include <QStringMatcher>
+#include <qutim/libqutim_global.h>
+
+namespace qutim_sdk_0_3 {
+LIBQUTIM_EXPORT QString convertTimeDate(const QString &macFormat, const QDateTime &datetime);
+LIBQUTIM_EXPORT void validateCpp(const QString &text, QString *result);
+}
+
+using namespace qutim_sdk_0_3;
+
+typedef WebKitMessageKeywords Keywords;
+
+static const char * const keywordNames[] = {
+	"time",
+	"messageId",
+	"shortTime",
+	"userIcons",
+	"messageClasses",
+	"senderColor",
+	"messageDirection",
+	"time{",
+	"userIconPath",
+	"service",
+	"serviceIconPath",
+	"variant",
+	"status",
+	"statusSender",
+	"senderScreenName",
+	"senderPrefix",
+	"sender",
+	"senderDisplayName",
+	"statusPhrase",
+	"message",
+	"topic"
+};
+
+static inline QString keywordPattern(int keyword)
+{
+	return QLatin1Char('%') + QLatin1String(keywordNames[keyword]) + QLatin1Char('%');
+}
+
+// Returns keyword which starts by '%' at pos and the position right after it
+static int keywordAt(const QString &html, int pos, int *end)
+{
+	if (html.midRef(pos + 1, 5) == QLatin1String(keywordNames[Keywords::TimeFormatKeyword])) {
+		const int close = html.indexOf(QLatin1String("}%"), pos + 6);
+		if (close != -1) {
+			*end = close + 2;
+			return Keywords::TimeFormatKeyword;
+		}
+	}
+	const int close = html.indexOf(QLatin1Char('%'), pos + 1);
+	if (close == -1)
+		return -1;
+	const QStringRef name = html.midRef(pos + 1, close - pos - 1);
+	for (int keyword = 0; keyword < Keywords::KeywordCount; ++keyword) {
+		if (keyword != Keywords::TimeFormatKeyword && name == QLatin1String(keywordNames[keyword])) {
+			*end = close + 1;
+			return keyword;
+		}
+	}
+	return -1;
+}
+
+static bool containsKeyword(const QString &text)
+{
+	int end;
+	for (int pos = 0; (pos = text.indexOf(QLatin1Char('%'), pos)) != -1; ++pos) {
+		if (keywordAt(text, pos, &end) != -1)
+			return true;
+	}
+	return false;
+}
+
+static inline void append(QString *result, const QString &text, bool escape)
+{
+	if (escape)
+		validateCpp(text, result);
+	else
+		*result += text;
+}
+
+WebKitMessageKeywords::WebKitMessageKeywords() : m_size(0), m_unsafe(false)
+{
+	for (int i = 0; i < KeywordCount; ++i)
+		m_defined[i] = false;
+}
+
+void WebKitMessageKeywords::setValue(Keyword keyword, const QString &value)
+{
+	m_size += value.size() - m_values[keyword].size();
+	m_values[keyword] = value;
+	m_defined[keyword] = true;
+	// Replacement chain looks for keywords inside of everything inserted before the message
+	if (keyword != MessageKeyword && keyword != TopicKeyword && value.contains(QLatin1Char('%')))
+		m_unsafe = true;
+}
+
+bool WebKitMessageKeywords::isSafe() const
+{
+	// %topic% is looked for after the message is inserted
+	return !m_unsafe && !(m_defined[TopicKeyword]
+	                      && m_values[MessageKeyword].contains(QLatin1Char('%')));
+}
+
+WebKitMessageTemplate::WebKitMessageTemplate()
+{
+	clear();
+}
+
+void WebKitMessageTemplate::clear()
+{
+	m_html.clear();
+	m_tokens.clear();
+	m_compiled = false;
+	m_hasStatusPhrase = false;
+	m_size = 0;
+	m_escapedSize = 0;
+}
+
+void WebKitMessageTemplate::setHtml(const QString &html)
+{
+	clear();
+	m_html = html;
+	m_compiled = true;
+
+	int literalStart = 0;
+	int pos = 0;
+	while ((pos = html.indexOf(QLatin1Char('%'), pos)) != -1) {
+		int end;
+		const int keyword = keywordAt(html, pos, &end);
+		if (keyword == -1) {
+			++pos;
+			continue;
+		}
+		appendLiteral(html.mid(literalStart, pos - literalStart));
+
+		Token token;
+		token.keyword = keyword;
+		if (keyword == Keywords::TimeFormatKeyword) {
+			token.text = html.mid(pos + 6, end - pos - 8);
+		} else {
+			token.text = html.mid(pos, end - pos);
+			validateCpp(token.text, &token.escaped);
+		}
+		m_tokens << token;
+		if (keyword == Keywords::StatusPhraseKeyword)
+			m_hasStatusPhrase = true;
+
+		// Replacement chain finds something else if the keyword shares '%' with
+		// the next one, if the format of %time{}% contains keywords or if the
+		// text around the keyword forms another keyword after empty replacement
+		int next;
+		if (keywordAt(html, end - 1, &next) != -1
+		        || (keyword == Keywords::TimeFormatKeyword && containsKeyword(token.text))) {
+			m_compiled = false;
+		} else if (pos > 0) {
+			const int left = html.lastIndexOf(QLatin1Char('%'), pos - 1);
+			const int right = html.indexOf(QLatin1Char('%'), end);
+			if (left != -1 && right != -1) {
+				const QString joined = html.mid(left, pos - left) + html.mid(end, right + 1 - end);
+				if (keywordAt(joined, 0, &next) != -1)
+					m_compiled = false;
+			}
+		}
+
+		pos = literalStart = end;
+	}
+	appendLiteral(html.mid(literalStart));
+}
+
+void WebKitMessageTemplate::appendLiteral(const QString &text)
+{
+	if (text.isEmpty())
+		return;
+	Token token;
+	token.keyword = -1;
+	token.text = text;
+	validateCpp(text, &token.escaped);
+	m_size += token.text.size();
+	m_escapedSize += token.escaped.size();
+	m_tokens << token;
+}
+
+void WebKitMessageTemplate::render(QString *result, const WebKitMessageKeywords &keywords, bool escape) const
+{
+	if (m_html.isEmpty())
+		return;
+	const int start = result->size();
+	if (m_compiled && keywords.isSafe()) {
+		result->reserve(start + (escape ? m_escapedSize : m_size) + keywords.size() + 64);
+		if (renderTokens(result, keywords, escape))
+			return;
+		result->truncate(start);
+	}
+	QString html = m_html;
+	fillKeywords(html, keywords);
+	append(result, html, escape);
+}
+
+bool WebKitMessageTemplate::renderTokens(QString *result, const WebKitMessageKeywords &keywords, bool escape) const
+{
+	const bool replacedStatusPhrase = m_hasStatusPhrase && keywords.hasValue(Keywords::StatusPhraseKeyword);
+	foreach (const Token &token, m_tokens) {
+		if (token.keyword == -1) {
+			*result += escape ? token.escaped : token.text;
+		} else if (token.keyword == Keywords::TimeFormatKeyword) {
+			const QString time = convertTimeDate(token.text, keywords.date());
+			if (time.contains(QLatin1Char('%')))
+				return false;
+			append(result, time, escape);
+		} else if (!keywords.hasValue(token.keyword)) {
+			*result += escape ? token.escaped : token.text;
+		} else if (token.keyword == Keywords::MessageKeyword && replacedStatusPhrase) {
+			continue;
+		} else {
+			append(result, keywords.value(token.keyword), escape);
+		}
+	}
+	return true;
+}
+
+QString &WebKitMessageTemplate::fillKeywords(QString &html, const WebKitMessageKeywords &keywords)
+{
+	bool replacedStatusPhrase = false;
+	for (int keyword = 0; keyword < Keywords::KeywordCount; ++keyword) {
+		if (keyword == Keywords::TimeFormatKeyword) {
+			//Replaces %time{x}% with a timestamp formatted like x (using NSDateFormatter)
+			const QStringMatcher matcher(QLatin1String("%time{"));
+			const int matcherSize = matcher.pattern().size();
+			const QStringMatcher endMatcher(QLatin1String("}%"));
+			const int endMatcherSize = endMatcher.pattern().size();
+			int range = 0;
+			while ((range = matcher.indexIn(html, range)) != -1) {
+				int endRange = endMatcher.indexIn(html, range + matcherSize);
+				if (endRange == -1)
+					break;
+				QString timeFormat = html.mid(range + matcherSize, endRange - range - matcherSize);
+				QString time = convertTimeDate(timeFormat, keywords.date());
+				html.replace(range, endRange + endMatcherSize - range, time);
+				range = range + time.size();
+			}
+			continue;
+		}
+		if (!keywords.hasValue(keyword))
+			continue;
+		const QString pattern = keywordPattern(keyword);
+		if (keyword == Keywords::StatusPhraseKeyword) {
+			if (!html.contains(pattern))
+				continue;
+			replacedStatusPhrase = true;
+		}
+		if (keyword == Keywords::MessageKeyword && replacedStatusPhrase)
+			html.replace(pattern, QString());
+		else
+			html.replace(pattern, keywords.value(keyword));
+	}
+	return html;
+}
@@ -0,0 +1,127 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Ruslan Nigmatullin <euroelessar@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef WEBKITMESSAGETEMPLATE_P_H
+#define WEBKITMESSAGETEMPLATE_P_H
+
+#include <QString>
+#include <QVector>
+#include <QDateTime>
+
+/*
+ * Values of message style keywords for a single message. Keywords are listed
+ * in the order they have always been replaced in, as the replacement chain
+ * is still used for templates which can't be compiled unambiguously.
+ * Keywords without a value are left in the template as is.
+ */
+class WebKitMessageKeywords
+{
+public:
+	enum Keyword {
+		TimeKeyword,
+		MessageIdKeyword,
+		ShortTimeKeyword,
+		UserIconsKeyword,
+		MessageClassesKeyword,
+		SenderColorKeyword,
+		MessageDirectionKeyword,
+		TimeFormatKeyword, // %time{format}%, formatted from date()
+		UserIconPathKeyword,
+		ServiceKeyword,
+		ServiceIconPathKeyword,
+		VariantKeyword,
+		StatusKeyword,
+		StatusSenderKeyword,
+		SenderScreenNameKeyword,
+		SenderPrefixKeyword,
+		SenderKeyword,
+		SenderDisplayNameKeyword,
+		StatusPhraseKeyword, // replaces %message% if template has it
+		MessageKeyword,
+		TopicKeyword,
+		KeywordCount
+	};
+
+	WebKitMessageKeywords();
+
+	QDateTime date() const { return m_date; }
+	void setDate(const QDateTime &date) { m_date = date; }
+	bool hasValue(int keyword) const { return m_defined[keyword]; }
+	const QString &value(int keyword) const { return m_values[keyword]; }
+	void setValue(Keyword keyword, const QString &value);
+	// Total size of all values
+	int size() const { return m_size; }
+	// Values may be inserted by a single pass if replacement chain wouldn't find anything inside of them
+	bool isSafe() const;
+
+private:
+	QDateTime m_date;
+	QString m_values[KeywordCount];
+	bool m_defined[KeywordCount];
+	int m_size;
+	bool m_unsafe;
+};
+
+/*
+ * Content template (Content.html, NextContent.html, Status.html and so on)
+ * split once into literal slices and keyword slots, so a message is rendered
+ * by a single pass into a preallocated buffer instead of a chain of
+ * QString::replace calls over the whole template.
+ */
+class WebKitMessageTemplate
+{
+public:
+	WebKitMessageTemplate();
+
+	void setHtml(const QString &html);
+	const QString &html() const { return m_html; }
+	bool isEmpty() const { return m_html.isEmpty(); }
+	void clear();
+
+	// Appends filled template to result, escaped like validateCpp does if escape is true
+	void render(QString *result, const WebKitMessageKeywords &keywords, bool escape) const;
+	// Classic replacement chain, output of render() is always the same
+	static QString &fillKeywords(QString &html, const WebKitMessageKeywords &keywords);
+
+private:
+	struct Token
+	{
+		int keyword; // -1 for literal text
+		QString text; // literal text, original keyword text or format of %time{format}%
+		QString escaped;
+	};
+
+	bool renderTokens(QString *result, const WebKitMessageKeywords &keywords, bool escape) const;
+	void appendLiteral(const QString &text);
+
+	QString m_html;
+	QVector<Token> m_tokens;
+	bool m_compiled;
+	bool m_hasStatusPhrase;
+	int m_size;
+	int m_escapedSize;
+};
+
+#endif // WEBKITMESSAGETEMPLATE_P_H
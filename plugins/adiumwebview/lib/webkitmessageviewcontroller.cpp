@@ -35,9 +35,45 @@
 #include <qutim/thememanager.h>
 #include <QDesktopServices>
 #include <QWebFrame>
+#include <QtConcurrentMap>
 
 using namespace qutim_sdk_0_3;
 
+// Html of the message, taken at the GUI thread. Message computes its html
+// lazily inside of the shared data, so workers must not touch messages at all
+struct WebKitMessageText
+{
+	WebKitMessageText(const Message &msg)
+		: html(msg.html()), topic(msg.property("topic", false)) {}
+	
+	QString html;
+	bool topic;
+};
+
+// Parses urls and emoticons, called by worker threads for batches of messages
+struct WebKitMessagePreparer
+{
+	typedef QString result_type;
+	
+	QString operator()(const WebKitMessageText &text) const
+	{
+		// We don't want emoticons in topic
+		if (text.topic)
+			return UrlParser::parseUrls(text.html, UrlParser::Html);
+		return EmoticonsTheme(theme).parseEmoticons(text.html, EmoticonsTheme::ParseUrls);
+	}
+	
+	static Message prepared(const Message &msg, const QString &html)
+	{
+		Message copy = msg;
+		copy.setHtml(html);
+		copy.setProperty("messageId", msg.id());
+		return copy;
+	}
+	
+	EmoticonsTheme theme;
+};
+
 WebViewLoaderLoop::WebViewLoaderLoop()
 {
 }
@@ -88,9 +124,11 @@ void WebViewLoaderLoop::onPageDestroyed()
 Q_GLOBAL_STATIC(WebViewLoaderLoop, loaderLoop)
 
 WebKitMessageViewController::WebKitMessageViewController(bool isPreview) :
-	m_page(0), m_isLoading(false), m_isPreview(isPreview)
+	m_page(0), m_isLoading(false), m_isPreview(isPreview), m_historyPending(0),
+	m_batchWatcher(new QFutureWatcher<QString>(this))
 {
 	m_topic.setProperty("topic", true);
+	connect(m_batchWatcher, SIGNAL(finished()), SLOT(onBatchPrepared()));
 }
 
 WebKitMessageViewController::~WebKitMessageViewController()
@@ -126,31 +164,117 @@ WebKitMessageViewStyle *WebKitMessageViewController::style()
 
 void WebKitMessageViewController::appendMessage(const qutim_sdk_0_3::Message &msg)
 {
-	Message copy = msg;
-	QString html = UrlParser::parseUrls(copy.html(), UrlParser::Html);
-	copy.setProperty("messageId", msg.id());
+	// Live messages are shown below the history which is still loaded
+	if (m_historyPending > 0 && !msg.property("history", false)) {
+		m_delayed << msg;
+		return;
+	}
+	// Keep order of messages while a batch is loaded
+	if (m_historyPending > 0 || !m_preparing.isEmpty()) {
+		m_batch << msg;
+		return;
+	}
+	WebKitMessagePreparer preparer;
+	preparer.theme = Emoticons::theme();
+	QString script = scriptForMessage(msg, preparer.prepared(msg, preparer(msg)), false);
+	if (!script.isEmpty())
+		evaluateJavaScript(script);
+}
+
+void WebKitMessageViewController::appendMessages(const qutim_sdk_0_3::MessageList &messages)
+{
+	m_batch << messages;
+	if (m_historyPending == 0 && m_preparing.isEmpty())
+		prepareBatch();
+}
+
+void WebKitMessageViewController::onHistoryMessageHandled()
+{
+	if (--m_historyPending > 0)
+		return;
+	m_batch << m_delayed;
+	m_delayed.clear();
+	prepareBatch();
+}
+
+void WebKitMessageViewController::prepareBatch()
+{
+	if (m_batch.isEmpty())
+		return;
+	m_preparing.swap(m_batch);
+#ifndef QT_NO_DEBUG
+	// History can't be shown below a live message
+	bool live = false;
+	foreach (const Message &msg, m_preparing) {
+		const bool history = msg.property("history", false);
+		Q_ASSERT(!history || !live);
+		live = live || !history;
+	}
+#endif
+	QList<WebKitMessageText> texts;
+	texts.reserve(m_preparing.size());
+	foreach (const Message &msg, m_preparing)
+		texts << msg;
+	WebKitMessagePreparer preparer;
+	preparer.theme = Emoticons::theme();
+	m_batchWatcher->setFuture(QtConcurrent::mapped(texts, preparer));
+}
+
+void WebKitMessageViewController::onBatchPrepared()
+{
+	// Batch was dropped by clearChat
+	if (m_preparing.isEmpty())
+		return;
+	const QStringList prepared = m_batchWatcher->future().results();
+	MessageList messages;
+	messages.swap(m_preparing);
+	Q_ASSERT(prepared.size() == messages.size());
+	
+	QString script;
+	for (int i = 0; i < messages.size(); ++i) {
+		const Message &msg = messages.at(i);
+		// Focus class is cleared only from the messages above this one
+		if (msg.property("firstFocus", false) && !script.isEmpty()) {
+			evaluateJavaScript(script);
+			script.clear();
+		}
+		script += scriptForMessage(msg, WebKitMessagePreparer::prepared(msg, prepared.at(i)),
+		                           i + 1 < messages.size());
+	}
+	if (!script.isEmpty())
+		evaluateJavaScript(script);
+	
+	// Messages which came while this batch was prepared
+	prepareBatch();
+}
+
+QString WebKitMessageViewController::scriptForMessage(const qutim_sdk_0_3::Message &msg,
+                                                      const qutim_sdk_0_3::Message &prepared,
+                                                      bool willAddMoreContentObjects)
+{
 	if (msg.property("topic", false)) {
-		copy.setHtml(html);
-		m_topic = copy;
+		m_topic = prepared;
 		if (!m_isLoading)
 			updateTopic();
-		return;
+		return QString();
 	}
 	if (msg.property("firstFocus", false))
 		clearFocusClass();
-	// We don't want emoticons in topic
-	html = Emoticons::theme().parseEmoticons(html);
-	copy.setHtml(html);
 	bool similiar = isContentSimiliar(m_last, msg);
-	QString script = m_style.scriptForAppendingContent(copy, similiar, false, false);
 	m_last = msg;
-	evaluateJavaScript(script);
+	return m_style.scriptForAppendingContent(prepared, similiar, willAddMoreContentObjects, false);
 }
 
 void WebKitMessageViewController::clearChat()
 {
 	if (!m_session || !m_page)
 		return;
+	m_batch.clear();
+	m_delayed.clear();
+	if (!m_preparing.isEmpty()) {
+		m_batchWatcher->waitForFinished();
+		m_preparing.clear();
+	}
 	m_last = Message();
 	m_isLoading = true;
 	loaderLoop()->addPage(m_page, m_style.baseTemplateForChat(m_session.data()));
@@ -289,15 +413,29 @@ void WebKitMessageViewController::loadHistory()
 {
 	Config config = Config(QLatin1String("appearance")).group(QLatin1String("chat/history"));
 	int max_num = config.value(QLatin1String("maxDisplayMessages"), 5);
-    MessageList messages = History::instance()->readSync(m_session.data()->unit(), max_num);
-	foreach (Message mess, messages) {
-		mess.setProperty("silent", true);
-		mess.setProperty("store", false);
-		mess.setProperty("history", true);
-		if (!mess.chatUnit()) //TODO FIXME
-			mess.setChatUnit(m_session.data()->unit());
-		m_session.data()->append(mess);
-	}
+	QPointer<ChatSession> session = m_session;
+	QPointer<WebKitMessageViewController> self = this;
+	// Live messages are held back until the history is shown above them
+	++m_historyPending;
+	History::instance()->read(session.data()->unit(), max_num).connect(this, [this, session, self] (const MessageList &messages) {
+		if (session && session == m_session) {
+			// Messages still pass through handlers and come back by appendMessage,
+			// they are shown at once when all of them are handled
+			m_historyPending += messages.size();
+			foreach (Message mess, messages) {
+				mess.setProperty("silent", true);
+				mess.setProperty("store", false);
+				mess.setProperty("history", true);
+				if (!mess.chatUnit()) //TODO FIXME
+					mess.setChatUnit(session.data()->unit());
+				session.data()->append(mess, [self] (quint64, const Message &, const QString &) {
+					if (self)
+						self->onHistoryMessageHandled();
+				});
+			}
+		}
+		onHistoryMessageHandled();
+	});
 }
 
 void WebKitMessageViewController::onLoadFinished()
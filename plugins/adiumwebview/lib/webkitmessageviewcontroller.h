@@ -29,6 +29,7 @@
 #include <QObject>
 #include <QWebElement>
 #include <QWebPage>
+#include <QFutureWatcher>
 #include <qutim/chatsession.h>
 #include "webkitmessageviewstyle.h"
 
@@ -64,6 +65,8 @@ public:
 	void setSession(qutim_sdk_0_3::ChatSession *session);
 	WebKitMessageViewStyle *style();
 	void appendMessage(const qutim_sdk_0_3::Message &msg);
+	// Shows all messages by a single script, html is prepared by a worker thread
+	void appendMessages(const qutim_sdk_0_3::MessageList &messages);
 	bool eventFilter(QObject *obj, QEvent *);
 	bool isPreview() const;
 	void setPreview(bool preview);
@@ -101,9 +104,14 @@ private slots:
 	void onContentsChanged();
 	void onObjectCleared();
 	void onLinkClicked(const QUrl &url);
+	void onBatchPrepared();
 	
 private:
 	void init();
+	void onHistoryMessageHandled();
+	void prepareBatch();
+	QString scriptForMessage(const qutim_sdk_0_3::Message &msg, const qutim_sdk_0_3::Message &prepared,
+	                         bool willAddMoreContentObjects);
 	
 	QWebPage *m_page;
 	QPointer<qutim_sdk_0_3::ChatSession> m_session;
@@ -114,6 +122,12 @@ private:
 	QStringList m_pendingScripts;
 	qutim_sdk_0_3::Message m_last;
 	qutim_sdk_0_3::Message m_topic;
+	int m_historyPending;
+	qutim_sdk_0_3::MessageList m_batch;
+	// Live messages which came while the history was loaded
+	qutim_sdk_0_3::MessageList m_delayed;
+	qutim_sdk_0_3::MessageList m_preparing;
+	QFutureWatcher<QString> *m_batchWatcher;
 };
 
 #endif // WEBKITMESSAGEVIEWCONTROLLER_H
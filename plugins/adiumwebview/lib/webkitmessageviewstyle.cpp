@@ -25,6 +25,7 @@
 
 #include "webkitmessageviewstyle.h"
 #include "webkitcolorsadditions_p.h"
+#include "webkitmessagetemplate_p.h"
 #include <QColor>
 #include <QImage>
 #include <QDir>
@@ -73,6 +74,20 @@ public:
 	QString actionInHTML;
 	QString actionOutHTML;
 	
+	//Compiled content templates
+	WebKitMessageTemplate contentInTemplate;
+	WebKitMessageTemplate nextContentInTemplate;
+	WebKitMessageTemplate contextInTemplate;
+	WebKitMessageTemplate nextContextInTemplate;
+	WebKitMessageTemplate contentOutTemplate;
+	WebKitMessageTemplate nextContentOutTemplate;
+	WebKitMessageTemplate contextOutTemplate;
+	WebKitMessageTemplate nextContextOutTemplate;
+	WebKitMessageTemplate statusTemplate;
+	WebKitMessageTemplate topicTemplate;
+	WebKitMessageTemplate actionInTemplate;
+	WebKitMessageTemplate actionOutTemplate;
+	
 	//Style settings
 	bool allowsCustomBackground;
 	bool transparentDefaultBackground;
@@ -485,8 +500,6 @@ QString WebKitMessageViewStyle::scriptForAppendingContent(const qutim_sdk_0_3::M
 	if (!d->combineConsecutive)
 		contentIsSimilar = false;
 	
-	//Fetch the correct template and substitute keywords for the passed content
-	QString newHTML = templateForContent(message, contentIsSimilar);
 	QString script;
 	
 	//BOM scripts vary by style version
@@ -520,7 +533,12 @@ QString WebKitMessageViewStyle::scriptForAppendingContent(const qutim_sdk_0_3::M
 		}
 	}
 	
-	return script.arg(validateCpp(newHTML));
+	//Fetch the correct template and substitute keywords for the passed content
+	const int contentPosition = script.indexOf(QLatin1String("%1"));
+	QString result = script.left(contentPosition);
+	appendContent(&result, message, contentIsSimilar, true);
+	result += script.midRef(contentPosition + 2);
+	return result;
 }
 
 QString &WebKitMessageViewStyle::injectScript(QString &inString, const QString &id, const QString &wsUri)
@@ -843,46 +861,68 @@ void WebKitMessageViewStyle::loadTemplates()
 	}
 	d->fileTransferHTML.replace(QLatin1String("Download %fileName%"),
 	                            QObject::tr("Download %fileName%"));
+	
+	d->contentInTemplate.setHtml(d->contentInHTML);
+	d->nextContentInTemplate.setHtml(d->nextContentInHTML);
+	d->contextInTemplate.setHtml(d->contextInHTML);
+	d->nextContextInTemplate.setHtml(d->nextContextInHTML);
+	d->contentOutTemplate.setHtml(d->contentOutHTML);
+	d->nextContentOutTemplate.setHtml(d->nextContentOutHTML);
+	d->contextOutTemplate.setHtml(d->contextOutHTML);
+	d->nextContextOutTemplate.setHtml(d->nextContextOutHTML);
+	d->statusTemplate.setHtml(d->statusHTML);
+	d->topicTemplate.setHtml(d->topicHTML);
+	d->actionInTemplate.setHtml(d->actionInHTML);
+	d->actionOutTemplate.setHtml(d->actionOutHTML);
 }
 
 QString WebKitMessageViewStyle::templateForContent(const qutim_sdk_0_3::Message &message, bool contentIsSimilar)
 {
-	Q_D(WebKitMessageViewStyle);
 	QString result;
+	appendContent(&result, message, contentIsSimilar, false);
+	return result;
+}
+
+void WebKitMessageViewStyle::appendContent(QString *result, const qutim_sdk_0_3::Message &message, bool contentIsSimilar, bool escape)
+{
+	Q_D(WebKitMessageViewStyle);
+	const WebKitMessageTemplate *content;
 	
-	// Get the correct result for what we're inserting
+	// Get the correct template for what we're inserting
 	
 	if (message.property("topic", false)) {
-		result = d->topicHTML;
+		content = &d->topicTemplate;
 	// FIXME: Implement file transfer support
 //	} else if (content.pro == IContent::FileTranfser) {
-//		result = d->fileTransferHTML;
+//		content = &d->fileTransferTemplate;
 	} else if (!message.property("service", false)) {
 		bool isAction = message.html().startsWith(QLatin1String("/me "), Qt::CaseInsensitive);
 		if (isAction && hasAction()) {
 			if (!message.isIncoming())
-				result = d->actionOutHTML;
+				content = &d->actionOutTemplate;
 			else
-				result = d->actionInHTML;
+				content = &d->actionInTemplate;
 		} else if (message.property("history", false)) {
 			if (!message.isIncoming())
-				result = contentIsSimilar ? d->nextContextOutHTML : d->contextOutHTML;
+				content = contentIsSimilar ? &d->nextContextOutTemplate : &d->contextOutTemplate;
 			else
-				result = contentIsSimilar ? d->nextContextInHTML : d->contextInHTML;
+				content = contentIsSimilar ? &d->nextContextInTemplate : &d->contextInTemplate;
 		} else {
 			if (!message.isIncoming())
-				result = contentIsSimilar ? d->nextContentOutHTML : d->contentOutHTML;
+				content = contentIsSimilar ? &d->nextContentOutTemplate : &d->contentOutTemplate;
 			else
-				result = contentIsSimilar ? d->nextContentInHTML : d->contentInHTML;
+				content = contentIsSimilar ? &d->nextContentInTemplate : &d->contentInTemplate;
 		} 
 	} else {
-		result = d->statusHTML;
+		content = &d->statusTemplate;
 	} 
 	
-	if (!result.isEmpty())
-		fillKeywords(result, message, contentIsSimilar);
+	if (content->isEmpty())
+		return;
 	
-	return result;
+	WebKitMessageKeywords keywords;
+	fillKeywords(keywords, message, contentIsSimilar);
+	content->render(result, keywords, escape);
 }
 
 WebKitMessageViewStyle::UnitData WebKitMessageViewStyle::getSourceData(const qutim_sdk_0_3::Message &message)
@@ -897,7 +937,7 @@ WebKitMessageViewStyle::UnitData WebKitMessageViewStyle::getSourceData(const qut
     return result;
 }
 
-QString &WebKitMessageViewStyle::fillKeywords(QString &inString, const qutim_sdk_0_3::Message &message, bool contentIsSimilar)
+void WebKitMessageViewStyle::fillKeywords(WebKitMessageKeywords &keywords, const qutim_sdk_0_3::Message &message, bool contentIsSimilar)
 {
 	Q_D(WebKitMessageViewStyle);
 	UnitData contentSource = getSourceData(message);
@@ -920,17 +960,18 @@ QString &WebKitMessageViewStyle::fillKeywords(QString &inString, const qutim_sdk
 
 	//date
 	QDateTime date = message.time();
+	keywords.setDate(date);
 	bool isService = message.property("service", false);
 	bool isTopic = message.property("topic", false);
 	bool isAutoreply = message.property("autoreply", false);
 	
 	//Replacements applicable to any AIContentObject
-	inString.replace(QLatin1String("%time%"), convertTimeDate(d->timeStampFormatter, date));
+	keywords.setValue(WebKitMessageKeywords::TimeKeyword, convertTimeDate(d->timeStampFormatter, date));
 	QString messageId = message.property("messageId").toString();
 	if (messageId.isEmpty())
 		messageId = QString::number(message.id());
-	inString.replace(QLatin1String("%messageId%"), QLatin1String("message") + messageId);
-	inString.replace(QLatin1String("%shortTime%"), date.toString(Qt::SystemLocaleShortDate));
+	keywords.setValue(WebKitMessageKeywords::MessageIdKeyword, QLatin1String("message") + messageId);
+	keywords.setValue(WebKitMessageKeywords::ShortTimeKeyword, date.toString(Qt::SystemLocaleShortDate));
 	
 	// FIXME: Implement
 //	inString.replace(QLatin1String("%senderStatusIcon%"), QUrl)
@@ -941,7 +982,7 @@ QString &WebKitMessageViewStyle::fillKeywords(QString &inString, const qutim_sdk
 //	}
 
 	
-	inString.replace(QLatin1String("%userIcons%"), QLatin1String(d->showUserIcons ? "showIcons" : "hideIcons"));
+	keywords.setValue(WebKitMessageKeywords::UserIconsKeyword, QLatin1String(d->showUserIcons ? "showIcons" : "hideIcons"));
 	
 	// Known classes:
 	// "mention" == highlight
@@ -969,63 +1010,45 @@ QString &WebKitMessageViewStyle::fillKeywords(QString &inString, const qutim_sdk
 		displayClasses << QLatin1String("message");
 		displayClasses << QLatin1String(message.isIncoming() ? "incoming" : "outgoing");
 	}
-	inString.replace(QLatin1String("%messageClasses%"), QLatin1String(contentIsSimilar ? "consecutive " : "") + displayClasses.join(QLatin1String(" ")));
+	keywords.setValue(WebKitMessageKeywords::MessageClassesKeyword, QLatin1String(contentIsSimilar ? "consecutive " : "") + displayClasses.join(QLatin1String(" ")));
 	
-	inString.replace(QLatin1String("%senderColor%"), WebKitColorsAdditions::representedColorForObject(contentSource.id, validSenderColors()));
+	keywords.setValue(WebKitMessageKeywords::SenderColorKeyword, WebKitColorsAdditions::representedColorForObject(contentSource.id, validSenderColors()));
 	
-	inString.replace(QLatin1String("%messageDirection%"), QLatin1String(message.text().isRightToLeft() ? "rtl" : "ltr"));
+	keywords.setValue(WebKitMessageKeywords::MessageDirectionKeyword, QLatin1String(message.text().isRightToLeft() ? "rtl" : "ltr"));
 	
-	//Replaces %time{x}% with a timestamp formatted like x (using NSDateFormatter)
-	const QStringMatcher matcher(QLatin1String("%time{"));
-	const int matcherSize = matcher.pattern().size();
-	const QStringMatcher endMatcher(QLatin1String("}%"));
-	const int endMatcherSize = endMatcher.pattern().size();
-	int range = 0;
-	do {
-		range = matcher.indexIn(inString, range);
-		if (range != -1) {
-			int endRange = endMatcher.indexIn(inString, range + matcherSize);
-			if (endRange != -1) {
-				QString timeFormat = inString.mid(range + matcherSize, endRange - range - matcherSize);
-				QString time = convertTimeDate(timeFormat, date);
-				inString.replace(range, endRange + endMatcherSize - range, time);
-				range = range + time.size();
-			}
-		}
-	} while (range != -1);
+	//%time{x}% is formatted from the date while rendering
 	
 	QString userIconPath;
 	if (d->showUserIcons)
 		userIconPath = urlFromFilePath(theSource.avatar);
 	if (userIconPath.isEmpty())
 		userIconPath = QLatin1String(message.isIncoming() ? "Incoming/buddy_icon.png" : "Outgoing/buddy_icon.png");
-	inString.replace(QLatin1String("%userIconPath%"), userIconPath);
+	keywords.setValue(WebKitMessageKeywords::UserIconPathKeyword, userIconPath);
 	
 	// Implement the way to get shortDescription and icon path for service icons
 	QString service = message.chatUnit() ? message.chatUnit()->account()->protocol()->id() : QString();
-	inString.replace(QLatin1String("%service%"), escapeString(service));
-	inString.replace(QLatin1String("%serviceIconPath%"), QString() /*content.chat->account.protocol.iconPath*/);
-	inString.replace(QLatin1String("%variant%"), activeVariantPath());
+	keywords.setValue(WebKitMessageKeywords::ServiceKeyword, escapeString(service));
+	keywords.setValue(WebKitMessageKeywords::ServiceIconPathKeyword, QString() /*content.chat->account.protocol.iconPath*/);
+	keywords.setValue(WebKitMessageKeywords::VariantKeyword, activeVariantPath());
 
-	bool replacedStatusPhrase = false;
 	//message stuff
 	if (isTopic || !isService) {
 		//Use content.source directly rather than the potentially-metaContact theSource
 		QString formattedUID = contentSource.id;
 		QString displayName = contentSource.title;
 		
-		inString.replace(QLatin1String("%status%"), QString());
-		inString.replace(QLatin1String("%senderScreenName%"), escapeString(formattedUID));
+		keywords.setValue(WebKitMessageKeywords::StatusKeyword, QString());
+		keywords.setValue(WebKitMessageKeywords::SenderScreenNameKeyword, escapeString(formattedUID));
 		// Should be used as %, @, + or something like irc's channel statuses
-		inString.replace(QLatin1String("%senderPrefix%"), message.property("senderPrefix", QString()));
+		keywords.setValue(WebKitMessageKeywords::SenderPrefixKeyword, message.property("senderPrefix", QString()));
 		QString senderDisplay = displayName;
 		if (isAutoreply) {
 			senderDisplay += " ";
 			senderDisplay += QObject::tr("(Autoreply)");
 		}
-		inString.replace(QLatin1String("%sender%"), escapeString(senderDisplay));
+		keywords.setValue(WebKitMessageKeywords::SenderKeyword, escapeString(senderDisplay));
 		// Should be server-side display name if possible
-		inString.replace(QLatin1String("%senderDisplayName%"), escapeString(displayName));
+		keywords.setValue(WebKitMessageKeywords::SenderDisplayNameKeyword, escapeString(displayName));
 
 		// Add support for %textbackgroundcolor{alpha?}%
 		// Background should be caught from content's html
@@ -1062,30 +1085,27 @@ QString &WebKitMessageViewStyle::fillKeywords(QString &inString, const qutim_sdk
 //		}
 
 		//Message (must do last)
-		inString.replace(QLatin1String("%message%"), htmlEncodedMessage);
+		keywords.setValue(WebKitMessageKeywords::MessageKeyword, htmlEncodedMessage);
 		
 		// Topic replacement (if applicable)
-		if (isTopic && inString.contains(QLatin1String("%topic%"))) {
-			inString.replace(QLatin1String("%topic%"),
-			                 QString::fromLatin1(TOPIC_INDIVIDUAL_WRAPPER).arg(htmlEncodedMessage));
+		if (isTopic) {
+			keywords.setValue(WebKitMessageKeywords::TopicKeyword,
+			                  QString::fromLatin1(TOPIC_INDIVIDUAL_WRAPPER).arg(htmlEncodedMessage));
 		}		
 	} else {
-		inString.replace(QLatin1String("%status%"), escapeString(message.property("status", QString())));
-		inString.replace(QLatin1String("%statusSender%"), QString());
-		inString.replace(QLatin1String("%senderScreenName%"), QString());
-		inString.replace(QLatin1String("%senderPrefix%"), QString());
-		inString.replace(QLatin1String("%sender%"), QString());
+		keywords.setValue(WebKitMessageKeywords::StatusKeyword, escapeString(message.property("status", QString())));
+		keywords.setValue(WebKitMessageKeywords::StatusSenderKeyword, QString());
+		keywords.setValue(WebKitMessageKeywords::SenderScreenNameKeyword, QString());
+		keywords.setValue(WebKitMessageKeywords::SenderPrefixKeyword, QString());
+		keywords.setValue(WebKitMessageKeywords::SenderKeyword, QString());
+		// Status phrase replaces the message if template has it
 		QString statusPhrase = message.property("statusPhrase", QString());
-		if (!statusPhrase.isEmpty() && inString.contains(QLatin1String("%statusPhrase%"))) {
-			inString.replace(QLatin1String("%statusPhrase%"), escapeString(statusPhrase));
-			replacedStatusPhrase = true;
-		}
+		if (!statusPhrase.isEmpty())
+			keywords.setValue(WebKitMessageKeywords::StatusPhraseKeyword, escapeString(statusPhrase));
 		
 		//Message (must do last)
-		inString.replace(QLatin1String("%message%"), replacedStatusPhrase ? QString() : htmlEncodedMessage);
+		keywords.setValue(WebKitMessageKeywords::MessageKeyword, htmlEncodedMessage);
 	}
-
-    return inString;
 }
 
 QString WebKitMessageViewStyle::pathForResource(const QString &name, const QString &directory)
@@ -1165,6 +1185,19 @@ void WebKitMessageViewStyle::releaseResources()
 	d->actionHTML.clear();
 	d->actionInHTML.clear();
 	d->actionOutHTML.clear();
+	
+	d->contentInTemplate.clear();
+	d->nextContentInTemplate.clear();
+	d->contextInTemplate.clear();
+	d->nextContextInTemplate.clear();
+	d->contentOutTemplate.clear();
+	d->nextContentOutTemplate.clear();
+	d->contextOutTemplate.clear();
+	d->nextContextOutTemplate.clear();
+	d->statusTemplate.clear();
+	d->topicTemplate.clear();
+	d->actionInTemplate.clear();
+	d->actionOutTemplate.clear();
 		
 	d->customBackgroundPath.clear();
 	d->customBackgroundColor = QColor();
@@ -41,6 +41,7 @@ class Message;
 }
 
 class WebKitMessageViewStylePrivate;
+class WebKitMessageKeywords;
 
 class ADIUMWEBVIEW_EXPORT WebKitMessageViewStyle : public QObject
 {
@@ -123,7 +124,8 @@ private:
 	void loadTemplates();
 	void releaseResources();
 	UnitData getSourceData(const qutim_sdk_0_3::Message &message);
-	QString &fillKeywords(QString &inString, const qutim_sdk_0_3::Message &message, bool contentIsSimilar);
+	void fillKeywords(WebKitMessageKeywords &keywords, const qutim_sdk_0_3::Message &message, bool contentIsSimilar);
+	void appendContent(QString *result, const qutim_sdk_0_3::Message &message, bool contentIsSimilar, bool escape);
     QString &injectScript(QString &inString, const QString &id, const QString &wsUri);
 	QString &fillKeywordsForBaseTemplate(QString &inString, qutim_sdk_0_3::ChatSession *session);
 	QString stringWithFormat(const QString &str, const QStringList &args);
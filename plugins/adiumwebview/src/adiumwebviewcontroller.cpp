@@ -97,7 +97,7 @@ void WebViewLoaderLoop::onPageDestroyed()
 Q_GLOBAL_STATIC(WebViewLoaderLoop, loaderLoop)
 
 WebViewController::WebViewController(bool isPreview) :
-    m_isLoading(false), m_isPreview(isPreview)
+    m_isLoading(false), m_isPreview(isPreview), m_historyPending(0)
 {
     m_topic.setProperty("topic", true);
     setNetworkAccessManager(new WebKitNetworkAccessManager(this));
@@ -129,6 +129,7 @@ void WebViewController::setChatSession(ChatSession *session)
         if (!m_isPreview) {
             loadSettings(false);
             clearChat();
+            m_delayed.clear();
             loadHistory();
         }
     }
@@ -149,11 +150,16 @@ bool WebViewController::isContentSimiliar(const Message &a, const Message &b)
 
 void WebViewController::appendMessage(const qutim_sdk_0_3::Message &msg)
 {
+    // History must be shown above messages received during its loading
+    if (m_historyPending > 0 && !msg.property("history", false)) {
+        m_delayed << msg;
+        return;
+    }
     Message copy = msg;
-    QString html = UrlParser::parseUrls(copy.html(), UrlParser::Html);
+    // Links and emoticons are found by a single pass, topic gets only links
+    copy.setHtml(msg.formattedHtml());
     copy.setProperty("messageId", msg.id());
     if (msg.property("topic", false)) {
-        copy.setHtml(html);
         m_topic = copy;
         if (!m_isLoading)
             updateTopic();
@@ -161,9 +167,6 @@ void WebViewController::appendMessage(const qutim_sdk_0_3::Message &msg)
     }
     if (msg.property("firstFocus", false))
         clearFocusClass();
-    // We don't want emoticons in topic
-    html = Emoticons::theme().parseEmoticons(html);
-    copy.setHtml(html);
     bool similiar = isContentSimiliar(m_last, msg);
     QString script = m_style.scriptForAppendingContent(copy, similiar, false, false);
     m_last = msg;
@@ -386,15 +389,36 @@ void WebViewController::loadHistory()
 {
     Config config = Config(QLatin1String("appearance")).group(QLatin1String("chat/history"));
 	int max_num = config.value(QLatin1String("maxDisplayMessages"), 5);
-    MessageList messages = History::instance()->readSync(m_session.data()->unit(), max_num);
-    foreach (Message mess, messages) {
-        mess.setProperty("silent", true);
-        mess.setProperty("store", false);
-        mess.setProperty("history", true);
-        if (!mess.chatUnit()) //TODO FIXME
-            mess.setChatUnit(m_session.data()->unit());
-        m_session.data()->append(mess);
-    }
+    QPointer<ChatSession> session = m_session;
+    QPointer<WebViewController> self = this;
+    ++m_historyPending;
+    History::instance()->read(session.data()->unit(), max_num).connect(this, [this, session, self] (const MessageList &messages) {
+        if (session && session == m_session) {
+            m_historyPending += messages.size();
+            foreach (Message mess, messages) {
+                mess.setProperty("silent", true);
+                mess.setProperty("store", false);
+                mess.setProperty("history", true);
+                if (!mess.chatUnit()) //TODO FIXME
+                    mess.setChatUnit(session.data()->unit());
+                session.data()->append(mess, [self] (quint64, const Message &, const QString &) {
+                    if (self)
+                        self->onHistoryMessageHandled();
+                });
+            }
+        }
+        onHistoryMessageHandled();
+    });
+}
+
+void WebViewController::onHistoryMessageHandled()
+{
+    if (--m_historyPending > 0)
+        return;
+    MessageList delayed;
+    delayed.swap(m_delayed);
+    foreach (const Message &msg, delayed)
+        appendMessage(msg);
 }
 
 void WebViewController::onLoadFinished()
@@ -91,6 +91,7 @@ protected:
 	bool isContentSimiliar(const qutim_sdk_0_3::Message &a, const qutim_sdk_0_3::Message &b);
 	void loadSettings(bool onFly);
 	void loadHistory();
+	void onHistoryMessageHandled();
 	
 private slots:
 	void onSettingsSaved();
@@ -110,6 +111,9 @@ private:
 	QStringList m_pendingScripts;
 	qutim_sdk_0_3::Message m_last;
 	qutim_sdk_0_3::Message m_topic;
+	// Live messages wait here while history is loaded
+	int m_historyPending;
+	qutim_sdk_0_3::MessageList m_delayed;
 };
 
 } // namespace Adium
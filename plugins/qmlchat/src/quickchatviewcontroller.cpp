@@ -93,7 +93,7 @@ static QVariant messageToVariant(const Message &mes)
 }
 
 QuickChatController::QuickChatController(QObject *parent) :
-	QObject(parent)
+	QObject(parent), m_historyPending(0)
 {
 }
 
@@ -105,6 +105,11 @@ void QuickChatController::appendMessage(const qutim_sdk_0_3::Message& msg)
 {
 	if (msg.text().isEmpty())
 		return;
+	// History must be shown above messages received during its loading
+	if (m_historyPending > 0 && !msg.property("history", false)) {
+		m_delayed << msg;
+		return;
+	}
 	emit messageAppended(messageToVariant(msg));
 }
 
@@ -123,15 +128,36 @@ void QuickChatController::loadHistory()
 	qDebug() << Q_FUNC_INFO;
 	Config config = Config(QStringLiteral("appearance")).group(QStringLiteral("chat/history"));
 	int max_num = 50 + config.value(QStringLiteral("maxDisplayMessages"), 5);
-    MessageList messages = History::instance()->readSync(m_session.data()->getUnit(), max_num);
-	foreach (Message mess, messages) {
-		mess.setProperty("silent", true);
-		mess.setProperty("store", false);
-		mess.setProperty("history", true);
-		if (!mess.chatUnit()) //TODO FIXME
-			mess.setChatUnit(m_session.data()->getUnit());
-		m_session.data()->append(mess);
-	}
+	QPointer<ChatSession> session = m_session;
+	QPointer<QuickChatController> self = this;
+	++m_historyPending;
+	History::instance()->read(session.data()->getUnit(), max_num).connect(this, [this, session, self] (const MessageList &messages) {
+		if (session && session == m_session) {
+			m_historyPending += messages.size();
+			foreach (Message mess, messages) {
+				mess.setProperty("silent", true);
+				mess.setProperty("store", false);
+				mess.setProperty("history", true);
+				if (!mess.chatUnit()) //TODO FIXME
+					mess.setChatUnit(session.data()->getUnit());
+				session.data()->append(mess, [self] (quint64, const Message &, const QString &) {
+					if (self)
+						self->onHistoryMessageHandled();
+				});
+			}
+		}
+		onHistoryMessageHandled();
+	});
+}
+
+void QuickChatController::onHistoryMessageHandled()
+{
+	if (--m_historyPending > 0)
+		return;
+	MessageList delayed;
+	delayed.swap(m_delayed);
+	foreach (const Message &msg, delayed)
+		appendMessage(msg);
 }
 
 void QuickChatController::setChatSession(ChatSession *session)
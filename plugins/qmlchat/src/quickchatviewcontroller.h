@@ -57,6 +57,7 @@ public slots:
 	void appendText(const QString &string);
 protected slots:
 	void loadHistory();
+	void onHistoryMessageHandled();
 protected:
 	bool eventFilter(QObject *, QEvent *);
 signals:
@@ -70,6 +71,9 @@ signals:
 private:
 	QPointer<qutim_sdk_0_3::ChatSession> m_session;
     QPointer<QQuickItem> m_item;
+	// Live messages wait here while history is loaded
+	int m_historyPending;
+	qutim_sdk_0_3::MessageList m_delayed;
 };
 
 } // namespace AdiumChat
@@ -60,6 +60,7 @@ Item {
 
     function appendMessage(message) {
         var index = findIndex(itemMessages, message);
+        var wasRelayoutDisabled = doNotRelayout;
         doNotRelayout = true;
 
         items.splice(index, 0, undefined);
@@ -88,6 +89,14 @@ Item {
 
         itemById[message.id] = items[index];
 
+        doNotRelayout = wasRelayoutDisabled;
+        doLayout();
+    }
+
+    function appendMessages(messages) {
+        doNotRelayout = true;
+        for (var i = 0; i < messages.length; ++i)
+            appendMessage(messages[i]);
         doNotRelayout = false;
         doLayout();
     }
@@ -21,6 +21,7 @@ Rectangle {
     Connections {
         target: session
         onMessageAppended: root.appendMessage(message)
+        onMessagesAppended: root.appendMessages(messages)
         onAppendTextRequested: root.appendTextRequested(text)
         onAppendNickRequested: root.appendNickRequested(nick)
     }
@@ -43,6 +44,23 @@ Rectangle {
             flickable.moveToEnd();
     }
 
+    function appendMessages(messages) {
+        var keepEnd = flickable.shouldKeepEnd();
+        var contentMessages = [];
+
+        for (var i = 0; i < messages.length; ++i) {
+            if (messages[i].property("topic", false))
+                root.topic = messages[i].html;
+            else
+                contentMessages.push(messages[i]);
+        }
+
+        layout.appendMessages(contentMessages);
+
+        if (keepEnd)
+            flickable.moveToEnd();
+    }
+
     ScrollView {
         id: scrollView
         anchors.fill: parent
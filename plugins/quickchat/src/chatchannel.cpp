@@ -218,19 +218,38 @@ void ChatChannel::loadHistory()
     config.beginGroup(QStringLiteral("chat/history"));
     int maxDisplayCount = config.value(QStringLiteral("maxDisplayMessages"), 5);
 
+    // Live messages are held back until the history is shown above them
+    ++m_historyPending;
     auto result = History::instance()->read(unit(), maxDisplayCount);
     result.connect(this, [this] (MessageList messages) {
+        m_historyPending += messages.size();
         for (Message &message : messages) {
             message.setProperty("silent", true);
             message.setProperty("store", false);
             message.setProperty("history", true);
             if (!message.chatUnit()) //TODO FIXME
                 message.setChatUnit(unit());
-            append(message);
+            append(message, [this] (quint64, const Message &, const QString &) {
+                onHistoryMessageHandled();
+            });
         }
+        onHistoryMessageHandled();
     });
 }
 
+void ChatChannel::onHistoryMessageHandled()
+{
+    if (--m_historyPending > 0)
+        return;
+    // History goes first, live messages which came meanwhile are below it
+    QVariantList messages;
+    messages.swap(m_batch);
+    messages << m_delayed;
+    m_delayed.clear();
+    if (!messages.isEmpty())
+        emit messagesAppended(messages);
+}
+
 QUrl ChatChannel::appendTextUrl(const QString &text)
 {
     return commandUrl(QStringLiteral("appendText"), text);
@@ -276,7 +295,13 @@ qint64 ChatChannel::doAppendMessage(qutim_sdk_0_3::Message &message)
 	if (!message.property("silent", false) && !isActive())
 		Notification::send(message);
 	
-	emit messageAppended(message);
+	// Keep order of messages while history is loaded
+	if (m_historyPending > 0 && message.property("history", false))
+		m_batch << QVariant::fromValue(message);
+	else if (m_historyPending > 0)
+		m_delayed << QVariant::fromValue(message);
+	else
+		emit messageAppended(message);
 	return message.id();
 }
 
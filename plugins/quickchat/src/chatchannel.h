@@ -91,6 +91,8 @@ protected:
 signals:
     void javaScriptRequest(const QString &script);
 	void messageAppended(const qutim_sdk_0_3::Message &message);
+	// History is delivered at once when all of its messages pass the handlers
+	void messagesAppended(const QVariantList &messages);
 	void unitChanged(qutim_sdk_0_3::ChatUnit *unit);
 	void unreadCountChanged(int);
 	void pageChanged(QObject *page);
@@ -100,6 +102,8 @@ signals:
     void clearRequested();
 	
 private:
+    void onHistoryMessageHandled();
+
     QString m_id;
 	qutim_sdk_0_3::ChatUnit *m_unit;
 	qutim_sdk_0_3::MessageList m_unread;
@@ -107,6 +111,10 @@ private:
 	ChatChannelUsersModel *m_units;
     QObject *m_page;
     int m_javaScriptListeners = 0;
+    int m_historyPending = 0;
+    QVariantList m_batch;
+    // Live messages which came while the history was loaded
+    QVariantList m_delayed;
 };
 }
 
@@ -5,7 +5,6 @@
 #include <qutim/debug.h>
 #include <qutim/account.h>
 #include <qutim/conference.h>
-#include <qutim/history.h>
 #include <qutim/emoticons.h>
 #include <qutim/notification.h>
 #include <qutim/servicemanager.h>
@@ -64,6 +63,7 @@ void ChatController::setSession(ChatChannel *session)
     if (session) {
         session->installEventFilter(this);
         connect(session, &ChatChannel::messageAppended, this, &ChatController::onMessageAppended);
+        connect(session, &ChatChannel::messagesAppended, this, &ChatController::onMessagesAppended);
     }
 
     emit sessionChanged(session);
@@ -82,26 +82,46 @@ bool ChatController::isContentSimiliar(const Message &a, const Message &b)
 }
 
 void ChatController::onMessageAppended(const qutim_sdk_0_3::Message &msg)
+{
+    QString script = scriptForMessage(msg, false);
+    if (!script.isEmpty())
+        evaluateJavaScript(script);
+}
+
+void ChatController::onMessagesAppended(const QVariantList &messages)
+{
+    QString script;
+    for (int i = 0; i < messages.size(); ++i) {
+        const Message msg = messages.at(i).value<Message>();
+        // Focus class is cleared only from the messages above this one
+        if (msg.property("firstFocus", false) && !script.isEmpty()) {
+            evaluateJavaScript(script);
+            script.clear();
+        }
+        script += scriptForMessage(msg, i + 1 < messages.size());
+    }
+    if (!script.isEmpty())
+        evaluateJavaScript(script);
+}
+
+QString ChatController::scriptForMessage(const qutim_sdk_0_3::Message &msg, bool willAddMoreContentObjects)
 {
     Message copy = msg;
-    QString html = UrlParser::parseUrls(copy.html(), UrlParser::Html);
+    // Links and emoticons are found by a single pass, topic gets only links
+    copy.setHtml(msg.formattedHtml());
     copy.setProperty("messageId", msg.id());
     if (msg.property("topic", false)) {
-        copy.setHtml(html);
         m_topic = copy;
 //        if (!m_isLoading)
 //            updateTopic();
-        return;
+        return QString();
     }
     if (msg.property("firstFocus", false))
         clearFocusClass();
-    // We don't want emoticons in topic
-    html = Emoticons::theme().parseEmoticons(html);
-    copy.setHtml(html);
     bool similiar = isContentSimiliar(m_last, msg);
-    QString script = m_style.scriptForAppendingContent(copy, similiar, false, false);
+    QString script = m_style.scriptForAppendingContent(copy, similiar, willAddMoreContentObjects, false);
     m_last = msg;
-    evaluateJavaScript(script);
+    return script;
 }
 
 void ChatController::clearChat()
@@ -231,17 +251,8 @@ void ChatController::onSettingsSaved()
 
 void ChatController::loadHistory()
 {
-    Config config = Config(QLatin1String("appearance")).group(QLatin1String("chat/history"));
-    int max_num = config.value(QLatin1String("maxDisplayMessages"), 5);
-    MessageList messages = History::instance()->readSync(m_session->unit(), max_num);
-    foreach (Message mess, messages) {
-        mess.setProperty("silent", true);
-        mess.setProperty("store", false);
-        mess.setProperty("history", true);
-        if (!mess.chatUnit()) //TODO FIXME
-            mess.setChatUnit(m_session->unit());
-        m_session->append(mess);
-    }
+    if (m_session)
+        m_session->loadHistory();
 }
 
 QString ChatController::scriptForFontUpdate()
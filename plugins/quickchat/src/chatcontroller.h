@@ -29,6 +29,8 @@ public:
 
 protected:
     void onMessageAppended(const qutim_sdk_0_3::Message &message);
+    void onMessagesAppended(const QVariantList &messages);
+    QString scriptForMessage(const qutim_sdk_0_3::Message &message, bool willAddMoreContentObjects);
     void clearChat();
     WebKitMessageViewStyle *style();
     bool eventFilter(QObject *obj, QEvent *);
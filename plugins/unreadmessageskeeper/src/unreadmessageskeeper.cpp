@@ -46,6 +46,9 @@ bool UnreadMessagesKeeper::load()
 			SLOT(sessionCreated(qutim_sdk_0_3::ChatSession*))
 			);
 
+	// Sessions are opened at once and all reads are started together,
+	// messages are appended to every session as soon as its read is done
+	QList<QPair<ChatUnit*, int> > units;
 	Config cfg("unreadmessages");
 	foreach (QString id,cfg.childGroups()) {
 		Protocol *p =  Protocol::all().value(id);
@@ -62,20 +65,27 @@ bool UnreadMessagesKeeper::load()
 				if(!u)
 					continue;
 				int count = cfg.value(id,0);
-                if (count) {
-					ChatSession *s = ChatLayer::get(u,true);
-                    MessageList list = History::instance()->readSync(u, count);
-					foreach(Message m,list) {
-						m.setProperty("store",false);
-						m.setProperty("fake",true); //mega spike
-						s->appendMessage(m);
-					}
-				}
+				if (count)
+					units << qMakePair(u, count);
 			}
 			cfg.endGroup();
 		}
 		cfg.endGroup();
 	}
+
+	for (int i = 0; i < units.size(); ++i) {
+		ChatUnit *u = units.at(i).first;
+		QPointer<ChatSession> s = ChatLayer::get(u,true);
+		History::instance()->read(u, units.at(i).second).connect(this, [s] (const MessageList &list) {
+			if (!s)
+				return;
+			foreach(Message m,list) {
+				m.setProperty("store",false);
+				m.setProperty("fake",true); //mega spike
+				s->appendMessage(m);
+			}
+		});
+	}
 	return true;
 }
 
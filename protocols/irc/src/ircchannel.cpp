@@ -219,7 +219,6 @@ void IrcChannel::onContactQuit(const QString &message)
 
 void IrcChannel::handleUserList(const QStringList &users)
 {
-	ChatSession *session = ChatLayer::instance()->getSession(this, true);
 	QString myNick = account()->name();
 	foreach (QString userNick, users) {
 		static QSet<QChar> flags = QSet<QChar>() << '+' << '%' << '@';
@@ -250,9 +249,21 @@ void IrcChannel::handleUserList(const QStringList &users)
 		}
 		if (isFlag)
 			user->setFlag(flag);
-		if (session)
-			session->addContact(user);
+		d->pendingUsers << user;
+	}
+}
+
+void IrcChannel::handleEndOfUserList()
+{
+	ChatSession *session = ChatLayer::instance()->getSession(this, true);
+	QList<Buddy*> users;
+	users.reserve(d->pendingUsers.size());
+	foreach (const QPointer<IrcChannelParticipant> &user, d->pendingUsers) {
+		if (user)
+			users << user.data();
 	}
+	d->pendingUsers.clear();
+	session->addContacts(users);
 	session->activate();
 }
 
@@ -434,6 +445,7 @@ void IrcChannel::clear(ChatSession *session)
 		delete user;
 	}
 	d->users.clear();
+	d->pendingUsers.clear();
 	setJoined(false);
 }
 
@@ -73,6 +73,7 @@ private slots:
 private:
 	void setBookmarkName(const QString &name);
 	void handleUserList(const QStringList &users);
+	void handleEndOfUserList();
 	void handleJoin(const QString &nick, const QString &host);
 	void handlePart(const QString &nick, const QString &message);
 	void handleKick(const QString &nick, const QString &by, const QString &message);
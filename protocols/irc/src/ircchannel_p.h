@@ -27,6 +27,7 @@
 #define IRCCHANNEL_P_H
 
 #include "ircchannel.h"
+#include <QPointer>
 
 namespace qutim_sdk_0_3 {
 
@@ -40,6 +41,8 @@ public:
 	ParticipantPointer me;
 	QString name;
 	QHash<QString, ParticipantPointer> users;
+	// Participants from RPL_NAMREPLY which are added to session on RPL_ENDOFNAMES
+	QList<QPointer<IrcChannelParticipant> > pendingUsers;
 	QString topic;
 	bool autojoin;
 	QString lastPassword;
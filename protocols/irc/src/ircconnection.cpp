@@ -32,9 +32,9 @@
 #include "ircavatar.h"
 #include "ircwhoisreplieshandler.h"
 #include "ircstandartctcphandler.h"
+#include "ircmessage.h"
 #include <QHostInfo>
 #include <QTextCodec>
-#include <QRegExp>
 #include <QDateTime>
 #include <qutim/objectgenerator.h>
 #include <qutim/chatsession.h>
@@ -48,7 +48,39 @@ namespace qutim_sdk_0_3 {
 
 namespace irc {
 
-static QRegExp ctcpRx("^\\001(\\S+)( (.*)|)\\001");
+enum IrcNamedCommand
+{
+	// Numeric replies are in range 1..999
+	IrcPing = 1000,
+	IrcPrivmsg,
+	IrcJoin,
+	IrcPart,
+	IrcNick,
+	IrcQuit,
+	IrcError,
+	IrcKick,
+	IrcMode,
+	IrcNotice
+};
+
+static int commandId(const IrcCommand &cmd)
+{
+	if (cmd.code())
+		return cmd.code();
+	static const QHash<QString, int> ids = {
+		{ QStringLiteral("PING"), IrcPing },
+		{ QStringLiteral("PRIVMSG"), IrcPrivmsg },
+		{ QStringLiteral("JOIN"), IrcJoin },
+		{ QStringLiteral("PART"), IrcPart },
+		{ QStringLiteral("NICK"), IrcNick },
+		{ QStringLiteral("QUIT"), IrcQuit },
+		{ QStringLiteral("ERROR"), IrcError },
+		{ QStringLiteral("KICK"), IrcKick },
+		{ QStringLiteral("MODE"), IrcMode },
+		{ QStringLiteral("NOTICE"), IrcNotice }
+	};
+	return ids.value(cmd.value());
+}
 
 IrcConnection::IrcConnection(IrcAccount *account, QObject *parent) :
 	QObject(parent), m_hostLookupId(0)
@@ -56,13 +88,14 @@ IrcConnection::IrcConnection(IrcAccount *account, QObject *parent) :
 	m_socket = new QSslSocket(this);
 	m_socket->setProxy(NetworkProxyManager::toNetworkProxy(NetworkProxyManager::settings(account)));
 	m_account = account;
-	m_messagesTimer.setInterval(500);
+	m_messagesTimer.setSingleShot(true);
 	connect(&m_messagesTimer, SIGNAL(timeout()), SLOT(sendNextMessage()));
 	connect(m_socket, SIGNAL(readyRead()), SLOT(readData()));
 	connect(m_socket, SIGNAL(stateChanged(QAbstractSocket::SocketState)), SLOT(stateChanged(QAbstractSocket::SocketState)));
 	connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(error(QAbstractSocket::SocketError)));
 	connect(m_socket, SIGNAL(sslErrors(QList<QSslError>)), SLOT(sslErrors(QList<QSslError>)));
 	connect(m_socket, SIGNAL(encrypted()), SLOT(encrypted()));
+	m_numericHandlers.resize(MaxReplyCode);
 	// Register handlers
 	foreach(const ObjectGenerator *gen, ObjectGenerator::module<IrcServerMessageHandler>())
 		registerHandler(gen->generate<IrcServerMessageHandler>());
@@ -121,8 +154,13 @@ void IrcConnection::connectToNetwork()
 
 void IrcConnection::registerHandler(IrcServerMessageHandler *handler)
 {
-	foreach (const IrcCommand &cmd, handler->cmds())
-		m_handlers.insert(cmd.value(), handler);
+	// Handlers registered later are called first
+	foreach (const IrcCommand &cmd, handler->cmds()) {
+		if (cmd.code() > 0 && cmd.code() < MaxReplyCode)
+			m_numericHandlers[cmd.code()].prepend(handler);
+		else
+			m_handlers[cmd.value()].prepend(handler);
+	}
 }
 
 void IrcConnection::registerCtcpHandler(IrcCtcpHandler *handler)
@@ -139,7 +177,11 @@ void IrcConnection::handleMessage(IrcAccount *account, const QString &name,  con
 		if (cmd == 432 || cmd == 433) // ERR_ERRONEUSNICKNAME or ERR_NICKNAMEINUSE
 			tryNextNick();
 	}
-	if (cmd == 1 || cmd == 2 || cmd == 3 || cmd == 4) { // WELCOME
+	switch (commandId(cmd)) {
+	case 1:
+	case 2:
+	case 3:
+	case 4: { // WELCOME
 		if (status == Status::Connecting) {
 			account->resetGroupChatManager(account->d->groupManager.data());
 			account->setState(Account::Connected);
@@ -164,39 +206,57 @@ void IrcConnection::handleMessage(IrcAccount *account, const QString &name,  con
 			msg = params.value(1);
 		}
 		account->log(msg, false, "Welcome");
-	} else if (cmd == 5) { // RPL_BOUNCE
+		break;
+	}
+	case 5: { // RPL_BOUNCE
 		QStringList list = params;
 		list.removeFirst();
 		account->log(list.join(" "), false, "Support");
-	} else if (cmd == 353) { // RPL_NAMREPLY
+		break;
+	}
+	case 353: { // RPL_NAMREPLY
 		QString channelName = params.value(2);
 		if (channelName.isEmpty())
 			qDebug() << "Incorrect RPL_NAMREPLY reply";
 		IrcChannel *channel = m_account->getChannel(channelName, false);
 		if (channel)
 			channel->handleUserList(params.value(3).split(' ', QString::SkipEmptyParts));
-	} else if (cmd == "PING") {
+		break;
+	}
+	case 366: { // RPL_ENDOFNAMES
+		IrcChannel *channel = m_account->getChannel(params.value(1), false);
+		if (channel)
+			channel->handleEndOfUserList();
+		break;
+	}
+	case IrcPing: {
 		QString server = params.value(0);
 		server = server.mid(0, server.indexOf(' '));
 		if (!server.isEmpty())
 			send(QString("PONG %1").arg(server));
 		else
 			qDebug() << "Incorrect PING request";		
-	} else if (cmd == "PRIVMSG") {
+		break;
+	}
+	case IrcPrivmsg: {
 		QString text = params.value(1);
-		if (ctcpRx.indexIn(text) == 0) { // Is it CTCP request?
+		QString ctcpCmd;
+		QString ctcpParams;
+		if (IrcMessage::parseCtcp(text, &ctcpCmd, &ctcpParams)) { // Is it CTCP request?
 			bool handled = false;
-			QString ctcpCmd = (ctcpRx.cap(1)).toUpper();
+			ctcpCmd = ctcpCmd.toUpper();
 			foreach (IrcCtcpHandler *handler, m_ctcpHandlers.values(ctcpCmd)) {
 				handled = true;
-				handler->handleCtcpRequest(account, name, host, params.value(0), ctcpCmd, ctcpRx.cap(3));
+				handler->handleCtcpRequest(account, name, host, params.value(0), ctcpCmd, ctcpParams);
 			}
 			if (!handled)
 				qDebug() << "Unknown CTCP request" << ctcpCmd << "from" << name;
 			return;
 		}
 		handleTextMessage(name, host, params.value(0), params.value(1));
-	} else if (cmd == "JOIN") {
+		break;
+	}
+	case IrcJoin: {
 		QString channelName = params.value(0);
 		// Create a new IrcChannel if we have joined a channel.
 		IrcChannel *channel = account->getChannel(channelName, name == m_account->name());
@@ -204,13 +264,17 @@ void IrcConnection::handleMessage(IrcAccount *account, const QString &name,  con
 			channel->handleJoin(name, host);
 		else
 			channelIsNotJoinedError(cmd, params.value(0));
-	} else if (cmd == "PART") {
+		break;
+	}
+	case IrcPart: {
 		IrcChannel *channel = account->getChannel(params.value(0), false);
 		if (channel)
 			channel->handlePart(name, params.value(1));
 		else
 			channelIsNotJoinedError(cmd, params.value(0));
-	} else if (cmd == "NICK") { // Someone has changed his nick
+		break;
+	}
+	case IrcNick: { // Someone has changed his nick
 		QString newNick = params.value(0);
 		if (name == account->name()) {
 			QString previous = m_nick;
@@ -222,52 +286,67 @@ void IrcConnection::handleMessage(IrcAccount *account, const QString &name,  con
 			contact->d->updateNick(params.value(0));
 		else
 			qDebug() << "NICK message from the unknown contact" << name;
-	} else if (cmd == "QUIT") {
+		break;
+	}
+	case IrcQuit: {
 		IrcContact *contact = account->getContact(name, false);
 		if (contact) {
 			emit contact->quit(params.value(0));
 		} else {
 			qDebug() << "QUIT message from the unknown contact" << name;
 		}
-	} else if (cmd == "ERROR") {
+		break;
+	}
+	case IrcError: {
 		m_account->log(params.value(0), false, "ERROR");
 		NotificationRequest request(Notification::System);
 		request.setObject(m_account);
 		request.setText(params.value(0));
 		request.send();
 		m_account->disconnectFromServer();
-	} else if (cmd == 332) { // RPL_TOPIC
+		break;
+	}
+	case 332: { // RPL_TOPIC
 		IrcChannel *channel = account->getChannel(params.value(1), false);
 		if (channel)
 			channel->handleTopic(params.value(2));
 		else
 			channelIsNotJoinedError("RPL_TOPIC", params.value(1));
-	} else if (cmd == 333) { // RPL_TOPIC_INFO
+		break;
+	}
+	case 333: { // RPL_TOPIC_INFO
 		IrcChannel *channel = account->getChannel(params.value(1), false);
 		if (channel)
 			channel->handleTopicInfo(params.value(2), params.value(3));
 		else
 			channelIsNotJoinedError("RPL_TOPIC_INFO", params.value(1));
-	} else if (cmd == "KICK") {
+		break;
+	}
+	case IrcKick: {
 		IrcChannel *channel = account->getChannel(params.value(0), false);
 		if (channel)
 			channel->handleKick(params.value(1), name, params.value(2));
 		else
 			channelIsNotJoinedError(cmd, params.value(0));
-	} else if (cmd == "MODE") {
+		break;
+	}
+	case IrcMode: {
 		QString object = params.value(0);
 		if (IrcChannel *channel = account->getChannel(object, false))
 			channel->handleMode(name, params.value(1), params.value(2));
 		else if (IrcContact *contact = account->getContact(name, false))
 			contact->handleMode(name, params.value(1), params.value(2));
-	} else if (cmd == "NOTICE") {
+		break;
+	}
+	case IrcNotice: {
 		QString text = params.value(1);
-		if (ctcpRx.indexIn(text) == 0) {
+		QString ctcpCmd;
+		QString ctcpParams;
+		if (IrcMessage::parseCtcp(text, &ctcpCmd, &ctcpParams)) {
 			bool handled = false;
-			QString ctcpCmd = ctcpRx.cap(1);
 			foreach (IrcCtcpHandler *handler, m_ctcpHandlers.values(ctcpCmd)) {
 				handled = true;
-				handler->handleCtcpResponse(account, name, host, params.value(0), ctcpCmd, ctcpRx.cap(3));
+				handler->handleCtcpResponse(account, name, host, params.value(0), ctcpCmd, ctcpParams);
 			}
 			if (!handled)
 				qDebug() << "Unknown CTCP response" << ctcpCmd << "from" << name;
@@ -275,19 +354,28 @@ void IrcConnection::handleMessage(IrcAccount *account, const QString &name,  con
 		}
 		QString msg = QString("%1: %2").arg(name).arg(text);
 		m_account->log(msg, true, "Notice");
-	} else if (cmd == 375) { // RPL_MOTDSTART
+		break;
+	}
+	case 375: { // RPL_MOTDSTART
 		m_account->log(tr("Message of the day:"), false, "MOTD");
-	} else if (cmd == 376) { // RPL_ENDOFMOTD
+		break;
+	}
+	case 376: { // RPL_ENDOFMOTD
 		m_account->log(tr("End of message of the day"), false, "MOTD");
-	} else if (cmd == 372) { // RPL_MOTD
+		break;
+	}
+	case 372: { // RPL_MOTD
 		m_account->log(params.value(1), false, "MOTD");
-
-	} else if (cmd == 321) { // RPL_LISTSTART
+		break;
+	}
+	case 321: { // RPL_LISTSTART
 		if (m_account->d->channelListForm)
 			m_account->d->channelListForm.data()->listStarted();
 		else
 			m_account->log(tr("Start of /LIST"), m_account->isUserInputtedCommand("LIST"), "LIST");
-	} else if (cmd == 322) { // RPL_LIST
+		break;
+	}
+	case 322: { // RPL_LIST
 		QString channel = params.value(1);
 		QString users = params.value(2);
 		QString topic = IrcProtocol::ircFormatToHtml(params.value(3));
@@ -300,22 +388,30 @@ void IrcConnection::handleMessage(IrcAccount *account, const QString &name,  con
 						   .arg(topic),
 						   m_account->isUserInputtedCommand("LIST"),
 						   "LIST");
-	} else if (cmd == 323) { // RPL_LISTEND
+		break;
+	}
+	case 323: { // RPL_LISTEND
 		if (m_account->d->channelListForm)
 			m_account->d->channelListForm.data()->listEnded();
 		else
 			m_account->log(tr("End of /LIST"), m_account->isUserInputtedCommand("LIST", true), "LIST");
-	} else if (cmd == 521) { // ERR_LISTSYNTAX
+		break;
+	}
+	case 521: { // ERR_LISTSYNTAX
 		QString error = tr("Bad list syntax, type /QUOTE HELP LIST");
 		if (m_account->d->channelListForm)
 			m_account->d->channelListForm.data()->error(error);
 		m_account->log(error, true, "ERROR");
-	} else if (cmd == 263) { // RPL_TRYAGAIN
+		break;
+	}
+	case 263: { // RPL_TRYAGAIN
 		QString error = tr("Server load is temporarily too heavy.\nPlease wait a while and try again.");
 		if (m_account->d->channelListForm)
 			m_account->d->channelListForm.data()->error(error);
 		m_account->log(error, true, "ERROR");
-	} else if (cmd == 301) { // RPL_AWAY
+		break;
+	}
+	case 301: { // RPL_AWAY
 		QString nick = params.value(1);
 		IrcContact *contact = account->getContact(nick, false);
 		if (contact) {
@@ -330,22 +426,25 @@ void IrcConnection::handleMessage(IrcAccount *account, const QString &name,  con
 							   m_account->isUserInputtedCommand("WHOIS"),
 							   "Away");
 		}
-	} else if (cmd == 305) { // RPL_UNAWAY
+		break;
+	}
+	case 305: { // RPL_UNAWAY
 		m_account->log(tr("You are no longer marked as being away"), false, "Away");
-	} else if (cmd == 306) { // RPL_NOWAWAY
+		break;
+	}
+	case 306: { // RPL_NOWAWAY
 		m_account->log(tr("You have been marked as being away"), false, "Away");
+		break;
+	}
+	default:
+		break;
 	}
 }
 
 void IrcConnection::send(QString command, bool highPriority)
 {
 	if (!command.isEmpty()) {
-		if (highPriority)
-			m_messagesQueue.push_back(command);
-		else
-			m_lowPriorityMessagesQueue.push_back(command);
-		if (!m_messagesTimer.isActive())
-			m_messagesTimer.start();
+		m_sendQueue.enqueue(command, highPriority);
 		sendNextMessage();
 	}
 }
@@ -426,6 +525,8 @@ void IrcConnection::loadSettings()
 #else
 	m_autoRequestWhois = cfg.value("autoRequestWhois", false);
 #endif
+	// Most of servers allow a burst of five commands and one command per two seconds after it
+	m_sendQueue.setLimits(cfg.value("floodBurst", 5), cfg.value("floodInterval", 2000));
 }
 
 void IrcConnection::tryConnectToNextServer()
@@ -489,24 +590,19 @@ void IrcConnection::tryNextNick()
 
 void IrcConnection::sendNextMessage()
 {
-	uint currentTime = QDateTime::currentDateTime().toTime_t();
-	if (currentTime - m_lastMessageTime <= 2)
-		return;
-
 	QString command;
-	if (!m_messagesQueue.isEmpty())
-		command = m_messagesQueue.takeFirst();
-	else if (!m_lowPriorityMessagesQueue.isEmpty())
-		command = m_lowPriorityMessagesQueue.takeFirst();
+	while (m_sendQueue.takeNext(&command)) {
+		QByteArray data = m_codec->fromUnicode(command) + "\r\n";
+		qDebug() << ">>>>" << data.trimmed();
+		if (m_sendQueue.latency() > 0)
+			qDebug() << "Command has been queued for" << m_sendQueue.latency() << "ms,"
+					 << m_sendQueue.depth() << "commands are still queued";
+		m_socket->write(data);
+	}
+	const int delay = m_sendQueue.nextDelay();
+	if (delay >= 0)
+		m_messagesTimer.start(delay);
 	else
-		return;
-
-	QByteArray data = m_codec->fromUnicode(command) + "\r\n";
-	qDebug() << ">>>>" << data.trimmed();
-	m_socket->write(data);
-
-	m_lastMessageTime = QDateTime::currentDateTime().toTime_t();
-	if (m_messagesQueue.isEmpty() && m_lowPriorityMessagesQueue.isEmpty())
 		m_messagesTimer.stop();
 }
 
@@ -517,7 +613,9 @@ void IrcConnection::handleTextMessage(const QString &from, const QString &fromHo
 	bool isPrivate = (to == m_nick);
 	Message msg(plainText);
 	msg.setIncoming(true);
-	msg.setTime(QDateTime::currentDateTime());
+	// IRCv3 server-time of messages replayed by bouncers
+	QDateTime time = QDateTime::fromString(m_tags.value(QStringLiteral("time")), Qt::ISODate);
+	msg.setTime(time.isValid() ? time.toLocalTime() : QDateTime::currentDateTime());
 	msg.setProperty("html", html);
 	ChatSession *session;
 	if (isPrivate) {
@@ -553,39 +651,21 @@ void IrcConnection::channelIsNotJoinedError(const QString &cmd, const QString &c
 
 void IrcConnection::readData()
 {
+	IrcMessage message;
 	while (m_socket->canReadLine()) {
-		QString msg = m_codec->toUnicode(m_socket->readLine());
-		qDebug() << "<<<<" << msg.trimmed();
-		static QRegExp rx("^(:([^\\s!@]+|)(\\S+|)\\s+|)(\\w+|\\d{3})(\\s+(.*)|)");
-		if (rx.indexIn(msg) == 0) {
-			QString params = rx.cap(6);
-			QStringList paramList;
-			static QRegExp paramRx("(:[^\\r\\n]*|[^\\s\\r\\n]+)");
-			int pos = 0;
-			forever {
-				pos = paramRx.indexIn(params, pos);
-				Q_ASSERT(paramRx.matchedLength());
-				if (pos < 0)
-					break;
-				QString param = paramRx.cap(1);
-				if (param.startsWith(':')) {
-					paramList << param.mid(1);
-					break;
-				} else {
-					paramList << param;
-				}
-				pos += paramRx.matchedLength();
-			}
-			QString name = rx.cap(2);
-			QString host = rx.cap(3);
-			if (host.startsWith('!'))
-				host = host.mid(1);
-			IrcCommand cmd(rx.cap(4));
-			bool handled = false;
-			foreach (IrcServerMessageHandler *handler, m_handlers.values(cmd)) {
-				handled = true;
-				handler->handleMessage(m_account, name, host, cmd, paramList);
-			}
+		const QByteArray line = m_socket->readLine();
+		qDebug() << "<<<<" << line.trimmed();
+		if (IrcMessage::parse(line, m_codec, &message)) {
+			QStringList &paramList = message.params;
+			const IrcCommand cmd(message.command);
+			const QList<IrcServerMessageHandler*> &handlers = cmd.code() > 0 && cmd.code() < MaxReplyCode
+					? m_numericHandlers.at(cmd.code())
+					: m_handlers.value(cmd.value());
+			const bool handled = !handlers.isEmpty();
+			qSwap(m_tags, message.tags);
+			foreach (IrcServerMessageHandler *handler, handlers)
+				handler->handleMessage(m_account, message.name, message.host, cmd, paramList);
+			qSwap(m_tags, message.tags);
 			if (!handled) {
 				if (cmd.code() >= 400 && cmd.code() <= 502) { // Error
 					m_account->log(paramList.last(), true, "ERROR");
@@ -606,6 +686,7 @@ void IrcConnection::stateChanged(QAbstractSocket::SocketState state)
     qWarning() << "New connection state:" << state;
 	if (state == QAbstractSocket::ConnectedState) {
 		SystemIntegration::keepAlive(m_socket);
+		m_sendQueue.reset();
 		IrcServer server = m_servers.at(m_currentServer);
 		if (server.protectedByPassword) {
 			if (m_passDialog) {
@@ -30,8 +30,10 @@
 #include "ircctcphandler.h"
 #include "ircprotocol.h"
 #include "ircaccount.h"
+#include "ircsendqueue.h"
 #include <QSslSocket>
 #include <QTimer>
+#include <QVector>
 
 class QHostInfo;
 
@@ -73,6 +75,8 @@ public:
 	bool autoRequestWhois() const { return m_autoRequestWhois; }
 	void handleTextMessage(const QString &from, const QString &fromHost, const QString &to, const QString &text);
 	QStringList supportedCtcpTags() { return m_ctcpHandlers.keys(); }
+	int sendQueueDepth() const { return m_sendQueue.depth(); }
+	qint64 sendQueueLatency() const { return m_sendQueue.latency(); }
 private:
 	void tryConnectToNextServer();
 	void tryNextNick();
@@ -88,7 +92,11 @@ private slots:
 	void passwordEntered(const QString &password, bool remember);
 private:
 	QSslSocket *m_socket;
-	QMultiMap<QString, IrcServerMessageHandler*> m_handlers;
+	enum { MaxReplyCode = 1000 };
+	QVector<QList<IrcServerMessageHandler*> > m_numericHandlers;
+	QHash<QString, QList<IrcServerMessageHandler*> > m_handlers;
+	// Tags of the message which is being handled
+	QHash<QString, QString> m_tags;
 	QMultiMap<QString, IrcCtcpHandler*> m_ctcpHandlers;
 	IrcAccount *m_account;
 	QList<IrcServer> m_servers;
@@ -100,10 +108,8 @@ private:
 	QString m_nickPassword;
 	QTextCodec *m_codec;
 	int m_hostLookupId;
-	QStringList m_messagesQueue;
-	QStringList m_lowPriorityMessagesQueue;
+	IrcSendQueue m_sendQueue;
 	QTimer m_messagesTimer;
-	uint m_lastMessageTime; // unix time when the last message had been sent
 	bool m_autoRequestWhois;
 	QPointer<PasswordDialog> m_passDialog;
 };
@@ -0,0 +1,179 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Alexey Prokhin <alexey.prokhin@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "ircmessage.h"
+#include <QTextCodec>
+
+namespace qutim_sdk_0_3 {
+
+namespace irc {
+
+static inline const char *skipSpaces(const char *p, const char *end)
+{
+	while (p < end && *p == ' ')
+		++p;
+	return p;
+}
+
+static inline const char *findSpace(const char *p, const char *end)
+{
+	while (p < end && *p != ' ')
+		++p;
+	return p;
+}
+
+static inline bool isCommandChar(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static QString unescapeTagValue(const char *p, const char *end)
+{
+	QByteArray value;
+	value.reserve(end - p);
+	for (; p < end; ++p) {
+		if (*p != '\\') {
+			value += *p;
+			continue;
+		}
+		if (++p == end)
+			break;
+		switch (*p) {
+		case ':':
+			value += ';';
+			break;
+		case 's':
+			value += ' ';
+			break;
+		case 'r':
+			value += '\r';
+			break;
+		case 'n':
+			value += '\n';
+			break;
+		default:
+			value += *p;
+		}
+	}
+	return QString::fromUtf8(value);
+}
+
+static void parseTags(const char *p, const char *end, QHash<QString, QString> *tags)
+{
+	while (p < end) {
+		const char *tagEnd = p;
+		while (tagEnd < end && *tagEnd != ';')
+			++tagEnd;
+		const char *keyEnd = p;
+		while (keyEnd < tagEnd && *keyEnd != '=')
+			++keyEnd;
+		if (keyEnd > p) {
+			const QString key = QString::fromUtf8(p, keyEnd - p);
+			tags->insert(key, keyEnd < tagEnd ? unescapeTagValue(keyEnd + 1, tagEnd) : QString());
+		}
+		p = tagEnd + 1;
+	}
+}
+
+void IrcMessage::clear()
+{
+	tags.clear();
+	name.clear();
+	host.clear();
+	command.clear();
+	params.clear();
+}
+
+bool IrcMessage::parse(const QByteArray &line, QTextCodec *codec, IrcMessage *message)
+{
+	message->clear();
+	const char *p = line.constData();
+	const char *end = p + line.size();
+	while (end > p && (end[-1] == '\n' || end[-1] == '\r'))
+		--end;
+	p = skipSpaces(p, end);
+
+	if (p < end && *p == '@') {
+		const char *tagsEnd = findSpace(p, end);
+		parseTags(p + 1, tagsEnd, &message->tags);
+		p = skipSpaces(tagsEnd, end);
+	}
+
+	if (p < end && *p == ':') {
+		const char *prefixEnd = findSpace(++p, end);
+		const char *nameEnd = p;
+		while (nameEnd < prefixEnd && *nameEnd != '!' && *nameEnd != '@')
+			++nameEnd;
+		message->name = codec->toUnicode(p, nameEnd - p);
+		const char *host = nameEnd < prefixEnd && *nameEnd == '!' ? nameEnd + 1 : nameEnd;
+		message->host = codec->toUnicode(host, prefixEnd - host);
+		p = skipSpaces(prefixEnd, end);
+	}
+
+	const char *commandEnd = p;
+	while (commandEnd < end && isCommandChar(*commandEnd))
+		++commandEnd;
+	if (commandEnd == p)
+		return false;
+	message->command = QString::fromLatin1(p, commandEnd - p);
+	p = commandEnd;
+
+	forever {
+		p = skipSpaces(p, end);
+		if (p >= end)
+			break;
+		if (*p == ':') {
+			message->params << codec->toUnicode(p + 1, end - p - 1);
+			break;
+		}
+		const char *paramEnd = findSpace(p, end);
+		message->params << codec->toUnicode(p, paramEnd - p);
+		p = paramEnd;
+	}
+	return true;
+}
+
+bool IrcMessage::parseCtcp(const QString &text, QString *cmd, QString *params)
+{
+	const QChar delimiter(0x01);
+	if (!text.startsWith(delimiter))
+		return false;
+	const int last = text.lastIndexOf(delimiter);
+	if (last <= 1)
+		return false;
+	const int space = text.indexOf(QLatin1Char(' '), 1);
+	if (space == 1)
+		return false;
+	if (space < 0 || space > last) {
+		*cmd = text.mid(1, last - 1);
+		params->clear();
+	} else {
+		*cmd = text.mid(1, space - 1);
+		*params = text.mid(space + 1, last - space - 1);
+	}
+	return true;
+}
+
+} } // namespace qutim_sdk_0_3::irc
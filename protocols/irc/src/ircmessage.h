@@ -0,0 +1,61 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Alexey Prokhin <alexey.prokhin@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef IRCMESSAGE_H
+#define IRCMESSAGE_H
+
+#include <QHash>
+#include <QStringList>
+
+class QTextCodec;
+
+namespace qutim_sdk_0_3 {
+
+namespace irc {
+
+/*
+ * Single line received from the server:
+ * [@tags] [:name[!host]] command [params] [:trailing]
+ * Only the prefix and parameters are decoded by the connection's codec,
+ * tags are always UTF-8 as IRCv3 requires.
+ */
+struct IrcMessage
+{
+	QHash<QString, QString> tags;
+	QString name;
+	QString host;
+	QString command;
+	QStringList params;
+
+	void clear();
+	// Parses the raw line, trailing CR and LF are ignored
+	static bool parse(const QByteArray &line, QTextCodec *codec, IrcMessage *message);
+	// Splits "\001CMD params\001" text of PRIVMSG and NOTICE messages
+	static bool parseCtcp(const QString &text, QString *cmd, QString *params);
+};
+
+} } // namespace qutim_sdk_0_3::irc
+
+#endif // IRCMESSAGE_H
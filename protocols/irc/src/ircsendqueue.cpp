@@ -0,0 +1,233 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Alexey Prokhin <alexey.prokhin@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "ircsendqueue.h"
+
+namespace qutim_sdk_0_3 {
+
+namespace irc {
+
+// Lines are limited by 512 bytes, leave a room for the multibyte characters
+enum { MaxJoinLength = 400 };
+
+// Nicks and channels can not contain spaces
+static const QString joinTarget = QLatin1String(" JOIN");
+static const QString quitTarget = QLatin1String(" QUIT");
+
+IrcSendQueue::IrcSendQueue() :
+	m_floodTime(0), m_burst(5), m_interval(2000), m_depth(0), m_latency(0)
+{
+	m_clock.start();
+}
+
+void IrcSendQueue::setLimits(int burst, int interval)
+{
+	m_burst = qMax(burst, 1);
+	m_interval = qMax(interval, 0);
+}
+
+void IrcSendQueue::enqueue(const QString &command, bool highPriority)
+{
+	Entry entry = { command, m_clock.elapsed() };
+	const QString key = target(command);
+	if (key == quitTarget) {
+		m_quits.enqueue(entry);
+		++m_depth;
+		return;
+	}
+	Level &level = m_levels[highPriority ? 0 : 1];
+	QStringList channels;
+	QStringList keys;
+	if (key == joinTarget && parseJoin(command, &channels, &keys)) {
+		// JOIN must not overtake commands queued for its channel before,
+		// JOINs of the other channels are still merged
+		for (int i = 0; i < channels.size(); ++i) {
+			const QString channel = channels.at(i).toLower();
+			entry.command = QLatin1String("JOIN ") + channels.at(i);
+			if (i < keys.size())
+				entry.command += QLatin1Char(' ') + keys.at(i);
+			push(level, level.queues.contains(channel) ? channel : joinTarget, entry);
+		}
+		return;
+	}
+	// And commands for the channel must not overtake its queued JOIN
+	if (!key.isEmpty() && key != joinTarget && hasJoin(level, key))
+		push(level, joinTarget, entry);
+	else
+		push(level, key, entry);
+}
+
+void IrcSendQueue::push(Level &level, const QString &key, const Entry &entry)
+{
+	QQueue<Entry> &queue = level.queues[key];
+	if (queue.isEmpty())
+		level.turns.enqueue(key);
+	queue.enqueue(entry);
+	++m_depth;
+}
+
+bool IrcSendQueue::hasJoin(const Level &level, const QString &channel)
+{
+	QHash<QString, QQueue<Entry> >::const_iterator it = level.queues.constFind(joinTarget);
+	if (it == level.queues.constEnd())
+		return false;
+	QStringList channels;
+	QStringList keys;
+	foreach (const Entry &entry, it.value()) {
+		if (target(entry.command) == channel)
+			return true;
+		if (!parseJoin(entry.command, &channels, &keys))
+			continue;
+		foreach (const QString &name, channels) {
+			if (name.toLower() == channel)
+				return true;
+		}
+	}
+	return false;
+}
+
+bool IrcSendQueue::takeNext(QString *command)
+{
+	if (nextDelay() != 0)
+		return false;
+	const qint64 now = m_clock.elapsed();
+	Entry entry;
+	if (!m_levels[0].turns.isEmpty()) {
+		entry = take(m_levels[0]);
+	} else if (!m_levels[1].turns.isEmpty()) {
+		entry = take(m_levels[1]);
+	} else {
+		// Nothing is sent after QUIT, so it waits for the rest of the queue
+		entry = m_quits.dequeue();
+		--m_depth;
+	}
+	m_latency = now - entry.time;
+	m_floodTime = qMax(m_floodTime, now) + m_interval;
+	*command = entry.command;
+	return true;
+}
+
+int IrcSendQueue::nextDelay() const
+{
+	if (m_depth == 0)
+		return -1;
+	const qint64 delay = m_floodTime - m_clock.elapsed() - qint64(m_burst - 1) * m_interval;
+	return int(qMax<qint64>(delay, 0));
+}
+
+void IrcSendQueue::reset()
+{
+	m_floodTime = 0;
+	// QUIT of the previous connection must not close the new one
+	m_depth -= m_quits.size();
+	m_quits.clear();
+}
+
+QString IrcSendQueue::target(const QString &command)
+{
+	const QStringList words = command.section(QLatin1Char('\n'), 0, 0)
+			.split(QLatin1Char(' '), QString::SkipEmptyParts);
+	const QString name = words.value(0).toUpper();
+	// Channel commands must not overtake messages queued for the channel
+	if (name == QLatin1String("PRIVMSG") || name == QLatin1String("NOTICE")
+			|| name == QLatin1String("PART") || name == QLatin1String("KICK")
+			|| name == QLatin1String("MODE") || name == QLatin1String("TOPIC")) {
+		return words.value(1).toLower();
+	}
+	if (name == QLatin1String("JOIN"))
+		return joinTarget;
+	if (name == QLatin1String("QUIT"))
+		return quitTarget;
+	// Other commands are sent in the order they were queued
+	return QString();
+}
+
+bool IrcSendQueue::parseJoin(const QString &command, QStringList *channels, QStringList *keys)
+{
+	const QStringList words = command.split(QLatin1Char(' '), QString::SkipEmptyParts);
+	if (words.size() < 2 || words.size() > 3 || command.contains(QLatin1Char('\n')))
+		return false;
+	if (words.at(0).toUpper() != QLatin1String("JOIN") || words.at(1) == QLatin1String("0"))
+		return false;
+	*channels = words.at(1).split(QLatin1Char(','), QString::SkipEmptyParts);
+	*keys = words.size() == 3 ? words.at(2).split(QLatin1Char(',')) : QStringList();
+	return !channels->isEmpty() && keys->size() <= channels->size();
+}
+
+IrcSendQueue::Entry IrcSendQueue::take(Level &level)
+{
+	const QString key = level.turns.dequeue();
+	QHash<QString, QQueue<Entry> >::iterator it = level.queues.find(key);
+	Entry entry;
+	if (key == joinTarget) {
+		entry = takeJoins(it.value());
+	} else {
+		entry = it.value().dequeue();
+		--m_depth;
+	}
+	if (it.value().isEmpty())
+		level.queues.erase(it);
+	else
+		level.turns.enqueue(key);
+	return entry;
+}
+
+IrcSendQueue::Entry IrcSendQueue::takeJoins(QQueue<Entry> &queue)
+{
+	Entry entry = queue.dequeue();
+	--m_depth;
+	QStringList keyedChannels;
+	QStringList keys;
+	QStringList channels;
+	QStringList joinChannels;
+	QStringList joinKeys;
+	if (!parseJoin(entry.command, &joinChannels, &joinKeys))
+		return entry;
+	int length = 0;
+	forever {
+		// Channels with keys have to go first
+		for (int i = 0; i < joinChannels.size(); ++i) {
+			if (i < joinKeys.size()) {
+				keyedChannels << joinChannels.at(i);
+				keys << joinKeys.at(i);
+			} else {
+				channels << joinChannels.at(i);
+			}
+		}
+		length += joinChannels.join(QLatin1Char(',')).size() + joinKeys.join(QLatin1Char(',')).size() + 2;
+		if (queue.isEmpty() || !parseJoin(queue.head().command, &joinChannels, &joinKeys))
+			break;
+		if (length + queue.head().command.size() > MaxJoinLength)
+			break;
+		queue.dequeue();
+		--m_depth;
+	}
+	entry.command = QLatin1String("JOIN ") + (keyedChannels + channels).join(QLatin1Char(','));
+	if (!keys.isEmpty())
+		entry.command += QLatin1Char(' ') + keys.join(QLatin1Char(','));
+	return entry;
+}
+
+} } // namespace qutim_sdk_0_3::irc
@@ -0,0 +1,94 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Alexey Prokhin <alexey.prokhin@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef IRCSENDQUEUE_H
+#define IRCSENDQUEUE_H
+
+#include <QHash>
+#include <QQueue>
+#include <QStringList>
+#include <QElapsedTimer>
+
+namespace qutim_sdk_0_3 {
+
+namespace irc {
+
+/*
+ * Flood control of commands sent to the server. Commands spend tokens of
+ * a bucket: up to burst commands may be sent at once, then one command per
+ * interval. Queued commands are grouped by their targets and the targets
+ * take turns, so a long paste to one channel doesn't hold back the others.
+ * Commands addressed to a channel share its queue. Queued JOINs are sent
+ * as a single command unless that would reorder commands of a channel,
+ * QUIT is sent after all other queued commands.
+ */
+class IrcSendQueue
+{
+public:
+	IrcSendQueue();
+	void setLimits(int burst, int interval);
+	void enqueue(const QString &command, bool highPriority);
+	// Takes the next command if the bucket allows to send it right now
+	bool takeNext(QString *command);
+	// Milliseconds until the next command may be sent, -1 if the queue is empty
+	int nextDelay() const;
+	// Fills the bucket and drops queued QUITs, for example for a new connection
+	void reset();
+	int depth() const { return m_depth; }
+	// Milliseconds the last sent command has waited in the queue
+	qint64 latency() const { return m_latency; }
+private:
+	struct Entry
+	{
+		QString command;
+		qint64 time;
+	};
+	struct Level
+	{
+		QHash<QString, QQueue<Entry> > queues;
+		QQueue<QString> turns;
+	};
+	static QString target(const QString &command);
+	static bool parseJoin(const QString &command, QStringList *channels, QStringList *keys);
+	// Queued JOIN or a command behind it is addressed to the channel
+	static bool hasJoin(const Level &level, const QString &channel);
+	void push(Level &level, const QString &key, const Entry &entry);
+	Entry take(Level &level);
+	Entry takeJoins(QQueue<Entry> &queue);
+
+	Level m_levels[2];
+	QQueue<Entry> m_quits;
+	QElapsedTimer m_clock;
+	// The bucket is empty until this time, every command moves it by an interval
+	qint64 m_floodTime;
+	int m_burst;
+	int m_interval;
+	int m_depth;
+	qint64 m_latency;
+};
+
+} } // namespace qutim_sdk_0_3::irc
+
+#endif // IRCSENDQUEUE_H
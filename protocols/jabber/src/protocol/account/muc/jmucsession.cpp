@@ -79,6 +79,8 @@ public:
 	QString topic;
 	QHash<QString, quint64> messages;
 	QHash<QString, JMUCUser *> users;
+	// Initial roster of the room, added to the session at once after joining
+	QList<JMUCUser *> pendingUsers;
 	bool isAutoRejoin;
 	Jreen::Bookmark::Conference bookmark;
 	QPointer<JConferenceConfig> config;
@@ -90,6 +92,7 @@ public:
 
 void JMUCSessionPrivate::removeUser(JMUCSession *conference, JMUCUser *user)
 {
+	pendingUsers.removeOne(user);
 	if (ChatSession *session = ChatLayer::get(conference, false))
 		session->removeContact(user);
 	
@@ -426,7 +429,9 @@ void JMUCSession::onParticipantPresence(const Jreen::Presence &presence,
 			else if (participant->role() == MUCRoom::RoleVisitor)
 				text = text % tr(" as") % tr(" visitor");
 			// addUser doesn't handle addition to the session
-			if (ChatSession *session = ChatLayer::get(this, false))
+			if (!d->room->isJoined())
+				d->pendingUsers << user;
+			else if (ChatSession *session = ChatLayer::get(this, false))
 				session->addContact(user);
 			notificationType = Notification::ChatUserJoined;
 		} else if (!user) {
@@ -748,7 +753,16 @@ void JMUCSession::joinedChanged()
 			user->setStatus(presence);
 			d->removeUser(this, user);
 		}
+	} else if (!d->pendingUsers.isEmpty()) {
+		if (ChatSession *session = ChatLayer::get(this, false)) {
+			QList<Buddy*> users;
+			users.reserve(d->pendingUsers.size());
+			foreach (JMUCUser *user, d->pendingUsers)
+				users << user;
+			session->addContacts(users);
+		}
 	}
+	d->pendingUsers.clear();
 	
 	setJoined(d->room->isJoined());
 }
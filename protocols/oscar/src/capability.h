@@ -95,7 +95,7 @@ struct fromDataUnitHelper<Capability, false>
 {
 	static inline Capability fromByteArray(const DataUnit &d)
 	{
-		return Capability(d.readData(16));
+		return Capability(d.readRawData(16));
 	}
 };
 
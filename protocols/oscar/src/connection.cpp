@@ -28,13 +28,29 @@
 #include <QBuffer>
 #include <QCoreApplication>
 #include <QNetworkProxy>
+#include <QLoggingCategory>
+#include <QVarLengthArray>
 #include <qutim/networkproxy.h>
 #include <qutim/systemintegration.h>
+#include <algorithm>
 
 namespace qutim_sdk_0_3 {
 
 namespace oscar {
 
+// Per-packet tracing is formatted only if it's enabled by QT_LOGGING_RULES
+Q_LOGGING_CATEGORY(oscarPackets, "qutim.oscar.packets", QtWarningMsg)
+
+static bool handlerEntryLessThan(const SNACHandlerEntry &entry, quint32 type)
+{
+	return entry.type < type;
+}
+
+static bool handlerEntryGreaterThan(quint32 type, const SNACHandlerEntry &entry)
+{
+	return type < entry.type;
+}
+
 ProtocolError::ProtocolError(const SNAC &snac)
 {
 	m_code = snac.read<qint16>();
@@ -248,8 +264,12 @@ void AbstractConnection::registerHandler(SNACHandler *handler)
 {
 	Q_D(AbstractConnection);
 	QList<SNACInfo> infos = handler->infos();
-	foreach(const SNACInfo &info, infos)
-		d->handlers.insertMulti((info.first << 16) | info.second, handler);
+	foreach(const SNACInfo &info, infos) {
+		const SNACHandlerEntry entry = { quint32(info.first << 16) | info.second, handler };
+		QVector<SNACHandlerEntry>::iterator it = std::upper_bound(d->handlers.begin(), d->handlers.end(),
+		                                                          entry.type, handlerEntryGreaterThan);
+		d->handlers.insert(it, entry);
+	}
 }
 
 void AbstractConnection::disconnectFromHost(bool force)
@@ -468,7 +488,7 @@ bool AbstractConnection::testRate(quint16 family, quint16 subtype, bool priority
 quint32 AbstractConnection::sendSnac(SNAC &snac)
 {
 	Q_D(AbstractConnection);
-	QString dbgStr;
+	const char *dbgStr;
 	quint32 id = 0;
 	// Not allow any snacs in unconnected state
 	if (d->state == Unconnected) {
@@ -478,7 +498,6 @@ quint32 AbstractConnection::sendSnac(SNAC &snac)
 	else if (d->state == Connecting && !d->initSnacs.contains(SNACInfo(snac.family(), snac.subtype()))) {
 		dbgStr = "Trying to send SNAC(0x%1, 0x%2) to %3 which is in connecting state";
 	} else {
-		dbgStr = "SNAC(0x%1, 0x%2) is sent to %3";
 		// Send this snac
 		FLAP flap(0x02);
 		id = d->nextId();
@@ -486,8 +505,13 @@ quint32 AbstractConnection::sendSnac(SNAC &snac)
 		flap.append(snac.toByteArray());
 		snac.lock();
 		send(flap);
+		qCDebug(oscarPackets) << QString("SNAC(0x%1, 0x%2) is sent to %3")
+								 .arg(snac.family(), 4, 16, QChar('0'))
+								 .arg(snac.subtype(), 4, 16, QChar('0'))
+								 .arg(metaObject()->className());
+		return id;
 	}
-    qWarning() << dbgStr
+	qWarning() << QString(dbgStr)
 					  .arg(snac.family(), 4, 16, QChar('0'))
 					  .arg(snac.subtype(), 4, 16, QChar('0'))
 					  .arg(metaObject()->className());
@@ -501,7 +525,7 @@ void AbstractConnection::setSeqNum(quint16 seqnum)
 
 void AbstractConnection::processNewConnection()
 {
-	qWarning() << QString("processNewConnection: %1 %2 %3")
+	qCDebug(oscarPackets) << QString("processNewConnection: %1 %2 %3")
 					  .arg(flap().channel(), 2, 16, QChar('0'))
 					  .arg(flap().seqNum())
 					  .arg(flap().data().toHex().constData());
@@ -511,7 +535,7 @@ void AbstractConnection::processNewConnection()
 void AbstractConnection::processCloseConnection()
 {
 	Q_D(AbstractConnection);
-	qWarning() << QString("processCloseConnection: %1 %2 %3")
+	qCDebug(oscarPackets) << QString("processCloseConnection: %1 %2 %3")
 					  .arg(d->flap.channel(), 2, 16, QChar('0'))
 					  .arg(d->flap.seqNum())
 					  .arg(d->flap.data().toHex().constData());
@@ -679,18 +703,25 @@ quint16 AbstractConnection::generateFlapSequence()
 void AbstractConnection::processSnac()
 {
 	Q_D(AbstractConnection);
+	// SNAC's data is a view of the FLAP, which is a view of the receive buffer
 	SNAC snac = SNAC::fromByteArray(d->flap.data());
-	qWarning() << QString("SNAC(0x%1, 0x%2) is received from %3")
-					  .arg(snac.family(), 4, 16, QChar('0'))
-					  .arg(snac.subtype(), 4, 16, QChar('0'))
-					  .arg(metaObject()->className());
-	bool found = false;
-	foreach(SNACHandler *handler, d->handlers.values((snac.family() << 16)| snac.subtype())) {
-		found = true;
+	qCDebug(oscarPackets) << QString("SNAC(0x%1, 0x%2) is received from %3")
+							 .arg(snac.family(), 4, 16, QChar('0'))
+							 .arg(snac.subtype(), 4, 16, QChar('0'))
+							 .arg(metaObject()->className());
+	const quint32 type = quint32(snac.family() << 16) | snac.subtype();
+	QVector<SNACHandlerEntry>::const_iterator begin = std::lower_bound(d->handlers.constBegin(), d->handlers.constEnd(),
+	                                                                   type, handlerEntryLessThan);
+	// Handlers may register new ones, so the range is copied first.
+	// The latest registered handler is called first as it was with QMultiMap
+	QVarLengthArray<SNACHandler*, 4> handlers;
+	for (QVector<SNACHandlerEntry>::const_iterator it = begin; it != d->handlers.constEnd() && it->type == type; ++it)
+		handlers.prepend(it->handler);
+	for (int i = 0; i < handlers.size(); ++i) {
 		snac.resetState();
-		handler->handleSNAC(this, snac);
+		handlers[i]->handleSNAC(this, snac);
 	}
-	if (!found) {
+	if (handlers.isEmpty()) {
 		qWarning() << QString("No handlers for SNAC(0x%1, 0x%2) in %3")
 					 .arg(snac.family(), 4, 16, QChar('0'))
 					 .arg(snac.subtype(), 4, 16, QChar('0'))
@@ -701,45 +732,65 @@ void AbstractConnection::processSnac()
 void AbstractConnection::readData()
 {
 	Q_D(AbstractConnection);
-	if (d->socket->bytesAvailable() <= 0) {
-		qDebug() << "readyRead emmited but the socket is empty";
+	// FLAPs are views of the buffer, so nested event loops of handlers must not touch it
+	if (d->reading)
 		return;
-	}
-	if (d->flap.readData(d->socket)) {
-		if (d->flap.isFinished()) {
-			switch (d->flap.channel()) {
-			case 0x01:
-				processNewConnection();
-				break;
-			case 0x02:
-				processSnac();
-				break;
-			case 0x04:
-				processCloseConnection();
-				break;
-			default:
-				qDebug() << "Unknown shac channel" << hex << d->flap.channel();
-			case 0x03:
-				break;
-			case 0x05:
-				qDebug() << "Connection alive!";
-				break;
-			}
-			d->flap.clear();
+	d->reading = true;
+	int offset = 0;
+	forever {
+		const qint64 available = d->socket->bytesAvailable();
+		if (available > 0) {
+			// Parsed frames are dropped before reading, the buffer's capacity is reused
+			d->buffer.remove(0, offset);
+			offset = 0;
+			const int size = d->buffer.size();
+			d->buffer.resize(size + int(available));
+			const qint64 read = d->socket->read(d->buffer.data() + size, available);
+			d->buffer.resize(size + int(qMax<qint64>(read, 0)));
 		}
-		// Just give a chance to other parts of qutIM to do something if needed
-		if (d->socket->bytesAvailable())
-			QTimer::singleShot(0, this, SLOT(readData()));
-	} else {
-		qCritical() << "Strange situation at" << Q_FUNC_INFO << ":" << __LINE__;
-		d->socket->close();
+		const int frameSize = FLAP::frameSize(d->buffer.constData() + offset, d->buffer.size() - offset);
+		if (frameSize < 0) {
+			qCritical() << "Strange situation at" << Q_FUNC_INFO << ":" << __LINE__;
+			d->buffer.clear();
+			d->reading = false;
+			d->socket->close();
+			return;
+		}
+		if (frameSize == 0)
+			break;
+		d->flap.setRawFrame(d->buffer.constData() + offset, frameSize);
+		offset += frameSize;
+		switch (d->flap.channel()) {
+		case 0x01:
+			processNewConnection();
+			break;
+		case 0x02:
+			processSnac();
+			break;
+		case 0x04:
+			processCloseConnection();
+			break;
+		default:
+			qDebug() << "Unknown shac channel" << hex << d->flap.channel();
+		case 0x03:
+			break;
+		case 0x05:
+			qDebug() << "Connection alive!";
+			break;
+		}
+		d->flap.clear();
 	}
+	d->buffer.remove(0, offset);
+	d->reading = false;
 }
 
 void AbstractConnection::stateChanged(QAbstractSocket::SocketState state)
 {
-	if (state == QAbstractSocket::ConnectedState)
+	if (state == QAbstractSocket::ConnectedState) {
 		SystemIntegration::keepAlive(d_func()->socket);
+		// Tail of the previous connection is useless
+		d_func()->buffer.clear();
+	}
 
 	qWarning() << "New connection state" << state << this->metaObject()->className();
 	if (state == QAbstractSocket::UnconnectedState) {
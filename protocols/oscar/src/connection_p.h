@@ -32,6 +32,7 @@
 #include <QTimer>
 #include <QDateTime>
 #include <QQueue>
+#include <QVector>
 
 namespace qutim_sdk_0_3 {
 
@@ -77,6 +78,12 @@ private:
 	AbstractConnection *m_conn;
 };
 
+struct SNACHandlerEntry
+{
+	quint32 type;
+	SNACHandler *handler;
+};
+
 class AbstractConnectionPrivate
 {
 public:
@@ -84,7 +91,11 @@ public:
 	inline quint32 nextId() { return id++; }
 	Socket *socket;
 	FLAP flap;
-	QMultiMap<quint32, SNACHandler*> handlers;
+	// Sorted by type, handlers of the same type are kept in registration order
+	QVector<SNACHandlerEntry> handlers;
+	// Received data, FLAPs are parsed in place
+	QByteArray buffer;
+	bool reading = false;
 	quint16 seqnum;
 	quint32 id;
 	ClientInfo clientInfo;
@@ -54,6 +54,9 @@ public:
 	operator QByteArray() const { return data(); }
 	void setData(const QByteArray &data) { m_data = data; m_state = 0; }
 	inline QByteArray readData(uint size) const;
+	// Same as readData(), but doesn't copy. Like readAll(), result refers to the unit's data,
+	// so it must be used before the unit is changed or destroyed
+	inline QByteArray readRawData(uint size) const;
 	inline void skipData(uint num) const { m_state = qMin<uint>(m_state + num, m_data.size()); }
 	inline void resetState() const { m_state = 0; }
 	inline uint dataSize() const { return m_data.size() > m_state ? m_data.size() - m_state : 0; }
@@ -61,6 +64,8 @@ public:
 	int state() const { return m_state; }
 	void setMaxSize(int size) { m_max_size = size; }
 	bool canAppend(int size) { return m_data.size() + size <= m_max_size; }
+	// Lets the writer allocate its buffer once if the final size is known
+	void reserve(int size) { m_data.reserve(size); }
 	template<typename T>
 	void append(const T& data);
 	void append(const char *data);
@@ -99,6 +104,7 @@ private:
 	mutable int m_state;
 };
 
+// Copies, as callers keep read fields long after the packet is gone
 QByteArray DataUnit::readData(uint size) const
 {
 	QByteArray str;
@@ -108,6 +114,14 @@ QByteArray DataUnit::readData(uint size) const
 	return str;
 }
 
+QByteArray DataUnit::readRawData(uint size) const
+{
+	size = qMin(dataSize(), size);
+	QByteArray data = QByteArray::fromRawData(m_data.constData() + m_state, size);
+	m_state += size;
+	return data;
+}
+
 
 QByteArray DataUnit::readAll() const
 {
@@ -199,10 +213,64 @@ struct toDataUnitHelper<T, true>
 	}
 };
 
+// Writes values right into the unit's buffer instead of concatenating temporary arrays
+template<typename T, bool is_int = is_simple<T>::value>
+struct appendDataUnitHelper
+{
+	static inline void append(QByteArray &buffer, const T &data)
+	{
+		buffer += toDataUnitHelper<T>::toByteArray(data);
+	}
+	template<typename A>
+	static inline void append(QByteArray &buffer, const T &data, A arg)
+	{
+		buffer += toDataUnitHelper<T>::toByteArray(data, arg);
+	}
+};
+
+template<typename T>
+struct appendDataUnitHelper<T, true>
+{
+	static inline void append(QByteArray &buffer, T data, ByteOrder bo = BigEndian)
+	{
+		const int size = buffer.size();
+		buffer.resize(size + int(sizeof(T)));
+		uchar *dest = reinterpret_cast<uchar *>(buffer.data() + size);
+		if (bo == BigEndian)
+			qToBigEndian<T>(data, dest);
+		else
+			qToLittleEndian<T>(data, dest);
+	}
+	static inline void append(QByteArray &buffer, const QByteArray &data, ByteOrder bo = BigEndian)
+	{
+		append(buffer, T(data.size()), bo);
+		buffer += data;
+	}
+	static inline void append(QByteArray &buffer, const QString &data, ByteOrder bo = BigEndian)
+	{
+		append(buffer, data, Util::defaultCodec(), bo);
+	}
+	static inline void append(QByteArray &buffer, const char *data, ByteOrder bo = BigEndian)
+	{
+		append(buffer, QString(data), Util::defaultCodec(), bo);
+	}
+	static inline void append(QByteArray &buffer, const QString &data, QTextCodec *codec, ByteOrder bo = BigEndian)
+	{
+		QByteArray buf = toDataUnitHelper<QString>::toByteArray(data, codec);
+		if (quint64(buf.size()) > quint64(std::numeric_limits<T>::max()))
+			buf.truncate(int(std::numeric_limits<T>::max()));
+		append(buffer, buf, bo);
+	}
+	static inline void append(QByteArray &buffer, const char *data, QTextCodec *codec, ByteOrder bo = BigEndian)
+	{
+		append(buffer, QString(data), codec, bo);
+	}
+};
+
 template<typename T>
 Q_INLINE_TEMPLATE void DataUnit::append(const T& data)
 {
-	m_data += toDataUnitHelper<T>::toByteArray(data);
+	appendDataUnitHelper<T>::append(m_data, data);
 	ensure_value();
 }
 
@@ -215,7 +283,7 @@ inline void DataUnit::append(const char *data)
 template<typename T>
 Q_INLINE_TEMPLATE void DataUnit::append(const T &data, ByteOrder bo)
 {
-	m_data += toDataUnitHelper<T>::toByteArray(data, bo);
+	appendDataUnitHelper<T>::append(m_data, data, bo);
 	ensure_value();
 }
 
@@ -234,35 +302,35 @@ inline void DataUnit::append(const char *data, QTextCodec *codec)
 template<typename L>
 Q_INLINE_TEMPLATE void DataUnit::append(const QByteArray &data, ByteOrder bo)
 {
-	m_data += toDataUnitHelper<L>::toByteArray(data, bo);
+	appendDataUnitHelper<L>::append(m_data, data, bo);
 	ensure_value();
 }
 
 template<typename L>
 Q_INLINE_TEMPLATE void DataUnit::append(const QString &data, QTextCodec *codec, ByteOrder bo)
 {
-	m_data += toDataUnitHelper<L>::toByteArray(data, codec, bo);
+	appendDataUnitHelper<L>::append(m_data, data, codec, bo);
 	ensure_value();
 }
 
 template<typename L>
 Q_INLINE_TEMPLATE void DataUnit::append(const char *data, QTextCodec *codec, ByteOrder bo)
 {
-	m_data += toDataUnitHelper<L>::toByteArray(data, codec, bo);
+	appendDataUnitHelper<L>::append(m_data, data, codec, bo);
 	ensure_value();
 }
 
 template<typename L>
 Q_INLINE_TEMPLATE void DataUnit::append(const QString &data, ByteOrder bo)
 {
-	m_data += toDataUnitHelper<L>::toByteArray(data, bo);
+	appendDataUnitHelper<L>::append(m_data, data, bo);
 	ensure_value();
 }
 
 template<typename L>
 Q_INLINE_TEMPLATE void DataUnit::append(const char *data, ByteOrder bo)
 {
-	m_data += toDataUnitHelper<L>::toByteArray(data, bo);
+	appendDataUnitHelper<L>::append(m_data, data, bo);
 	ensure_value();
 }
 
@@ -316,7 +384,7 @@ struct fromDataUnitHelper<QString, false>
 	template<class L>
 	static inline QString fromByteArray(const DataUnit &d, QTextCodec *codec, L count)
 	{
-		return codec->toUnicode(d.readData(count));
+		return codec->toUnicode(d.readRawData(count));
 	}
 	template<class L>
 	static inline QString fromByteArray(const DataUnit &d, L count, ByteOrder)
@@ -26,11 +26,14 @@
 #include "flap.h"
 #include "util.h"
 #include <QIODevice>
+#include <QtEndian>
 
 namespace qutim_sdk_0_3 {
 
 namespace oscar {
 
+enum { FlapHeaderSize = 6 };
+
 FLAP::FLAP(quint8 channel)
 {
 	m_channel = channel;
@@ -88,6 +91,26 @@ bool FLAP::readData(QIODevice *dev)
 	return true;
 }
 
+int FLAP::frameSize(const char *data, int size)
+{
+	if (size > 0 && quint8(data[0]) != 0x2a)
+		return -1;
+	if (size < FlapHeaderSize)
+		return 0;
+	const int length = FlapHeaderSize + qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(data) + 4);
+	return size < length ? 0 : length;
+}
+
+void FLAP::setRawFrame(const char *data, int size)
+{
+	const uchar *header = reinterpret_cast<const uchar*>(data);
+	m_channel = header[1];
+	m_sequence_number = qFromBigEndian<quint16>(header + 2);
+	m_length = 0;
+	m_state = Finished;
+	setData(QByteArray::fromRawData(data + FlapHeaderSize, size - FlapHeaderSize));
+}
+
 void FLAP::clear()
 {
 	m_state = ReadHeader;
@@ -46,6 +46,10 @@ public:
 	operator QByteArray() const { return toByteArray(); };
 	QByteArray header() const;
 	bool readData(QIODevice *dev);
+	// Size of the complete frame at the data, 0 if it's incomplete and -1 if it's not a FLAP
+	static int frameSize(const char *data, int size);
+	// Makes the FLAP a view of the frame, so the data must outlive it
+	void setRawFrame(const char *data, int size);
 	inline bool isFinished() const { return m_state == Finished; }
 	void clear();
 private:
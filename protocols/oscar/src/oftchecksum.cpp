@@ -0,0 +1,177 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Alexey Prokhin <alexey.prokhin@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#include "oftchecksum.h"
+#include <limits>
+
+#if defined(Q_PROCESSOR_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+# define OFT_CHECKSUM_SSE2
+# include <emmintrin.h>
+# if defined(Q_CC_GNU) && !defined(Q_CC_INTEL)
+#  define OFT_CHECKSUM_AVX2
+#  include <immintrin.h>
+# endif
+#endif
+
+namespace qutim_sdk_0_3 {
+
+namespace oscar {
+
+// Sums of bytes at even and odd positions of a buffer and numbers of them with the high bit set
+struct OftChecksumSums
+{
+	quint64 even;
+	quint64 odd;
+	quint64 evenHigh;
+	quint64 oddHigh;
+};
+
+static void sumScalar(const uchar *data, qint64 size, OftChecksumSums &sums)
+{
+	for (qint64 i = 0; i < size; ++i) {
+		if (i & 1) {
+			sums.odd += data[i];
+			sums.oddHigh += data[i] >> 7;
+		} else {
+			sums.even += data[i];
+			sums.evenHigh += data[i] >> 7;
+		}
+	}
+}
+
+#ifdef OFT_CHECKSUM_SSE2
+static inline quint64 sumLanes(__m128i value)
+{
+	quint64 lanes[2];
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), value);
+	return lanes[0] + lanes[1];
+}
+
+// Returns number of processed bytes, it's always even
+static qint64 sumSse2(const uchar *data, qint64 size, OftChecksumSums &sums)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+	const __m128i highBits = _mm_set1_epi16(0x0101);
+	__m128i even = zero, odd = zero, evenHigh = zero, oddHigh = zero;
+	qint64 i = 0;
+	for (; i + 16 <= size; i += 16) {
+		const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		// High bits of even bytes become low bytes of the words, high bits of odd ones become high bytes
+		const __m128i high = _mm_and_si128(_mm_srli_epi16(value, 7), highBits);
+		even = _mm_add_epi64(even, _mm_sad_epu8(_mm_and_si128(value, lowBytes), zero));
+		odd = _mm_add_epi64(odd, _mm_sad_epu8(_mm_srli_epi16(value, 8), zero));
+		evenHigh = _mm_add_epi64(evenHigh, _mm_sad_epu8(_mm_and_si128(high, lowBytes), zero));
+		oddHigh = _mm_add_epi64(oddHigh, _mm_sad_epu8(_mm_srli_epi16(high, 8), zero));
+	}
+	sums.even += sumLanes(even);
+	sums.odd += sumLanes(odd);
+	sums.evenHigh += sumLanes(evenHigh);
+	sums.oddHigh += sumLanes(oddHigh);
+	return i;
+}
+#endif
+
+#ifdef OFT_CHECKSUM_AVX2
+__attribute__((target("avx2")))
+static inline quint64 sumLanes(__m256i value)
+{
+	quint64 lanes[4];
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), value);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("avx2")))
+static qint64 sumAvx2(const uchar *data, qint64 size, OftChecksumSums &sums)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i lowBytes = _mm256_set1_epi16(0x00ff);
+	const __m256i highBits = _mm256_set1_epi16(0x0101);
+	__m256i even = zero, odd = zero, evenHigh = zero, oddHigh = zero;
+	qint64 i = 0;
+	for (; i + 32 <= size; i += 32) {
+		const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+		const __m256i high = _mm256_and_si256(_mm256_srli_epi16(value, 7), highBits);
+		even = _mm256_add_epi64(even, _mm256_sad_epu8(_mm256_and_si256(value, lowBytes), zero));
+		odd = _mm256_add_epi64(odd, _mm256_sad_epu8(_mm256_srli_epi16(value, 8), zero));
+		evenHigh = _mm256_add_epi64(evenHigh, _mm256_sad_epu8(_mm256_and_si256(high, lowBytes), zero));
+		oddHigh = _mm256_add_epi64(oddHigh, _mm256_sad_epu8(_mm256_srli_epi16(high, 8), zero));
+	}
+	sums.even += sumLanes(even);
+	sums.odd += sumLanes(odd);
+	sums.evenHigh += sumLanes(evenHigh);
+	sums.oddHigh += sumLanes(oddHigh);
+	return i;
+}
+
+static bool hasAvx2()
+{
+	static const bool result = __builtin_cpu_supports("avx2");
+	return result;
+}
+#endif
+
+quint64 OftChecksum::sum(const char *data, qint64 size, qint64 position)
+{
+	const uchar *bytes = reinterpret_cast<const uchar *>(data);
+	OftChecksumSums sums = { 0, 0, 0, 0 };
+	qint64 processed = 0;
+#if defined(OFT_CHECKSUM_AVX2)
+	processed = hasAvx2() ? sumAvx2(bytes, size, sums) : sumSse2(bytes, size, sums);
+#elif defined(OFT_CHECKSUM_SSE2)
+	processed = sumSse2(bytes, size, sums);
+#endif
+	sumScalar(bytes + processed, size - processed, sums);
+
+	// Bytes at odd positions have always been sign extended if char is signed
+	const quint64 extension = std::numeric_limits<char>::is_signed ? 0xff00 : 0;
+	if ((position & 1) == 0)
+		return (sums.even << 8) + sums.odd + extension * sums.oddHigh;
+	else
+		return (sums.odd << 8) + sums.even + extension * sums.evenHigh;
+}
+
+quint32 OftChecksum::update(quint32 checksum, quint64 sum)
+{
+	// Code adapted from miranda's oft_calc_checksum subtracts values one by one from
+	// a 32-bit number and subtracts one more every time it wraps around. Result depends
+	// only on the number of wraps, which also counts the subtracted ones themselves.
+	const qint64 start = (checksum >> 16) & 0xffff;
+	qint64 borrows = 0;
+	qint64 value;
+	forever {
+		value = start - qint64(sum) - borrows;
+		const qint64 wraps = value < 0 ? (Q_INT64_C(0xffffffff) - value) >> 32 : 0;
+		if (wraps == borrows)
+			break;
+		borrows = wraps;
+	}
+	quint32 result = quint32(value);
+	result = (result & 0x0000ffff) + (result >> 16);
+	result = (result & 0x0000ffff) + (result >> 16);
+	return result << 16;
+}
+
+} } // namespace qutim_sdk_0_3::oscar
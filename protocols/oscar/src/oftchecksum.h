@@ -0,0 +1,54 @@
+/****************************************************************************
+**
+** qutIM - instant messenger
+**
+** Copyright © 2011 Alexey Prokhin <alexey.prokhin@yandex.ru>
+**
+*****************************************************************************
+**
+** $QUTIM_BEGIN_LICENSE$
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+** See the GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+** $QUTIM_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef OFTCHECKSUM_H
+#define OFTCHECKSUM_H
+
+#include <QtGlobal>
+
+namespace qutim_sdk_0_3 {
+
+namespace oscar {
+
+/*
+ * OFT checksum is a one's complement difference of 16-bit values, where bytes
+ * at even positions of the file are high halves of the values. So it's fully
+ * defined by the plain sum of those values, and sums of any parts of a file
+ * may be calculated independently and added afterwards.
+ */
+class OftChecksum
+{
+public:
+	// Sum of the values for the data starting at the given position of the file
+	static quint64 sum(const char *data, qint64 size, qint64 position);
+	// Updates checksum with the sum of the following data
+	static quint32 update(quint32 checksum, quint64 sum);
+	static inline quint32 update(quint32 checksum, const char *data, qint64 size, qint64 position)
+	{ return update(checksum, sum(data, size, position)); }
+};
+
+} } // namespace qutim_sdk_0_3::oscar
+
+#endif // OFTCHECKSUM_H
@@ -30,10 +30,13 @@
 #include "icqaccount.h"
 #include "oscarconnection.h"
 #include "icqprotocol.h"
+#include "oftchecksum.h"
 #include <QHostAddress>
 #include <QDir>
 #include <QTimer>
 #include <QApplication>
+#include <QThreadPool>
+#include <QAtomicInt>
 
 namespace qutim_sdk_0_3 {
 
@@ -42,7 +45,8 @@ namespace oscar {
 QHash<quint16, OftServer*> OftFileTransferFactory::m_servers;
 bool OftFileTransferFactory::m_allowAnyPort;
 
-const int BUFFER_SIZE = 4096;
+const int READ_BUFFER_SIZE = 256 * 1024;
+const qint64 PARALLEL_CHUNK_SIZE = 16 * 1024 * 1024;
 using namespace Util;
 
 OftHeader::OftHeader() :
@@ -431,51 +435,116 @@ void OftServer::onTimeout()
 	close();
 }
 
-OftChecksumThread::OftChecksumThread(QIODevice *f, int b) :
+// Every thread reads its own part of the file through a separate handle
+class OftChecksumTask : public QRunnable
+{
+public:
+	OftChecksumTask(const QString &fileName, qint64 position, qint64 size, quint64 *sum, QAtomicInt *failed) :
+		m_fileName(fileName), m_position(position), m_size(size), m_sum(sum), m_failed(failed)
+	{
+	}
+
+	void run()
+	{
+		QFile file(m_fileName);
+		if (!file.open(QIODevice::ReadOnly)) {
+			m_failed->store(1);
+			return;
+		}
+		if (uchar *data = file.map(m_position, m_size)) {
+			*m_sum = OftChecksum::sum(reinterpret_cast<const char *>(data), m_size, m_position);
+			return;
+		}
+		QByteArray buffer(qMin<qint64>(READ_BUFFER_SIZE, m_size), Qt::Uninitialized);
+		qint64 totalRead = 0;
+		file.seek(m_position);
+		while (totalRead < m_size && !m_failed->load()) {
+			const qint64 read = file.read(buffer.data(), qMin<qint64>(buffer.size(), m_size - totalRead));
+			if (read <= 0) {
+				m_failed->store(1);
+				return;
+			}
+			*m_sum += OftChecksum::sum(buffer.constData(), read, m_position + totalRead);
+			totalRead += read;
+		}
+	}
+
+private:
+	QString m_fileName;
+	qint64 m_position;
+	qint64 m_size;
+	quint64 *m_sum;
+	QAtomicInt *m_failed;
+};
+
+OftChecksumThread::OftChecksumThread(QIODevice *f, qint64 b) :
 	file(f), bytes(b)
 {
 }
 
+OftChecksumThread::OftChecksumThread(const QString &name, qint64 b) :
+	file(0), fileName(name), bytes(b)
+{
+}
+
 quint32 OftChecksumThread::chunkChecksum(const char *buffer, int len, quint32 oldChecksum, int offset)
 {
-	// code adapted from miranda's oft_calc_checksum
-	quint32 checksum = (oldChecksum >> 16) & 0xffff;
-	for (int i = 0; i < len; i++)
-	{
-		quint16 val = buffer[i];
-		//quint32 oldchecksum = checksum;
-		if (((i + offset) & 1) == 0)
-			val = val << 8;
-		if (checksum < val)
-			checksum -= val + 1;
-		else // simulate carry
-			checksum -= val;
-	}
-	checksum = ((checksum & 0x0000ffff) + (checksum >> 16));
-	checksum = ((checksum & 0x0000ffff) + (checksum >> 16));
-	return (quint32)checksum << 16;
+	return OftChecksum::update(oldChecksum, buffer, len, offset);
 }
 
 void OftChecksumThread::run()
 {
-	quint32 checksum = 0xFFFF0000;
-	QByteArray data;
-	data.reserve(BUFFER_SIZE);
-	int totalRead = 0;
+	QScopedPointer<QFile> ownFile;
+	if (!file) {
+		ownFile.reset(new QFile(fileName));
+		file = ownFile.data();
+	}
 	if (bytes <= 0)
 		bytes = file->size();
-	bool isOpen = file->isOpen();
-	if (!isOpen)
-		file->open(QIODevice::ReadOnly);
-	while (totalRead < bytes) {
-		data = file->read(qMin(BUFFER_SIZE, bytes - totalRead));
-		checksum = chunkChecksum(data.constData(), data.size(), checksum, totalRead);
-		totalRead += data.size();
-		//QApplication::processEvents(); // This call causes crashes
+
+	quint64 sum = 0;
+	QFile *qfile = qobject_cast<QFile*>(file);
+	if (!qfile || bytes < 2 * PARALLEL_CHUNK_SIZE || !parallelSum(qfile->fileName(), &sum)) {
+		sum = 0;
+		QByteArray data(READ_BUFFER_SIZE, Qt::Uninitialized);
+		qint64 totalRead = 0;
+		bool isOpen = file->isOpen();
+		if (!isOpen)
+			file->open(QIODevice::ReadOnly);
+		while (totalRead < bytes) {
+			const qint64 read = file->read(data.data(), qMin<qint64>(data.size(), bytes - totalRead));
+			if (read <= 0)
+				break;
+			sum += OftChecksum::sum(data.constData(), read, totalRead);
+			totalRead += read;
+		}
+		if (!isOpen)
+			file->close();
+	}
+	if (ownFile)
+		file = 0;
+	emit done(OftChecksum::update(0xFFFF0000, sum));
+}
+
+bool OftChecksumThread::parallelSum(const QString &fileName, quint64 *sum)
+{
+	const int count = int((bytes + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE);
+	QVector<quint64> sums(count, 0);
+	QAtomicInt failed(0);
+	QThreadPool pool;
+	pool.setMaxThreadCount(QThread::idealThreadCount());
+	for (int i = 0; i < count; ++i) {
+		const qint64 position = qint64(i) * PARALLEL_CHUNK_SIZE;
+		const qint64 size = qMin<qint64>(PARALLEL_CHUNK_SIZE, bytes - position);
+		pool.start(new OftChecksumTask(fileName, position, size, &sums[i], &failed));
 	}
-	if (!isOpen)
-		file->close();
-	emit done(checksum);
+	pool.waitForDone();
+	if (failed.load())
+		return false;
+	*sum = 0;
+	foreach (quint64 part, sums)
+		*sum += part;
+	return true;
 }
 
 OftConnection::OftConnection(IcqContact *contact, Direction direction, quint64 cookie, OftFileTransferFactory *manager, bool forceProxy) :
@@ -488,10 +557,13 @@ OftConnection::OftConnection(IcqContact *contact, Direction direction, quint64 c
 	m_connInited(false)
 {
 	m_transfer->addConnection(this);
+	connect(this, SIGNAL(dataTransferFinished(qutim_sdk_0_3::FileTransferJob::ErrorType)),
+			SLOT(onDataTransferFinished(qutim_sdk_0_3::FileTransferJob::ErrorType)));
 }
 
 OftConnection::~OftConnection()
 {
+	stopDataTransfer();
 	m_transfer->removeConnection(this);
 }
 
@@ -550,6 +622,7 @@ void OftConnection::close(bool error)
 			m_socket.data()->close();
 		m_socket.data()->deleteLater();
 	}
+	stopDataTransfer();
 	if (m_data)
 		m_data.reset();
 	if (error) {
@@ -771,6 +844,7 @@ void OftConnection::onNewData()
 	}
 	if (m_socket.data()->bytesAvailable() <= 0)
 		return;
+	// Files are received by the transfer engine, other devices are written here
 	QByteArray buf = m_socket.data()->read(m_header.size - m_header.bytesReceived);
 	m_header.receivedChecksum =
 			OftChecksumThread::chunkChecksum(buf.constData(), buf.size(),
@@ -781,32 +855,55 @@ void OftConnection::onNewData()
 	setFileProgress(m_header.bytesReceived);
 	if (m_header.bytesReceived == m_header.size) {
 		disconnect(m_socket.data(), SIGNAL(newData()), this, SLOT(onNewData()));
-		m_data.reset();
-		m_header.type = OftDone;
-		--m_header.filesLeft;
-		m_header.writeData(m_socket.data());
-		m_socket.data()->dataReaded();
-		if (m_header.filesLeft == 0) {
-			setState(Finished);
-		}
+		onDataTransferFinished(NoError);
 	}
 }
 
-void OftConnection::onSendData()
+void OftConnection::onDataTransferFinished(ErrorType error)
 {
-	if (!m_data && m_socket.data()->bytesToWrite())
+	if (error == IOError) {
+		setState(Error);
+		setError(IOError);
+		close(false);
+		return;
+	} else if (error != NoError) {
+		qDebug() << "File transfer connection error" << error;
+		close();
 		return;
-	QByteArray buf = m_data.data()->read(BUFFER_SIZE);
-	m_header.receivedChecksum =
-			OftChecksumThread::chunkChecksum(buf.constData(), buf.size(),
-											 m_header.receivedChecksum,
-											 m_header.bytesReceived);
-	m_header.bytesReceived += buf.size();
-	m_socket.data()->write(buf);
-	setFileProgress(m_header.bytesReceived);
-	if (m_header.bytesReceived == m_header.size) {
-		disconnect(m_socket.data(), SIGNAL(bytesWritten(qint64)), this, SLOT(onSendData()));
-		m_data.reset();
+	}
+	m_header.bytesReceived = m_header.size;
+	QFile *file = qobject_cast<QFile*>(m_data.data());
+	const QString fileName = file ? file->fileName() : QString();
+	m_data.reset();
+	if (direction() == Outgoing)
+		return;
+	// Checksum of a file is calculated by OftChecksumThread when the file is complete
+	if (file) {
+		OftChecksumThread *checksum = new OftChecksumThread(fileName, m_header.size);
+		connect(checksum, SIGNAL(done(quint32)), SLOT(finishFileReceiving(quint32)));
+		checksum->start();
+	} else {
+		finishFileReceiving();
+	}
+}
+
+void OftConnection::finishFileReceiving(quint32 checksum)
+{
+	sender()->deleteLater();
+	m_header.receivedChecksum = checksum;
+	finishFileReceiving();
+}
+
+void OftConnection::finishFileReceiving()
+{
+	if (!m_socket)
+		return;
+	m_header.type = OftDone;
+	--m_header.filesLeft;
+	m_header.writeData(m_socket.data());
+	m_socket.data()->dataReaded();
+	if (m_header.filesLeft == 0) {
+		setState(Finished);
 	}
 }
 
@@ -872,7 +969,6 @@ void OftConnection::startFileReceiving(const int index)
 			return;
 		}
 		m_header.type = OftAcknowledge;
-		onNewData();
 		startFileReceivingImpl(false);
 	}
 }
@@ -888,10 +984,22 @@ void OftConnection::startFileReceivingImpl(bool resume)
 {
 	m_header.cookie = m_cookie;
 	m_header.writeData(m_socket.data());
+	setState(Started);
+	// Resumed data is received after OftSenderResume
 	if (resume)
 		m_socket.data()->dataReaded();
-	setState(Started);
-	connect(m_socket.data(), SIGNAL(newData()), SLOT(onNewData()));
+	else
+		startDataReceiving();
+}
+
+void OftConnection::startDataReceiving()
+{
+	if (qobject_cast<QFile*>(m_data.data())) {
+		startDataTransfer(m_data.data(), m_socket.data(), m_header.bytesReceived, m_header.size);
+	} else {
+		connect(m_socket.data(), SIGNAL(newData()), SLOT(onNewData()), Qt::UniqueConnection);
+		onNewData();
+	}
 }
 
 void OftConnection::resumeFileReceivingImpl(quint32 checksum)
@@ -1016,6 +1124,7 @@ void OftConnection::onHeaderReaded()
 			}
 			if (m_data.data()->open(flags)) {
 				m_header.writeData(m_socket.data());
+				startDataReceiving();
 			} else {
 				close();
 			}
@@ -1025,9 +1134,9 @@ void OftConnection::onHeaderReaded()
 		case OftAcknowledge: {	// receiver are waiting file
 			m_socket.data()->dataReaded();
 			if (m_data.data()->open(QFile::ReadOnly)) {
-				connect(m_socket.data(), SIGNAL(bytesWritten(qint64)), this, SLOT(onSendData()));
+				// The receiver reports its checksum by OftDone, ours is already sent by OftPrompt
 				setState(Started);
-				onSendData();
+				startDataTransfer(m_data.data(), m_socket.data(), m_header.bytesReceived, m_header.size);
 			} else {
 				close();
 			}
@@ -180,15 +180,18 @@ class OftChecksumThread : public QThread
 {
 	Q_OBJECT
 public:
-	OftChecksumThread(QIODevice *file, int bytes = 0);
+	OftChecksumThread(QIODevice *file, qint64 bytes = 0);
+	OftChecksumThread(const QString &fileName, qint64 bytes = 0);
 	static quint32 chunkChecksum(const char *buffer, int len, quint32 checksum, int offset);
 protected:
 	void run();
 signals:
 	void done(quint32 checksum);
 private:
+	bool parallelSum(const QString &fileName, quint64 *sum);
 	QIODevice *file;
-	int bytes;
+	QString fileName;
+	qint64 bytes;
 };
 
 class OftConnection : public FileTransferJob
@@ -214,6 +217,8 @@ private:
 	void startFileSending();
 	void startFileReceiving(const int index);
 	void startFileReceivingImpl(bool resume);
+	void startDataReceiving();
+	void finishFileReceiving();
 private slots:
 	void close() { close(true); }
 	void startNextStage();
@@ -222,10 +227,11 @@ private slots:
 	void onError(QAbstractSocket::SocketError);
 	void onHeaderReaded();
 	void onNewData();
-	void onSendData();
+	void onDataTransferFinished(qutim_sdk_0_3::FileTransferJob::ErrorType error);
 	void startFileSendingImpl(quint32 checksum);
 	void startFileReceivingImpl(quint32 checksum);
 	void resumeFileReceivingImpl(quint32 checksum);
+	void finishFileReceiving(quint32 checksum);
 private:
 	friend class OftServer;
 	friend class OftFileTransferFactory;
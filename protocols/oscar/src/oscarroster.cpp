@@ -326,7 +326,7 @@ void Roster::handleUserOnline(IcqAccount *account, const SNAC &snac)
 	if (tlvs.contains(0x0019)) {
 		DataUnit data(tlvs.value(0x0019));
 		while (data.dataSize() >= 2)
-			newCaps.push_back(Capability(data.readData(2)));
+			newCaps.push_back(Capability(data.readRawData(2)));
 	}
 	contact->d_func()->setCapabilities(newCaps);
 	if (tlvs.contains(0x000f))
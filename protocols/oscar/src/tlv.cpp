@@ -25,15 +25,90 @@
 
 #include "tlv.h"
 #include <QDataStream>
+#include <QVarLengthArray>
+#include <algorithm>
 
 namespace qutim_sdk_0_3 {
 
 namespace oscar {
 
+static bool tlvTypeLessThan(const TLV &tlv, quint16 type)
+{
+	return tlv.type() < type;
+}
+
+static bool tlvTypeLess(const TLV &left, const TLV &right)
+{
+	return left.type() < right.type();
+}
+
+static bool tlvTypeNotLess(const TLV &left, const TLV &right)
+{
+	return left.type() >= right.type();
+}
+
+TLVMap::TLVMap(const QMap<quint16, TLV> &other)
+{
+	m_tlvs.reserve(other.size());
+	foreach (const TLV &tlv, other)
+		insert(tlv);
+}
+
+void TLVMap::clear()
+{
+	m_tlvs.clear();
+	m_block.clear();
+}
+
+TLVMap::const_iterator TLVMap::find(quint16 type) const
+{
+	QVector<TLV>::const_iterator it = std::lower_bound(m_tlvs.constBegin(), m_tlvs.constEnd(),
+	                                                   type, tlvTypeLessThan);
+	if (it != m_tlvs.constEnd() && it->type() == type)
+		return it;
+	return m_tlvs.constEnd();
+}
+
+TLV TLVMap::value(int key) const
+{
+	const_iterator it = find(key);
+	return it != constEnd() ? detached(*it) : TLV();
+}
+
+QList<TLV> TLVMap::values(quint16 type) const
+{
+	QList<TLV> result;
+	const_iterator it = find(type);
+	if (it != constEnd())
+		result << detached(*it);
+	return result;
+}
+
+TLVMap::iterator TLVMap::insert(const TLV &tlv)
+{
+	QVector<TLV>::iterator it = std::lower_bound(m_tlvs.begin(), m_tlvs.end(),
+	                                             tlv.type(), tlvTypeLessThan);
+	if (it != m_tlvs.end() && it->type() == tlv.type())
+		*it = tlv;
+	else
+		it = m_tlvs.insert(it, tlv);
+	return QVector<TLV>::const_iterator(it);
+}
+
+int TLVMap::remove(quint16 type)
+{
+	QVector<TLV>::iterator it = std::lower_bound(m_tlvs.begin(), m_tlvs.end(),
+	                                             type, tlvTypeLessThan);
+	if (it == m_tlvs.end() || it->type() != type)
+		return 0;
+	m_tlvs.erase(it);
+	return 1;
+}
+
 quint32 TLVMap::valuesSize() const
 {
 	quint32 size = 0;
-	foreach(const TLV &tlv, *this)
+	foreach(const TLV &tlv, m_tlvs)
 		size = size + tlv.data().size() + 4;
 	return size;
 }
@@ -41,10 +116,72 @@ quint32 TLVMap::valuesSize() const
 TLVMap::operator QByteArray() const
 {
 	QByteArray data;
-	foreach(const TLV &tlv, *this)
-		data += tlv;
+	appendDataUnitHelper<TLVMap>::append(data, *this);
 	return data;
 }
 
+TLVMap TLVMap::read(const DataUnit &data, int maxCount, ByteOrder bo)
+{
+	struct Entry
+	{
+		quint16 type;
+		int offset;
+		int size;
+	};
+	// The first pass finds bounds of TLVs, so the whole block is copied at once
+	const uchar *begin = reinterpret_cast<const uchar *>(data.data().constData()) + data.state();
+	const int available = data.dataSize();
+	QVarLengthArray<Entry, 32> entries;
+	int offset = 0;
+	while ((maxCount < 0 || entries.size() < maxCount) && available - offset >= 4) {
+		Entry entry;
+		entry.type = bo == BigEndian ? qFromBigEndian<quint16>(begin + offset)
+		                             : qFromLittleEndian<quint16>(begin + offset);
+		const quint16 length = bo == BigEndian ? qFromBigEndian<quint16>(begin + offset + 2)
+		                                       : qFromLittleEndian<quint16>(begin + offset + 2);
+		entry.offset = offset + 4;
+		entry.size = qMin<int>(length, available - entry.offset);
+		offset = entry.offset + entry.size;
+		// Type 0xffff was always treated as the end of the block
+		if (entry.type == 0xffff)
+			break;
+		entries.append(entry);
+	}
+	data.skipData(offset);
+
+	TLVMap tlvs;
+	tlvs.m_block = QByteArray(reinterpret_cast<const char *>(begin), offset);
+	tlvs.m_tlvs.reserve(entries.size());
+	const char *block = tlvs.m_block.constData();
+	for (int i = 0; i < entries.size(); ++i) {
+		TLV tlv(entries[i].type);
+		tlv.setData(QByteArray::fromRawData(block + entries[i].offset, entries[i].size));
+		tlvs.m_tlvs.append(tlv);
+	}
+	// The later TLV of the same type wins as it was with QMap
+	QVector<TLV> &list = tlvs.m_tlvs;
+	if (std::adjacent_find(list.constBegin(), list.constEnd(), tlvTypeNotLess) != list.constEnd()) {
+		std::stable_sort(list.begin(), list.end(), tlvTypeLess);
+		int size = 0;
+		for (int i = 0; i < list.size(); ++i) {
+			if (i + 1 < list.size() && list.at(i + 1).type() == list.at(i).type())
+				continue;
+			list[size++] = list.at(i);
+		}
+		list.resize(size);
+	}
+	return tlvs;
+}
+
+TLV TLVMap::detached(const TLV &tlv) const
+{
+	const char *data = tlv.data().constData();
+	if (data < m_block.constData() || data >= m_block.constData() + m_block.size())
+		return tlv;
+	TLV result(tlv.type());
+	result.setData(QByteArray(data, tlv.data().size()));
+	return result;
+}
+
 } } // namespace qutim_sdk_0_3::oscar
 
@@ -29,6 +29,7 @@
 #include <QByteArray>
 #include <QString>
 #include <QMap>
+#include <QVector>
 #include <QtEndian>
 #include "icq_global.h"
 #include "util.h"
@@ -58,25 +59,86 @@ private:
 	quint16 m_type;
 };
 
-class TLVMap: public QMap<quint16, TLV>
+/*
+ * Flat array of TLVs sorted by type. TLVs parsed from incoming data are views
+ * of a single copy of the whole TLV block, so parsing of a SNAC with a dozen
+ * of TLVs costs two allocations instead of a couple per TLV. TLVs returned
+ * by value are detached from the block, so they may outlive the map.
+ */
+class LIBOSCAR_EXPORT TLVMap
 {
 public:
+	class const_iterator
+	{
+	public:
+		inline const_iterator() {}
+		inline const_iterator(QVector<TLV>::const_iterator it) : m_it(it) {}
+		inline quint16 key() const { return m_it->type(); }
+		inline const TLV &value() const { return *m_it; }
+		inline const TLV &operator*() const { return *m_it; }
+		inline const TLV *operator->() const { return &*m_it; }
+		inline const_iterator &operator++() { ++m_it; return *this; }
+		inline const_iterator operator++(int) { const_iterator it = *this; ++m_it; return it; }
+		inline bool operator==(const const_iterator &other) const { return m_it == other.m_it; }
+		inline bool operator!=(const const_iterator &other) const { return m_it != other.m_it; }
+	private:
+		QVector<TLV>::const_iterator m_it;
+	};
+	typedef const_iterator iterator;
+
 	inline TLVMap();
-	inline TLVMap(const QMap<quint16, TLV> &other);
-	inline TLV value(int key) const;
+	TLVMap(const QMap<quint16, TLV> &other);
+	inline int size() const { return m_tlvs.size(); }
+	inline int count() const { return m_tlvs.size(); }
+	inline bool isEmpty() const { return m_tlvs.isEmpty(); }
+	void clear();
+	const_iterator find(quint16 type) const;
+	inline bool contains(quint16 type) const { return find(type) != constEnd(); }
+	TLV value(int key) const;
 	template<typename T>
 	T value(quint16 type, const T &def = T()) const;
+	QList<TLV> values(quint16 type) const;
 	template<typename T>
 	TLVMap::iterator insert(quint16 type, const T &data);
 	inline TLVMap::iterator insert(quint16 type);
-	inline TLVMap::iterator insert(const TLV &tlv);
+	TLVMap::iterator insert(const TLV &tlv);
+	int remove(quint16 type);
+	inline const_iterator begin() const { return m_tlvs.constBegin(); }
+	inline const_iterator end() const { return m_tlvs.constEnd(); }
+	inline const_iterator constBegin() const { return m_tlvs.constBegin(); }
+	inline const_iterator constEnd() const { return m_tlvs.constEnd(); }
 	quint32 valuesSize() const;
 	operator QByteArray() const;
 	inline static TLVMap fromByteArray(const QByteArray &data, ByteOrder bo = BigEndian);
+	// Reads at most maxCount TLVs, all of them if maxCount is negative
+	static TLVMap read(const DataUnit &data, int maxCount, ByteOrder bo = BigEndian);
 private:
 	TLVMap::iterator insert(quint16 type, const TLV &data);
+	TLV detached(const TLV &tlv) const;
+	QVector<TLV> m_tlvs;
+	QByteArray m_block;
 };
 
+template<>
+struct appendDataUnitHelper<TLV>
+{
+	static inline void append(QByteArray &buffer, const TLV &tlv, ByteOrder bo = BigEndian)
+	{
+		appendDataUnitHelper<quint16>::append(buffer, tlv.type(), bo);
+		appendDataUnitHelper<quint16>::append(buffer, tlv.data(), bo);
+	}
+};
+
+template<>
+struct appendDataUnitHelper<TLVMap>
+{
+	static inline void append(QByteArray &buffer, const TLVMap &tlvs, ByteOrder bo = BigEndian)
+	{
+		buffer.reserve(buffer.size() + tlvs.valuesSize());
+		for (TLVMap::const_iterator it = tlvs.constBegin(); it != tlvs.constEnd(); ++it)
+			appendDataUnitHelper<TLV>::append(buffer, *it, bo);
+	}
+};
 
 TLV::TLV(quint16 type)
 {
@@ -94,10 +156,10 @@ Q_INLINE_TEMPLATE TLV::TLV(quint16 type, const T &data):
 
 QByteArray TLV::toByteArray(ByteOrder bo) const
 {
-	DataUnit data;
-	data.append<quint16>(m_type, bo);
-	data.append<quint16>(m_data, bo);
-	return data.data();
+	QByteArray data;
+	data.reserve(4 + m_data.size());
+	appendDataUnitHelper<TLV>::append(data, *this, bo);
+	return data;
 }
 
 TLV TLV::fromByteArray(const QByteArray &data, ByteOrder bo)
@@ -109,16 +171,6 @@ TLVMap::TLVMap()
 {
 }
 
-TLVMap::TLVMap(const QMap<quint16, TLV> &other) :
-	QMap<quint16, TLV>(other)
-{
-}
-
-TLV TLVMap::value(int key) const
-{
-	return QMap<quint16, TLV>::value(key);
-}
-
 template<typename T>
 Q_INLINE_TEMPLATE T TLVMap::value(quint16 type, const T &def) const
 {
@@ -134,22 +186,17 @@ Q_INLINE_TEMPLATE T TLVMap::value(quint16 type, const T &def) const
 template<typename T>
 Q_INLINE_TEMPLATE TLVMap::iterator TLVMap::insert(quint16 type, const T &data)
 {
-	return QMap<quint16, TLV>::insert(type, TLV(type, data));
+	return insert(TLV(type, data));
 }
 
 TLVMap::iterator TLVMap::insert(quint16 type)
 {
-	return QMap<quint16, TLV>::insert(type, TLV(type));
-}
-
-TLVMap::iterator TLVMap::insert(const TLV &tlv)
-{
-	return QMap<quint16, TLV>::insert(tlv.type(), tlv);
+	return insert(TLV(type));
 }
 
 TLVMap TLVMap::fromByteArray(const QByteArray &data, ByteOrder bo)
 {
-	return DataUnit(data).read<TLVMap>(bo);
+	return read(DataUnit(data), -1, bo);
 }
 
 void DataUnit::appendTLV(quint16 type, ByteOrder bo)
@@ -191,26 +238,12 @@ struct fromDataUnitHelper<TLVMap>
 {
 	static inline TLVMap fromByteArray(const DataUnit &d, ByteOrder bo = BigEndian)
 	{
-		TLVMap tlvs;
-		forever {
-			TLV tlv = fromDataUnitHelper<TLV>::fromByteArray(d, bo);
-			if (tlv.type() == 0xffff)
-				return tlvs;
-			tlvs.insert(tlv);
-		}
-		return tlvs;
+		return TLVMap::read(d, -1, bo);
 	}
 	template<class L>
 	static inline TLVMap fromByteArray(const DataUnit &d, L count, ByteOrder bo = BigEndian)
 	{
-		TLVMap tlvs;
-		for (L i = 0; i < count; i++) {
-			TLV tlv = fromDataUnitHelper<TLV>::fromByteArray(d, bo);
-			if (tlv.type() == 0xffff)
-				return tlvs;
-			tlvs.insert(tlv);
-		}
-		return tlvs;
+		return TLVMap::read(d, int(count), bo);
 	}
 };
 